@@ -0,0 +1,922 @@
+/*
+
+Bench
+
+Micro-benchmarks for the PegasusWinterface system. Run with the name of a benchmark, or no
+arguments to list them
+
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+
+#include "PegasusWinterface.h"
+#include "TitleMatcher.h"
+#include "InjectDaemon.h"
+#include "InjectClient.h"
+#include "ThreadConfig.h"
+#include "ScriptParser.h"
+#include "Script.h"
+#include "InjectionPlan.h"
+#include "SequenceJournal.h"
+#include "ScreenProbe.h"
+#include "EventCodec.h"
+#include "TimingVariation.h"
+
+#include "Soak.h"
+
+namespace pi = pinterface;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double ElapsedNs(BenchClock::time_point start) {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - start).count();
+}
+
+/*******************************************************************************
+        Title matching
+********************************************************************************/
+
+static std::vector<pi::WinInfo_t> MakeSyntheticWindows(size_t count) {
+    const wchar_t* apps[] = { L"Notepad", L"Visual Studio Code", L"Mozilla Firefox", L"Command Prompt", L"Explorer", L"Steam" };
+    std::vector<pi::WinInfo_t> windows;
+    for (size_t i = 0; i < count; i++) {
+        pi::WinInfo_t w;
+        w.title = L"Document " + std::to_wstring(i) + L" - " + apps[i % (sizeof(apps) / sizeof(apps[0]))];
+        w.isVisible = (i % 3) != 0;
+        w.pid = (DWORD)(1000 + i);
+        w.tid = (DWORD)(5000 + i);
+        windows.push_back(w);
+    }
+    // The window we are looking for, last so that linear scans pay for every window
+    pi::WinInfo_t target;
+    target.title = L"Pegasus Target Window \x00c9t\x00e9";
+    target.isVisible = true;
+    target.pid = 42;
+    target.tid = 43;
+    windows.push_back(target);
+    return windows;
+}
+
+static void BenchTitleMatch() {
+    const size_t WINDOWS = 5000;
+    const int ROUNDS = 200;
+    std::vector<pi::WinInfo_t> windows = MakeSyntheticWindows(WINDOWS);
+
+    BenchClock::time_point start = BenchClock::now();
+    pi::TitleIndex index(windows);
+    cout << "Index build: " << std::fixed << std::setprecision(1) << ElapsedNs(start) / windows.size() << " ns/window" << endl;
+
+    typedef pi::TitleMatcher::MatchType MT;
+    struct Case { const char* name; pi::TitleMatcher matcher; };
+    std::vector<Case> cases = {
+        { "exact", pi::TitleMatcher(L"Pegasus Target Window \x00c9t\x00e9", MT::TMATCH_EXACT) },
+        { "prefix", pi::TitleMatcher(L"Pegasus Target", MT::TMATCH_PREFIX) },
+        { "contains", pi::TitleMatcher(L"Target Window", MT::TMATCH_CONTAINS) },
+        { "contains_nocase", pi::TitleMatcher(L"target window \x00e9t\x00e9", MT::TMATCH_CONTAINS_NOCASE) },
+        { "glob", pi::TitleMatcher(L"pegasus*window ?t?", MT::TMATCH_GLOB) },
+        { "regex", pi::TitleMatcher(L"^Pegasus [A-Za-z]+ Window", MT::TMATCH_REGEX) },
+    };
+
+    std::vector<std::wstring> normalized;
+    for (auto& w : windows)
+        normalized.push_back(pi::TitleMatcher::Normalize(w.title));
+
+    cout << std::left << std::setw(18) << "matcher" << std::setw(18) << "ns/window (scan)" << "ns/lookup (index)" << endl;
+    for (Case& c : cases) {
+        // Per window cost of evaluating the matcher against pre-normalized titles (normalization is the index build cost)
+        size_t hits = 0;
+        start = BenchClock::now();
+        for (int r = 0; r < ROUNDS; r++) {
+            for (size_t i = 0; i < windows.size(); i++) {
+                if (c.matcher.matches(windows[i].title, normalized[i]))
+                    hits++;
+            }
+        }
+        double scanNs = ElapsedNs(start) / ((double)ROUNDS * windows.size());
+
+        // Cost of a full lookup through the index, which is what bind() and rebinding pay
+        int found = -1;
+        start = BenchClock::now();
+        for (int r = 0; r < ROUNDS; r++) {
+            found = index.find(c.matcher);
+        }
+        double lookupNs = ElapsedNs(start) / ROUNDS;
+
+        cout << std::setw(18) << c.name << std::setw(18) << scanNs << lookupNs
+             << (found == (int)WINDOWS && hits == (size_t)ROUNDS ? "" : "  [UNEXPECTED RESULT]") << endl;
+    }
+}
+
+/*******************************************************************************
+        Injection daemon stress
+********************************************************************************/
+
+static const int INJECT_CLIENTS = 8;
+static const int INJECT_BATCHES = 20000;
+
+// Events in batch i of a client, varied so batches wrap around the ring at different points
+static UINT32 InjectBatchSize(int i) {
+    return 1 + (UINT32)(i % 8);
+}
+
+// Counts what the daemon sends and checks each client's events arrive in order. Clients put their id in dx and the
+// batch number in dy
+class CheckingBackend : public pi::InputBackend {
+public:
+    bool sendInputs(pi::WinInfo_t& window, std::vector<INPUT>& inputs) override {
+        for (INPUT& in : inputs) {
+            LONG client = in.mi.dx;
+            LONG batch = in.mi.dy;
+            if (client < 0 || client >= INJECT_CLIENTS || batch < lastBatch[client])
+                outOfOrder++;
+            else
+                lastBatch[client] = batch;
+            events++;
+        }
+        return true;
+    }
+
+    UINT64 events = 0;
+    UINT64 outOfOrder = 0;
+    LONG lastBatch[INJECT_CLIENTS] = {};
+};
+
+// Runs in a child process started by BenchInject
+static int RunInjectClient(const std::wstring& name, int client) {
+    pi::InjectClient injector;
+    if (!injector.connect(name))
+        return EXIT_FAILURE;
+    int target = injector.findTarget(client % 2 ? L"Bench Target B" : L"Bench Target A");
+    if (target < 0)
+        return EXIT_FAILURE;
+
+    // Written straight in the wire layout, which is what a latency sensitive client would do
+    pi::InjectEvent_t batch[8];
+    for (pi::InjectEvent_t& e : batch) {
+        e = {};
+        e.kind = pi::INJECT_KIND_MOUSE;
+        e.type = (UINT8)pi::MouseEvent::EventType::MEVT_MOVE;
+        e.flags = pi::INJECT_FLAG_GROUP_START;
+        e.target = (UINT16)target;
+        e.priority = (UINT8)pi::SubmitPriority::SPRIO_NORMAL;
+        e.dx = client;
+    }
+
+    std::vector<double> costs;
+    costs.reserve(INJECT_BATCHES);
+    UINT64 fullRetries = 0;
+    for (int i = 0; i < INJECT_BATCHES; i++) {
+        for (pi::InjectEvent_t& e : batch)
+            e.dy = i;
+        BenchClock::time_point start = BenchClock::now();
+        while (!injector.submit(batch, InjectBatchSize(i))) {
+            fullRetries++;
+            std::this_thread::yield();
+            start = BenchClock::now();
+        }
+        costs.push_back(ElapsedNs(start));
+    }
+
+    std::sort(costs.begin(), costs.end());
+    cout << "client " << client << ": submit p50 " << std::fixed << std::setprecision(0) << costs[costs.size() / 2] << " ns, p99 "
+         << costs[costs.size() * 99 / 100] << " ns, ring full " << fullRetries << " times" << endl;
+    return EXIT_SUCCESS;
+}
+
+// Slots the crashing client claims and never writes
+static const UINT32 INJECT_CRASH_SLOTS = 5;
+static const UINT INJECT_CRASH_EXIT = 3;
+
+// Runs in a child process started by BenchInject. Claims slots the way a push does and is killed before writing any of
+// them, which the daemon has to skip rather than wait on forever
+static int RunInjectCrashClient(const std::wstring& name) {
+    pi::InjectRing ring;
+    if (!ring.open(name))
+        return EXIT_FAILURE;
+    ring.getHeader()->enqueuePos.fetch_add(INJECT_CRASH_SLOTS);
+    TerminateProcess(GetCurrentProcess(), INJECT_CRASH_EXIT);
+    return EXIT_FAILURE;
+}
+
+// Starts this executable again with the arguments, returning the process or NULL
+static HANDLE StartBenchProcess(const std::wstring& args) {
+    WCHAR exe[MAX_PATH];
+    GetModuleFileNameW(NULL, exe, MAX_PATH);
+    std::wstring cmd = L"\"" + std::wstring(exe) + L"\" " + args;
+    STARTUPINFOW si = {};
+    si.cb = sizeof(si);
+    PROCESS_INFORMATION pinfo = {};
+    if (!CreateProcessW(NULL, &cmd[0], NULL, NULL, FALSE, 0, NULL, NULL, &si, &pinfo))
+        return NULL;
+    CloseHandle(pinfo.hThread);
+    return pinfo.hProcess;
+}
+
+static void BenchInject() {
+    std::wstring name = L"Local\\PegasusInjectBench" + std::to_wstring(GetCurrentProcessId());
+
+    // Fake targets, so the stress test doesn't need real windows
+    std::shared_ptr<CheckingBackend> backend = std::make_shared<CheckingBackend>();
+    pi::PegasusWinterface apps[2];
+    const wchar_t* titles[] = { L"Bench Target A", L"Bench Target B" };
+    pi::InjectDaemon daemon(name);
+    for (int i = 0; i < 2; i++) {
+        pi::WinInfo_t info;
+        info.title = titles[i];
+        info.isVisible = true;
+        info.pid = 0;
+        info.tid = 0;
+        apps[i].setBackend(backend);
+        apps[i].bind(info);
+        daemon.addTarget(&apps[i]);
+    }
+    if (!daemon.start()) {
+        cerr << "Unable to start the daemon" << endl;
+        return;
+    }
+
+    std::atomic<bool> quit{ false };
+    std::thread dispatcher([&]() { daemon.run(quit); });
+
+    // A client killed between claiming slots and writing them goes first, so every other client's batches queue up behind
+    // the slots it left
+    DWORD crashCode = EXIT_FAILURE;
+    HANDLE crash = StartBenchProcess(L"inject-crash \"" + name + L"\"");
+    if (crash == NULL) {
+        cerr << "Unable to start the crashing client (error " << GetLastError() << ")" << endl;
+    }
+    else {
+        WaitForSingleObject(crash, INFINITE);
+        GetExitCodeProcess(crash, &crashCode);
+        CloseHandle(crash);
+    }
+
+    // Clients are separate processes, running this executable in client mode
+    std::vector<HANDLE> processes;
+    BenchClock::time_point start = BenchClock::now();
+    for (int c = 0; c < INJECT_CLIENTS; c++) {
+        HANDLE p = StartBenchProcess(L"inject-client \"" + name + L"\" " + std::to_wstring(c));
+        if (p == NULL) {
+            cerr << "Unable to start client " << c << " (error " << GetLastError() << ")" << endl;
+            continue;
+        }
+        processes.push_back(p);
+    }
+
+    int failed = 0;
+    for (HANDLE p : processes) {
+        WaitForSingleObject(p, INFINITE);
+        DWORD code = EXIT_FAILURE;
+        GetExitCodeProcess(p, &code);
+        if (code != EXIT_SUCCESS)
+            failed++;
+        CloseHandle(p);
+    }
+    double submitMs = ElapsedNs(start) / 1e6;
+
+    quit.store(true, std::memory_order_release);
+    dispatcher.join();
+    // Drain whatever the dispatcher hadn't got to
+    while (daemon.tick() != pi::PEGASUS_TICK_IDLE);
+
+    UINT64 expected = 0;
+    for (int i = 0; i < INJECT_BATCHES; i++)
+        expected += InjectBatchSize(i);
+    expected *= processes.size();
+
+    cout << processes.size() << " clients finished in " << std::fixed << std::setprecision(1) << submitMs << " ms, "
+         << daemon.getBatchCount() << " batches, " << backend->events << "/" << expected << " events sent, "
+         << backend->outOfOrder << " out of order, " << daemon.getRejectedCount() << " rejected, " << failed << " clients failed, "
+         << daemon.getSkippedCount() << "/" << INJECT_CRASH_SLOTS << " slots of the killed client skipped"
+         << (backend->events == expected && backend->outOfOrder == 0 && failed == 0 && crashCode == INJECT_CRASH_EXIT
+             && daemon.getSkippedCount() == INJECT_CRASH_SLOTS ? "" : "  [UNEXPECTED RESULT]") << endl;
+    daemon.stop();
+}
+
+/*******************************************************************************
+        Dispatch jitter
+********************************************************************************/
+
+// Keeps the time each batch arrives, nothing is sent
+class IntervalBackend : public pi::InputBackend {
+public:
+    IntervalBackend(std::shared_ptr<pi::ClockSource> clock) : clock_(clock) {}
+
+    bool sendInputs(pi::WinInfo_t& window, std::vector<INPUT>& inputs) override {
+        times_.push_back(clock_->now());
+        return true;
+    }
+
+    std::shared_ptr<pi::ClockSource> clock_;
+    std::vector<INT64> times_;
+};
+
+// Plays keys a fixed period apart on a thread set up with the config, sleeping on the interface timer between them the way
+// a dispatcher would. Returns how far each gap between keys was from the period, in us
+static std::vector<double> MeasureJitter(const pi::ThreadConfig_t& config, int events, int periodMs) {
+    std::vector<double> errors;
+    std::thread dispatcher([&]() {
+        pi::ScopedThreadConfig scope(config);
+        std::shared_ptr<pi::ClockSource> clock = std::make_shared<pi::RealClock>();
+        std::shared_ptr<IntervalBackend> backend = std::make_shared<IntervalBackend>(clock);
+        backend->times_.reserve(events);
+
+        pi::PegasusWinterface app;
+        pi::WinInfo_t info;
+        info.title = L"Bench Jitter Target";
+        info.isVisible = true;
+        info.pid = 0;
+        info.tid = 0;
+        app.setClock(clock);
+        app.setBackend(backend);
+        // Raw wake-up precision, without the overhead compensation hiding any of it
+        app.setCalibrationEnabled(false);
+        app.bind(info);
+
+        HANDLE wake = app.getWaitableHandle();
+        app.submitKeys(std::vector<pi::TimedKeyEvent>(events, pi::TimedKeyEvent(pi::KeyEvent('J'), periodMs)));
+        while (app.hasEventsInQueue()) {
+            int wait = app.tick();
+            if (wait != 0)
+                WaitForSingleObject(wake, wait == pi::PEGASUS_TICK_IDLE ? 50 : INFINITE);
+        }
+
+        for (size_t i = 1; i < backend->times_.size(); i++)
+            errors.push_back(std::abs((double)(backend->times_[i] - backend->times_[i - 1] - periodMs * 1000)));
+    });
+    dispatcher.join();
+    std::sort(errors.begin(), errors.end());
+    return errors;
+}
+
+static void BenchJitter() {
+    const int EVENTS = 500;
+    const int PERIOD_MS = 2;
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+
+    struct Case { const char* name; pi::ThreadConfig_t config; };
+    std::vector<Case> cases(4);
+    cases[0].name = "default";
+    cases[1].name = "timer 1 ms";
+    cases[1].config.timerPeriodMs = 1;
+    cases[2].name = "highest + timer";
+    cases[2].config.priority = pi::ThreadPriority::TPRIO_HIGHEST;
+    cases[2].config.timerPeriodMs = 1;
+    cases[3].name = "pinned + mmcss + timer";
+    cases[3].config.affinityMask = (DWORD_PTR)1 << (std::min<unsigned>(cpus, sizeof(DWORD_PTR) * 8) - 1);
+    cases[3].config.mmcssTask = L"Pro Audio";
+    cases[3].config.timerPeriodMs = 1;
+
+    for (int loaded = 0; loaded < 2; loaded++) {
+        // Every CPU kept busy at normal priority, which is what pushes the dispatcher off its core
+        std::atomic<bool> stop{ false };
+        std::vector<std::thread> load;
+        if (loaded) {
+            for (unsigned i = 0; i < cpus; i++) {
+                load.emplace_back([&stop]() {
+                    volatile UINT64 spin = 0;
+                    while (!stop.load(std::memory_order_relaxed))
+                        spin = spin + 1;
+                });
+            }
+        }
+
+        for (Case& c : cases) {
+            // The interface logs every key it sends
+            std::streambuf* coutBuffer = cout.rdbuf(nullptr);
+            std::wstreambuf* wcoutBuffer = std::wcout.rdbuf(nullptr);
+            std::vector<double> errors = MeasureJitter(c.config, EVENTS, PERIOD_MS);
+            cout.rdbuf(coutBuffer);
+            std::wcout.rdbuf(wcoutBuffer);
+            if (errors.empty())
+                continue;
+            cout << (loaded ? "loaded " : "idle   ") << std::left << std::setw(24) << c.name << std::right << " gap error p50 "
+                 << std::fixed << std::setprecision(0) << std::setw(6) << errors[errors.size() / 2] << " us, p99 " << std::setw(6)
+                 << errors[errors.size() * 99 / 100] << " us, max " << std::setw(6) << errors.back() << " us" << endl;
+        }
+
+        stop.store(true, std::memory_order_relaxed);
+        for (std::thread& t : load)
+            t.join();
+    }
+}
+
+/*******************************************************************************
+        Dispatch specialisation
+********************************************************************************/
+
+// Counts what arrives and sends nothing. Final, so an interface built on it calls it directly
+class NoopBackend final : public pi::InputBackend {
+public:
+    bool sendInputs(pi::WinInfo_t& window, std::vector<INPUT>& inputs) override {
+        inputs_ += inputs.size();
+        return true;
+    }
+
+    UINT64 inputs_ = 0;
+};
+
+static pi::WinInfo_t DispatchTarget() {
+    pi::WinInfo_t info;
+    info.title = L"Bench Dispatch Target";
+    info.isVisible = true;
+    info.pid = 0;
+    info.tid = 0;
+    return info;
+}
+
+// Best of a few runs of play, in ns per group
+static double TimeDispatch(int groups, const std::function<UINT64()>& play) {
+    const int RUNS = 3;
+    double best = 0;
+    for (int run = 0; run < RUNS; run++) {
+        BenchClock::time_point start = BenchClock::now();
+        UINT64 inputs = play();
+        double ns = ElapsedNs(start) / groups;
+        if (inputs != (UINT64)groups * 2)
+            cerr << "Expected " << groups * 2 << " inputs, got " << inputs << endl;
+        if (run == 0 || ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+// Plays the same keys, 1 ms apart on a manual clock so nothing waits, through the same interface built on the shared
+// backend and clock, then without logging, then on the backend and clock themselves
+static void BenchDispatch() {
+    const int GROUPS = 20000;
+    std::vector<pi::TimedKeyEvent> keys(GROUPS, pi::TimedKeyEvent(pi::KeyEvent('D'), 1));
+
+    // Only PegasusWinterface prints, so the cost of the logging itself is left out of its time
+    std::streambuf* coutBuffer = cout.rdbuf(nullptr);
+    std::wstreambuf* wcoutBuffer = std::wcout.rdbuf(nullptr);
+
+    double iface = TimeDispatch(GROUPS, [&]() {
+        std::shared_ptr<NoopBackend> backend = std::make_shared<NoopBackend>();
+        pi::PegasusWinterface app;
+        app.setClock(std::make_shared<pi::ManualClock>());
+        app.setBackend(backend);
+        app.bind(DispatchTarget());
+        app.executeKeys(keys);
+        app.runUntilIdle();
+        return backend->inputs_;
+    });
+
+    cout.rdbuf(coutBuffer);
+    std::wcout.rdbuf(wcoutBuffer);
+
+    double quiet = TimeDispatch(GROUPS, [&]() {
+        std::shared_ptr<NoopBackend> backend = std::make_shared<NoopBackend>();
+        pi::BasicPegasusWinterface<pi::SharedBackend, pi::SharedClock, pi::NoLog> app;
+        app.setClock(pi::SharedClock(std::make_shared<pi::ManualClock>()));
+        app.setBackend(pi::SharedBackend(backend));
+        app.bind(DispatchTarget());
+        app.executeKeys(keys);
+        app.runUntilIdle();
+        return backend->inputs_;
+    });
+
+    double specialised = TimeDispatch(GROUPS, [&]() {
+        pi::BasicPegasusWinterface<NoopBackend, pi::ManualClock, pi::NoLog> app;
+        app.bind(DispatchTarget());
+        app.executeKeys(keys);
+        app.runUntilIdle();
+        return app.getBackend().inputs_;
+    });
+
+    struct Row { const char* name; double ns; };
+    Row rows[] = {
+        { "PegasusWinterface", iface },
+        { "<Shared, Shared, NoLog>", quiet },
+        { "<Noop, ManualClock, NoLog>", specialised },
+    };
+    for (Row& row : rows) {
+        cout << std::left << std::setw(38) << row.name << std::right << std::fixed << std::setprecision(1) << std::setw(9) << row.ns
+             << " ns/group  " << std::setprecision(2) << std::setw(6) << iface / row.ns << "x" << endl;
+    }
+}
+
+/*******************************************************************************
+        Redundant input elision
+********************************************************************************/
+
+// Scripts in the shape of the ones we record: held movement keys pressed again on every step, shortcuts sent while the
+// modifier is already down, drags that press the button twice, and plain typing
+static const std::pair<const char*, const char*> ELIDE_WORKLOADS[] = {
+    { "movement", "pace 16\ndown w\ndown w\ndown w\ndown d\ndown w\nup d\ndown w\nup w\nup w\ndown s\ndown s\nup s\nup d\n" },
+    { "shortcuts", "pace 40\ndown ctrl\nchord ctrl+s\nchord ctrl+c\nchord ctrl+v\nchord ctrl+shift+z\nup ctrl\nup ctrl\n" },
+    { "drag", "pace 10\nmdown left\nmove 5 0\nmdown left\nmove 5 0\nmove 5 0\nmup left\nmup left\nclick left\n" },
+    { "typing", "pace 30\ntext \"Hello World this is a test\"\nkey enter\n" },
+};
+
+static void BenchElide() {
+    const int REPEATS = 200;
+    for (auto& workload : ELIDE_WORKLOADS) {
+        std::vector<pi::TimedEvent> evts;
+        pi::ScriptParser parser;
+        std::string script;
+        for (int i = 0; i < REPEATS; i++)
+            script += workload.second;
+        if (!parser.feed(script.data(), script.size(), evts) || !parser.finish(evts)) {
+            cerr << workload.first << ": line " << parser.getLine() << ": " << parser.getError() << endl;
+            continue;
+        }
+
+        std::shared_ptr<pi::ManualClock> clock = std::make_shared<pi::ManualClock>();
+        std::shared_ptr<pi::RecordingBackend> backend = std::make_shared<pi::RecordingBackend>(clock);
+        pi::InputStateCounters_t counters;
+        {
+            std::streambuf* coutBuffer = cout.rdbuf(nullptr);
+            std::wstreambuf* wcoutBuffer = std::wcout.rdbuf(nullptr);
+            pi::PegasusWinterface app;
+            app.setClock(clock);
+            app.setBackend(backend);
+            app.bind(DispatchTarget());
+            app.executeEvents(evts);
+            app.runUntilIdle();
+            app.unbind();
+            counters = app.getInputStateCounters();
+            cout.rdbuf(coutBuffer);
+            std::wcout.rdbuf(wcoutBuffer);
+        }
+
+        UINT64 elided = counters.elidedPresses + counters.elidedReleases;
+        UINT64 built = counters.sent + elided - counters.released;
+        cout << std::left << std::setw(10) << workload.first << std::right << std::setw(7) << built << " records built, "
+             << std::setw(7) << counters.sent << " sent (" << counters.released << " on unbind), " << std::setw(6) << elided
+             << " elided (" << std::fixed << std::setprecision(1) << (built > 0 ? 100.0 * elided / built : 0.0) << "%), "
+             << counters.skippedBatches << " batches not sent" << endl;
+    }
+}
+
+/*******************************************************************************
+        Compiled injection plans
+********************************************************************************/
+
+// The same macro played over and over: built and translated every run, looked up in the plan cache every run, and compiled
+// once and held
+static void BenchPlan() {
+    const int REPLAYS = 2000;
+    auto buildMacro = []() {
+        std::vector<pi::TimedKeyEvent> keys = pi::ScriptTarget::TextToKeys(L"the quick brown fox jumps over the lazy dog", 5);
+        std::vector<pi::TimedEvent> evts(keys.begin(), keys.end());
+        evts.push_back(pi::TimedKeyEvent({ pi::KeyEvent(VK_CONTROL, pi::KeyEvent::EventType::KEVT_PRESSED), pi::KeyEvent('S'),
+            pi::KeyEvent(VK_CONTROL, pi::KeyEvent::EventType::KEVT_RELEASED) }, 20));
+        return evts;
+    };
+    std::vector<pi::TimedEvent> macro = buildMacro();
+    pi::InjectionPlanCache cache;
+
+    std::streambuf* coutBuffer = cout.rdbuf(nullptr);
+    std::wstreambuf* wcoutBuffer = std::wcout.rdbuf(nullptr);
+    std::shared_ptr<pi::ManualClock> clock = std::make_shared<pi::ManualClock>();
+    std::shared_ptr<NoopBackend> backend = std::make_shared<NoopBackend>();
+    pi::PegasusWinterface app;
+    app.setClock(clock);
+    app.setBackend(backend);
+    app.bind(DispatchTarget());
+
+    auto time = [&](const std::function<void()>& replay) {
+        BenchClock::time_point start = BenchClock::now();
+        for (int i = 0; i < REPLAYS; i++) {
+            replay();
+            app.runUntilIdle();
+        }
+        return ElapsedNs(start) / REPLAYS / 1000.0;
+    };
+    double rebuilt = time([&]() { app.executeEvents(buildMacro()); });
+    double cached = time([&]() { app.executePlan(cache.get(macro)); });
+    std::shared_ptr<const pi::InjectionPlan> plan = pi::InjectionPlan::Compile(macro);
+    double held = time([&]() { app.executePlan(plan); });
+    app.unbind();
+
+    cout.rdbuf(coutBuffer);
+    std::wcout.rdbuf(wcoutBuffer);
+
+    cout << macro.size() << " groups, " << plan->getRecordCount() << " records per replay, " << backend->inputs_ << " records sent"
+         << endl;
+    cout << std::fixed << std::setprecision(1) << "rebuilt every run  " << std::setw(8) << rebuilt << " us/replay" << endl;
+    cout << "plan cache lookup  " << std::setw(8) << cached << " us/replay  " << std::setprecision(2) << rebuilt / cached << "x, "
+         << cache.getHits() << " hits, " << cache.getMisses() << " misses" << endl;
+    cout << std::setprecision(1) << "plan held          " << std::setw(8) << held << " us/replay  " << std::setprecision(2)
+         << rebuilt / held << "x" << endl;
+}
+
+/*******************************************************************************
+        Sequence journal
+********************************************************************************/
+
+// Submitted sequences played with and without a journal, and the time to open a journal left with every sequence unfinished
+static void BenchJournal() {
+    const int SEQUENCES = 500;
+    const std::wstring PATH = L"bench_journal.pwj";
+    std::vector<pi::TimedKeyEvent> keys = pi::ScriptTarget::TextToKeys(L"the quick brown fox jumps over the lazy dog", 5);
+    std::vector<pi::TimedEvent> sequence(keys.begin(), keys.end());
+
+    std::streambuf* coutBuffer = cout.rdbuf(nullptr);
+    std::wstreambuf* wcoutBuffer = std::wcout.rdbuf(nullptr);
+    DeleteFileW(PATH.c_str());
+
+    auto time = [&](std::shared_ptr<pi::SequenceJournal> journal) {
+        std::shared_ptr<pi::ManualClock> clock = std::make_shared<pi::ManualClock>();
+        pi::PegasusWinterface app;
+        app.setClock(clock);
+        app.setBackend(std::make_shared<NoopBackend>());
+        app.bind(DispatchTarget());
+        app.setJournal(journal);
+        BenchClock::time_point start = BenchClock::now();
+        for (int i = 0; i < SEQUENCES; i++) {
+            app.submitEvents(sequence);
+            app.runUntilIdle();
+        }
+        return ElapsedNs(start) / ((double)SEQUENCES * sequence.size()) / 1000.0;
+    };
+    double plain = time(nullptr);
+    std::shared_ptr<pi::SequenceJournal> journal = pi::SequenceJournal::Open(PATH);
+    double journaled = journal ? time(journal) : 0.0;
+    UINT64 records = journal ? journal->getRecordCount() : 0;
+
+    // Sequences that were never sent, as a crash straight after submitting them would leave
+    size_t unfinished = 0;
+    double resume = 0.0;
+    if (journal) {
+        for (int i = 0; i < SEQUENCES; i++)
+            journal->append(sequence, pi::SubmitPriority::SPRIO_NORMAL);
+        journal.reset();
+        BenchClock::time_point start = BenchClock::now();
+        journal = pi::SequenceJournal::Open(PATH);
+        resume = ElapsedNs(start) / 1e6;
+        unfinished = journal ? journal->takeUnfinished().size() : 0;
+        journal.reset();
+    }
+    DeleteFileW(PATH.c_str());
+
+    cout.rdbuf(coutBuffer);
+    std::wcout.rdbuf(wcoutBuffer);
+
+    if (records == 0) {
+        cerr << "Unable to open a journal in the working directory" << endl;
+        return;
+    }
+    cout << SEQUENCES << " sequences of " << sequence.size() << " groups, " << records << " journal records" << endl;
+    cout << std::fixed << std::setprecision(2) << "no journal     " << std::setw(8) << plain << " us/group" << endl;
+    cout << "journaled      " << std::setw(8) << journaled << " us/group  +" << journaled - plain << " us" << endl;
+    cout << "reopen         " << std::setw(8) << resume << " ms for " << unfinished << " unfinished sequences" << endl;
+}
+
+/*******************************************************************************
+        Screen probe comparisons
+********************************************************************************/
+
+// Compares a region that matches its reference, so every pixel is looked at, against plain per-pixel loops
+static void BenchProbe() {
+    const LONG SIDE = 64;
+    const int COMPARES = 20000;
+    const size_t count = (size_t)SIDE * SIDE;
+    std::vector<UINT32> reference(count), capture(count);
+    for (size_t i = 0; i < count; i++) {
+        reference[i] = pi::ScreenProbe::Rgb((BYTE)(i * 7), (BYTE)(i * 13), (BYTE)(i * 29));
+        // Alpha differs and every channel is off by one, as a capture of the same thing may be
+        capture[i] = reference[i] ^ 0xFF000000;
+        if ((capture[i] & 0xFF) < 0xFF)
+            capture[i] += 1;
+    }
+
+    volatile bool sink = false;
+    auto time = [&](const std::function<bool()>& compare) {
+        BenchClock::time_point start = BenchClock::now();
+        for (int i = 0; i < COMPARES; i++)
+            sink = compare();
+        return ElapsedNs(start) / COMPARES / 1000.0;
+    };
+    std::vector<UINT32> copy = capture;
+    const UINT32* a = capture.data();
+    const UINT32* b = reference.data();
+    const UINT32* c = copy.data();
+    double scalarExact = time([&]() {
+        bool same = true;
+        for (size_t i = 0; i < count; i++)
+            same &= ((a[i] ^ c[i]) & 0x00FFFFFF) == 0;
+        return same;
+    });
+    double exact = time([&]() { return pi::ScreenProbe::Equal(a, c, count); });
+    double scalarWithin = time([&]() {
+        bool within = true;
+        for (size_t i = 0; i < count; i++) {
+            for (int shift = 0; shift < 24; shift += 8)
+                within &= std::abs((int)((a[i] >> shift) & 0xFF) - (int)((b[i] >> shift) & 0xFF)) <= 2;
+        }
+        return within;
+    });
+    double within = time([&]() { return pi::ScreenProbe::Within(a, b, count, 2); });
+    double hash = time([&]() { return pi::ScreenProbe::Hash(a, count) != 0; });
+
+    // Throttling: a probe polled every millisecond for a second of virtual time
+    std::shared_ptr<pi::ManualClock> clock = std::make_shared<pi::ManualClock>();
+    std::shared_ptr<pi::SyntheticFrameSource> screen = std::make_shared<pi::SyntheticFrameSource>(640, 480, clock);
+    pi::ScreenProbe probe(screen, { 0, 0, SIDE, SIDE });
+    probe.setReference(reference);
+    pi::WinDimensions_t window = { { 0, 0 }, { 640, 480 }, 640, 480 };
+    for (int ms = 0; ms < 1000; ms++) {
+        probe.poll(window, clock->now());
+        clock->advanceBy(1000);
+    }
+
+    cout << SIDE << "x" << SIDE << " region, " << count << " pixels" << endl;
+    cout << std::fixed << std::setprecision(2) << "exact, scalar      " << std::setw(8) << scalarExact << " us" << endl;
+    cout << "exact             " << std::setw(8) << exact << " us  " << scalarExact / exact << "x" << endl;
+    cout << "tolerance, scalar " << std::setw(8) << scalarWithin << " us" << endl;
+    cout << "tolerance         " << std::setw(8) << within << " us  " << scalarWithin / within << "x" << endl;
+    cout << "hash              " << std::setw(8) << hash << " us" << endl;
+    cout << "1000 polls at 1 ms took " << probe.getStats().captures << " captures" << endl;
+}
+
+/*******************************************************************************
+        Event stream codec
+********************************************************************************/
+
+// A long recording of typing and mouse movement, its size encoded against the InjectEvent_t layout, and how fast it decodes
+static void BenchCodec() {
+    const int GROUPS = 1000000;
+    const int DECODES = 5;
+    std::vector<pi::TimedEvent> groups;
+    groups.reserve(GROUPS);
+    for (int i = 0; i < GROUPS; i++) {
+        if (i % 4 == 0) {
+            pi::MouseEvent move(pi::MouseEvent::EventType::MEVT_MOVE);
+            move.setMoveValues(3 + (i / 40) % 3, -1);
+            groups.push_back(pi::TimedMouseEvent(move, 16));
+        }
+        else {
+            groups.push_back(pi::TimedKeyEvent(pi::KeyEvent((WORD)('A' + i % 26)), 30 + i % 5));
+        }
+    }
+    std::vector<pi::InjectEvent_t> raw;
+    pi::EncodeInjectEvents(0, groups, pi::SubmitPriority::SPRIO_NORMAL, raw);
+
+    BenchClock::time_point start = BenchClock::now();
+    std::vector<BYTE> packed;
+    pi::EventCodec::Encode(raw.data(), raw.size(), packed);
+    double encodeMs = ElapsedNs(start) / 1e6;
+
+    std::vector<pi::InjectEvent_t> decoded(raw.size());
+    double best = 0;
+    for (int i = 0; i < DECODES; i++) {
+        start = BenchClock::now();
+        pi::EventStreamReader reader(packed.data(), packed.size());
+        size_t read = reader.read(decoded.data(), decoded.size());
+        double ns = ElapsedNs(start);
+        if (read != raw.size()) {
+            cerr << "Decoded " << read << " of " << raw.size() << " events" << endl;
+            return;
+        }
+        best = i == 0 ? ns : std::min(best, ns);
+    }
+    bool same = memcmp(decoded.data(), raw.data(), raw.size() * sizeof(pi::InjectEvent_t)) == 0;
+
+    start = BenchClock::now();
+    pi::TimedEventGenerator generator = pi::MakeEventStreamGenerator(std::make_shared<std::vector<BYTE>>(packed));
+    size_t played = 0;
+    while (generator())
+        played++;
+    double groupsNs = ElapsedNs(start);
+
+    cout << raw.size() << " events, " << raw.size() * sizeof(pi::InjectEvent_t) << " bytes as InjectEvent_t, " << packed.size()
+         << " encoded (" << std::fixed << std::setprecision(2) << (double)packed.size() / raw.size() << " bytes/event)" << endl;
+    cout << std::setprecision(1) << "encode             " << std::setw(8) << encodeMs << " ms" << endl;
+    cout << "decode to events   " << std::setw(8) << raw.size() / (best / 1e9) / 1e6 << " M events/s" << (same ? "" : "  MISMATCH") << endl;
+    cout << "decode to groups   " << std::setw(8) << played / (groupsNs / 1e9) / 1e6 << " M groups/s" << endl;
+}
+
+/*******************************************************************************
+        variation
+********************************************************************************/
+
+static void BenchVariation() {
+    const int GROUPS = 1000000;
+    // Built the way scripts have done it, one rand() per delay and per coordinate
+    srand(1);
+    BenchClock::time_point start = BenchClock::now();
+    std::vector<pi::TimedEvent> randomised;
+    randomised.reserve(GROUPS);
+    for (int i = 0; i < GROUPS; i++) {
+        if (i % 4 == 0) {
+            pi::MouseEvent move(pi::MouseEvent::EventType::MEVT_MOVE);
+            move.setMoveValues(3 + rand() % 5 - 2, -1 + rand() % 5 - 2);
+            randomised.push_back(pi::TimedMouseEvent(move, 16 + rand() % 9 - 4));
+        }
+        else {
+            randomised.push_back(pi::TimedKeyEvent(pi::KeyEvent((WORD)('A' + i % 26)), 30 + rand() % 9 - 4));
+        }
+    }
+    double randNs = ElapsedNs(start);
+
+    start = BenchClock::now();
+    std::vector<pi::TimedEvent> groups;
+    groups.reserve(GROUPS);
+    for (int i = 0; i < GROUPS; i++) {
+        if (i % 4 == 0) {
+            pi::MouseEvent move(pi::MouseEvent::EventType::MEVT_MOVE);
+            move.setMoveValues(3, -1);
+            groups.push_back(pi::TimedMouseEvent(move, 16));
+        }
+        else {
+            groups.push_back(pi::TimedKeyEvent(pi::KeyEvent((WORD)('A' + i % 26)), 30));
+        }
+    }
+    double plainNs = ElapsedNs(start);
+
+    pi::VariationConfig_t config;
+    config.seed = 1;
+    config.delay = { pi::VariationDistribution::VDIST_CLAMPED_NORMAL, 2.0f, 4.0f };
+    config.move = { pi::VariationDistribution::VDIST_UNIFORM, 2.0f };
+    pi::TimingVariation variation(config);
+    start = BenchClock::now();
+    variation.apply(groups, 0);
+    double applyNs = ElapsedNs(start);
+
+    static float samples[1 << 20];
+    pi::VariationRng rng(1);
+    // Once to fault the buffer in
+    rng.fillUnit(samples, 1 << 20);
+    start = BenchClock::now();
+    rng.fillUnit(samples, 1 << 20);
+    double unitNs = ElapsedNs(start);
+    start = BenchClock::now();
+    pi::TimingVariation::Fill(rng, config.delay, samples, 1 << 20);
+    double normalNs = ElapsedNs(start);
+
+    cout << std::fixed << std::setprecision(1);
+    cout << "build with rand()       " << std::setw(8) << randNs / 1e6 << " ms" << endl;
+    cout << "build plain + apply     " << std::setw(8) << plainNs / 1e6 << " + " << applyNs / 1e6 << " ms ("
+         << std::setprecision(2) << applyNs / GROUPS << " ns/group)" << endl;
+    cout << "unit samples            " << std::setw(8) << unitNs / (1 << 20) << " ns/sample" << endl;
+    cout << "clamped normal samples  " << std::setw(8) << normalNs / (1 << 20) << " ns/sample" << endl;
+}
+
+/*******************************************************************************
+        main
+********************************************************************************/
+
+int main(int argc, char* argv[]) {
+    if (argc == 4 && std::string(argv[1]) == "inject-client")
+        return RunInjectClient(pi::WinAssist::Utf8ToWide(argv[2]), atoi(argv[3]));
+    if (argc == 3 && std::string(argv[1]) == "inject-crash")
+        return RunInjectCrashClient(pi::WinAssist::Utf8ToWide(argv[2]));
+
+    cout << "Bench : PegasusWinterface system benchmarks" << endl;
+
+    // Takes its own options and reports pass or fail through the exit code, so it runs on its own
+    if (argc >= 2 && std::string(argv[1]) == "soak")
+        return RunSoak(argc - 2, argv + 2);
+
+    std::vector<std::pair<std::string, std::function<void()>>> benches = {
+        { "match", BenchTitleMatch },
+        { "inject", BenchInject },
+        { "jitter", BenchJitter },
+        { "dispatch", BenchDispatch },
+        { "elide", BenchElide },
+        { "plan", BenchPlan },
+        { "journal", BenchJournal },
+        { "probe", BenchProbe },
+        { "codec", BenchCodec },
+        { "variation", BenchVariation },
+    };
+
+    if (argc == 1) {
+        cout << "Available benchmarks:";
+        for (auto& b : benches)
+            cout << " " << b.first;
+        cout << " soak" << endl;
+        return EXIT_SUCCESS;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        bool ran = false;
+        for (auto& b : benches) {
+            if (b.first == argv[i]) {
+                cout << "== " << b.first << " ==" << endl;
+                b.second();
+                ran = true;
+            }
+        }
+        if (!ran) {
+            cerr << "Unknown benchmark '" << argv[i] << "'" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
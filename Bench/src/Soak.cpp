@@ -0,0 +1,333 @@
+/*
+
+Soak
+
+Long running soak test of the PegasusWinterface system against a fake backend. Producer
+threads submit randomised key and mouse sequences to many bindings while a dispatcher
+thread ticks them, and every interval a sample of memory, queue depth, lateness and
+allocations is appended to a CSV time series:
+
+    Bench soak [--duration <s>] [--interval <s>] [--bindings <n>] [--producers <n>] [--csv <path>]
+               [--max-growth-mb <mb>] [--max-drift-us <us>]
+
+*/
+
+#include "Soak.h"
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <string>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <cstdlib>
+#include <algorithm>
+
+#include <Windows.h>
+#include <Psapi.h>
+
+#include "PegasusWinterface.h"
+
+namespace pi = pinterface;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+/*******************************************************************************
+        Allocation counting
+********************************************************************************/
+
+static std::atomic<UINT64> ALLOCATIONS{ 0 };
+
+void* operator new(size_t size) {
+    ALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+/*******************************************************************************
+        Soak test
+********************************************************************************/
+
+typedef struct SoakOptions {
+    double durationS = 60.0;
+    double intervalS = 5.0;
+    int bindings = 16;
+    int producers = 2;
+    std::string csvPath = "soak.csv";
+    // Growth of the working set from the start of the run to the end, once warmed up, that counts as a leak
+    double maxGrowthMb = 16.0;
+    // Rise in p99 lateness from the start of the run to the end that counts as drift
+    INT64 maxDriftUs = 2000;
+} SoakOptions_t;
+
+typedef struct SoakSample {
+    double elapsedS;
+    UINT64 workingSetKb;
+    UINT64 privateKb;
+    size_t queueDepth;
+    INT64 latenessP50Us;
+    INT64 latenessP99Us;
+    UINT64 allocations; // Since the previous sample
+    UINT64 inputs; // Since the previous sample
+} SoakSample_t;
+
+// Stands in for the target windows. Takes a little time per dispatch, like a real injection, so calibration has something
+// to compensate for
+class SoakBackend : public pi::InputBackend {
+public:
+    bool sendInputs(pi::WinInfo_t& window, std::vector<INPUT>& inputs) override {
+        std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + std::chrono::microseconds(20 + inputs.size() * 5);
+        while (std::chrono::steady_clock::now() < until);
+        inputs_ += inputs.size();
+        return true;
+    }
+
+    // Only touched by the dispatcher thread
+    UINT64 inputs_ = 0;
+};
+
+static std::vector<pi::TimedEvent> RandomSequence(std::mt19937& rng) {
+    std::uniform_int_distribution<int> groups(1, 20);
+    std::uniform_int_distribution<int> delay(0, 20);
+    std::uniform_int_distribution<int> kind(0, 3);
+    std::uniform_int_distribution<int> key('A', 'Z');
+    std::uniform_int_distribution<int> move(-50, 50);
+
+    std::vector<pi::TimedEvent> evts;
+    int count = groups(rng);
+    for (int i = 0; i < count; i++) {
+        switch (kind(rng)) {
+        case 0: {
+            pi::MouseEvent evt(pi::MouseEvent::EventType::MEVT_MOVE);
+            evt.setMoveValues(move(rng), move(rng));
+            evts.push_back(pi::TimedMouseEvent(evt, delay(rng)));
+            break;
+        }
+        case 1:
+            evts.push_back(pi::TimedMouseEvent(pi::MouseEvent(pi::MouseEvent::EventType::MEVT_KEY_PRESSED, pi::MouseEvent::MouseKey::MKEY_LEFT), delay(rng)));
+            break;
+        default:
+            evts.push_back(pi::TimedKeyEvent(pi::KeyEvent((WORD)key(rng)), delay(rng)));
+            break;
+        }
+    }
+    return evts;
+}
+
+static UINT64 Median(std::vector<UINT64> values) {
+    if (values.empty())
+        return 0;
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+static bool ParseSoakOptions(int argc, char* argv[], SoakOptions_t& options) {
+    for (int i = 0; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            cerr << "Missing value for " << arg << endl;
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--duration")
+            options.durationS = atof(value);
+        else if (arg == "--interval")
+            options.intervalS = atof(value);
+        else if (arg == "--bindings")
+            options.bindings = std::max(1, atoi(value));
+        else if (arg == "--producers")
+            options.producers = std::max(1, atoi(value));
+        else if (arg == "--csv")
+            options.csvPath = value;
+        else if (arg == "--max-growth-mb")
+            options.maxGrowthMb = atof(value);
+        else if (arg == "--max-drift-us")
+            options.maxDriftUs = atoll(value);
+        else {
+            cerr << "Unknown soak option '" << arg << "'" << endl;
+            return false;
+        }
+    }
+    return options.durationS > 0 && options.intervalS > 0;
+}
+
+int RunSoak(int argc, char* argv[]) {
+    SoakOptions_t options;
+    if (!ParseSoakOptions(argc, argv, options))
+        return EXIT_FAILURE;
+
+    std::ofstream csv(options.csvPath);
+    if (!csv) {
+        cerr << "Unable to write '" << options.csvPath << "'" << endl;
+        return EXIT_FAILURE;
+    }
+    csv << "elapsed_s,working_set_kb,private_kb,queue_depth,lateness_p50_us,lateness_p99_us,allocations,inputs" << endl;
+
+    // The library logs every key it sends, which would swamp the output and the timings
+    std::streambuf* coutBuffer = cout.rdbuf(nullptr);
+
+    std::shared_ptr<SoakBackend> backend = std::make_shared<SoakBackend>();
+    std::vector<std::unique_ptr<pi::PegasusWinterface>> apps;
+    for (int i = 0; i < options.bindings; i++) {
+        std::unique_ptr<pi::PegasusWinterface> app(new pi::PegasusWinterface());
+        pi::WinInfo_t info;
+        info.title = L"Soak Target " + std::to_wstring(i);
+        info.isVisible = true;
+        info.pid = 0;
+        info.tid = 0;
+        app->setBackend(backend);
+        app->bind(info);
+        apps.push_back(std::move(app));
+    }
+
+    std::atomic<bool> quit{ false };
+    std::vector<SoakSample_t> samples;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < options.producers; p++) {
+        producers.emplace_back([&, p]() {
+            std::mt19937 rng(1234 + p);
+            std::uniform_int_distribution<int> binding(0, options.bindings - 1);
+            std::uniform_int_distribution<int> priority(0, pi::SUBMIT_PRIORITY_COUNT - 1);
+            std::uniform_int_distribution<int> percent(0, 99);
+            std::uniform_int_distribution<int> pause(0, 4);
+            std::deque<pi::SequenceHandle> inFlight;
+
+            while (!quit.load(std::memory_order_acquire)) {
+                // Bounded in flight, so the queues only grow if the dispatcher falls behind for good
+                while (!inFlight.empty() && inFlight.front().isFinished())
+                    inFlight.pop_front();
+                if (inFlight.size() >= 64) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    continue;
+                }
+
+                pi::SequenceHandle h = apps[binding(rng)]->submitEvents(RandomSequence(rng), (pi::SubmitPriority)priority(rng));
+                if (percent(rng) < 5)
+                    h.cancel();
+                inFlight.push_back(h);
+                std::this_thread::sleep_for(std::chrono::milliseconds(pause(rng)));
+            }
+            for (pi::SequenceHandle& h : inFlight)
+                h.cancel();
+        });
+    }
+
+    std::thread dispatcher([&]() {
+        std::mt19937 rng(99);
+        std::uniform_int_distribution<int> percent(0, 99);
+        std::uniform_int_distribution<int> binding(0, options.bindings - 1);
+        double nextSample = options.intervalS;
+        UINT64 lastAllocations = ALLOCATIONS.load(std::memory_order_relaxed);
+        UINT64 lastInputs = 0;
+
+        while (!quit.load(std::memory_order_acquire)) {
+            int wait = pi::PEGASUS_TICK_IDLE;
+            for (auto& app : apps) {
+                int appWait = app->tick();
+                if (appWait != pi::PEGASUS_TICK_IDLE && (wait == pi::PEGASUS_TICK_IDLE || appWait < wait))
+                    wait = appWait;
+            }
+
+            // The single threaded API gets some traffic too
+            if (percent(rng) == 0) {
+                pi::PegasusWinterface& app = *apps[binding(rng)];
+                std::vector<pi::TimedKeyEvent> keys(3, pi::TimedKeyEvent(pi::KeyEvent('Q'), 5));
+                app.executeKeys(keys, true);
+            }
+
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (elapsed >= nextSample) {
+                nextSample += options.intervalS;
+
+                SoakSample_t sample = {};
+                sample.elapsedS = elapsed;
+                PROCESS_MEMORY_COUNTERS_EX pmc = {};
+                pmc.cb = sizeof(pmc);
+                if (GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&pmc, sizeof(pmc))) {
+                    sample.workingSetKb = pmc.WorkingSetSize / 1024;
+                    sample.privateKb = pmc.PrivateUsage / 1024;
+                }
+                std::vector<INT64> p50s;
+                for (auto& app : apps) {
+                    sample.queueDepth += app->getQueueDepth();
+                    pi::CalibrationState_t state = app->getCalibrationState();
+                    p50s.push_back(state.residualP50Us);
+                    sample.latenessP99Us = std::max(sample.latenessP99Us, state.residualAbsP99Us);
+                }
+                std::nth_element(p50s.begin(), p50s.begin() + p50s.size() / 2, p50s.end());
+                sample.latenessP50Us = p50s[p50s.size() / 2];
+                UINT64 allocations = ALLOCATIONS.load(std::memory_order_relaxed);
+                sample.allocations = allocations - lastAllocations;
+                lastAllocations = allocations;
+                sample.inputs = backend->inputs_ - lastInputs;
+                lastInputs = backend->inputs_;
+
+                samples.push_back(sample);
+                csv << std::fixed << std::setprecision(1) << sample.elapsedS << "," << sample.workingSetKb << "," << sample.privateKb << ","
+                    << sample.queueDepth << "," << sample.latenessP50Us << "," << sample.latenessP99Us << "," << sample.allocations << ","
+                    << sample.inputs << endl;
+                cerr << "[" << std::fixed << std::setprecision(0) << sample.elapsedS << " s] ws " << sample.workingSetKb << " KB, depth "
+                     << sample.queueDepth << ", late p50 " << sample.latenessP50Us << " us p99 " << sample.latenessP99Us << " us, "
+                     << sample.inputs << " inputs" << endl;
+            }
+
+            if (wait != 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(wait == pi::PEGASUS_TICK_IDLE ? 1 : std::min(wait, 1)));
+        }
+    });
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.durationS));
+    quit.store(true, std::memory_order_release);
+    for (std::thread& t : producers)
+        t.join();
+    dispatcher.join();
+    cout.rdbuf(coutBuffer);
+
+    // Judge the last quarter of the run against the quarter after the first (the first is allowed for warming up)
+    size_t quarter = samples.size() / 4;
+    if (quarter == 0) {
+        cout << "Soak: only " << samples.size() << " samples, too short to judge. Time series in " << options.csvPath << endl;
+        return EXIT_SUCCESS;
+    }
+    std::vector<UINT64> earlyWs, lateWs, earlyP99, lateP99;
+    for (size_t i = quarter; i < 2 * quarter; i++) {
+        earlyWs.push_back(samples[i].workingSetKb);
+        earlyP99.push_back((UINT64)std::max<INT64>(0, samples[i].latenessP99Us));
+    }
+    for (size_t i = samples.size() - quarter; i < samples.size(); i++) {
+        lateWs.push_back(samples[i].workingSetKb);
+        lateP99.push_back((UINT64)std::max<INT64>(0, samples[i].latenessP99Us));
+    }
+    double growthMb = ((double)Median(lateWs) - (double)Median(earlyWs)) / 1024.0;
+    INT64 driftUs = (INT64)Median(lateP99) - (INT64)Median(earlyP99);
+    bool leaked = growthMb > options.maxGrowthMb;
+    bool drifted = driftUs > options.maxDriftUs;
+
+    cout << "Soak: " << samples.size() << " samples over " << std::fixed << std::setprecision(0) << options.durationS << " s, "
+         << options.bindings << " bindings. Working set grew " << std::setprecision(1) << growthMb << " MB (limit "
+         << options.maxGrowthMb << "), p99 lateness moved " << driftUs << " us (limit " << options.maxDriftUs << ")" << endl;
+    cout << "Time series in " << options.csvPath << endl;
+    if (leaked)
+        cout << "FAILED: memory kept growing" << endl;
+    if (drifted)
+        cout << "FAILED: p99 lateness drifted" << endl;
+    return (leaked || drifted) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
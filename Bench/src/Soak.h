@@ -0,0 +1,12 @@
+#pragma once
+/*
+
+Soak
+
+Long running soak test of the PegasusWinterface system against a fake backend
+
+*/
+
+// Runs the soak test with the options after "soak" on the command line. Returns the process exit code, failure if memory
+// kept growing or lateness drifted
+int RunSoak(int argc, char* argv[]);
@@ -0,0 +1,119 @@
+/*
+
+Daemon
+
+Injection daemon for the PegasusWinterface system. Binds the target windows once and sends
+the batches that client processes submit through an InjectClient
+
+    Daemon [--name <section>] --target "<title>" [--target "<title>" ...]
+           [--affinity <cpu mask>] [--priority normal|above|highest|critical] [--mmcss <task>] [--timer-period <ms>]
+
+The scheduling options apply to the dispatching thread while the daemon runs
+
+*/
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+
+#include "PegasusWinterface.h"
+#include "InjectDaemon.h"
+#include "ThreadConfig.h"
+
+namespace pi = pinterface;
+using std::cout;
+using std::cerr;
+using std::wcerr;
+using std::wcout;
+using std::endl;
+
+static std::atomic<bool> QUIT{ false };
+
+static bool PriorityFromName(const std::string& name, pi::ThreadPriority& priority) {
+    if (name == "normal")
+        priority = pi::ThreadPriority::TPRIO_DEFAULT;
+    else if (name == "above")
+        priority = pi::ThreadPriority::TPRIO_ABOVE_NORMAL;
+    else if (name == "highest")
+        priority = pi::ThreadPriority::TPRIO_HIGHEST;
+    else if (name == "critical")
+        priority = pi::ThreadPriority::TPRIO_TIME_CRITICAL;
+    else
+        return false;
+    return true;
+}
+
+static BOOL WINAPI OnConsoleCtrl(DWORD type) {
+    QUIT.store(true, std::memory_order_release);
+    return TRUE;
+}
+
+int main(int argc, char* argv[]) {
+    cout << "Daemon : PegasusWinterface injection daemon" << endl;
+
+    std::wstring name = pi::INJECT_DEFAULT_NAME;
+    std::vector<std::string> titles;
+    pi::ThreadConfig_t threadConfig;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--name" && i + 1 < argc) {
+            name = pi::WinAssist::Utf8ToWide(argv[++i]);
+        }
+        else if (arg == "--target" && i + 1 < argc) {
+            titles.push_back(argv[++i]);
+        }
+        else if (arg == "--affinity" && i + 1 < argc) {
+            threadConfig.affinityMask = (DWORD_PTR)strtoull(argv[++i], nullptr, 0);
+        }
+        else if (arg == "--priority" && i + 1 < argc && PriorityFromName(argv[i + 1], threadConfig.priority)) {
+            i++;
+        }
+        else if (arg == "--mmcss" && i + 1 < argc) {
+            threadConfig.mmcssTask = pi::WinAssist::Utf8ToWide(argv[++i]);
+        }
+        else if (arg == "--timer-period" && i + 1 < argc) {
+            threadConfig.timerPeriodMs = (UINT)atoi(argv[++i]);
+        }
+        else {
+            cerr << "Unknown argument '" << arg << "'" << endl;
+            cerr << "Usage: Daemon [--name <section>] --target \"<title>\" [--target \"<title>\" ...]" << endl;
+            cerr << "       [--affinity <cpu mask>] [--priority normal|above|highest|critical] [--mmcss <task>] [--timer-period <ms>]" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (titles.empty()) {
+        cerr << "Need at least one --target to bind" << endl;
+        return EXIT_FAILURE;
+    }
+
+    pi::InjectDaemon daemon(name);
+    std::vector<std::unique_ptr<pi::PegasusWinterface>> apps;
+    for (std::string& title : titles) {
+        std::unique_ptr<pi::PegasusWinterface> app(new pi::PegasusWinterface());
+        if (!app->bind(title)) {
+            cerr << "Unable to find a window title containing '" << title << "' to bind!" << endl;
+            return EXIT_FAILURE;
+        }
+        int index = daemon.addTarget(app.get());
+        if (index < 0)
+            return EXIT_FAILURE;
+        wcout << "Target " << index << ": '" << app->getWinInfo().title << "'" << endl;
+        apps.push_back(std::move(app));
+    }
+
+    if (!daemon.start())
+        return EXIT_FAILURE;
+
+    SetConsoleCtrlHandler(OnConsoleCtrl, TRUE);
+    {
+        pi::ScopedThreadConfig scope(threadConfig);
+        daemon.run(QUIT);
+    }
+    daemon.stop();
+
+    cout << "Sent " << daemon.getBatchCount() << " batches (" << daemon.getEventCount() << " events), rejected "
+         << daemon.getRejectedCount() << endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,259 @@
+/*
+
+Driver
+
+pwdrive, command line driver for the PegasusWinterface system. Reads a script (see
+ScriptParser.h for the syntax) from a file or stdin and sends it to the target window.
+Parsing runs on its own thread and hands the events over in pieces as they are parsed, so a
+piped or very large script starts running straight away:
+
+    generate_script | pwdrive --target "Notepad"
+    pwdrive --target "Notepad" --match exact script.txt
+
+--trace <file> writes a Chrome trace of the run, to open in chrome://tracing or ui.perfetto.dev
+
+--journal <file> keeps a journal of the pieces submitted and how far each has been sent. If the
+run is cut short, --resume with the same journal sends whatever was left, without a script:
+
+    pwdrive --target "Notepad" --journal run.pwj script.txt
+    pwdrive --target "Notepad" --journal run.pwj --resume
+
+Only pieces that had already been parsed and submitted are in the journal
+
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "PegasusWinterface.h"
+#include "ScriptParser.h"
+#include "Trace.h"
+
+namespace pi = pinterface;
+using std::cout;
+using std::cerr;
+using std::wcerr;
+using std::wcout;
+using std::endl;
+
+// Size of each read from the input
+static const DWORD READ_SIZE = 64 * 1024;
+// Sequences submitted but not yet sent, beyond which the parser waits so a huge script isn't all held in memory at once
+static const size_t MAX_IN_FLIGHT = 16;
+
+typedef struct ParseResult {
+    bool ok = true;
+    UINT64 bytes = 0;
+    UINT64 groups = 0;
+    UINT64 sequences = 0;
+} ParseResult_t;
+
+static void PrintUsage() {
+    cerr << "Usage: pwdrive --target \"<title>\" [--match contains|exact|prefix|nocase|glob|regex] [--trace <file>] [--journal <file>] [<script file>|-]" << endl;
+    cerr << "       pwdrive --target \"<title>\" [--match ...] [--trace <file>] --journal <file> --resume" << endl;
+    cerr << "       pwdrive --parse-only [<script file>|-]" << endl;
+}
+
+static bool MatchTypeFromName(const std::string& name, pi::TitleMatcher::MatchType& type) {
+    typedef pi::TitleMatcher::MatchType MT;
+    if (name == "contains")
+        type = MT::TMATCH_CONTAINS;
+    else if (name == "exact")
+        type = MT::TMATCH_EXACT;
+    else if (name == "prefix")
+        type = MT::TMATCH_PREFIX;
+    else if (name == "nocase")
+        type = MT::TMATCH_CONTAINS_NOCASE;
+    else if (name == "glob")
+        type = MT::TMATCH_GLOB;
+    else if (name == "regex")
+        type = MT::TMATCH_REGEX;
+    else
+        return false;
+    return true;
+}
+
+// Runs on the parser thread. Submits each piece of the script as soon as it is parsed. app is null when only parsing
+static void ParseInput(HANDLE input, pi::PegasusWinterface* app, ParseResult_t& result, std::atomic<bool>& done) {
+    if (pi::Tracer::IsEnabled())
+        pi::Tracer::SetThreadName("parser");
+    pi::ScriptParser parser;
+    std::vector<char> buffer(READ_SIZE);
+    std::vector<pi::TimedEvent> groups;
+    std::deque<pi::SequenceHandle> inFlight;
+
+    auto submit = [&]() {
+        if (groups.empty())
+            return;
+        result.groups += groups.size();
+        result.sequences++;
+        if (app == nullptr) {
+            groups.clear();
+            return;
+        }
+        // Keep a bounded number of pieces queued. Each finishes in order, so only the oldest needs watching
+        while (inFlight.size() >= MAX_IN_FLIGHT) {
+            if (inFlight.front().isFinished())
+                inFlight.pop_front();
+            else
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        inFlight.push_back(app->submitEvents(std::move(groups)));
+        groups.clear();
+    };
+
+    while (true) {
+        DWORD read = 0;
+        // Returns whatever a pipe has available rather than waiting for the buffer to fill
+        if (!ReadFile(input, buffer.data(), READ_SIZE, &read, NULL) || read == 0)
+            break;
+        result.bytes += read;
+        pi::TraceScope span("parse", "driver");
+        if (!parser.feed(buffer.data(), read, groups)) {
+            result.ok = false;
+            break;
+        }
+        submit();
+    }
+
+    if (result.ok)
+        result.ok = parser.finish(groups);
+    if (result.ok) {
+        submit();
+    }
+    else {
+        cerr << "Script error, " << parser.getError() << endl;
+        // Don't run half a script
+        for (pi::SequenceHandle& h : inFlight)
+            h.cancel();
+    }
+    done.store(true, std::memory_order_release);
+}
+
+int main(int argc, char* argv[]) {
+    std::string target;
+    std::string path = "-";
+    std::string tracePath;
+    std::string journalPath;
+    bool parseOnly = false;
+    bool resume = false;
+    pi::TitleMatcher::MatchType matchType = pi::TitleMatcher::MatchType::TMATCH_CONTAINS;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--target" && i + 1 < argc) {
+            target = argv[++i];
+        }
+        else if (arg == "--match" && i + 1 < argc) {
+            if (!MatchTypeFromName(argv[++i], matchType)) {
+                PrintUsage();
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        }
+        else if (arg == "--journal" && i + 1 < argc) {
+            journalPath = argv[++i];
+        }
+        else if (arg == "--resume") {
+            resume = true;
+        }
+        else if (arg == "--parse-only") {
+            parseOnly = true;
+        }
+        else if (arg.size() > 1 && arg[0] == '-' && arg != "-") {
+            PrintUsage();
+            return EXIT_FAILURE;
+        }
+        else {
+            path = arg;
+        }
+    }
+    if ((target.empty() && !parseOnly) || (resume && (journalPath.empty() || parseOnly))) {
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+
+    HANDLE input = INVALID_HANDLE_VALUE;
+    if (resume) {
+        // Nothing is read, the journal holds everything to send
+    }
+    else if (path == "-") {
+        input = GetStdHandle(STD_INPUT_HANDLE);
+    }
+    else {
+        input = CreateFileW(pi::WinAssist::Utf8ToWide(path).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (input == INVALID_HANDLE_VALUE) {
+            cerr << "Unable to open '" << path << "' (error " << GetLastError() << ")" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    pi::PegasusWinterface app;
+    if (!parseOnly) {
+        pi::TitleMatcher matcher(pi::WinAssist::Utf8ToWide(target), matchType);
+        if (!matcher.isValid() || !app.bind(matcher)) {
+            cerr << "Unable to find a window matching '" << target << "' to bind!" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!journalPath.empty() && !parseOnly) {
+        std::shared_ptr<pi::SequenceJournal> journal = pi::SequenceJournal::Open(pi::WinAssist::Utf8ToWide(journalPath));
+        if (!journal) {
+            cerr << "Unable to use '" << journalPath << "' as a journal" << endl;
+            return EXIT_FAILURE;
+        }
+        app.setJournal(journal);
+        if (resume && app.resumeJournal() == 0)
+            cout << "Nothing left to resume in '" << journalPath << "'" << endl;
+    }
+
+    if (!tracePath.empty()) {
+        pi::Tracer::Start();
+        pi::Tracer::SetThreadName("dispatch");
+    }
+
+    ParseResult_t result;
+    std::atomic<bool> done{ resume };
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::thread parser;
+    if (!resume)
+        parser = std::thread(ParseInput, input, parseOnly ? nullptr : &app, std::ref(result), std::ref(done));
+
+    if (!parseOnly) {
+        // This thread only dispatches. It sleeps on the interface timer, and wakes at least every 50 ms while idle to see
+        // whether the parser has finished
+        HANDLE wake = app.getWaitableHandle();
+        while (!done.load(std::memory_order_acquire) || app.hasEventsInQueue()) {
+            int wait = app.tick();
+            if (wait != 0)
+                WaitForSingleObject(wake, wait == pi::PEGASUS_TICK_IDLE ? 50 : INFINITE);
+        }
+    }
+    if (parser.joinable())
+        parser.join();
+
+    if (input != INVALID_HANDLE_VALUE && path != "-")
+        CloseHandle(input);
+
+    if (!tracePath.empty()) {
+        pi::Tracer::Stop();
+        pi::Tracer::ExportChromeJson(tracePath);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    cout << "Parsed " << result.bytes << " bytes into " << result.groups << " groups (" << result.sequences << " pieces) in "
+         << std::fixed << std::setprecision(3) << seconds << " s";
+    if (parseOnly && seconds > 0)
+        cout << ", " << std::setprecision(1) << (double)result.bytes / seconds / (1024.0 * 1024.0) << " MB/s";
+    cout << endl;
+    return result.ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,861 @@
+/*
+
+Checks
+
+Self-contained checks of the PegasusWinterface system, run against fake backends and a
+manual clock so they need no window and give the same result every run:
+
+    Test checks [<check> ...]
+
+*/
+
+#include "Checks.h"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <functional>
+#include <memory>
+
+#include <Windows.h>
+
+#include "PegasusWinterface.h"
+#include "Script.h"
+#include "ScriptParser.h"
+#include "InjectDaemon.h"
+#include "InjectClient.h"
+#include "EventCodec.h"
+#include "TimingVariation.h"
+
+namespace pi = pinterface;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+/*******************************************************************************
+        Helpers
+********************************************************************************/
+
+// Number of expectations that failed in the check being run
+static int FAILURES = 0;
+
+static bool Expect(bool ok, const std::string& what) {
+    if (!ok) {
+        cout << "  failed: " << what << endl;
+        FAILURES++;
+    }
+    return ok;
+}
+
+// A made up target, for interfaces that only ever send to fake backends
+static pi::WinInfo_t CheckTarget(const wchar_t* title) {
+    pi::WinInfo_t info;
+    info.title = title;
+    info.isVisible = true;
+    info.pid = 0;
+    info.tid = 0;
+    return info;
+}
+
+// Records what it sends like RecordingBackend, and fails every send while failing is set
+class FailingBackend : public pi::RecordingBackend {
+public:
+    FailingBackend(std::shared_ptr<pi::ClockSource> clock) : pi::RecordingBackend(clock) {}
+
+    bool sendInputs(pi::WinInfo_t& window, std::vector<INPUT>& inputs) override {
+        if (failing)
+            return false;
+        return pi::RecordingBackend::sendInputs(window, inputs);
+    }
+
+    bool failing = false;
+};
+
+// Records like RecordingBackend, with every send taking sendUs of the ManualClock's time. The records are stamped
+// when the send completes
+class SlowBackend : public pi::RecordingBackend {
+public:
+    SlowBackend(std::shared_ptr<pi::ManualClock> clock, INT64 sendUs) : pi::RecordingBackend(clock), m_clock(clock), m_sendUs(sendUs) {}
+
+    bool sendInputs(pi::WinInfo_t& window, std::vector<INPUT>& inputs) override {
+        m_clock->advanceBy(m_sendUs);
+        return pi::RecordingBackend::sendInputs(window, inputs);
+    }
+
+private:
+    std::shared_ptr<pi::ManualClock> m_clock;
+    INT64 m_sendUs;
+};
+
+// Keys typed delayMs apart, the first straight away
+static std::vector<pi::TimedKeyEvent> TypedKeys(const std::string& keys, int delayMs) {
+    std::vector<pi::TimedKeyEvent> evts;
+    for (char c : keys)
+        evts.push_back(pi::TimedKeyEvent(pi::KeyEvent((WORD)c), evts.empty() ? 0 : delayMs));
+    return evts;
+}
+
+// Virtual keys of the first event of each group, as a string
+static std::string GroupKeys(std::vector<pi::TimedEvent>& groups) {
+    std::string keys;
+    for (auto& group : groups) {
+        if (group.kind() == pi::TimedEvent::Kind::TEVT_KEY && !group.key().getEvents().empty())
+            keys += (char)group.key().getEvents().front().vKey();
+    }
+    return keys;
+}
+
+// Batches a RecordingBackend was sent, as "<time in us>:<virtual key of the first record>"
+static std::vector<std::string> RecordedBatches(pi::RecordingBackend& backend) {
+    std::vector<std::string> batches;
+    UINT64 last = (UINT64)-1;
+    for (const pi::RecordedInput_t& record : backend.getRecords()) {
+        if (record.batch == last)
+            continue;
+        last = record.batch;
+        WORD vk = record.input.type == INPUT_KEYBOARD ? record.input.ki.wVk : 0;
+        batches.push_back(std::to_string(record.time) + ":" + std::string(1, (char)vk));
+    }
+    return batches;
+}
+
+// One input as the virtual key, or L, R or M for a mouse button, then + for down or - for up. m for a mouse move
+static std::string DescribeInput(const INPUT& input) {
+    if (input.type == INPUT_KEYBOARD) {
+        WORD vk = input.ki.wVk;
+        std::string key = (vk >= '0' && vk <= 'Z') ? std::string(1, (char)vk) : std::to_string(vk);
+        return key + ((input.ki.dwFlags & KEYEVENTF_KEYUP) ? "-" : "+");
+    }
+    DWORD flags = input.mi.dwFlags;
+    if (flags & MOUSEEVENTF_LEFTDOWN) return "L+";
+    if (flags & MOUSEEVENTF_LEFTUP) return "L-";
+    if (flags & MOUSEEVENTF_RIGHTDOWN) return "R+";
+    if (flags & MOUSEEVENTF_RIGHTUP) return "R-";
+    if (flags & MOUSEEVENTF_MIDDLEDOWN) return "M+";
+    if (flags & MOUSEEVENTF_MIDDLEUP) return "M-";
+    return "m";
+}
+
+// Batches a RecordingBackend was sent with every input in them, as "<us from start>:<input>,<input>..."
+static std::vector<std::string> RecordedTimeline(pi::RecordingBackend& backend, INT64 start) {
+    std::vector<std::string> batches;
+    UINT64 last = (UINT64)-1;
+    for (const pi::RecordedInput_t& record : backend.getRecords()) {
+        if (record.batch != last)
+            batches.push_back(std::to_string(record.time - start) + ":");
+        else
+            batches.back() += ",";
+        last = record.batch;
+        batches.back() += DescribeInput(record.input);
+    }
+    return batches;
+}
+
+static std::string Join(const std::vector<std::string>& parts) {
+    std::string joined;
+    for (const std::string& part : parts)
+        joined += (joined.empty() ? "" : " ") + part;
+    return joined;
+}
+
+/*******************************************************************************
+        Scripts
+********************************************************************************/
+
+// Types AB, notes when it got control back, waits 100 ms and types C
+static pi::Script TypeThenDelay(pi::ScriptTarget& target, std::shared_ptr<pi::ClockSource> clock, INT64& resumedAt) {
+    co_await target.keys(TypedKeys("AB", 10));
+    resumedAt = clock->now();
+    co_await pi::delay(std::chrono::milliseconds(100));
+    co_await target.keys(TypedKeys("C", 0));
+}
+
+static pi::Script DelayThenType(pi::ScriptTarget& target) {
+    co_await pi::delay(std::chrono::milliseconds(50));
+    co_await target.keys(TypedKeys("X", 0));
+}
+
+// Scripts on a scheduler made without a clock run on the interface's ManualClock, and a script waiting on a sequence
+// is resumed as it finishes rather than on a later poll
+static void CheckScripts() {
+    std::shared_ptr<pi::ManualClock> clock = std::make_shared<pi::ManualClock>();
+    std::shared_ptr<pi::RecordingBackend> backend = std::make_shared<pi::RecordingBackend>(clock);
+    pi::PegasusWinterface app;
+    app.setClock(clock);
+    app.setBackend(backend);
+    app.setCalibrationEnabled(false);
+    app.bind(CheckTarget(L"Checks Scripts"));
+    pi::ScriptTarget target(app);
+
+    INT64 resumedAt = -1;
+    pi::ScriptScheduler scheduler;
+    scheduler.spawn(TypeThenDelay(target, clock, resumedAt));
+    scheduler.spawn(DelayThenType(target));
+    scheduler.run();
+
+    Expect(scheduler.getClock() == clock, "the scheduler took the interface's clock");
+    Expect(resumedAt == 10000, "resumed as AB finished at 10000 us, got " + std::to_string(resumedAt));
+    std::string batches = Join(RecordedBatches(*backend));
+    Expect(batches == "0:A 10000:B 50000:X 110000:C", "recorded '" + batches + "'");
+    Expect(clock->now() == 110000, "run() ended with the last key, at " + std::to_string(clock->now()));
+}
+
+/*******************************************************************************
+        Recorded timeline
+********************************************************************************/
+
+static const char* TIMELINE_SCRIPT =
+    "pace 20\n"
+    "key A B\n"
+    "wait 250\n"
+    "chord ctrl+c\n"
+    "click left\n";
+// TIMELINE_SCRIPT as it should reach the target
+static const std::vector<std::string> TIMELINE_EXPECTED = {
+    "20000:A+,A-",
+    "40000:B+,B-",
+    "310000:17+,C+,C-,17-",
+    "330000:L+,L-",
+};
+
+static bool ParseScript(const std::string& text, std::vector<pi::TimedEvent>& groups) {
+    pi::ScriptParser parser;
+    if (!parser.feed(text.data(), text.size(), groups) || !parser.finish(groups))
+        return Expect(false, "the script parses: " + parser.getError());
+    return true;
+}
+
+// A script played on a ManualClock reaches the backend exactly when it says, however long it waits, without taking
+// that long. On a ScaledClock it takes the scaled time and stays within a little of the same timeline
+static void CheckTimeline() {
+    // Ten minutes in, then the same again
+    std::vector<pi::TimedEvent> groups;
+    if (!ParseScript(std::string(TIMELINE_SCRIPT) + "wait 600000\n" + TIMELINE_SCRIPT, groups))
+        return;
+    std::vector<std::string> expected = TIMELINE_EXPECTED;
+    for (const std::string& batch : TIMELINE_EXPECTED) {
+        size_t colon = batch.find(':');
+        expected.push_back(std::to_string(std::stoll(batch.substr(0, colon)) + 330000 + 600000000) + batch.substr(colon));
+    }
+
+    {
+        std::shared_ptr<pi::ManualClock> clock = std::make_shared<pi::ManualClock>(5000);
+        std::shared_ptr<pi::RecordingBackend> backend = std::make_shared<pi::RecordingBackend>(clock);
+        pi::PegasusWinterface app;
+        app.setClock(clock);
+        app.setBackend(backend);
+        app.setCalibrationEnabled(false);
+        app.bind(CheckTarget(L"Checks Timeline"));
+
+        pi::PegasusTimer timer;
+        timer.restart();
+        app.submitEvents(groups);
+        app.runUntilIdle();
+        std::string recorded = Join(RecordedTimeline(*backend, 5000));
+        Expect(recorded == Join(expected), "recorded '" + recorded + "'");
+        Expect(clock->now() == 5000 + 600660000, "the clock ended on the last batch, at " + std::to_string(clock->now()));
+        Expect(timer.getElapsedTimeAsMilliseconds() < 1000, "ten minutes played in under a second");
+    }
+
+    {
+        // 330 ms of script in about 33
+        std::vector<pi::TimedEvent> scaledGroups;
+        if (!ParseScript(TIMELINE_SCRIPT, scaledGroups))
+            return;
+        const INT64 TOLERANCE = 50000;
+        std::shared_ptr<pi::ScaledClock> clock = std::make_shared<pi::ScaledClock>(10.0);
+        std::shared_ptr<pi::RecordingBackend> backend = std::make_shared<pi::RecordingBackend>(clock);
+        pi::PegasusWinterface app;
+        app.setClock(clock);
+        app.setBackend(backend);
+        app.setCalibrationEnabled(false);
+        app.bind(CheckTarget(L"Checks Timeline"));
+
+        pi::PegasusTimer timer;
+        timer.restart();
+        INT64 start = clock->now();
+        app.submitEvents(scaledGroups);
+        app.runUntilIdle();
+        INT64 realMs = timer.getElapsedTimeAsMilliseconds();
+
+        std::vector<std::string> recorded = RecordedTimeline(*backend, start);
+        if (Expect(recorded.size() == TIMELINE_EXPECTED.size(), "recorded '" + Join(recorded) + "'")) {
+            for (size_t i = 0; i < recorded.size(); i++) {
+                size_t colon = recorded[i].find(':');
+                size_t expectedColon = TIMELINE_EXPECTED[i].find(':');
+                INT64 time = std::stoll(recorded[i].substr(0, colon));
+                INT64 expectedTime = std::stoll(TIMELINE_EXPECTED[i].substr(0, expectedColon));
+                Expect(recorded[i].substr(colon) == TIMELINE_EXPECTED[i].substr(expectedColon), "batch " + std::to_string(i) + " sent '" + recorded[i] + "'");
+                Expect(time >= expectedTime && time < expectedTime + TOLERANCE, "batch " + std::to_string(i) + " at " + std::to_string(time) + " us");
+            }
+        }
+        Expect(realMs < 330 / 2, "played at ten times speed in " + std::to_string(realMs) + " ms");
+    }
+
+    {
+        // Waits and pace add up to the longest delay a group can have, and no further
+        std::vector<pi::TimedEvent> longest;
+        if (ParseScript("pace 147483647\nwait 1000000000\nwait 1000000000\nkey A\n", longest))
+            Expect(longest.size() == 1 && longest[0].key().delayBefore() == INT_MAX, "the delay is INT_MAX");
+
+        const char* overflows[] = { "wait 2000000000\nwait 2000000000\nkey A\n", "wait 2000000000\npace 2000000000\nkey A\n" };
+        for (const char* text : overflows) {
+            std::vector<pi::TimedEvent> rejected;
+            pi::ScriptParser parser;
+            std::string script = text;
+            bool parsed = parser.feed(script.data(), script.size(), rejected) && parser.finish(rejected);
+            Expect(!parsed && parser.getLine() == 2, "a delay over INT_MAX is an error on line 2, got '" + parser.getError() + "'");
+        }
+    }
+}
+
+/*******************************************************************************
+        Calibration
+********************************************************************************/
+
+// Types 32 keys 10 ms apart through a backend that takes 2 ms a send, and returns the calibration state after
+static pi::CalibrationState_t PlaySlowSends(bool calibrate, std::vector<std::string>& batches) {
+    std::shared_ptr<pi::ManualClock> clock = std::make_shared<pi::ManualClock>();
+    std::shared_ptr<SlowBackend> backend = std::make_shared<SlowBackend>(clock, 2000);
+    pi::PegasusWinterface app;
+    app.setClock(clock);
+    app.setBackend(backend);
+    app.setCalibrationEnabled(calibrate);
+    app.bind(CheckTarget(L"Checks Calibration"));
+    app.submitKeys(TypedKeys("ABCDEFGHIJKLMNOPQRSTUVWXYZ012345", 10));
+    app.runUntilIdle();
+    batches = RecordedBatches(*backend);
+    return app.getCalibrationState();
+}
+
+// Without calibration every key lands 2 ms late. With it, once warmed up, dispatches start 2 ms early and land on time
+static void CheckCalibration() {
+    std::vector<std::string> batches;
+    pi::CalibrationState_t off = PlaySlowSends(false, batches);
+    Expect(!off.enabled, "calibration reported off");
+    Expect(off.samples == 32, "32 dispatches measured with calibration off, got " + std::to_string(off.samples));
+    Expect(off.leadUs == 0, "no lead with calibration off, got " + std::to_string(off.leadUs));
+    Expect(off.overheadP50Us == 2000, "overhead measured as 2000 us, got " + std::to_string(off.overheadP50Us));
+    Expect(off.lastResidualUs == 2000 && off.residualP50Us == 2000, "2000 us late with calibration off, got " + std::to_string(off.lastResidualUs) + " last and " + std::to_string(off.residualP50Us) + " median");
+    Expect(batches.size() == 32 && batches.back() == "312000:5", "last key landed at 312000 us with calibration off, got '" + (batches.empty() ? "" : batches.back()) + "'");
+
+    pi::CalibrationState_t on = PlaySlowSends(true, batches);
+    Expect(on.enabled, "calibration reported on");
+    Expect(on.leadUs == 2000, "dispatches start 2000 us early, got " + std::to_string(on.leadUs));
+    Expect(on.lastResidualUs == 0 && on.residualP50Us == 0, "on time with calibration on, got " + std::to_string(on.lastResidualUs) + " last and " + std::to_string(on.residualP50Us) + " median");
+    Expect(on.residualAbsP99Us <= 2000, "never more than 2000 us out, got " + std::to_string(on.residualAbsP99Us));
+    Expect(batches.size() == 32 && batches.back() == "310000:5", "last key landed at 310000 us with calibration on, got '" + (batches.empty() ? "" : batches.back()) + "'");
+}
+
+/*******************************************************************************
+        Elision
+********************************************************************************/
+
+// Presses of what is already held are dropped with the release that answers them, so a chord on a held modifier and a
+// click of a held button leave them held until their own release
+static void CheckElision() {
+    std::vector<pi::TimedEvent> groups;
+    if (!ParseScript("pace 10\ndown shift\nchord shift+a\nmdown left\nclick left\nup shift\nmup left\n", groups))
+        return;
+
+    std::shared_ptr<pi::ManualClock> clock = std::make_shared<pi::ManualClock>();
+    std::shared_ptr<pi::RecordingBackend> backend = std::make_shared<pi::RecordingBackend>(clock);
+    pi::PegasusWinterface app;
+    app.setClock(clock);
+    app.setBackend(backend);
+    app.setCalibrationEnabled(false);
+    app.bind(CheckTarget(L"Checks Elision"));
+    app.executeEvents(groups);
+    app.runUntilIdle();
+
+    // The click has nothing left to send, so there is no batch at 40000
+    std::string recorded = Join(RecordedTimeline(*backend, 0));
+    Expect(recorded == "10000:16+ 20000:A+,A- 30000:L+ 50000:16- 60000:L-", "recorded '" + recorded + "'");
+    pi::InputStateCounters_t counters = app.getInputStateCounters();
+    Expect(counters.elidedPresses == 2 && counters.elidedReleases == 2, "two presses and two releases elided, got "
+        + std::to_string(counters.elidedPresses) + " and " + std::to_string(counters.elidedReleases));
+    Expect(counters.skippedBatches == 1, "the click's batch skipped, got " + std::to_string(counters.skippedBatches));
+    Expect(!app.isKeyHeld(VK_SHIFT), "shift released at the end");
+}
+
+/*******************************************************************************
+        Target watchdog
+********************************************************************************/
+
+// The target events seen, as "<time in us>:<from>-><to>", with "@<hwnd>" added for a rebind
+static std::vector<std::string> WATCHDOG_EVENTS;
+
+static void RecordTargetEvent(const pi::TargetEvent_t& evt) {
+    std::string text = std::to_string(evt.time) + ":" + pi::TargetWatchdog::StateName(evt.from) + "->" + pi::TargetWatchdog::StateName(evt.to);
+    if (evt.rebound)
+        text += "@" + std::to_string((UINT_PTR)evt.hwnd);
+    WATCHDOG_EVENTS.push_back(text);
+}
+
+static pi::WinInfo_t WatchdogTarget(UINT_PTR hwnd, DWORD tid) {
+    pi::WinInfo_t target = CheckTarget(L"Checks Watchdog");
+    target.hwnd = (HWND)hwnd;
+    target.pid = 42;
+    target.tid = tid;
+    return target;
+}
+
+// A hung target holds the queue, and once it answers again everything left goes as far after the recovery as it was
+// after the send that failed
+static void CheckWatchdogHung() {
+    std::shared_ptr<pi::ManualClock> clock = std::make_shared<pi::ManualClock>();
+    std::shared_ptr<pi::SimulatedTargetBackend> backend = std::make_shared<pi::SimulatedTargetBackend>(clock, WatchdogTarget(0x100, 7));
+    pi::PegasusWinterface app;
+    app.setClock(clock);
+    app.setBackend(backend);
+    app.setCalibrationEnabled(false);
+    app.bind(WatchdogTarget(0x100, 7));
+    WATCHDOG_EVENTS.clear();
+    app.setTargetEventCallback(RecordTargetEvent);
+    pi::SequenceHandle handle = app.submitKeys(TypedKeys("ABC", 100));
+
+    app.tick();
+    backend->hang();
+    // B fails, which finds the target hung
+    clock->advanceTo(100000);
+    app.tick();
+    // Still hung at the next probe, and C's deadline has gone by
+    clock->advanceTo(350000);
+    app.tick();
+    Expect(backend->getBatchCount() == 1, "only A sent while hung, got " + std::to_string(backend->getBatchCount()));
+    Expect(backend->getRejectedCount() == 1, "one send rejected, got " + std::to_string(backend->getRejectedCount()));
+    Expect(!handle.isFinished(), "the sequence is held while hung");
+
+    // Recovered at the probe 500 ms after the pause started
+    backend->recover();
+    clock->advanceTo(600000);
+    app.runUntilIdle();
+    std::string batches = Join(RecordedBatches(*backend));
+    Expect(batches == "0:A 600000:B 700000:C", "recorded '" + batches + "'");
+    std::string events = Join(WATCHDOG_EVENTS);
+    Expect(events == "100000:ok->hung 600000:hung->ok", "target events '" + events + "'");
+    Expect(handle.isFinished(), "the sequence finished after recovering");
+}
+
+// A closed target holds the queue, and a new window for the same process is picked up by the next probe and sent the
+// rest of the queue
+static void CheckWatchdogRecreated() {
+    std::shared_ptr<pi::ManualClock> clock = std::make_shared<pi::ManualClock>();
+    std::shared_ptr<pi::SimulatedTargetBackend> backend = std::make_shared<pi::SimulatedTargetBackend>(clock, WatchdogTarget(0x100, 7));
+    pi::PegasusWinterface app;
+    app.setClock(clock);
+    app.setBackend(backend);
+    app.setCalibrationEnabled(false);
+    app.bind(WatchdogTarget(0x100, 7));
+    WATCHDOG_EVENTS.clear();
+    app.setTargetEventCallback(RecordTargetEvent);
+    app.submitKeys(TypedKeys("ABC", 100));
+
+    app.tick();
+    backend->close();
+    clock->advanceTo(100000);
+    app.tick();
+    Expect(backend->getBatchCount() == 1, "only A sent to the closed target, got " + std::to_string(backend->getBatchCount()));
+
+    // Nothing to find until the window comes back
+    clock->advanceTo(350000);
+    app.tick();
+    backend->recreate(WatchdogTarget(0x200, 8));
+    clock->advanceTo(600000);
+    app.runUntilIdle();
+
+    std::string batches = Join(RecordedBatches(*backend));
+    Expect(batches == "0:A 600000:B 700000:C", "recorded '" + batches + "'");
+    std::string events = Join(WATCHDOG_EVENTS);
+    Expect(events == "100000:ok->missing 600000:missing->ok@512", "target events '" + events + "'");
+    Expect(app.getWinInfo().hwnd == (HWND)0x200 && app.getWinInfo().tid == 8, "bound to the new window");
+    Expect(backend->getRejectedCount() == 1, "one send rejected, got " + std::to_string(backend->getRejectedCount()));
+}
+
+static void CheckWatchdog() {
+    CheckWatchdogHung();
+    CheckWatchdogRecreated();
+}
+
+/*******************************************************************************
+        Injection daemon
+********************************************************************************/
+
+// A client still connected when the daemon stops keeps the section mapped, but is told it is gone rather than filling
+// a ring nobody reads
+static void CheckInjectStop() {
+    const std::wstring NAME = L"PegasusChecksInject";
+    std::shared_ptr<pi::ManualClock> clock = std::make_shared<pi::ManualClock>();
+    std::shared_ptr<pi::RecordingBackend> backend = std::make_shared<pi::RecordingBackend>(clock);
+    pi::PegasusWinterface app;
+    app.setClock(clock);
+    app.setBackend(backend);
+    app.bind(CheckTarget(L"Checks Inject"));
+
+    pi::InjectDaemon daemon(NAME);
+    daemon.addTarget(&app);
+    if (!Expect(daemon.start(), "the daemon starts"))
+        return;
+    pi::InjectClient client;
+    if (!Expect(client.connect(NAME), "the client connects"))
+        return;
+    Expect(client.submitKeys(0, TypedKeys("A", 0)), "a submit while the daemon runs");
+    daemon.tick();
+    Expect(backend->getBatchCount() == 1, "the daemon sent the batch, got " + std::to_string(backend->getBatchCount()));
+
+    daemon.stop();
+    Expect(!client.isConnected(), "the client sees the daemon stop");
+    Expect(!client.submitKeys(0, TypedKeys("B", 0)), "a submit after the daemon stopped fails");
+    pi::InjectClient late;
+    Expect(!late.connect(NAME), "a new client can't connect to the stopped daemon");
+}
+
+/*******************************************************************************
+        Sequence journal
+********************************************************************************/
+
+// A batch dropped for a failed send is done with like one that was sent, so reopening the journal resumes after it
+static void CheckJournal() {
+    const std::wstring PATH = L"checks_journal.pwj";
+    DeleteFileW(PATH.c_str());
+
+    std::shared_ptr<pi::ManualClock> clock = std::make_shared<pi::ManualClock>();
+    std::shared_ptr<FailingBackend> backend = std::make_shared<FailingBackend>(clock);
+    {
+        std::shared_ptr<pi::SequenceJournal> journal = pi::SequenceJournal::Open(PATH);
+        if (!Expect(journal != nullptr, "the journal opens"))
+            return;
+        pi::PegasusWinterface app;
+        app.setClock(clock);
+        app.setBackend(backend);
+        app.setJournal(journal);
+        app.bind(CheckTarget(L"Checks Journal"));
+        app.submitKeys(TypedKeys("ABCDE", 10));
+
+        // A sent, B dropped while the target is fine but the send fails, C sent. The process then dies with D and E to go
+        app.tick();
+        backend->failing = true;
+        clock->advanceBy(10000);
+        app.tick();
+        backend->failing = false;
+        clock->advanceBy(10000);
+        app.tick();
+        Expect(backend->getBatchCount() == 2, "two batches sent before the crash");
+        journal->sync();
+    }
+
+    {
+        std::shared_ptr<pi::SequenceJournal> journal = pi::SequenceJournal::Open(PATH);
+        if (!Expect(journal != nullptr, "the journal opens again"))
+            return;
+        std::vector<pi::JournaledSequence_t> unfinished = journal->takeUnfinished();
+        if (Expect(unfinished.size() == 1, "one sequence unfinished")) {
+            std::string keys = GroupKeys(unfinished[0].groups);
+            Expect(keys == "DE", "resumes with DE, got '" + keys + "'");
+        }
+    }
+
+    // Resumed, with the last group dropped as well, which still ends the sequence
+    {
+        std::shared_ptr<pi::SequenceJournal> journal = pi::SequenceJournal::Open(PATH);
+        if (!Expect(journal != nullptr, "the journal opens to resume"))
+            return;
+        pi::PegasusWinterface app;
+        app.setClock(clock);
+        app.setBackend(backend);
+        app.setJournal(journal);
+        app.bind(CheckTarget(L"Checks Journal"));
+        Expect(app.resumeJournal() == 1, "one sequence resumed");
+        // D keeps its delay, E is dropped
+        app.tick();
+        clock->advanceBy(10000);
+        app.tick();
+        backend->failing = true;
+        clock->advanceBy(10000);
+        app.tick();
+        backend->failing = false;
+        Expect(backend->getBatchCount() == 3, "D sent on resuming");
+        journal->sync();
+    }
+
+    std::shared_ptr<pi::SequenceJournal> journal = pi::SequenceJournal::Open(PATH);
+    if (Expect(journal != nullptr, "the journal opens a last time"))
+        Expect(journal->takeUnfinished().empty(), "nothing left unfinished");
+    journal.reset();
+    DeleteFileW(PATH.c_str());
+}
+
+/*******************************************************************************
+        Event codec
+********************************************************************************/
+
+// Groups with keys, a chord, clicks, moves both ways and a scroll, at a changing pace
+static const char* CODEC_SCRIPT =
+    "pace 15\n"
+    "key A B\n"
+    "chord ctrl+shift+z\n"
+    "wait 400\n"
+    "move 12 -7\n"
+    "move -3000 2500\n"
+    "moveto 640 480\n"
+    "click right\n"
+    "scroll 240\n"
+    "pace 0\n"
+    "key C\n";
+
+static bool SameInjectEvent(const pi::InjectEvent_t& a, const pi::InjectEvent_t& b) {
+    return a.kind == b.kind && a.type == b.type && a.flags == b.flags && a.priority == b.priority && a.target == b.target
+        && a.code == b.code && a.delayMs == b.delayMs && a.dx == b.dx && a.dy == b.dy && a.scrollDelta == b.scrollDelta;
+}
+
+static bool SameInjectEvents(const std::vector<pi::InjectEvent_t>& a, const std::vector<pi::InjectEvent_t>& b) {
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (!SameInjectEvent(a[i], b[i]))
+            return false;
+    }
+    return true;
+}
+
+// Decodes a copy of the first size bytes, so reading past them is reading past the allocation
+static bool DecodePrefix(const std::vector<BYTE>& packed, size_t size, std::vector<pi::InjectEvent_t>& out) {
+    std::vector<BYTE> prefix(packed.begin(), packed.begin() + size);
+    return pi::EventCodec::Decode(prefix.data(), prefix.size(), out);
+}
+
+static void CheckCodecRoundTrip(std::vector<pi::TimedEvent>& groups) {
+    std::vector<pi::InjectEvent_t> evts;
+    pi::EncodeInjectEvents(3, groups, pi::SubmitPriority::SPRIO_URGENT, evts);
+    std::vector<BYTE> packed;
+    size_t written = pi::EventCodec::Encode(evts.data(), evts.size(), packed);
+    Expect(written == packed.size(), "Encode returned " + std::to_string(written) + " of " + std::to_string(packed.size()) + " bytes");
+    Expect(pi::EventCodec::PeekCount(packed.data(), packed.size()) == evts.size(), "the header counts every event");
+
+    std::vector<pi::InjectEvent_t> decoded;
+    if (Expect(pi::EventCodec::Decode(packed.data(), packed.size(), decoded), "the stream decodes"))
+        Expect(SameInjectEvents(evts, decoded), "decoded events are the ones encoded");
+
+    // Through groups, which drop the target and priority, and back again
+    std::vector<BYTE> packedGroups;
+    pi::EventCodec::EncodeGroups(groups, packedGroups, pi::SubmitPriority::SPRIO_URGENT);
+    std::vector<pi::TimedEvent> decodedGroups;
+    std::vector<pi::InjectEvent_t> again;
+    if (Expect(pi::EventCodec::DecodeGroups(packedGroups.data(), packedGroups.size(), decodedGroups), "the groups decode")) {
+        pi::EncodeInjectEvents(3, decodedGroups, pi::SubmitPriority::SPRIO_URGENT, again);
+        Expect(SameInjectEvents(evts, again), "decoded groups are the ones encoded");
+    }
+
+    // Deltas wrap, so the far ends of the range round trip as well
+    std::vector<pi::InjectEvent_t> extremes(4);
+    for (size_t i = 0; i < extremes.size(); i++) {
+        extremes[i].kind = pi::INJECT_KIND_MOUSE;
+        extremes[i].flags = pi::INJECT_FLAG_GROUP_START;
+        extremes[i].delayMs = i % 2 == 0 ? INT_MAX : INT_MIN;
+        extremes[i].dx = i % 2 == 0 ? INT_MIN : INT_MAX;
+        extremes[i].dy = (INT32)i - 2;
+        extremes[i].scrollDelta = UINT_MAX;
+    }
+    std::vector<BYTE> packedExtremes;
+    pi::EventCodec::Encode(extremes.data(), extremes.size(), packedExtremes);
+    decoded.clear();
+    if (Expect(pi::EventCodec::Decode(packedExtremes.data(), packedExtremes.size(), decoded), "the extremes decode"))
+        Expect(SameInjectEvents(extremes, decoded), "decoded extremes are the ones encoded");
+}
+
+// nextGroup() hands back the groups as they were encoded, across the blocks it decodes ahead
+static void CheckCodecGroups(std::vector<pi::TimedEvent>& groups) {
+    std::vector<pi::TimedEvent> many;
+    std::vector<pi::InjectEvent_t> evts;
+    while (evts.size() < pi::EventStreamReader::DECODE_AHEAD * 2 + 1) {
+        many.insert(many.end(), groups.begin(), groups.end());
+        evts.clear();
+        pi::EncodeInjectEvents(0, many, pi::SubmitPriority::SPRIO_NORMAL, evts);
+    }
+    std::vector<BYTE> packed;
+    pi::EventCodec::EncodeGroups(many, packed);
+
+    pi::EventStreamReader reader(packed.data(), packed.size());
+    size_t count = 0;
+    size_t mismatched = 0;
+    while (std::optional<pi::TimedEvent> group = reader.nextGroup()) {
+        std::vector<pi::TimedEvent> one = { *group };
+        std::vector<pi::TimedEvent> expected = { count < many.size() ? many[count] : *group };
+        std::vector<pi::InjectEvent_t> got;
+        std::vector<pi::InjectEvent_t> want;
+        pi::EncodeInjectEvents(0, one, pi::SubmitPriority::SPRIO_NORMAL, got);
+        pi::EncodeInjectEvents(0, expected, pi::SubmitPriority::SPRIO_NORMAL, want);
+        if (!SameInjectEvents(got, want))
+            mismatched++;
+        count++;
+    }
+    Expect(count == many.size(), std::to_string(count) + " groups read, " + std::to_string(many.size()) + " encoded");
+    Expect(mismatched == 0, std::to_string(mismatched) + " groups read differently to how they were encoded");
+    Expect(reader.isValid() && reader.getPosition() == evts.size(), "the reader reached the end of the stream");
+}
+
+static void CheckCodecRejects(std::vector<pi::TimedEvent>& groups) {
+    std::vector<BYTE> packed;
+    pi::EventCodec::EncodeGroups(groups, packed);
+
+    // Cut anywhere, in the header or in any event, whether it is read with checks or not
+    std::vector<pi::InjectEvent_t> out(1);
+    size_t accepted = 0;
+    for (size_t size = 0; size < packed.size(); size++) {
+        if (DecodePrefix(packed, size, out))
+            accepted++;
+    }
+    Expect(accepted == 0, std::to_string(accepted) + " truncated streams decoded");
+    Expect(out.size() == 1, "a failed decode leaves out as it was");
+
+    std::vector<BYTE> corrupt = packed;
+    corrupt[0] ^= 0xFF;
+    Expect(!pi::EventCodec::Decode(corrupt.data(), corrupt.size(), out), "a bad magic is rejected");
+    corrupt = packed;
+    corrupt[4] = pi::EVENT_CODEC_VERSION + 1;
+    Expect(!pi::EventCodec::Decode(corrupt.data(), corrupt.size(), out), "another version is rejected");
+
+    // The first event is a literal, so the dictionary is empty when it is read and any other index is out of range
+    corrupt = packed;
+    corrupt[9] = 0x80 | 5;
+    Expect(!pi::EventCodec::Decode(corrupt.data(), corrupt.size(), out), "a tag past the dictionary is rejected");
+
+    // A group start whose delay never ends, far enough from the end to be read without checks
+    corrupt = packed;
+    corrupt.resize(10 + 64);
+    corrupt[8] = 1;
+    corrupt[9] = 0x80 | (BYTE)pi::EVENT_CODEC_DICTIONARY_SIZE;
+    std::fill(corrupt.begin() + 10, corrupt.begin() + 13, 0);
+    corrupt[13] = 0x41;
+    corrupt[14] = 0;
+    std::fill(corrupt.begin() + 15, corrupt.end(), 0x80);
+    Expect(!pi::EventCodec::Decode(corrupt.data(), corrupt.size(), out), "a varint that doesn't end is rejected");
+    // The same at the end of the stream, where it would run past the data
+    Expect(!DecodePrefix(corrupt, 20, out), "a varint running past the end is rejected");
+    Expect(out.size() == 1, "rejected streams leave out as it was");
+}
+
+static void CheckCodec() {
+    std::vector<pi::TimedEvent> groups;
+    if (!ParseScript(CODEC_SCRIPT, groups))
+        return;
+    CheckCodecRoundTrip(groups);
+    CheckCodecGroups(groups);
+    CheckCodecRejects(groups);
+}
+
+/*******************************************************************************
+        Timing variation
+********************************************************************************/
+
+// The first draws of VariationRng(1234), as the 24 bits each float in [0, 1) is made from. The SSE2 and scalar paths
+// have to give these, so a replay varies the same on any build
+static const UINT32 VARIATION_EXPECTED[16] = {
+    13033406, 15344231, 16085240, 15359610, 13980346, 1709621, 2726185, 7666287,
+    6196405, 13366610, 12035869, 4718568, 10551700, 3125729, 239043, 9704788
+};
+
+// Delay before each key group, space separated
+static std::string GroupDelays(std::vector<pi::TimedEvent>& groups) {
+    std::vector<std::string> delays;
+    for (auto& group : groups) {
+        if (group.kind() == pi::TimedEvent::Kind::TEVT_KEY)
+            delays.push_back(std::to_string(group.key().delayBefore()));
+    }
+    return Join(delays);
+}
+
+// count key groups 50 ms apart
+static std::vector<pi::TimedEvent> SpacedKeys(size_t count) {
+    std::vector<pi::TimedEvent> groups;
+    for (size_t i = 0; i < count; i++)
+        groups.push_back(pi::TimedEvent(pi::TimedKeyEvent(pi::KeyEvent((WORD)('A' + i % 26)), 50)));
+    return groups;
+}
+
+static void CheckVariation() {
+    // Filled in two goes, so the state carried between fills is covered too
+    pi::VariationRng rng(1234);
+    float unit[16];
+    rng.fillUnit(unit, 8);
+    rng.fillUnit(unit + 8, 8);
+    for (size_t i = 0; i < 16; i++) {
+        UINT32 bits = (UINT32)(unit[i] * 16777216.0f);
+        Expect(bits == VARIATION_EXPECTED[i], "sample " + std::to_string(i) + " is " + std::to_string(bits) + ", expected "
+            + std::to_string(VARIATION_EXPECTED[i]));
+    }
+
+    pi::VariationConfig_t config;
+    config.seed = 1234;
+    config.delay = { pi::VariationDistribution::VDIST_CLAMPED_NORMAL, 4.0f, 10.0f };
+    pi::TimingVariation variation(config);
+
+    // Past one block, so the second fill is a partial one
+    std::vector<pi::TimedEvent> first = SpacedKeys(300);
+    std::vector<pi::TimedEvent> again = SpacedKeys(300);
+    std::vector<pi::TimedEvent> unvaried = SpacedKeys(300);
+    variation.apply(first, 7);
+    variation.apply(again, 7);
+    std::string delays = GroupDelays(first);
+    Expect(delays == GroupDelays(again), "sequence 7 varied the same twice");
+    Expect(delays != GroupDelays(unvaried), "sequence 7 varied at all");
+
+    // A shorter sequence fills less, but draws the same numbers
+    std::vector<pi::TimedEvent> shorter = SpacedKeys(5);
+    variation.apply(shorter, 7);
+    std::string prefix = GroupDelays(shorter);
+    Expect(delays.compare(0, prefix.size() + 1, prefix + " ") == 0, "5 groups of sequence 7 varied '" + prefix
+        + "', the first of 300 '" + delays.substr(0, prefix.size()) + "'");
+
+    // Sequences numbered in the order they are varied
+    std::vector<pi::TimedEvent> counted = SpacedKeys(5);
+    std::vector<pi::TimedEvent> numbered = SpacedKeys(5);
+    variation.apply(counted);
+    variation.apply(counted);
+    variation.reset();
+    variation.apply(numbered);
+    variation.apply(numbered, 1);
+    Expect(GroupDelays(counted) == GroupDelays(numbered), "apply() varied '" + GroupDelays(counted) + "', apply(0) then apply(1) '"
+        + GroupDelays(numbered) + "'");
+}
+
+/*******************************************************************************
+        RunChecks
+********************************************************************************/
+
+int RunChecks(int argc, char* argv[]) {
+    std::vector<std::pair<std::string, std::function<void()>>> checks = {
+        { "scripts", CheckScripts },
+        { "timeline", CheckTimeline },
+        { "calibration", CheckCalibration },
+        { "elision", CheckElision },
+        { "watchdog", CheckWatchdog },
+        { "journal", CheckJournal },
+        { "inject", CheckInjectStop },
+        { "codec", CheckCodec },
+        { "variation", CheckVariation },
+    };
+
+    int failed = 0;
+    int ran = 0;
+    for (auto& check : checks) {
+        bool wanted = argc == 0;
+        for (int i = 0; i < argc; i++)
+            wanted |= check.first == argv[i];
+        if (!wanted)
+            continue;
+        FAILURES = 0;
+        cout << "== " << check.first << " ==" << endl;
+        check.second();
+        cout << (FAILURES == 0 ? "PASS " : "FAIL ") << check.first << endl;
+        if (FAILURES > 0)
+            failed++;
+        ran++;
+    }
+    if (ran == 0) {
+        cerr << "No such check" << endl;
+        return EXIT_FAILURE;
+    }
+    cout << ran - failed << "/" << ran << " checks passed" << endl;
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
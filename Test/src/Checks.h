@@ -0,0 +1,13 @@
+#pragma once
+/*
+
+Checks
+
+Self-contained checks of the PegasusWinterface system, run against fake backends and a
+manual clock so they need no window and give the same result every run
+
+*/
+
+// Runs the checks named after "checks" on the command line, or all of them. Returns the process exit code, failure if
+// any check failed
+int RunChecks(int argc, char* argv[]);
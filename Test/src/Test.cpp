@@ -15,6 +15,8 @@ Testing program for the PegasusWinterface system
 #include "WinAssist.h"
 #include "ExtraKeyCodes.h"
 
+#include "Checks.h"
+
 namespace pi = pinterface;
 using std::cout;
 using std::cerr;
@@ -25,6 +27,10 @@ using std::endl;
 int main(int argc, char* argv[]) {
     cout << "InputSimulatorV1 : PegasusWinterface system test program" << endl;
 
+    // Need no window and report pass or fail through the exit code, so they run on their own
+    if (argc >= 2 && std::string(argv[1]) == "checks")
+        return RunChecks(argc - 2, argv + 2);
+
     if (argc == 1) {
         // We need more than one argument so we know what to search for in the window title
         cerr << "argc == 1, need argument for window title search" << endl;
@@ -78,9 +84,11 @@ int main(int argc, char* argv[]) {
     cout << "Sending keys (non-blocking):" << endl;
     app.setBlocking(false);
     app.executeKeys(kEvents);
-    while (app.hasEventsInQueue()) {
+    // Sleep on the interface's timer between events rather than spinning
+    HANDLE wake = app.getWaitableHandle();
+    while (app.tick() != pi::PEGASUS_TICK_IDLE) {
         // cout << "Ticking" << endl;
-        app.tick();
+        WaitForSingleObject(wake, INFINITE);
     }
     cout << "Done" << endl;
 
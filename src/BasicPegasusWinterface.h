@@ -0,0 +1,1216 @@
+#pragma once
+/*
+
+BasicPegasusWinterface
+
+The interface with its input backend, clock and logging chosen at compile time. This is
+the one implementation of everything PegasusWinterface does; PegasusWinterface is this
+template on the shared backend and clock, which can be swapped at run time, logging to the
+console. Built on concrete types with NoLog the whole dispatch path has no virtual calls
+and no logging:
+
+	pi::BasicPegasusWinterface<MyBackend, pi::ManualClock, pi::NoLog> app;
+	app.bind(window);
+	app.executeKeys(keys);
+	app.runUntilIdle();
+
+A backend has sendInputs, probeTarget and findTarget like InputBackend, and a clock has now,
+waitUntil, toRealDuration and isVirtual like ClockSource. Classes derived from those can be
+used as they are, and are called without going through the vtable if they are final
+
+*/
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <concepts>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+
+#include "WinAssist.h"
+#include "TitleMatcher.h"
+#include "TimedEvents.h"
+#include "SubmissionQueue.h"
+#include "Timeline.h"
+#include "ClockSource.h"
+#include "InputBackend.h"
+#include "Calibration.h"
+#include "Trace.h"
+#include "TargetWatchdog.h"
+#include "InputState.h"
+#include "InjectionPlan.h"
+#include "SequenceJournal.h"
+#include "TimingVariation.h"
+#include "LogPolicy.h"
+#include "InputBuilder.h"
+
+namespace pinterface {
+
+	// Returned by tick() when nothing is queued
+	constexpr int PEGASUS_TICK_IDLE = -1;
+
+	// Sends batches of INPUT records to a window, and checks on and finds the window for the watchdog
+	template<class T>
+	concept DispatchBackend = requires(T& backend, WinInfo_t& window, std::vector<INPUT>& inputs, const TitleMatcher* matcher) {
+		{ backend.sendInputs(window, inputs) } -> std::convertible_to<bool>;
+		{ backend.probeTarget(window, (UINT)0) } -> std::convertible_to<TargetState>;
+		{ backend.findTarget(window, matcher) } -> std::convertible_to<bool>;
+	};
+
+	// Reads and waits in microseconds, like a ClockSource
+	template<class T>
+	concept DispatchClock = requires(T& clock, INT64 time) {
+		{ clock.now() } -> std::convertible_to<INT64>;
+		clock.waitUntil(time);
+		{ clock.toRealDuration(time) } -> std::convertible_to<INT64>;
+		{ clock.isVirtual() } -> std::convertible_to<bool>;
+	};
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy = ConsoleLog>
+	class BasicPegasusWinterface {
+/*******************************************************************************
+		class BasicPegasusWinterface, private
+********************************************************************************/
+	private:
+		/* Private static variables */
+		// How far ahead of its deadline a group is taken from a generator
+		static constexpr INT64 GENERATOR_WINDOW_US = 50000;
+		// Most groups taken from one generator in a tick, so a generator with no delays can't hold up the thread
+		static constexpr int GENERATOR_MAX_PULL = 256;
+
+		/* Private member variables */
+		bool m_bound = false;
+		bool m_blocking = false;
+		// Every deadline is in microseconds on this clock, read once per tick
+		Clock m_clock;
+		// Where the batches are sent
+		Backend m_backend;
+		// unsigned int m_waitTime = 0;
+		// Key and mouse groups waiting to be sent, in the order they are due
+		Timeline m_timeline;
+		// Reused between ticks to avoid reallocating
+		std::vector<TimelineEntry_t> m_dueBatch;
+		std::vector<INPUT> m_inputBatch;
+		// Submitted sequence each record of m_inputBatch came from
+		std::vector<UINT64> m_inputOwners;
+		// Generators given to execute<EVENT>, per source. Only the front of each is played, the rest follow on from it
+		std::deque<TimedEventStream_t> m_streams[TIMELINE_SOURCE_COUNT];
+
+		WinInfo_t m_winInfo;
+		WinDimensions_t m_winDims;
+		// The criteria the interface was bound with, reused when rebinding
+		TitleMatcher m_matcher;
+		bool m_boundByTitle = false;
+
+		// Sequences submitted from other threads, moved into their priority lane by tick()
+		SubmissionQueue m_submissions;
+		std::deque<std::unique_ptr<SubmittedSequence_t>> m_lanes[SUBMIT_PRIORITY_COUNT];
+		// Sequence the last group was scheduled from, so a switch of sequence restarts the timing
+		SubmittedSequence_t* m_activeSequence = nullptr;
+		// Deadline of the last group scheduled from the active sequence
+		INT64 m_sequenceLast = 0;
+		std::atomic<UINT64> m_nextSequenceId{ 1 };
+		std::atomic<size_t> m_pendingSequences{ 0 };
+
+		// Measures dispatch overhead for the current binding and predicts how early to start dispatches
+		DispatchCalibrator m_calibration;
+		// Holds the queue while the target is hung or missing, and finds it again
+		TargetWatchdog m_watchdog;
+		std::function<void(const TargetEvent_t&)> m_targetCallback;
+		// Keys and buttons left down, so redundant transitions can be dropped and the rest released
+		InputStateTracker m_inputState;
+		// Sequences cancelled after they had started, so tick() releases what each of them left down
+		std::vector<UINT64> m_cancelReleases;
+		// Records submitted sequences and their progress, so they can be resumed after a crash. Null unless set
+		std::shared_ptr<SequenceJournal> m_journal;
+		// Varies the delays and moves of vectors of groups as they are submitted or executed. Null unless set
+		std::shared_ptr<TimingVariation> m_variation;
+		// Clock time the last batch was sent, -1 until one has been
+		INT64 m_lastInputTime = -1;
+
+		// Waitable timer armed to the next deadline, created on the first call to getWaitableHandle()
+		HANDLE m_waitTimer = NULL;
+
+		/* Private member functions */
+		SequenceHandle submit(std::unique_ptr<SubmittedSequence_t> seq);
+		// Moves the submitted groups due by the horizon onto the timeline, highest priority lane first
+		void scheduleSequences(INT64 now, INT64 horizon);
+		// Sends or schedules groups for execute<EVENT>. Events are timed one after the other in the order given
+		void execute(std::vector<TimedEvent>& evts, bool appendToQueue, TimelineSource source);
+		// The same for a generator
+		void executeStream(TimedEventGenerator generator, bool appendToQueue, TimelineSource source);
+		// Sends one group in blocking mode, waiting for its deadline first
+		void sendBlocking(TimedEvent& evt, INT64 deadline);
+		// Groups that play the steps of a plan, compiling it again first if the keyboard layout has changed
+		std::vector<TimedEvent> planGroups(std::shared_ptr<const InjectionPlan> plan);
+		// Drops what is queued from the source ahead of replacing it. A mixed source replaces both kinds
+		void clearSource(TimelineSource source);
+		// Latest deadline queued from the source, including generators still playing
+		INT64 lastQueuedDeadline(TimelineSource source, INT64 now);
+		// Moves groups from the generators onto the timeline up to the deadline
+		void pullStreams(INT64 until);
+		// Moves everything queued by delta, for a change of clock or after the queue was held
+		void shiftQueue(INT64 delta);
+		// Sends a batch of due entries with a single injection. Returns false if the backend could not send it
+		bool dispatch(std::vector<TimelineEntry_t>& batch);
+		// Probes the target and acts on any change: rebinds, and resumes the queue shifted by the time it was held
+		void checkTarget(INT64 now);
+		// Records a dispatch that started at start (interface clock) and traceStart (trace clock). Only called while tracing
+		void traceDispatch(std::vector<TimelineEntry_t>& batch, INT64 start, INT64 traceStart, INT64 traceInject);
+		// Deadline of the next group of the submitted sequences, or -1 if there is none
+		INT64 nextSequenceDeadline(INT64 now);
+		// Earliest deadline of the timeline and the sequences already popped from the submission queue, or -1 if there is none
+		INT64 nextDeadline(INT64 now);
+		// Works out the time to the next deadline and arms the waitable timer to it. Returns the time in ms, rounded up
+		int armNextDeadline(INT64 now);
+		// Marks the sequence at the front of a lane as finished and removes it
+		void finishSequence(std::deque<std::unique_ptr<SubmittedSequence_t>>& lane);
+		// Sends the release batch built into m_inputBatch
+		bool sendRelease(size_t count);
+
+/*******************************************************************************
+		class BasicPegasusWinterface, public
+********************************************************************************/
+	public:
+		BasicPegasusWinterface();
+		~BasicPegasusWinterface();
+		BasicPegasusWinterface(const BasicPegasusWinterface&) = delete;
+		BasicPegasusWinterface& operator=(const BasicPegasusWinterface&) = delete;
+		
+		/* Public member functions */
+		// Bind functions. Takes a string to search window titles for, or a process ID. Returns true if bind is successful
+		bool bind(std::wstring& str);
+		// UTF-8 title search
+		bool bind(std::string& str);
+		bool bind(DWORD processID);
+		// Binds to the first window whose title is accepted by the matcher
+		bool bind(const TitleMatcher& matcher);
+		// Binds to window information obtained elsewhere, e.g. from WinAssist::GetWindowListAsync, or to a made up target
+		// when sending to a RecordingBackend
+		void bind(const WinInfo_t& window);
+		// Finds the bound window again using the original bind criteria (title matcher, then pid). Use after the title of the
+		// target has changed or it has been recreated. Returns true if a window was found
+		bool rebind();
+		// Returns the current status of the interface
+		inline bool isBound() { return m_bound; }
+		// Unbinds the interface, releasing any key or mouse button still held in one batch
+		void unbind();
+		// Sets the blocking behaviour of the interface. If true, will execute the events when execute<EVENT> is called, instead
+		// of scheduling to be executed if appropriate it the tick function
+		void setBlocking(bool block);
+		// Returns the current blocking status
+		bool isBlocking();
+		// Returns the information about the Window and process that is captured. Not a copy so cannot be modified
+		WinInfo_t getWinInfo();
+		// Returns the window dimension information
+		WinDimensions_t getWindowDimensions();
+		// Executes the current queue of events when appropriate according to their timing. Everything due is sent as one
+		// batch. Events already queued are sent from here whatever the blocking setting.
+		// Returns the time in ms until the next event is due (0 if tick() should be called again straight away), or
+		// PEGASUS_TICK_IDLE if nothing is queued. The time is real time, except under a ManualClock where it is how far the
+		// clock needs advancing
+		int tick();
+		// Returns a waitable timer that is signalled when the next event is due, for use with WaitForMultipleObjects. It is
+		// re-armed by tick() and execute<EVENT>, and signalled when a sequence is submitted. Owned by the interface.
+		// Under a ManualClock it is signalled whenever anything is queued, as the waits are up to the clock's owner
+		HANDLE getWaitableHandle();
+		// Sends everything queued, waiting on the clock between deadlines, and returns once nothing is left. Under a
+		// ManualClock the waits are instant, so a long script plays back immediately with exactly the timing it would have had
+		void runUntilIdle();
+		// Replaces the clock the interface is timed on. Events already queued keep their remaining delays
+		void setClock(Clock clock);
+		Clock& getClock();
+		// Replaces where the inputs are sent
+		void setBackend(Backend backend);
+		Backend& getBackend();
+		// Dispatches are started early by the predicted overhead of attaching, focusing and injecting, so the inputs land
+		// when they are due. Enabled by default. The overhead is measured either way, so the state stays useful when off
+		void setCalibrationEnabled(bool enabled);
+		bool isCalibrationEnabled();
+		CalibrationState_t getCalibrationState();
+		// Clock time in microseconds the last batch of input was sent, or -1 if none has been. Used as the start of the
+		// input to response latency screen probes measure
+		INT64 getLastInputTime();
+		// The target is probed through the backend every so often and whenever a dispatch fails. While it is hung or missing
+		// nothing is sent and the queue is held, then resumes with its timing intact once the target answers again or has
+		// been found by the bind criteria. Enabled by default
+		void setWatchdogConfig(const WatchdogConfig_t& config);
+		WatchdogConfig_t getWatchdogConfig();
+		TargetState getTargetState();
+		// Called from tick() whenever the target changes state or is replaced
+		void setTargetEventCallback(std::function<void(const TargetEvent_t&)> callback);
+		// Keys and mouse buttons pressed without a release are tracked per binding. A press of something already down or a
+		// release of something already up is dropped, and a batch left with nothing in it isn't sent. Chords are one group
+		// and so one injection; a modifier the chord presses that is already held stays held. Enabled by default
+		void setElisionEnabled(bool enabled);
+		bool isElisionEnabled();
+		// Releases every key and mouse button still held, most recent first, in one batch. Done by unbind(). Call from the
+		// ticking thread. Returns false if the batch could not be sent
+		bool releaseAll();
+		// Releases what the submitted sequence pressed and still holds, leaving anything held by others down. Done by
+		// tick() for a sequence cancelled part way. Call from the ticking thread
+		bool releaseSequence(UINT64 id);
+		bool isKeyHeld(WORD vk);
+		InputStateCounters_t getInputStateCounters();
+		// Submitted sequences are written to the journal, and each group that is sent is acknowledged in it. Set it before
+		// submitting anything; sequences already submitted aren't journaled. A cancel is journaled when tick() drops the
+		// sequence, so one cancelled just before a crash may still be resumed. Null turns journaling off
+		void setJournal(std::shared_ptr<SequenceJournal> journal);
+		std::shared_ptr<SequenceJournal> getJournal();
+		// Submits the sequences the journal found unfinished when it was opened, from the first group that was not sent,
+		// in the order they were first submitted. Returns the number submitted
+		size_t resumeJournal();
+		// Each vector of groups submitted or executed is varied as the next sequence from the variation's seed, on the
+		// calling thread and before it is journaled. Resumed sequences were varied before, and generators and plans are
+		// sent as they are. Set it before submitting anything. Null turns variation off
+		void setVariation(std::shared_ptr<TimingVariation> variation);
+		std::shared_ptr<TimingVariation> getVariation();
+		// Checks if there are events in the queues
+		bool hasEventsInQueue();
+		// Groups waiting on the timeline plus submitted sequences that haven't finished. Call from the ticking thread
+		size_t getQueueDepth();
+		// Schedules or immediately executes key events
+		void executeKeys(std::vector<TimedKeyEvent> keys, bool appendToQueue = false);
+		// Schedules or immediately executes mouse events
+		void executeMouse(std::vector<TimedMouseEvent> evts, bool appendToQueue = false);
+		// Schedules or immediately executes a mix of key and mouse events, timed one after the other in the order given.
+		// Unless appending, replaces every queued key and mouse event
+		void executeEvents(std::vector<TimedEvent> evts, bool appendToQueue = false);
+		// Lazy forms of the above. Groups are taken from the generator on the ticking thread only once they are within
+		// GENERATOR_WINDOW_US of being due, so an endless or very long sequence (key repeat, continuous scrolling) uses the
+		// same memory however long it runs. The generator ends the sequence by returning nothing. Appended generators and
+		// vectors follow on once everything before them from the same source is done. In blocking mode these only return
+		// at the end of the sequence
+		void executeKeys(std::function<std::optional<TimedKeyEvent>()> generator, bool appendToQueue = false);
+		void executeMouse(std::function<std::optional<TimedMouseEvent>()> generator, bool appendToQueue = false);
+		void executeEvents(TimedEventGenerator generator, bool appendToQueue = false);
+		// Any input range of groups, e.g. a std::views pipeline, walked lazily. See MakeTimedEventGenerator
+		template<std::ranges::input_range R>
+			requires std::convertible_to<std::ranges::range_reference_t<R>, TimedKeyEvent> && (!std::same_as<std::remove_cvref_t<R>, std::vector<TimedKeyEvent>>)
+		void executeKeys(R&& range, bool appendToQueue = false) {
+			if (m_bound)
+				executeStream(MakeTimedEventGenerator(std::forward<R>(range)), appendToQueue, TimelineSource::TSRC_KEYS);
+		}
+		template<std::ranges::input_range R>
+			requires std::convertible_to<std::ranges::range_reference_t<R>, TimedMouseEvent> && (!std::same_as<std::remove_cvref_t<R>, std::vector<TimedMouseEvent>>)
+		void executeMouse(R&& range, bool appendToQueue = false) {
+			if (m_bound)
+				executeStream(MakeTimedEventGenerator(std::forward<R>(range)), appendToQueue, TimelineSource::TSRC_MOUSE);
+		}
+		// Schedules or immediately plays a compiled plan, like executeEvents. A plan compiled under a different keyboard
+		// layout is compiled again first. See InjectionPlanCache for compiling repeated macros once
+		void executePlan(std::shared_ptr<const InjectionPlan> plan, bool appendToQueue = false);
+		// Submits a sequence to be sent by tick(). Unlike the rest of the interface these may be called from any thread.
+		// Sequences run one at a time per lane in submission order, and a sequence in a higher priority lane takes over
+		// from a lower one between groups. The handle cancels this sequence only
+		SequenceHandle submitKeys(std::vector<TimedKeyEvent> keys, SubmitPriority priority = SubmitPriority::SPRIO_NORMAL);
+		SequenceHandle submitMouse(std::vector<TimedMouseEvent> evts, SubmitPriority priority = SubmitPriority::SPRIO_NORMAL);
+		SequenceHandle submitEvents(std::vector<TimedEvent> evts, SubmitPriority priority = SubmitPriority::SPRIO_NORMAL);
+		SequenceHandle submitPlan(std::shared_ptr<const InjectionPlan> plan, SubmitPriority priority = SubmitPriority::SPRIO_NORMAL);
+		// Updates the information held by the interface
+		void update();
+	};
+
+/*******************************************************************************
+		class BasicPegasusWinterface, public
+********************************************************************************/
+
+	/* Constructor */
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	BasicPegasusWinterface<Backend, Clock, LogPolicy>::BasicPegasusWinterface() {
+		m_bound = false;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	BasicPegasusWinterface<Backend, Clock, LogPolicy>::~BasicPegasusWinterface() {
+		unbind();
+		if (m_waitTimer != NULL)
+			CloseHandle(m_waitTimer);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::unbind() {
+		if (!m_bound)
+			return;
+		releaseAll();
+		// Whatever couldn't be released belonged to a window we are done with
+		m_inputState.clearHeld();
+		m_bound = false;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	WinInfo_t BasicPegasusWinterface<Backend, Clock, LogPolicy>::getWinInfo() {
+		return m_winInfo;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	WinDimensions_t BasicPegasusWinterface<Backend, Clock, LogPolicy>::getWindowDimensions() {
+		return m_winDims;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	bool BasicPegasusWinterface<Backend, Clock, LogPolicy>::bind(DWORD processID) {
+		// Count and list all the windows for us. The index is kept with the list, for rebinding from it later
+		std::shared_ptr<const TitleIndex> index = WinAssist::GetWindowIndex();
+
+		int found = index->findByPid(processID);
+		if (found >= 0) {
+			const WinInfo_t& window = index->at(found);
+			LogPolicy::PrintWide("Found window with pid ", window.pid, " (name='", window.title, "'), binding...");
+			LogPolicy::EndWideLine();
+			unbind();
+			m_winInfo = window;
+			m_boundByTitle = false;
+			m_bound = true;
+			m_calibration.reset();
+			m_watchdog.reset(m_clock.now());
+			update();
+			return true;
+		}
+		return false;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	bool BasicPegasusWinterface<Backend, Clock, LogPolicy>::bind(std::string& str) {
+		std::wstring s = WinAssist::Utf8ToWide(str);
+		return bind(s);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	bool BasicPegasusWinterface<Backend, Clock, LogPolicy>::bind(std::wstring& str) {
+		return bind(TitleMatcher(str, TitleMatcher::MatchType::TMATCH_CONTAINS));
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	bool BasicPegasusWinterface<Backend, Clock, LogPolicy>::bind(const TitleMatcher& matcher) {
+		// Count and list all the windows for us. The index is kept with the list, for rebinding from it later
+		std::shared_ptr<const TitleIndex> index = WinAssist::GetWindowIndex();
+
+		int found = index->find(matcher);
+		if (found >= 0) {
+			const WinInfo_t& window = index->at(found);
+			LogPolicy::PrintWide("Found window with name '", window.title, "' (pid=", window.pid, "), binding...");
+			LogPolicy::EndWideLine();
+			unbind();
+			m_winInfo = window;
+			m_matcher = matcher;
+			m_boundByTitle = true;
+			m_bound = true;
+			m_calibration.reset();
+			m_watchdog.reset(m_clock.now());
+			update();
+			return true;
+		}
+		return false;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::bind(const WinInfo_t& window) {
+		LogPolicy::PrintWide("Binding to window with name '", window.title, "' (pid=", window.pid, ")");
+		LogPolicy::EndWideLine();
+		unbind();
+		m_winInfo = window;
+		m_boundByTitle = false;
+		m_bound = true;
+		m_calibration.reset();
+		m_watchdog.reset(m_clock.now());
+		update();
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	bool BasicPegasusWinterface<Backend, Clock, LogPolicy>::rebind() {
+		if (!m_bound)
+			return false;
+
+		// GetWindowHWND leaves m_winInfo alone if the window is still where it was
+		HWND previous = m_winInfo.hwnd;
+		HWND hwnd = WinAssist::GetWindowHWND(m_winInfo, true, m_boundByTitle ? &m_matcher : nullptr);
+		if (hwnd == 0)
+			return false;
+		// A different window may well cost a different amount to inject into
+		if (m_winInfo.hwnd != previous)
+			m_calibration.reset();
+		// Found by hand, so anything held for the old window can go
+		if (m_watchdog.isPaused())
+			checkTarget(m_clock.now());
+		update();
+		return true;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::setBlocking(bool block) {
+		m_blocking = block;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	bool BasicPegasusWinterface<Backend, Clock, LogPolicy>::isBlocking() {
+		return m_blocking;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::runUntilIdle() {
+		while (m_bound) {
+			tick();
+			INT64 next = nextDeadline(m_clock.now());
+			if (next >= 0)
+				m_clock.waitUntil(next - m_calibration.getLead());
+			else if (m_submissions.empty())
+				return;
+		}
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::setClock(Clock clock) {
+		// Carry the queue over so every deadline is still the same distance away
+		INT64 delta = clock.now() - m_clock.now();
+		shiftQueue(delta);
+		m_watchdog.shift(delta);
+		m_clock = std::move(clock);
+		armNextDeadline(m_clock.now());
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	Clock& BasicPegasusWinterface<Backend, Clock, LogPolicy>::getClock() {
+		return m_clock;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::setBackend(Backend backend) {
+		m_backend = std::move(backend);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	Backend& BasicPegasusWinterface<Backend, Clock, LogPolicy>::getBackend() {
+		return m_backend;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::setCalibrationEnabled(bool enabled) {
+		m_calibration.setEnabled(enabled);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	bool BasicPegasusWinterface<Backend, Clock, LogPolicy>::isCalibrationEnabled() {
+		return m_calibration.isEnabled();
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	CalibrationState_t BasicPegasusWinterface<Backend, Clock, LogPolicy>::getCalibrationState() {
+		return m_calibration.getState();
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	INT64 BasicPegasusWinterface<Backend, Clock, LogPolicy>::getLastInputTime() {
+		return m_lastInputTime;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::setWatchdogConfig(const WatchdogConfig_t& config) {
+		bool wasPaused = m_watchdog.isPaused();
+		m_watchdog.setConfig(config);
+		// Turning it off lets a held queue go
+		if (wasPaused && !m_watchdog.isPaused()) {
+			shiftQueue(m_clock.now() - m_watchdog.getPausedSince());
+		}
+		armNextDeadline(m_clock.now());
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	WatchdogConfig_t BasicPegasusWinterface<Backend, Clock, LogPolicy>::getWatchdogConfig() {
+		return m_watchdog.getConfig();
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	TargetState BasicPegasusWinterface<Backend, Clock, LogPolicy>::getTargetState() {
+		return m_watchdog.getState();
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::setTargetEventCallback(std::function<void(const TargetEvent_t&)> callback) {
+		m_targetCallback = callback;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::setElisionEnabled(bool enabled) {
+		m_inputState.setElisionEnabled(enabled);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	bool BasicPegasusWinterface<Backend, Clock, LogPolicy>::isElisionEnabled() {
+		return m_inputState.isElisionEnabled();
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	bool BasicPegasusWinterface<Backend, Clock, LogPolicy>::releaseAll() {
+		if (!m_bound || m_inputState.getHeldCount() == 0)
+			return true;
+
+		m_inputBatch.clear();
+		return sendRelease(m_inputState.buildRelease(m_inputBatch));
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	bool BasicPegasusWinterface<Backend, Clock, LogPolicy>::releaseSequence(UINT64 id) {
+		if (!m_bound)
+			return true;
+
+		m_inputBatch.clear();
+		return sendRelease(m_inputState.buildRelease(m_inputBatch, id));
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	bool BasicPegasusWinterface<Backend, Clock, LogPolicy>::isKeyHeld(WORD vk) {
+		return m_inputState.isKeyHeld(vk);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::setJournal(std::shared_ptr<SequenceJournal> journal) {
+		m_journal = journal;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	std::shared_ptr<SequenceJournal> BasicPegasusWinterface<Backend, Clock, LogPolicy>::getJournal() {
+		return m_journal;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	size_t BasicPegasusWinterface<Backend, Clock, LogPolicy>::resumeJournal() {
+		if (!m_journal)
+			return 0;
+		std::vector<JournaledSequence_t> unfinished = m_journal->takeUnfinished();
+		for (auto& journaled : unfinished) {
+			std::unique_ptr<SubmittedSequence_t> seq(new SubmittedSequence_t());
+			seq->groups = std::move(journaled.groups);
+			seq->priority = journaled.priority;
+			// Already in the journal, under its old id
+			seq->journalId = journaled.id;
+			submit(std::move(seq));
+		}
+		if (!unfinished.empty()) {
+			LogPolicy::Print("Resumed ", unfinished.size(), " sequences from the journal");
+			LogPolicy::EndLine();
+		}
+		return unfinished.size();
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::setVariation(std::shared_ptr<TimingVariation> variation) {
+		m_variation = variation;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	std::shared_ptr<TimingVariation> BasicPegasusWinterface<Backend, Clock, LogPolicy>::getVariation() {
+		return m_variation;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	InputStateCounters_t BasicPegasusWinterface<Backend, Clock, LogPolicy>::getInputStateCounters() {
+		return m_inputState.getCounters();
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	bool BasicPegasusWinterface<Backend, Clock, LogPolicy>::hasEventsInQueue() {
+		for (auto& streams : m_streams) {
+			if (!streams.empty())
+				return true;
+		}
+		return !m_timeline.empty() || m_pendingSequences.load(std::memory_order_acquire) > 0;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	size_t BasicPegasusWinterface<Backend, Clock, LogPolicy>::getQueueDepth() {
+		size_t depth = m_timeline.size() + m_pendingSequences.load(std::memory_order_acquire);
+		for (auto& streams : m_streams)
+			depth += streams.size();
+		return depth;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	int BasicPegasusWinterface<Backend, Clock, LogPolicy>::tick() {
+		if (!m_bound)
+			return PEGASUS_TICK_IDLE;
+
+		// One clock read for the whole pass, so everything is judged against the same instant
+		INT64 now = m_clock.now();
+		if (m_watchdog.isProbeDue(now))
+			checkTarget(now);
+		// Everything stays queued until the target is back
+		if (m_watchdog.isPaused())
+			return armNextDeadline(now);
+
+		// Everything due within the predicted dispatch overhead goes now, so it lands on time
+		INT64 horizon = now + m_calibration.getLead();
+		scheduleSequences(now, horizon);
+		pullStreams(now + GENERATOR_WINDOW_US);
+
+		m_dueBatch.clear();
+		if (m_timeline.popDue(horizon, m_dueBatch) > 0) {
+			LogPolicy::Print("Non-blocking exec: ");
+			bool sent = dispatch(m_dueBatch);
+			bool held = false;
+			if (!sent && m_watchdog.getConfig().enabled) {
+				// Find out why straight away. If the target is gone or hung, the batch waits with the rest of the queue
+				checkTarget(now);
+				held = m_watchdog.isPaused();
+				if (held) {
+					for (auto& entry : m_dueBatch)
+						m_timeline.push(entry);
+				}
+			}
+			// Sent or dropped, the groups are done with either way, so a resume carries on after them
+			if (!held && m_journal) {
+				for (auto& entry : m_dueBatch) {
+					if (entry.tag != 0)
+						m_journal->acknowledge(entry.tag, entry.group);
+				}
+			}
+		}
+		for (UINT64 id : m_cancelReleases)
+			releaseSequence(id);
+		m_cancelReleases.clear();
+		if (m_journal)
+			m_journal->flushIfDue();
+
+		return armNextDeadline(now);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	HANDLE BasicPegasusWinterface<Backend, Clock, LogPolicy>::getWaitableHandle() {
+		if (m_waitTimer == NULL) {
+			// Manual reset, so it stays signalled until tick() re-arms it. High resolution where the OS supports it
+			m_waitTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_MANUAL_RESET | CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+			if (m_waitTimer == NULL)
+				m_waitTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_MANUAL_RESET, TIMER_ALL_ACCESS);
+			if (m_waitTimer == NULL) {
+				std::cerr << "Failed to create the waitable timer (error " << GetLastError() << ")" << std::endl;
+				return NULL;
+			}
+			armNextDeadline(m_clock.now());
+		}
+		return m_waitTimer;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::executeKeys(std::vector<TimedKeyEvent> keys, bool appendToQueue) {
+		if (!m_bound)
+			return;
+		LogPolicy::Print("Executing/scheduling ", keys.size(), " timed key events");
+		LogPolicy::EndLine();
+		std::vector<TimedEvent> evts(keys.begin(), keys.end());
+		execute(evts, appendToQueue, TimelineSource::TSRC_KEYS);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::executeMouse(std::vector<TimedMouseEvent> evts, bool appendToQueue) {
+		if (!m_bound)
+			return;
+		LogPolicy::Print("Executing/scheduling ", evts.size(), " timed mouse events");
+		LogPolicy::EndLine();
+		std::vector<TimedEvent> events(evts.begin(), evts.end());
+		execute(events, appendToQueue, TimelineSource::TSRC_MOUSE);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::executeEvents(std::vector<TimedEvent> evts, bool appendToQueue) {
+		if (!m_bound)
+			return;
+		LogPolicy::Print("Executing/scheduling ", evts.size(), " timed events");
+		LogPolicy::EndLine();
+		execute(evts, appendToQueue, TimelineSource::TSRC_MIXED);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::executePlan(std::shared_ptr<const InjectionPlan> plan, bool appendToQueue) {
+		if (!m_bound || !plan)
+			return;
+		LogPolicy::Print("Executing/scheduling a plan of ", plan->getStepCount(), " steps");
+		LogPolicy::EndLine();
+		std::vector<TimedEvent> evts = planGroups(plan);
+		execute(evts, appendToQueue, TimelineSource::TSRC_MIXED);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::executeKeys(std::function<std::optional<TimedKeyEvent>()> generator, bool appendToQueue) {
+		if (!m_bound)
+			return;
+		LogPolicy::Print("Executing/scheduling generated key events");
+		LogPolicy::EndLine();
+		executeStream([generator]() -> std::optional<TimedEvent> {
+			std::optional<TimedKeyEvent> evt = generator();
+			if (!evt)
+				return std::nullopt;
+			return TimedEvent(std::move(*evt));
+		}, appendToQueue, TimelineSource::TSRC_KEYS);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::executeMouse(std::function<std::optional<TimedMouseEvent>()> generator, bool appendToQueue) {
+		if (!m_bound)
+			return;
+		LogPolicy::Print("Executing/scheduling generated mouse events");
+		LogPolicy::EndLine();
+		executeStream([generator]() -> std::optional<TimedEvent> {
+			std::optional<TimedMouseEvent> evt = generator();
+			if (!evt)
+				return std::nullopt;
+			return TimedEvent(std::move(*evt));
+		}, appendToQueue, TimelineSource::TSRC_MOUSE);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::executeEvents(TimedEventGenerator generator, bool appendToQueue) {
+		if (!m_bound)
+			return;
+		LogPolicy::Print("Executing/scheduling generated events");
+		LogPolicy::EndLine();
+		executeStream(std::move(generator), appendToQueue, TimelineSource::TSRC_MIXED);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	SequenceHandle BasicPegasusWinterface<Backend, Clock, LogPolicy>::submitKeys(std::vector<TimedKeyEvent> keys, SubmitPriority priority) {
+		return submitEvents(std::vector<TimedEvent>(keys.begin(), keys.end()), priority);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	SequenceHandle BasicPegasusWinterface<Backend, Clock, LogPolicy>::submitMouse(std::vector<TimedMouseEvent> evts, SubmitPriority priority) {
+		return submitEvents(std::vector<TimedEvent>(evts.begin(), evts.end()), priority);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	SequenceHandle BasicPegasusWinterface<Backend, Clock, LogPolicy>::submitEvents(std::vector<TimedEvent> evts, SubmitPriority priority) {
+		std::unique_ptr<SubmittedSequence_t> seq(new SubmittedSequence_t());
+		seq->groups = std::move(evts);
+		seq->priority = priority;
+		return submit(std::move(seq));
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	SequenceHandle BasicPegasusWinterface<Backend, Clock, LogPolicy>::submitPlan(std::shared_ptr<const InjectionPlan> plan, SubmitPriority priority) {
+		if (!plan)
+			return SequenceHandle();
+		return submitEvents(planGroups(plan), priority);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::update() {
+		if (!m_bound)
+			return;
+
+		m_winDims = WinAssist::GetWindowDimensions(m_winInfo);
+	}
+
+/*******************************************************************************
+		class BasicPegasusWinterface, private
+********************************************************************************/
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	SequenceHandle BasicPegasusWinterface<Backend, Clock, LogPolicy>::submit(std::unique_ptr<SubmittedSequence_t> seq) {
+		seq->state = std::make_shared<SequenceState_t>();
+		seq->state->id = m_nextSequenceId.fetch_add(1, std::memory_order_relaxed);
+		// A sequence with a journal id is being resumed, and was varied when it was first submitted
+		if (m_variation && seq->journalId == 0)
+			m_variation->apply(seq->groups);
+		if (m_journal && seq->journalId == 0 && !seq->groups.empty())
+			seq->journalId = m_journal->append(seq->groups, seq->priority);
+		SequenceHandle handle(seq->state);
+		// Counted before the push so hasEventsInQueue() can't miss a sequence in flight
+		m_pendingSequences.fetch_add(1, std::memory_order_acq_rel);
+		if (Tracer::IsEnabled())
+			Tracer::Instant("submit", "queue", Tracer::Now(), "sequence", (INT64)seq->state->id, "priority", (INT64)seq->priority);
+		m_submissions.push(std::move(seq));
+
+		// Wake a caller waiting on the handle. Done after the push: if the dispatcher re-arms in between, it sees the
+		// sequence when it checks the queue after arming
+		if (m_waitTimer != NULL) {
+			LARGE_INTEGER due;
+			due.QuadPart = -1;
+			SetWaitableTimer(m_waitTimer, &due, 0, NULL, NULL, FALSE);
+		}
+		return handle;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::finishSequence(std::deque<std::unique_ptr<SubmittedSequence_t>>& lane) {
+		SubmittedSequence_t* seq = lane.front().get();
+		if (seq == m_activeSequence)
+			m_activeSequence = nullptr;
+		// Stopped part way, so it may have left keys down
+		if (seq->next > 0 && seq->next < seq->groups.size())
+			m_cancelReleases.push_back(seq->state->id);
+		// A sequence that ran to the end is ended in the journal by the acknowledgement of its last group
+		if (m_journal && seq->journalId != 0 && seq->next < seq->groups.size())
+			m_journal->finish(seq->journalId);
+		std::shared_ptr<SequenceState_t> state = seq->state;
+		lane.pop_front();
+		m_pendingSequences.fetch_sub(1, std::memory_order_acq_rel);
+		// Last, so a callback that looks at the queue sees the sequence gone
+		FinishSequenceState(*state);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	bool BasicPegasusWinterface<Backend, Clock, LogPolicy>::sendRelease(size_t count) {
+		if (count == 0) {
+			m_inputState.commit();
+			return true;
+		}
+		LogPolicy::Print("Releasing ", count, " held keys and buttons");
+		LogPolicy::EndLine();
+		if (!m_backend.sendInputs(m_winInfo, m_inputBatch)) {
+			std::cerr << "Unable to release the held keys and buttons" << std::endl;
+			return false;
+		}
+		m_inputState.commit();
+		return true;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::scheduleSequences(INT64 now, INT64 horizon) {
+		// Move everything submitted since the last tick into its lane
+		while (std::unique_ptr<SubmittedSequence_t> seq = m_submissions.pop()) {
+			m_lanes[(int)seq->priority].push_back(std::move(seq));
+		}
+
+		while (true) {
+			// Find the front of the highest priority lane, dropping sequences that are cancelled or done on the way
+			SubmittedSequence_t* seq = nullptr;
+			for (auto& lane : m_lanes) {
+				while (!lane.empty() && (lane.front()->state->cancelled.load(std::memory_order_acquire) || lane.front()->next >= lane.front()->groups.size())) {
+					finishSequence(lane);
+				}
+				if (!lane.empty()) {
+					seq = lane.front().get();
+					break;
+				}
+			}
+			if (seq == nullptr)
+				return;
+
+			if (seq != m_activeSequence) {
+				// A new sequence, or one that was preempted: its next delay runs from now
+				m_activeSequence = seq;
+				m_sequenceLast = now;
+			}
+
+			// Groups only go on the timeline once due, so a higher lane can still take over before then
+			INT64 due = m_sequenceLast + (INT64)seq->groups[seq->next].delayBefore() * 1000;
+			if (due > horizon)
+				return;
+
+			m_timeline.push(due, seq->groups[seq->next], TimelineSource::TSRC_SEQUENCE, seq->journalId, seq->state->id, (UINT32)seq->next);
+			if (Tracer::IsEnabled())
+				Tracer::Instant("schedule", "queue", Tracer::Now(), "sequence", (INT64)seq->state->id, "dueInUs", due - now);
+			seq->next++;
+			m_sequenceLast = due;
+		}
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::execute(std::vector<TimedEvent>& evts, bool appendToQueue, TimelineSource source) {
+		INT64 deadline = m_clock.now();
+		if (m_variation)
+			m_variation->apply(evts);
+		if (Tracer::IsEnabled())
+			Tracer::Instant("execute", "queue", Tracer::Now(), "groups", (INT64)evts.size(), "blocking", m_blocking);
+
+		if (m_blocking) {
+			// Process the events here immediately and wait as necessary
+			for (auto& evt : evts) {
+				deadline += (INT64)evt.delayBefore() * 1000;
+				sendBlocking(evt, deadline);
+			}
+			return;
+		}
+
+		if (!appendToQueue) {
+			clearSource(source);
+		}
+		else if (!m_streams[(int)source].empty()) {
+			// A generator from the same source is still playing, so these wait their turn behind it
+			executeStream(MakeTimedEventGenerator(std::move(evts)), true, source);
+			return;
+		}
+		else {
+			// Appended events follow on from the last one still queued from the same source
+			deadline = lastQueuedDeadline(source, deadline);
+		}
+
+		for (auto& evt : evts) {
+			deadline += (INT64)evt.delayBefore() * 1000;
+			m_timeline.push(deadline, evt, source);
+		}
+		armNextDeadline(m_clock.now());
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::executeStream(TimedEventGenerator generator, bool appendToQueue, TimelineSource source) {
+		INT64 now = m_clock.now();
+		if (Tracer::IsEnabled())
+			Tracer::Instant("execute", "queue", Tracer::Now(), "groups", -1, "blocking", m_blocking);
+
+		if (m_blocking) {
+			INT64 deadline = now;
+			while (std::optional<TimedEvent> evt = generator()) {
+				deadline += (INT64)evt->delayBefore() * 1000;
+				sendBlocking(*evt, deadline);
+			}
+			return;
+		}
+
+		if (!appendToQueue)
+			clearSource(source);
+
+		TimedEventStream_t stream;
+		stream.next = std::move(generator);
+		// Behind another generator, this is brought up to date when that one ends
+		stream.last = lastQueuedDeadline(source, now);
+		m_streams[(int)source].push_back(std::move(stream));
+		// Takes the first groups now, so anything due straight away goes on the next tick
+		pullStreams(now + GENERATOR_WINDOW_US);
+		armNextDeadline(now);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::sendBlocking(TimedEvent& evt, INT64 deadline) {
+		// Wait until the event can be sent, early by the predicted overhead
+		m_clock.waitUntil(deadline - m_calibration.getLead());
+		// Execute the event
+		INT64 start = m_clock.now();
+		INT64 traceStart = Tracer::IsEnabled() ? Tracer::Now() : -1;
+		m_inputBatch.clear();
+		InputBuilder<LogPolicy>::BuildGroup(evt, m_inputBatch);
+		m_inputState.filter(m_inputBatch);
+		if (m_inputBatch.empty()) {
+			m_inputState.commit();
+			return;
+		}
+		if (m_backend.sendInputs(m_winInfo, m_inputBatch)) {
+			m_inputState.commit();
+			m_lastInputTime = m_clock.now();
+			m_calibration.record(start, m_lastInputTime, deadline);
+		}
+		if (traceStart >= 0)
+			Tracer::Span("dispatch", "dispatch", traceStart, Tracer::Now(), "groups", 1, "lateUs", start - deadline);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	std::vector<TimedEvent> BasicPegasusWinterface<Backend, Clock, LogPolicy>::planGroups(std::shared_ptr<const InjectionPlan> plan) {
+		if (!plan->isCurrent()) {
+			LogPolicy::Print("The keyboard layout has changed since the plan was compiled, compiling it again");
+			LogPolicy::EndLine();
+			plan = InjectionPlan::Compile(plan->getSource());
+		}
+		std::vector<TimedEvent> evts;
+		evts.reserve(plan->getStepCount());
+		for (size_t i = 0; i < plan->getStepCount(); i++)
+			evts.push_back(TimedEvent(PlannedGroup_t{ plan, (UINT32)i }));
+		return evts;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::clearSource(TimelineSource source) {
+		m_timeline.removeSource(source);
+		m_streams[(int)source].clear();
+		if (source == TimelineSource::TSRC_MIXED) {
+			clearSource(TimelineSource::TSRC_KEYS);
+			clearSource(TimelineSource::TSRC_MOUSE);
+		}
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	INT64 BasicPegasusWinterface<Backend, Clock, LogPolicy>::lastQueuedDeadline(TimelineSource source, INT64 now) {
+		INT64 last = std::max(now, m_timeline.lastDeadline(source));
+		for (auto& stream : m_streams[(int)source])
+			last = std::max(last, stream.last);
+		if (source == TimelineSource::TSRC_MIXED) {
+			last = std::max(last, lastQueuedDeadline(TimelineSource::TSRC_KEYS, now));
+			last = std::max(last, lastQueuedDeadline(TimelineSource::TSRC_MOUSE, now));
+		}
+		return last;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::pullStreams(INT64 until) {
+		for (int source = 0; source < TIMELINE_SOURCE_COUNT; source++) {
+			std::deque<TimedEventStream_t>& streams = m_streams[source];
+			int pulled = 0;
+			while (!streams.empty() && pulled < GENERATOR_MAX_PULL) {
+				TimedEventStream_t& stream = streams.front();
+				if (!stream.pending) {
+					stream.pending = stream.next();
+					if (!stream.pending) {
+						// Finished, the one behind it starts from where this one ended
+						INT64 last = stream.last;
+						streams.pop_front();
+						if (!streams.empty())
+							streams.front().last = std::max(streams.front().last, last);
+						continue;
+					}
+					stream.pendingDeadline = stream.last + (INT64)stream.pending->delayBefore() * 1000;
+				}
+				if (stream.pendingDeadline > until)
+					break;
+				m_timeline.push(stream.pendingDeadline, std::move(*stream.pending), (TimelineSource)source);
+				stream.last = stream.pendingDeadline;
+				stream.pending.reset();
+				pulled++;
+			}
+		}
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::shiftQueue(INT64 delta) {
+		m_timeline.shift(delta);
+		m_sequenceLast += delta;
+		for (auto& streams : m_streams) {
+			for (auto& stream : streams) {
+				stream.last += delta;
+				stream.pendingDeadline += delta;
+			}
+		}
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	bool BasicPegasusWinterface<Backend, Clock, LogPolicy>::dispatch(std::vector<TimelineEntry_t>& batch) {
+		INT64 start = m_clock.now();
+		INT64 traceStart = Tracer::IsEnabled() ? Tracer::Now() : -1;
+		// Entries arrive in (deadline, order) order, so the records are inserted in exactly that order
+		m_inputBatch.clear();
+		m_inputOwners.clear();
+		for (auto& entry : batch) {
+			InputBuilder<LogPolicy>::BuildGroup(entry.event, m_inputBatch);
+			m_inputOwners.resize(m_inputBatch.size(), entry.sequence);
+		}
+		m_inputState.filter(m_inputBatch, m_inputOwners);
+		// Nothing but presses of held keys and releases of free ones, so there is nothing to send
+		if (m_inputBatch.empty()) {
+			m_inputState.commit();
+			return true;
+		}
+		INT64 traceInject = traceStart >= 0 ? Tracer::Now() : -1;
+		bool sent = m_backend.sendInputs(m_winInfo, m_inputBatch);
+		// Judged against the earliest deadline in the batch, which is the one the dispatch was started for
+		if (sent) {
+			m_inputState.commit();
+			m_lastInputTime = m_clock.now();
+			m_calibration.record(start, m_lastInputTime, batch.front().deadline);
+		}
+		if (traceStart >= 0)
+			traceDispatch(batch, start, traceStart, traceInject);
+		return sent;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::checkTarget(INT64 now) {
+		bool wasPaused = m_watchdog.isPaused();
+		TargetEvent_t evt;
+		if (!m_watchdog.probe(now, m_backend, m_winInfo, m_boundByTitle ? &m_matcher : nullptr, evt))
+			return;
+
+		LogPolicy::PrintWide("Target '", m_winInfo.title, "' (pid=", m_winInfo.pid, ") ", TargetWatchdog::StateName(evt.from), " -> ",
+			TargetWatchdog::StateName(evt.to), evt.rebound ? ", rebound" : "");
+		LogPolicy::EndWideLine();
+		if (Tracer::IsEnabled())
+			Tracer::Instant("target", "watchdog", Tracer::Now(), "state", (INT64)evt.to, "rebound", evt.rebound);
+		if (evt.rebound) {
+			m_calibration.reset();
+			update();
+		}
+		// Picks up where it left off: everything held keeps its distance from the moment sending stopped
+		if (wasPaused && !m_watchdog.isPaused()) {
+			shiftQueue(now - m_watchdog.getPausedSince());
+		}
+		if (m_targetCallback)
+			m_targetCallback(evt);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	void BasicPegasusWinterface<Backend, Clock, LogPolicy>::traceDispatch(std::vector<TimelineEntry_t>& batch, INT64 start, INT64 traceStart, INT64 traceInject) {
+		INT64 traceEnd = Tracer::Now();
+		// Each deadline placed on the trace clock, so the gap to the dispatch shows how early or late it went
+		for (auto& entry : batch) {
+			INT64 lateUs = m_clock.toRealDuration(start - entry.deadline);
+			Tracer::Instant("due", "dispatch", traceStart - lateUs, "source", (INT64)entry.source);
+		}
+		Tracer::Span("inject", "dispatch", traceInject, traceEnd, "inputs", (INT64)m_inputBatch.size());
+		Tracer::Span("dispatch", "dispatch", traceStart, traceEnd, "groups", (INT64)batch.size(), "lateUs", start - batch.front().deadline);
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	INT64 BasicPegasusWinterface<Backend, Clock, LogPolicy>::nextSequenceDeadline(INT64 now) {
+		for (auto& lane : m_lanes) {
+			if (lane.empty())
+				continue;
+			SubmittedSequence_t* seq = lane.front().get();
+			if (seq->state->cancelled.load(std::memory_order_acquire) || seq->next >= seq->groups.size())
+				return now; // Needs a tick to be cleared away
+			INT64 start = (seq == m_activeSequence) ? m_sequenceLast : now;
+			return start + (INT64)seq->groups[seq->next].delayBefore() * 1000;
+		}
+		return -1;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	INT64 BasicPegasusWinterface<Backend, Clock, LogPolicy>::nextDeadline(INT64 now) {
+		// Nothing can be sent before the target is back, which the next probe finds out
+		if (m_watchdog.isPaused())
+			return hasEventsInQueue() ? m_watchdog.getNextProbe() : -1;
+		INT64 next = -1;
+		if (!m_timeline.empty())
+			next = m_timeline.nextDeadline();
+		// A generator needs a tick once its next group comes within the window
+		for (auto& streams : m_streams) {
+			if (streams.empty())
+				continue;
+			INT64 pull = streams.front().pending ? streams.front().pendingDeadline - GENERATOR_WINDOW_US : now;
+			if (next < 0 || pull < next)
+				next = pull;
+		}
+		INT64 seqNext = nextSequenceDeadline(now);
+		if (seqNext >= 0 && (next < 0 || seqNext < next))
+			next = seqNext;
+		return next;
+	}
+
+	template<DispatchBackend Backend, DispatchClock Clock, class LogPolicy>
+	int BasicPegasusWinterface<Backend, Clock, LogPolicy>::armNextDeadline(INT64 now) {
+		INT64 next = nextDeadline(now);
+		if (next >= 0)
+			next -= m_calibration.getLead();
+
+		// Real time until the deadline. A virtual clock doesn't move by itself, so there is nothing to wait for
+		INT64 waitUs = next < 0 ? -1 : m_clock.toRealDuration(std::max<INT64>(0, next - now));
+
+		if (m_waitTimer != NULL) {
+			LARGE_INTEGER due;
+			if (waitUs < 0) {
+				// Setting the timer clears the signal, cancelling stops it from being signalled again
+				due.QuadPart = std::numeric_limits<LONGLONG>::min();
+				SetWaitableTimer(m_waitTimer, &due, 0, NULL, NULL, FALSE);
+				CancelWaitableTimer(m_waitTimer);
+			}
+			else {
+				// Relative due times are negative, in 100ns units. -1 is as soon as possible
+				due.QuadPart = (waitUs > 0 && !m_clock.isVirtual()) ? -waitUs * 10 : -1;
+				SetWaitableTimer(m_waitTimer, &due, 0, NULL, NULL, FALSE);
+			}
+
+			// A sequence submitted while arming would otherwise wait for the timer we just set
+			if (!m_submissions.empty()) {
+				due.QuadPart = -1;
+				SetWaitableTimer(m_waitTimer, &due, 0, NULL, NULL, FALSE);
+				waitUs = 0;
+			}
+		}
+		else if (!m_submissions.empty()) {
+			waitUs = 0;
+		}
+
+		if (waitUs < 0)
+			return PEGASUS_TICK_IDLE;
+		return (int)((waitUs + 999) / 1000);
+	}
+
+}
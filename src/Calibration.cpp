@@ -0,0 +1,107 @@
+/*
+
+Calibration
+
+Closed-loop compensation of dispatch overhead
+
+*/
+
+#include "Calibration.h"
+
+#include <algorithm>
+
+namespace pi = pinterface;
+using namespace pi;
+
+/*******************************************************************************
+		class MovingPercentile, public
+********************************************************************************/
+
+MovingPercentile::MovingPercentile(size_t window) {
+	m_window = std::max<size_t>(window, 1);
+	m_samples.reserve(m_window);
+	m_sorted.reserve(m_window);
+}
+
+void MovingPercentile::add(INT64 sample) {
+	if (m_samples.size() < m_window) {
+		m_samples.push_back(sample);
+		return;
+	}
+	m_samples[m_next] = sample;
+	m_next = (m_next + 1) % m_window;
+}
+
+INT64 MovingPercentile::percentile(double p) const {
+	if (m_samples.empty())
+		return 0;
+	// The window is small, so a selection over a copy is cheaper than keeping an order statistic structure up to date
+	m_sorted.assign(m_samples.begin(), m_samples.end());
+	size_t index = (size_t)(std::clamp(p, 0.0, 1.0) * (double)(m_sorted.size() - 1) + 0.5);
+	std::nth_element(m_sorted.begin(), m_sorted.begin() + index, m_sorted.end());
+	return m_sorted[index];
+}
+
+size_t MovingPercentile::size() const {
+	return m_samples.size();
+}
+
+void MovingPercentile::clear() {
+	m_samples.clear();
+	m_next = 0;
+}
+
+/*******************************************************************************
+		class DispatchCalibrator, public
+********************************************************************************/
+
+DispatchCalibrator::DispatchCalibrator(size_t window, double percentile, INT64 maxLeadUs)
+	: m_overhead(window), m_residual(window), m_residualAbs(window) {
+	m_percentile = percentile;
+	m_maxLead = maxLeadUs;
+}
+
+void DispatchCalibrator::setEnabled(bool enabled) {
+	m_enabled = enabled;
+}
+
+bool DispatchCalibrator::isEnabled() const {
+	return m_enabled;
+}
+
+INT64 DispatchCalibrator::getLead() const {
+	return m_enabled ? m_lead : 0;
+}
+
+void DispatchCalibrator::record(INT64 start, INT64 end, INT64 deadline) {
+	m_overhead.add(end - start);
+	m_lastResidual = end - deadline;
+	m_residual.add(m_lastResidual);
+	m_residualAbs.add(m_lastResidual < 0 ? -m_lastResidual : m_lastResidual);
+	m_samples++;
+
+	if (m_samples >= WARMUP_SAMPLES)
+		m_lead = std::min(m_overhead.percentile(m_percentile), m_maxLead);
+}
+
+CalibrationState_t DispatchCalibrator::getState() const {
+	CalibrationState_t state;
+	state.enabled = m_enabled;
+	state.samples = m_samples;
+	state.leadUs = getLead();
+	state.overheadP50Us = m_overhead.percentile(0.5);
+	state.overheadP99Us = m_overhead.percentile(0.99);
+	state.lastResidualUs = m_lastResidual;
+	state.residualP50Us = m_residual.percentile(0.5);
+	state.residualAbsP99Us = m_residualAbs.percentile(0.99);
+	return state;
+}
+
+void DispatchCalibrator::reset() {
+	m_overhead.clear();
+	m_residual.clear();
+	m_residualAbs.clear();
+	m_samples = 0;
+	m_lead = 0;
+	m_lastResidual = 0;
+}
@@ -0,0 +1,103 @@
+#pragma once
+/*
+
+Calibration
+
+Closed-loop compensation of dispatch overhead. Attaching to the target thread, focusing it
+and SendInput take long enough, and vary enough with load, that inputs land late by that
+much. The calibrator measures every dispatch and predicts the overhead as a moving
+percentile, so the interface can start each dispatch early by that amount
+
+*/
+
+#include <Windows.h>
+
+#include <vector>
+
+namespace pinterface {
+
+	// Percentile of the last few samples. Old samples fall out, so the estimate follows changes in load
+	class MovingPercentile {
+/*******************************************************************************
+		class MovingPercentile, public
+********************************************************************************/
+	public:
+		MovingPercentile(size_t window);
+
+		void add(INT64 sample);
+		// p from 0 to 1. Returns 0 if there are no samples
+		INT64 percentile(double p) const;
+		size_t size() const;
+		void clear();
+
+/*******************************************************************************
+		class MovingPercentile, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		std::vector<INT64> m_samples;
+		size_t m_window;
+		size_t m_next = 0;
+		// Scratch space for percentile(), so it doesn't allocate
+		mutable std::vector<INT64> m_sorted;
+	};
+
+/*******************************************************************************
+		struct CalibrationState
+********************************************************************************/
+	typedef struct CalibrationState {
+		bool enabled;
+		// Dispatches measured since the binding was made
+		UINT64 samples;
+		// Predicted overhead, the amount dispatches are started early by. 0 while disabled or still warming up
+		INT64 leadUs;
+		// Measured overhead of recent dispatches
+		INT64 overheadP50Us;
+		INT64 overheadP99Us;
+		// Time the last injection completed relative to its deadline. Positive is late
+		INT64 lastResidualUs;
+		INT64 residualP50Us;
+		// 99th percentile of the residual's magnitude
+		INT64 residualAbsP99Us;
+	} CalibrationState_t;
+
+	class DispatchCalibrator {
+/*******************************************************************************
+		class DispatchCalibrator, public
+********************************************************************************/
+	public:
+		// The lead is the given percentile of the last window dispatches, and never more than maxLeadUs
+		DispatchCalibrator(size_t window = 64, double percentile = 0.5, INT64 maxLeadUs = 20000);
+
+		// Measurements carry on while disabled, only the lead is turned off
+		void setEnabled(bool enabled);
+		bool isEnabled() const;
+		// Amount to start dispatches early by
+		INT64 getLead() const;
+		// Records a dispatch that started at start and finished injecting at end, aiming to finish at deadline
+		void record(INT64 start, INT64 end, INT64 deadline);
+		CalibrationState_t getState() const;
+		// Forgets every measurement, for a new binding
+		void reset();
+
+/*******************************************************************************
+		class DispatchCalibrator, private
+********************************************************************************/
+	private:
+		/* Private static variables */
+		// Measurements needed before the lead is applied
+		static constexpr UINT64 WARMUP_SAMPLES = 8;
+
+		/* Private member variables */
+		bool m_enabled = true;
+		double m_percentile;
+		INT64 m_maxLead;
+		MovingPercentile m_overhead;
+		MovingPercentile m_residual;
+		MovingPercentile m_residualAbs;
+		UINT64 m_samples = 0;
+		INT64 m_lead = 0;
+		INT64 m_lastResidual = 0;
+	};
+
+}
@@ -0,0 +1,95 @@
+/*
+
+ClockSource
+
+Time sources for PegasusWinterface and ScriptScheduler
+
+*/
+
+#include "ClockSource.h"
+
+#include <iostream>
+
+namespace pi = pinterface;
+using namespace pi;
+using std::cerr;
+using std::endl;
+
+/*******************************************************************************
+		class RealClock, public
+********************************************************************************/
+
+RealClock::RealClock() {
+	m_timer.restart();
+}
+
+INT64 RealClock::now() {
+	return m_timer.getElapsedTimeAsMicroseconds();
+}
+
+void RealClock::waitUntil(INT64 deadline) {
+	while (m_timer.getElapsedTimeAsMicroseconds() < deadline);
+}
+
+/*******************************************************************************
+		class ManualClock, public
+********************************************************************************/
+
+ManualClock::ManualClock(INT64 start) {
+	m_now.store(start, std::memory_order_relaxed);
+}
+
+INT64 ManualClock::now() {
+	return m_now.load(std::memory_order_acquire);
+}
+
+void ManualClock::waitUntil(INT64 deadline) {
+	advanceTo(deadline);
+}
+
+void ManualClock::advanceBy(INT64 us) {
+	if (us > 0)
+		m_now.fetch_add(us, std::memory_order_acq_rel);
+}
+
+void ManualClock::advanceTo(INT64 us) {
+	INT64 current = m_now.load(std::memory_order_acquire);
+	while (current < us && !m_now.compare_exchange_weak(current, us, std::memory_order_acq_rel));
+}
+
+/*******************************************************************************
+		class ScaledClock, public
+********************************************************************************/
+
+ScaledClock::ScaledClock(double scale) {
+	m_scale = 1.0;
+	m_timer.restart();
+	setScale(scale);
+}
+
+INT64 ScaledClock::now() {
+	INT64 real = m_timer.getElapsedTimeAsMicroseconds();
+	return m_base + (INT64)((double)(real - m_realBase) * m_scale);
+}
+
+void ScaledClock::waitUntil(INT64 deadline) {
+	while (now() < deadline);
+}
+
+INT64 ScaledClock::toRealDuration(INT64 duration) {
+	return (INT64)((double)duration / m_scale);
+}
+
+void ScaledClock::setScale(double scale) {
+	if (scale <= 0.0) {
+		cerr << "ScaledClock: scale must be greater than 0, keeping " << m_scale << endl;
+		return;
+	}
+	m_base = now();
+	m_realBase = m_timer.getElapsedTimeAsMicroseconds();
+	m_scale = scale;
+}
+
+double ScaledClock::getScale() const {
+	return m_scale;
+}
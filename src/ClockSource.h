@@ -0,0 +1,108 @@
+#pragma once
+/*
+
+ClockSource
+
+Time sources for PegasusWinterface and ScriptScheduler. RealClock follows the performance
+counter, ManualClock only moves when advanced so long scripts can be played back instantly
+and deterministically, and ScaledClock runs real time faster or slower
+
+*/
+
+#include <Windows.h>
+
+#include <atomic>
+
+#include "PegasusTimer.h"
+
+namespace pinterface {
+
+	class ClockSource {
+/*******************************************************************************
+		class ClockSource, public
+********************************************************************************/
+	public:
+		virtual ~ClockSource() = default;
+
+		// Current time in microseconds. Only differences between readings are meaningful
+		virtual INT64 now() = 0;
+		// Returns once now() has reached the deadline
+		virtual void waitUntil(INT64 deadline) = 0;
+		// Converts a duration on this clock to the real time it takes to pass, both in microseconds
+		virtual INT64 toRealDuration(INT64 duration) { return duration; }
+		// True if the clock only moves when something advances it, in which case nothing should wait on it in real time
+		virtual bool isVirtual() const { return false; }
+	};
+
+	class RealClock : public ClockSource {
+/*******************************************************************************
+		class RealClock, public
+********************************************************************************/
+	public:
+		RealClock();
+
+		INT64 now() override;
+		// Busy waits, as the blocking mode always has, so the deadline isn't overshot by the scheduler
+		void waitUntil(INT64 deadline) override;
+
+/*******************************************************************************
+		class RealClock, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		PegasusTimer m_timer;
+	};
+
+	class ManualClock : public ClockSource {
+/*******************************************************************************
+		class ManualClock, public
+********************************************************************************/
+	public:
+		ManualClock(INT64 start = 0);
+
+		// Safe to read from any thread
+		INT64 now() override;
+		// Jumps straight to the deadline. Never goes backwards
+		void waitUntil(INT64 deadline) override;
+		bool isVirtual() const override { return true; }
+
+		void advanceBy(INT64 us);
+		void advanceTo(INT64 us);
+
+/*******************************************************************************
+		class ManualClock, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		std::atomic<INT64> m_now;
+	};
+
+	class ScaledClock : public ClockSource {
+/*******************************************************************************
+		class ScaledClock, public
+********************************************************************************/
+	public:
+		// A scale of 10 plays a script back ten times faster than real time
+		ScaledClock(double scale = 1.0);
+
+		INT64 now() override;
+		void waitUntil(INT64 deadline) override;
+		INT64 toRealDuration(INT64 duration) override;
+
+		// Changes the scale from now on. The clock carries on from its current reading rather than jumping
+		void setScale(double scale);
+		double getScale() const;
+
+/*******************************************************************************
+		class ScaledClock, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		PegasusTimer m_timer;
+		double m_scale;
+		// Scaled time at the last scale change, and the real time it happened
+		INT64 m_base = 0;
+		INT64 m_realBase = 0;
+	};
+
+}
@@ -0,0 +1,384 @@
+/*
+
+EventCodec
+
+Delta and varint encoding of InjectEvent_t streams, with a dictionary of event kinds
+
+A stream is a header and then the events:
+
+	UINT32 magic, UINT8 version, UINT8 priority, UINT16 target, varint event count
+
+Each event starts with a tag byte. The top bit marks the first event of a group, the rest is
+an index into the dictionary, or EVENT_CODEC_DICTIONARY_SIZE for an event written out in full
+as kind, type and flags bytes, a varint code and a fields byte. That entry joins the
+dictionary while it has room. After the tag come, if present:
+
+	group start            zigzag varint change in delayMs from the last group
+	CODEC_FIELD_DX, _DY    zigzag varint change in dx, dy from the last event of the same kind
+	CODEC_FIELD_SCROLL     varint scrollDelta
+
+*/
+
+#include "EventCodec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+namespace pi = pinterface;
+using namespace pi;
+using std::cerr;
+using std::endl;
+
+static const UINT8 CODEC_GROUP_START = 0x80;
+static const UINT8 CODEC_FIELD_DX = 0x01;
+static const UINT8 CODEC_FIELD_DY = 0x02;
+static const UINT8 CODEC_FIELD_SCROLL = 0x04;
+static const size_t CODEC_HEADER_BYTES = 8;
+// Longest an event can be: tag, literal entry (3 bytes, a varint code and the fields byte) and four varints
+static const size_t CODEC_MAX_EVENT_BYTES = 1 + 3 + 5 + 1 + 4 * 5;
+
+static void WriteVarint(std::vector<BYTE>& out, UINT32 value) {
+	while (value >= 0x80) {
+		out.push_back((BYTE)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((BYTE)value);
+}
+
+static UINT32 ZigZag(INT32 value) {
+	return ((UINT32)value << 1) ^ (UINT32)(value >> 31);
+}
+
+static INT32 UnZigZag(UINT32 value) {
+	return (INT32)((value >> 1) ^ (0u - (value & 1)));
+}
+
+// Differences wrap rather than overflow, so any pair of values round trips
+static INT32 Delta(INT32 value, INT32 from) {
+	return (INT32)((UINT32)value - (UINT32)from);
+}
+
+static INT32 ApplyDelta(INT32 from, INT32 delta) {
+	return (INT32)((UINT32)from + (UINT32)delta);
+}
+
+// CHECKED reads stop at end, the rest rely on the caller having left CODEC_MAX_EVENT_BYTES
+template<bool CHECKED>
+static inline bool ReadVarint(const BYTE*& p, const BYTE* end, UINT32& value) {
+	if ((!CHECKED || p < end) && *p < 0x80) {
+		value = *p++;
+		return true;
+	}
+	UINT32 result = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		if (CHECKED && p >= end)
+			return false;
+		BYTE b = *p++;
+		result |= (UINT32)(b & 0x7F) << shift;
+		if ((b & 0x80) == 0) {
+			value = result;
+			return true;
+		}
+	}
+	return false;
+}
+
+static UINT64 ShapeKey(const InjectEvent_t& e, UINT8 fields) {
+	return (UINT64)e.kind | ((UINT64)e.type << 8) | ((UINT64)(e.flags & ~INJECT_FLAG_GROUP_START) << 16) | ((UINT64)e.code << 24) | ((UINT64)fields << 40);
+}
+
+/*******************************************************************************
+		class EventCodec, public
+********************************************************************************/
+/* Public static functions */
+size_t EventCodec::Encode(const InjectEvent_t* evts, size_t count, std::vector<BYTE>& out) {
+	size_t start = out.size();
+	UINT8 priority = count > 0 ? evts[0].priority : 0;
+	UINT16 target = count > 0 ? evts[0].target : 0;
+	out.reserve(start + CODEC_HEADER_BYTES + 5 + count * 2);
+	BYTE header[CODEC_HEADER_BYTES];
+	UINT32 magic = EVENT_CODEC_MAGIC;
+	memcpy(header, &magic, 4);
+	header[4] = EVENT_CODEC_VERSION;
+	header[5] = priority;
+	memcpy(header + 6, &target, 2);
+	out.insert(out.end(), header, header + CODEC_HEADER_BYTES);
+	WriteVarint(out, (UINT32)count);
+
+	std::unordered_map<UINT64, UINT8> dictionary;
+	INT32 delay = 0;
+	INT32 dx[2] = { 0, 0 };
+	INT32 dy[2] = { 0, 0 };
+	for (size_t i = 0; i < count; i++) {
+		const InjectEvent_t& e = evts[i];
+		int k = e.kind == INJECT_KIND_MOUSE ? 1 : 0;
+		bool groupStart = (e.flags & INJECT_FLAG_GROUP_START) != 0;
+		UINT8 fields = (e.dx != dx[k] ? CODEC_FIELD_DX : 0) | (e.dy != dy[k] ? CODEC_FIELD_DY : 0) | (e.scrollDelta != 0 ? CODEC_FIELD_SCROLL : 0);
+
+		UINT64 key = ShapeKey(e, fields);
+		auto found = dictionary.find(key);
+		if (found != dictionary.end()) {
+			out.push_back(found->second | (groupStart ? CODEC_GROUP_START : 0));
+		}
+		else {
+			out.push_back((BYTE)EVENT_CODEC_DICTIONARY_SIZE | (groupStart ? CODEC_GROUP_START : 0));
+			out.push_back(e.kind);
+			out.push_back(e.type);
+			out.push_back(e.flags & ~INJECT_FLAG_GROUP_START);
+			WriteVarint(out, e.code);
+			out.push_back(fields);
+			if (dictionary.size() < EVENT_CODEC_DICTIONARY_SIZE)
+				dictionary.emplace(key, (UINT8)dictionary.size());
+		}
+
+		if (groupStart) {
+			WriteVarint(out, ZigZag(Delta(e.delayMs, delay)));
+			delay = e.delayMs;
+		}
+		if (fields & CODEC_FIELD_DX)
+			WriteVarint(out, ZigZag(Delta(e.dx, dx[k])));
+		if (fields & CODEC_FIELD_DY)
+			WriteVarint(out, ZigZag(Delta(e.dy, dy[k])));
+		if (fields & CODEC_FIELD_SCROLL)
+			WriteVarint(out, e.scrollDelta);
+		dx[k] = e.dx;
+		dy[k] = e.dy;
+	}
+	return out.size() - start;
+}
+
+size_t EventCodec::EncodeGroups(std::vector<TimedEvent>& groups, std::vector<BYTE>& out, SubmitPriority priority) {
+	std::vector<InjectEvent_t> evts;
+	EncodeInjectEvents(0, groups, priority, evts);
+	return Encode(evts.data(), evts.size(), out);
+}
+
+bool EventCodec::Decode(const BYTE* data, size_t size, std::vector<InjectEvent_t>& out) {
+	EventStreamReader reader(data, size);
+	if (!reader.isValid())
+		return false;
+	size_t start = out.size();
+	out.resize(start + reader.getEventCount());
+	size_t read = reader.read(out.data() + start, reader.getEventCount());
+	if (read != reader.getEventCount() || !reader.isValid()) {
+		out.resize(start);
+		return false;
+	}
+	return true;
+}
+
+bool EventCodec::DecodeGroups(const BYTE* data, size_t size, std::vector<TimedEvent>& out) {
+	std::vector<InjectEvent_t> evts;
+	if (!Decode(data, size, evts))
+		return false;
+	return DecodeInjectEvents(evts.data(), (UINT32)evts.size(), out);
+}
+
+size_t EventCodec::PeekCount(const BYTE* data, size_t size) {
+	EventStreamReader reader(data, size);
+	return reader.isValid() ? reader.getEventCount() : 0;
+}
+
+/*******************************************************************************
+		class EventStreamReader, private
+********************************************************************************/
+/* Private member functions */
+bool EventStreamReader::addShape(const InjectEvent_t& shape, UINT8 fields) {
+	if (m_shapeCount >= EVENT_CODEC_DICTIONARY_SIZE)
+		return false;
+	m_shapes[m_shapeCount] = shape;
+	m_shapeFields[m_shapeCount] = fields;
+	m_shapeCount++;
+	return true;
+}
+
+template<bool CHECKED>
+size_t EventStreamReader::decodeRun(InjectEvent_t* out, size_t max, const BYTE* stop) {
+	// Kept in locals for the length of the run so they stay in registers
+	const BYTE* p = m_at;
+	const BYTE* end = m_end;
+	INT32 delay = m_delay;
+	INT32 dx[2] = { m_dx[0], m_dx[1] };
+	INT32 dy[2] = { m_dy[0], m_dy[1] };
+	size_t n = 0;
+	bool malformed = false;
+
+	for (; n < max && (CHECKED || p < stop); n++) {
+		// Running out of data early is as bad as a broken event, read() only asks for what the header says is there
+		malformed = true;
+		if (CHECKED && p >= end)
+			break;
+		InjectEvent_t& e = out[n];
+		BYTE tag = *p++;
+		UINT32 index = tag & ~CODEC_GROUP_START;
+		UINT8 fields;
+		if (index < m_shapeCount) {
+			e = m_shapes[index];
+			fields = m_shapeFields[index];
+		}
+		else if (index == EVENT_CODEC_DICTIONARY_SIZE) {
+			if (CHECKED && end - p < 3)
+				break;
+			e = {};
+			e.kind = p[0];
+			e.type = p[1];
+			e.flags = p[2] & ~INJECT_FLAG_GROUP_START;
+			e.target = m_target;
+			e.priority = m_priority;
+			p += 3;
+			UINT32 code;
+			if (!ReadVarint<CHECKED>(p, end, code) || (CHECKED && p >= end))
+				break;
+			e.code = (UINT16)code;
+			fields = *p++;
+			addShape(e, fields);
+		}
+		else {
+			break;
+		}
+
+		UINT32 value;
+		if (tag & CODEC_GROUP_START) {
+			if (!ReadVarint<CHECKED>(p, end, value))
+				break;
+			delay = ApplyDelta(delay, UnZigZag(value));
+			e.flags |= INJECT_FLAG_GROUP_START;
+			e.delayMs = delay;
+		}
+		int k = e.kind == INJECT_KIND_MOUSE ? 1 : 0;
+		if (fields != 0) {
+			if ((fields & CODEC_FIELD_DX) && !ReadVarint<CHECKED>(p, end, value))
+				break;
+			if (fields & CODEC_FIELD_DX)
+				dx[k] = ApplyDelta(dx[k], UnZigZag(value));
+			if ((fields & CODEC_FIELD_DY) && !ReadVarint<CHECKED>(p, end, value))
+				break;
+			if (fields & CODEC_FIELD_DY)
+				dy[k] = ApplyDelta(dy[k], UnZigZag(value));
+			if ((fields & CODEC_FIELD_SCROLL) && !ReadVarint<CHECKED>(p, end, value))
+				break;
+			if (fields & CODEC_FIELD_SCROLL)
+				e.scrollDelta = value;
+		}
+		e.dx = dx[k];
+		e.dy = dy[k];
+		malformed = false;
+	}
+	m_error = m_error || malformed;
+
+	m_at = p;
+	m_delay = delay;
+	m_dx[0] = dx[0];
+	m_dx[1] = dx[1];
+	m_dy[0] = dy[0];
+	m_dy[1] = dy[1];
+	return n;
+}
+
+size_t EventStreamReader::decode(InjectEvent_t* out, size_t max) {
+	size_t n = 0;
+	// Events that start before stop can't run past the end, so they are read without checks
+	if ((size_t)(m_end - m_at) > CODEC_MAX_EVENT_BYTES)
+		n = decodeRun<false>(out, max, m_end - CODEC_MAX_EVENT_BYTES);
+	if (n < max && !m_error)
+		n += decodeRun<true>(out + n, max - n, m_end);
+	if (n < max) {
+		m_error = true;
+		cerr << "EventStreamReader: event " << m_decoded + n << " is malformed at byte " << (m_at - m_data) << endl;
+	}
+	m_decoded += n;
+	return n;
+}
+
+void EventStreamReader::fillAhead() {
+	// A group runs until the next group start, so read until one is in sight past the first event or the stream ends
+	while (m_decoded < m_count && !m_error) {
+		bool whole = false;
+		for (size_t i = m_aheadPos + 1; i < m_ahead.size(); i++) {
+			if (m_ahead[i].flags & INJECT_FLAG_GROUP_START) {
+				whole = true;
+				break;
+			}
+		}
+		if (whole)
+			return;
+		m_ahead.erase(m_ahead.begin(), m_ahead.begin() + m_aheadPos);
+		m_aheadPos = 0;
+		size_t have = m_ahead.size();
+		m_ahead.resize(have + DECODE_AHEAD);
+		m_ahead.resize(have + read(m_ahead.data() + have, DECODE_AHEAD));
+	}
+}
+
+/*******************************************************************************
+		class EventStreamReader, public
+********************************************************************************/
+
+EventStreamReader::EventStreamReader(const BYTE* data, size_t size) {
+	m_data = data;
+	m_end = data + size;
+	m_at = data;
+
+	UINT32 magic = 0;
+	if (size >= CODEC_HEADER_BYTES)
+		memcpy(&magic, data, 4);
+	// The magic is only read from a full header, so the version is there to check
+	if (magic != EVENT_CODEC_MAGIC || data[4] != EVENT_CODEC_VERSION) {
+		cerr << "EventStreamReader: not an event stream of version " << (int)EVENT_CODEC_VERSION << endl;
+		m_error = true;
+		return;
+	}
+	m_priority = data[5];
+	memcpy(&m_target, data + 6, 2);
+	m_at = data + CODEC_HEADER_BYTES;
+	UINT32 count;
+	if (!ReadVarint<true>(m_at, m_end, count)) {
+		m_error = true;
+		return;
+	}
+	m_count = count;
+}
+
+size_t EventStreamReader::read(InjectEvent_t* out, size_t max) {
+	if (m_error)
+		return 0;
+	return decode(out, std::min(max, m_count - m_decoded));
+}
+
+std::optional<TimedEvent> EventStreamReader::nextGroup() {
+	fillAhead();
+	if (m_aheadPos >= m_ahead.size())
+		return std::nullopt;
+	size_t end = m_aheadPos + 1;
+	while (end < m_ahead.size() && (m_ahead[end].flags & INJECT_FLAG_GROUP_START) == 0)
+		end++;
+
+	std::vector<TimedEvent> group;
+	bool ok = DecodeInjectEvents(m_ahead.data() + m_aheadPos, (UINT32)(end - m_aheadPos), group);
+	m_aheadPos = end;
+	if (!ok || group.empty()) {
+		m_error = true;
+		return std::nullopt;
+	}
+	return std::move(group.front());
+}
+
+bool EventStreamReader::isValid() const {
+	return !m_error;
+}
+
+size_t EventStreamReader::getEventCount() const {
+	return m_count;
+}
+
+size_t EventStreamReader::getPosition() const {
+	return m_decoded;
+}
+
+TimedEventGenerator pi::MakeEventStreamGenerator(std::shared_ptr<const std::vector<BYTE>> data) {
+	std::shared_ptr<EventStreamReader> reader = std::make_shared<EventStreamReader>(data->data(), data->size());
+	// The generator holds the data for as long as the reader needs it
+	return [data, reader]() { return reader->nextGroup(); };
+}
@@ -0,0 +1,120 @@
+#pragma once
+/*
+
+EventCodec
+
+Compact encoding of event streams in the InjectEvent_t layout, for keeping recordings and
+queued sequences on disk or in memory. Group delays and mouse movements are stored as the
+change from the one before, every number is a varint, and each distinct (kind, type, flags,
+code) the stream uses is put in a dictionary the first time it is seen and referred to by a
+one byte index after that. A key event in a run typed at a steady pace takes two bytes, a
+mouse move at a steady speed one:
+
+	std::vector<BYTE> packed;
+	pi::EventCodec::EncodeGroups(macro, packed);
+	...
+	app.executeEvents(pi::MakeEventStreamGenerator(std::make_shared<std::vector<BYTE>>(packed)));
+
+EventStreamReader decodes a block of events at a time from a table of prebuilt events, so
+the scheduler can be fed from a stream without it ever being unpacked in full
+
+*/
+
+#include <Windows.h>
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "TimedEvents.h"
+#include "SubmissionQueue.h"
+#include "InjectProtocol.h"
+
+namespace pinterface {
+
+	constexpr UINT32 EVENT_CODEC_MAGIC = 0x43455750; // "PWEC"
+	constexpr UINT8 EVENT_CODEC_VERSION = 1;
+	// Most dictionary entries a stream can have. Events of any other kind are written out in full each time
+	constexpr UINT32 EVENT_CODEC_DICTIONARY_SIZE = 127;
+
+	class EventCodec {
+/*******************************************************************************
+		class EventCodec, public
+********************************************************************************/
+	public:
+		/* Public static functions */
+		// Encodes the events as one stream, appended to out. Target and priority are taken from the first event. Returns
+		// the number of bytes written
+		static size_t Encode(const InjectEvent_t* evts, size_t count, std::vector<BYTE>& out);
+		// Encodes groups through EncodeInjectEvents
+		static size_t EncodeGroups(std::vector<TimedEvent>& groups, std::vector<BYTE>& out, SubmitPriority priority = SubmitPriority::SPRIO_NORMAL);
+		// Decodes a whole stream, appending to out. Returns false if it is malformed, leaving out as it was
+		static bool Decode(const BYTE* data, size_t size, std::vector<InjectEvent_t>& out);
+		static bool DecodeGroups(const BYTE* data, size_t size, std::vector<TimedEvent>& out);
+		// Events in the stream according to its header, or 0 if it has none
+		static size_t PeekCount(const BYTE* data, size_t size);
+	};
+
+	// Decodes a stream in blocks. The data must outlive the reader
+	class EventStreamReader {
+/*******************************************************************************
+		class EventStreamReader, private
+********************************************************************************/
+	private:
+		/* Private member functions */
+		bool addShape(const InjectEvent_t& shape, UINT8 fields);
+		// Decodes events until max or an event starting at or after stop. CHECKED reads stop at the end of the data, the
+		// others rely on stop leaving room for the longest event
+		template<bool CHECKED>
+		size_t decodeRun(InjectEvent_t* out, size_t max, const BYTE* stop);
+		// Decodes max events, which read() has made sure the stream holds
+		size_t decode(InjectEvent_t* out, size_t max);
+		// Tops up the events read ahead for nextGroup() so a whole group is there
+		void fillAhead();
+
+		/* Private member variables */
+		const BYTE* m_data;
+		const BYTE* m_end;
+		const BYTE* m_at;
+		size_t m_count = 0;
+		size_t m_decoded = 0;
+		bool m_error = false;
+		UINT16 m_target = 0;
+		UINT8 m_priority = 0;
+		// Each dictionary entry as a prebuilt event, and the fields that follow it
+		InjectEvent_t m_shapes[EVENT_CODEC_DICTIONARY_SIZE];
+		UINT8 m_shapeFields[EVENT_CODEC_DICTIONARY_SIZE];
+		UINT32 m_shapeCount = 0;
+		// Values the deltas are taken from, movements per kind with keys first
+		INT32 m_delay = 0;
+		INT32 m_dx[2] = { 0, 0 };
+		INT32 m_dy[2] = { 0, 0 };
+		// Events decoded ahead by nextGroup()
+		std::vector<InjectEvent_t> m_ahead;
+		size_t m_aheadPos = 0;
+
+/*******************************************************************************
+		class EventStreamReader, public
+********************************************************************************/
+	public:
+		/* Public static variables */
+		// Events nextGroup() decodes at once
+		static constexpr size_t DECODE_AHEAD = 1024;
+
+		EventStreamReader(const BYTE* data, size_t size);
+
+		// Decodes up to max more events into out. Returns the number decoded, 0 at the end of the stream or on an error
+		size_t read(InjectEvent_t* out, size_t max);
+		// The next group, decoded ahead in blocks of DECODE_AHEAD events. Nothing at the end of the stream or on an error
+		std::optional<TimedEvent> nextGroup();
+		// The header was good and nothing malformed has been read since
+		bool isValid() const;
+		size_t getEventCount() const;
+		// Events decoded so far
+		size_t getPosition() const;
+	};
+
+	// Plays an encoded stream through executeEvents(), decoding it as the scheduler asks for groups
+	TimedEventGenerator MakeEventStreamGenerator(std::shared_ptr<const std::vector<BYTE>> data);
+
+}
@@ -0,0 +1,77 @@
+/*
+
+InjectClient
+
+Client side of the injection daemon
+
+*/
+
+#include "InjectClient.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cwchar>
+
+namespace pi = pinterface;
+using namespace pi;
+using std::cerr;
+using std::endl;
+
+/*******************************************************************************
+		class InjectClient, public
+********************************************************************************/
+
+InjectClient::InjectClient() {
+}
+
+bool InjectClient::connect(const std::wstring& name) {
+	return m_ring.open(name);
+}
+
+void InjectClient::disconnect() {
+	m_ring.close();
+}
+
+bool InjectClient::isConnected() const {
+	return m_ring.isDaemonAlive();
+}
+
+int InjectClient::findTarget(const std::wstring& title) {
+	int count = getTargetCount();
+	InjectHeader_t* header = m_ring.getHeader();
+	for (int i = 0; i < count; i++) {
+		std::wstring targetTitle(header->targetTitles[i], wcsnlen(header->targetTitles[i], INJECT_TITLE_LENGTH));
+		if (STD_WSTRING_CONTAINS(targetTitle, title))
+			return i;
+	}
+	return -1;
+}
+
+int InjectClient::getTargetCount() {
+	InjectHeader_t* header = m_ring.getHeader();
+	if (header == nullptr)
+		return 0;
+	return (int)std::min<UINT32>(header->targetCount, INJECT_MAX_TARGETS);
+}
+
+bool InjectClient::submit(const InjectEvent_t* evts, UINT32 count) {
+	return m_ring.push(evts, count);
+}
+
+bool InjectClient::submitKeys(int target, std::vector<TimedKeyEvent> keys, SubmitPriority priority) {
+	return submitEvents(target, std::vector<TimedEvent>(keys.begin(), keys.end()), priority);
+}
+
+bool InjectClient::submitMouse(int target, std::vector<TimedMouseEvent> evts, SubmitPriority priority) {
+	return submitEvents(target, std::vector<TimedEvent>(evts.begin(), evts.end()), priority);
+}
+
+bool InjectClient::submitEvents(int target, std::vector<TimedEvent> evts, SubmitPriority priority) {
+	if (target < 0 || target >= getTargetCount()) {
+		cerr << "InjectClient: no target " << target << endl;
+		return false;
+	}
+	std::vector<InjectEvent_t> encoded;
+	EncodeInjectEvents((UINT16)target, evts, priority, encoded);
+	return submit(encoded.data(), (UINT32)encoded.size());
+}
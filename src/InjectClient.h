@@ -0,0 +1,53 @@
+#pragma once
+/*
+
+InjectClient
+
+Client side of the injection daemon. Submits batches of events to a target the daemon
+has bound, without binding or enumerating windows in this process
+
+*/
+
+#include <string>
+#include <vector>
+
+#include "InjectRing.h"
+
+namespace pinterface {
+
+	class InjectClient {
+/*******************************************************************************
+		class InjectClient, public
+********************************************************************************/
+	public:
+		InjectClient();
+		InjectClient(const InjectClient&) = delete;
+		InjectClient& operator=(const InjectClient&) = delete;
+
+		// Connects to a running daemon. Returns false if there is none under the name
+		bool connect(const std::wstring& name = INJECT_DEFAULT_NAME);
+		void disconnect();
+		// False once the daemon has stopped, after which every submit fails
+		bool isConnected() const;
+
+		// Index of the first daemon target whose title contains the text, or -1
+		int findTarget(const std::wstring& title);
+		// Number of targets the daemon has bound
+		int getTargetCount();
+
+		// Submits the events as one batch, which the daemon sends as one sequence. Safe from any thread. Never blocks:
+		// returns false if the daemon's ring is full or the batch is larger than INJECT_MAX_BATCH events
+		bool submit(const InjectEvent_t* evts, UINT32 count);
+		bool submitKeys(int target, std::vector<TimedKeyEvent> keys, SubmitPriority priority = SubmitPriority::SPRIO_NORMAL);
+		bool submitMouse(int target, std::vector<TimedMouseEvent> evts, SubmitPriority priority = SubmitPriority::SPRIO_NORMAL);
+		bool submitEvents(int target, std::vector<TimedEvent> evts, SubmitPriority priority = SubmitPriority::SPRIO_NORMAL);
+
+/*******************************************************************************
+		class InjectClient, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		InjectRing m_ring;
+	};
+
+}
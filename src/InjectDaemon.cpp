@@ -0,0 +1,144 @@
+/*
+
+InjectDaemon
+
+Owns the window bindings and scheduling for every process on the machine
+
+*/
+
+#include "InjectDaemon.h"
+
+#include <iostream>
+#include <algorithm>
+
+namespace pi = pinterface;
+using namespace pi;
+using std::wcout;
+using std::cerr;
+using std::endl;
+
+/*******************************************************************************
+		class InjectDaemon, public
+********************************************************************************/
+
+InjectDaemon::InjectDaemon(const std::wstring& name) {
+	m_name = name;
+}
+
+int InjectDaemon::addTarget(PegasusWinterface* app) {
+	if (m_targets.size() >= INJECT_MAX_TARGETS) {
+		cerr << "InjectDaemon: no room for more than " << INJECT_MAX_TARGETS << " targets" << endl;
+		return -1;
+	}
+	m_targets.push_back(app);
+	if (m_ring.isOpen())
+		publishTargets();
+	return (int)m_targets.size() - 1;
+}
+
+bool InjectDaemon::start() {
+	if (!m_ring.create(m_name))
+		return false;
+
+	publishTargets();
+	wcout << "InjectDaemon: listening on '" << m_name << "' with " << m_targets.size() << " targets" << endl;
+	return true;
+}
+
+void InjectDaemon::stop() {
+	if (m_ring.isOpen())
+		m_ring.getHeader()->daemonAlive.store(0, std::memory_order_release);
+	m_ring.close();
+}
+
+bool InjectDaemon::isRunning() const {
+	return m_ring.isOpen();
+}
+
+int InjectDaemon::tick() {
+	m_batch.clear();
+	while (UINT32 count = m_ring.pop(m_batch)) {
+		const InjectEvent_t& first = m_batch[m_batch.size() - count];
+		m_groups.clear();
+		if (first.target >= m_targets.size() || first.priority >= SUBMIT_PRIORITY_COUNT
+			|| !DecodeInjectEvents(&first, count, m_groups)) {
+			cerr << "InjectDaemon: rejected a batch of " << count << " events for target " << first.target << endl;
+			m_rejected++;
+		}
+		else {
+			m_targets[first.target]->submitEvents(std::move(m_groups), (SubmitPriority)first.priority);
+			m_batches++;
+			m_events += count;
+		}
+		m_batch.clear();
+	}
+
+	int wait = PEGASUS_TICK_IDLE;
+	for (PegasusWinterface* app : m_targets) {
+		int appWait = app->tick();
+		if (appWait != PEGASUS_TICK_IDLE && (wait == PEGASUS_TICK_IDLE || appWait < wait))
+			wait = appWait;
+	}
+	return wait;
+}
+
+void InjectDaemon::run(std::atomic<bool>& quit) {
+	std::vector<HANDLE> handles;
+	handles.push_back(m_ring.getDoorbell());
+	for (PegasusWinterface* app : m_targets) {
+		HANDLE h = app->getWaitableHandle();
+		if (h != NULL)
+			handles.push_back(h);
+	}
+
+	while (!quit.load(std::memory_order_acquire) && m_ring.isOpen()) {
+		int wait = tick();
+		if (wait == 0)
+			continue;
+
+		DWORD timeout;
+		if (!m_ring.prepareToSleep()) {
+			// A client claimed slots but hasn't finished writing them, give it a moment rather than spinning. If it never does,
+			// the ring skips the slots after INJECT_STALL_TIMEOUT_MS
+			timeout = 1;
+		}
+		else {
+			// Wake up now and then regardless, so quit is noticed
+			timeout = (wait == PEGASUS_TICK_IDLE) ? 100 : (DWORD)std::min(wait, 100);
+		}
+		WaitForMultipleObjects((DWORD)handles.size(), handles.data(), FALSE, timeout);
+		m_ring.wake();
+	}
+}
+
+UINT64 InjectDaemon::getBatchCount() const {
+	return m_batches;
+}
+
+UINT64 InjectDaemon::getEventCount() const {
+	return m_events;
+}
+
+UINT64 InjectDaemon::getRejectedCount() const {
+	return m_rejected;
+}
+
+UINT64 InjectDaemon::getSkippedCount() const {
+	return m_ring.getSkippedCount();
+}
+
+/*******************************************************************************
+		class InjectDaemon, private
+********************************************************************************/
+
+void InjectDaemon::publishTargets() {
+	InjectHeader_t* header = m_ring.getHeader();
+	for (size_t i = 0; i < m_targets.size(); i++) {
+		std::wstring title = m_targets[i]->getWinInfo().title.substr(0, INJECT_TITLE_LENGTH - 1);
+		std::copy(title.begin(), title.end(), header->targetTitles[i]);
+		header->targetTitles[i][title.size()] = L'\0';
+	}
+	// Titles first, so a client never sees a count covering a title that isn't written yet
+	std::atomic_thread_fence(std::memory_order_release);
+	header->targetCount = (UINT32)m_targets.size();
+}
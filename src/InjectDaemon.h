@@ -0,0 +1,72 @@
+#pragma once
+/*
+
+InjectDaemon
+
+Owns the window bindings and scheduling for every process on the machine. Client processes
+submit batches through an InjectRing, which the daemon turns into submitted sequences on
+the target interfaces, so only one process contends for focus and enumerates windows
+
+*/
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "InjectRing.h"
+#include "PegasusWinterface.h"
+
+namespace pinterface {
+
+	class InjectDaemon {
+/*******************************************************************************
+		class InjectDaemon, public
+********************************************************************************/
+	public:
+		InjectDaemon(const std::wstring& name = INJECT_DEFAULT_NAME);
+		InjectDaemon(const InjectDaemon&) = delete;
+		InjectDaemon& operator=(const InjectDaemon&) = delete;
+
+		// Adds a bound interface as a target. Returns the index clients use for it, or -1 if the table is full. The
+		// interface must outlive the daemon, and is only used from the thread calling tick()/run()
+		int addTarget(PegasusWinterface* app);
+		// Creates the shared ring and publishes the targets added so far. Returns false if another daemon is using the name
+		bool start();
+		void stop();
+		bool isRunning() const;
+
+		// Moves every complete batch from the ring onto its target, then ticks the targets. Returns the time in ms until
+		// something is due, or PEGASUS_TICK_IDLE
+		int tick();
+		// Calls tick() until quit is set, sleeping on the doorbell and the targets' timers in between
+		void run(std::atomic<bool>& quit);
+
+		UINT64 getBatchCount() const;
+		UINT64 getEventCount() const;
+		// Batches dropped for naming a target that doesn't exist or failing to decode
+		UINT64 getRejectedCount() const;
+		// Ring slots skipped because a client claimed them and never wrote them
+		UINT64 getSkippedCount() const;
+
+/*******************************************************************************
+		class InjectDaemon, private
+********************************************************************************/
+	private:
+		/* Private member functions */
+		// Writes the target titles into the shared header for InjectClient::findTarget
+		void publishTargets();
+
+		/* Private member variables */
+		std::wstring m_name;
+		InjectRing m_ring;
+		std::vector<PegasusWinterface*> m_targets;
+		// Reused between batches to avoid reallocating
+		std::vector<InjectEvent_t> m_batch;
+		std::vector<TimedEvent> m_groups;
+
+		UINT64 m_batches = 0;
+		UINT64 m_events = 0;
+		UINT64 m_rejected = 0;
+	};
+
+}
@@ -0,0 +1,122 @@
+/*
+
+InjectProtocol
+
+Fixed binary layout shared between the injection daemon and its clients
+
+*/
+
+#include "InjectProtocol.h"
+#include "InjectionPlan.h"
+
+#include <iostream>
+
+namespace pi = pinterface;
+using namespace pi;
+using std::cerr;
+using std::endl;
+
+void pi::EncodeInjectEvents(UINT16 target, std::vector<TimedEvent>& evts, SubmitPriority priority, std::vector<InjectEvent_t>& out) {
+	for (TimedEvent& evt : evts) {
+		// A compiled step goes over as the group it was compiled from, the records only hold for this machine's layout
+		std::optional<TimedEvent> source;
+		if (evt.kind() == TimedEvent::Kind::TEVT_PLANNED)
+			source = evt.planned().plan->getSourceGroup(evt.planned().step);
+		TimedEvent& group = source ? *source : evt;
+		size_t start = out.size();
+		if (group.kind() == TimedEvent::Kind::TEVT_KEY) {
+			for (KeyEvent& evt : group.key().getEvents()) {
+				InjectEvent_t e = {};
+				e.kind = INJECT_KIND_KEY;
+				e.type = (UINT8)evt.type();
+				e.flags = (evt.scanCode() ? INJECT_FLAG_SCAN_CODE : 0) | (evt.isExtended() ? INJECT_FLAG_EXTENDED : 0);
+				e.code = evt.vKey();
+				out.push_back(e);
+			}
+		}
+		else {
+			for (MouseEvent& evt : group.mouse().getEvents()) {
+				InjectEvent_t e = {};
+				e.kind = INJECT_KIND_MOUSE;
+				e.type = (UINT8)evt.type();
+				e.code = (UINT16)evt.key();
+				e.dx = evt.dx();
+				e.dy = evt.dy();
+				e.scrollDelta = evt.scrollDelta();
+				out.push_back(e);
+			}
+		}
+
+		if (out.size() == start) {
+			// An empty group still carries its delay, so send it as an event that produces no input
+			InjectEvent_t e = {};
+			e.kind = group.kind() == TimedEvent::Kind::TEVT_KEY ? INJECT_KIND_KEY : INJECT_KIND_MOUSE;
+			e.type = 0; // KEVT_NONE or MEVT_NONE
+			out.push_back(e);
+		}
+		out[start].flags |= INJECT_FLAG_GROUP_START;
+		out[start].delayMs = group.delayBefore();
+	}
+
+	for (InjectEvent_t& e : out) {
+		e.target = target;
+		e.priority = (UINT8)priority;
+	}
+}
+
+bool pi::DecodeInjectEvents(const InjectEvent_t* evts, UINT32 count, std::vector<TimedEvent>& out) {
+	std::vector<KeyEvent> keys;
+	std::vector<MouseEvent> mouse;
+	int delay = 0;
+	bool open = false;
+	UINT8 kind = INJECT_KIND_KEY;
+
+	auto close = [&]() {
+		if (!open)
+			return;
+		if (kind == INJECT_KIND_KEY)
+			out.push_back(TimedKeyEvent(keys, delay));
+		else
+			out.push_back(TimedMouseEvent(mouse, delay));
+		keys.clear();
+		mouse.clear();
+	};
+
+	for (UINT32 i = 0; i < count; i++) {
+		const InjectEvent_t& e = evts[i];
+		if (e.flags & INJECT_FLAG_GROUP_START) {
+			close();
+			open = true;
+			kind = e.kind;
+			delay = e.delayMs;
+		}
+		else if (!open || e.kind != kind) {
+			cerr << "DecodeInjectEvents: event " << i << " does not belong to a group, dropping the batch" << endl;
+			return false;
+		}
+
+		if (e.kind == INJECT_KIND_KEY) {
+			if (e.type > (UINT8)KeyEvent::EventType::KEVT_RELEASED) {
+				cerr << "DecodeInjectEvents: bad key event type " << (int)e.type << ", dropping the batch" << endl;
+				return false;
+			}
+			keys.push_back(KeyEvent(e.code, (KeyEvent::EventType)e.type, (e.flags & INJECT_FLAG_SCAN_CODE) != 0, (e.flags & INJECT_FLAG_EXTENDED) != 0));
+		}
+		else if (e.kind == INJECT_KIND_MOUSE) {
+			if (e.type > (UINT8)MouseEvent::EventType::MEVT_KEY_UP || e.code > (UINT16)MouseEvent::MouseKey::MKEY_MID) {
+				cerr << "DecodeInjectEvents: bad mouse event type " << (int)e.type << ", dropping the batch" << endl;
+				return false;
+			}
+			MouseEvent evt((MouseEvent::EventType)e.type, (MouseEvent::MouseKey)e.code);
+			evt.setMoveValues(e.dx, e.dy);
+			evt.setScrollDelta(e.scrollDelta);
+			mouse.push_back(evt);
+		}
+		else {
+			cerr << "DecodeInjectEvents: unknown event kind " << (int)e.kind << ", dropping the batch" << endl;
+			return false;
+		}
+	}
+	close();
+	return true;
+}
@@ -0,0 +1,105 @@
+#pragma once
+/*
+
+InjectProtocol
+
+Fixed binary layout shared between the injection daemon and its clients. Everything here
+lives in a named shared memory section, so it must stay plain data (and lock-free atomics)
+with the same layout in every process. Bump INJECT_PROTOCOL_VERSION on any change
+
+*/
+
+#include <Windows.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "TimedEvents.h"
+#include "SubmissionQueue.h"
+
+namespace pinterface {
+
+	constexpr UINT32 INJECT_PROTOCOL_MAGIC = 0x4A4E4950; // "PINJ"
+	constexpr UINT32 INJECT_PROTOCOL_VERSION = 2;
+	// Must be a power of two
+	constexpr UINT32 INJECT_RING_SLOTS = 4096;
+	// Largest batch a client may submit at once
+	constexpr UINT32 INJECT_MAX_BATCH = 256;
+	// Time the daemon waits on slots that were claimed but never written before skipping them, in ms. Long enough for a
+	// client that was only preempted, a client that died mid push would otherwise hold up everything behind it for good
+	constexpr UINT32 INJECT_STALL_TIMEOUT_MS = 500;
+	constexpr UINT32 INJECT_MAX_TARGETS = 16;
+	constexpr UINT32 INJECT_TITLE_LENGTH = 128;
+	// Name of the shared memory section, the doorbell event is the same name with ".doorbell" on the end
+	constexpr const wchar_t* INJECT_DEFAULT_NAME = L"Local\\PegasusInject";
+
+	// Values of InjectEvent::kind
+	constexpr UINT8 INJECT_KIND_KEY = 0;
+	constexpr UINT8 INJECT_KIND_MOUSE = 1;
+	// Bits of InjectEvent::flags
+	constexpr UINT8 INJECT_FLAG_GROUP_START = 0x01; // First event of a group, the group's delay is read from it
+	constexpr UINT8 INJECT_FLAG_SCAN_CODE = 0x02;
+	constexpr UINT8 INJECT_FLAG_EXTENDED = 0x04;
+
+	static_assert(std::atomic<UINT64>::is_always_lock_free && std::atomic<UINT32>::is_always_lock_free,
+		"Shared memory atomics must be lock-free to work across processes");
+
+/*******************************************************************************
+		struct InjectEvent
+********************************************************************************/
+	// One key or mouse event as written into the ring
+	typedef struct InjectEvent {
+		UINT8 kind; // INJECT_KIND_
+		UINT8 type; // KeyEvent::EventType or MouseEvent::EventType
+		UINT8 flags; // INJECT_FLAG_
+		UINT8 priority; // SubmitPriority of the batch, read from the first event
+		UINT16 target; // Index into the daemon's target table, read from the first event
+		UINT16 code; // Virtual key, or MouseEvent::MouseKey
+		INT32 delayMs; // Delay before the group, on INJECT_FLAG_GROUP_START events
+		INT32 dx;
+		INT32 dy;
+		UINT32 scrollDelta;
+		UINT32 batchCount; // Number of events in the batch, filled in on the first event by the ring
+		UINT32 reserved;
+	} InjectEvent_t;
+	static_assert(sizeof(InjectEvent_t) == 32, "InjectEvent_t is part of the shared memory layout");
+
+/*******************************************************************************
+		struct InjectSlot
+********************************************************************************/
+	// A ring slot is a whole cache line so producers writing neighbouring slots don't contend
+	typedef struct alignas(64) InjectSlot {
+		// Equal to the position when free for it, position + 1 once written (Vyukov's bounded queue). A slot the daemon
+		// skipped is moved on to the next lap, so the client that claimed it can't publish it any more
+		std::atomic<UINT64> sequence;
+		InjectEvent_t event;
+	} InjectSlot_t;
+	static_assert(sizeof(InjectSlot_t) == 64, "InjectSlot_t is part of the shared memory layout");
+
+/*******************************************************************************
+		struct InjectHeader
+********************************************************************************/
+	typedef struct alignas(64) InjectHeader {
+		UINT32 magic;
+		UINT32 version;
+		UINT32 slotCount;
+		UINT32 targetCount;
+		WCHAR targetTitles[INJECT_MAX_TARGETS][INJECT_TITLE_LENGTH];
+
+		// Claimed by producers with a compare exchange
+		alignas(64) std::atomic<UINT64> enqueuePos;
+		// Only written by the daemon
+		alignas(64) std::atomic<UINT64> dequeuePos;
+		// Set by the daemon before waiting on the doorbell, so clients only pay for signalling it when it is asleep
+		alignas(64) std::atomic<UINT32> daemonSleeping;
+		// Cleared by the daemon as it stops. A client can keep the section mapped after that, so pushes check it
+		std::atomic<UINT32> daemonAlive;
+	} InjectHeader_t;
+
+	// Turns groups of events into ring events for one batch, appending to out
+	void EncodeInjectEvents(UINT16 target, std::vector<TimedEvent>& evts, SubmitPriority priority, std::vector<InjectEvent_t>& out);
+	// Turns the events of a batch back into groups. Returns false if the batch is malformed
+	bool DecodeInjectEvents(const InjectEvent_t* evts, UINT32 count, std::vector<TimedEvent>& out);
+
+}
@@ -0,0 +1,318 @@
+/*
+
+InjectRing
+
+Bounded multi-producer single-consumer ring of InjectEvents in named shared memory
+
+*/
+
+#include "InjectRing.h"
+
+#include <algorithm>
+#include <iostream>
+#include <new>
+
+namespace pi = pinterface;
+using namespace pi;
+using std::wcerr;
+using std::cerr;
+using std::endl;
+
+namespace {
+	DWORD SectionSize() {
+		return (DWORD)(sizeof(InjectHeader_t) + sizeof(InjectSlot_t) * INJECT_RING_SLOTS);
+	}
+
+	std::wstring DoorbellName(const std::wstring& name) {
+		return name + L".doorbell";
+	}
+}
+
+/*******************************************************************************
+		class InjectRing, public
+********************************************************************************/
+
+InjectRing::InjectRing() {
+}
+
+InjectRing::~InjectRing() {
+	close();
+}
+
+bool InjectRing::create(const std::wstring& name) {
+	close();
+
+	m_mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, SectionSize(), name.c_str());
+	if (m_mapping == NULL) {
+		wcerr << "InjectRing: unable to create section '" << name << "' (error " << GetLastError() << ")" << endl;
+		return false;
+	}
+	if (GetLastError() == ERROR_ALREADY_EXISTS) {
+		wcerr << "InjectRing: section '" << name << "' already exists, is another daemon running?" << endl;
+		close();
+		return false;
+	}
+
+	void* view = MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, SectionSize());
+	if (view == nullptr) {
+		wcerr << "InjectRing: unable to map section '" << name << "' (error " << GetLastError() << ")" << endl;
+		close();
+		return false;
+	}
+
+	// A new section is zero filled. Construct the atomics in place, then publish the header last via the magic
+	m_header = new (view) InjectHeader_t();
+	m_slots = reinterpret_cast<InjectSlot_t*>(reinterpret_cast<char*>(view) + sizeof(InjectHeader_t));
+	for (UINT32 i = 0; i < INJECT_RING_SLOTS; i++) {
+		InjectSlot_t* s = new (&m_slots[i]) InjectSlot_t();
+		s->sequence.store(i, std::memory_order_relaxed);
+	}
+	m_mask = INJECT_RING_SLOTS - 1;
+	m_dequeuePos = 0;
+	m_stalled = false;
+	m_skipped = 0;
+	m_header->slotCount = INJECT_RING_SLOTS;
+	m_header->version = INJECT_PROTOCOL_VERSION;
+	m_header->enqueuePos.store(0, std::memory_order_relaxed);
+	m_header->dequeuePos.store(0, std::memory_order_relaxed);
+	m_header->daemonSleeping.store(0, std::memory_order_relaxed);
+	m_header->daemonAlive.store(1, std::memory_order_release);
+	std::atomic_thread_fence(std::memory_order_release);
+	m_header->magic = INJECT_PROTOCOL_MAGIC;
+
+	// Auto reset, so each ring wakes the daemon once
+	m_doorbell = CreateEventW(NULL, FALSE, FALSE, DoorbellName(name).c_str());
+	if (m_doorbell == NULL) {
+		wcerr << "InjectRing: unable to create the doorbell for '" << name << "' (error " << GetLastError() << ")" << endl;
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool InjectRing::open(const std::wstring& name) {
+	close();
+
+	m_mapping = OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+	if (m_mapping == NULL) {
+		wcerr << "InjectRing: no daemon section '" << name << "' (error " << GetLastError() << ")" << endl;
+		return false;
+	}
+	void* view = MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, SectionSize());
+	if (view == nullptr) {
+		wcerr << "InjectRing: unable to map section '" << name << "' (error " << GetLastError() << ")" << endl;
+		close();
+		return false;
+	}
+
+	m_header = reinterpret_cast<InjectHeader_t*>(view);
+	if (m_header->magic != INJECT_PROTOCOL_MAGIC || m_header->version != INJECT_PROTOCOL_VERSION || m_header->slotCount != INJECT_RING_SLOTS) {
+		wcerr << "InjectRing: section '" << name << "' is not a compatible daemon (version " << m_header->version << ")" << endl;
+		close();
+		return false;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	// Another client can keep the section of a daemon that has stopped
+	if (m_header->daemonAlive.load(std::memory_order_acquire) == 0) {
+		wcerr << "InjectRing: the daemon of '" << name << "' has stopped" << endl;
+		close();
+		return false;
+	}
+	m_slots = reinterpret_cast<InjectSlot_t*>(reinterpret_cast<char*>(view) + sizeof(InjectHeader_t));
+	m_mask = INJECT_RING_SLOTS - 1;
+
+	m_doorbell = OpenEventW(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE, DoorbellName(name).c_str());
+	if (m_doorbell == NULL) {
+		wcerr << "InjectRing: unable to open the doorbell for '" << name << "' (error " << GetLastError() << ")" << endl;
+		close();
+		return false;
+	}
+	return true;
+}
+
+void InjectRing::close() {
+	if (m_header != nullptr) {
+		UnmapViewOfFile(m_header);
+		m_header = nullptr;
+		m_slots = nullptr;
+	}
+	if (m_mapping != NULL) {
+		CloseHandle(m_mapping);
+		m_mapping = NULL;
+	}
+	if (m_doorbell != NULL) {
+		CloseHandle(m_doorbell);
+		m_doorbell = NULL;
+	}
+}
+
+bool InjectRing::isOpen() const {
+	return m_header != nullptr;
+}
+
+bool InjectRing::isDaemonAlive() const {
+	return m_header != nullptr && m_header->daemonAlive.load(std::memory_order_acquire) != 0;
+}
+
+bool InjectRing::push(const InjectEvent_t* evts, UINT32 count) {
+	if (m_header == nullptr || count == 0 || count > INJECT_MAX_BATCH)
+		return false;
+	// Nobody would ever pop it
+	if (m_header->daemonAlive.load(std::memory_order_acquire) == 0)
+		return false;
+
+	// Claim count consecutive positions. The daemon frees slots in order, so if the last one is free they all are
+	UINT64 pos = m_header->enqueuePos.load(std::memory_order_relaxed);
+	while (true) {
+		UINT64 last = pos + count - 1;
+		UINT64 seq = slot(last).sequence.load(std::memory_order_acquire);
+		INT64 diff = (INT64)(seq - last);
+		if (diff == 0) {
+			if (m_header->enqueuePos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0) {
+			return false; // Full
+		}
+		else {
+			pos = m_header->enqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	for (UINT32 i = 0; i < count; i++) {
+		InjectSlot_t& s = slot(pos + i);
+		// The daemon skips slots left unwritten too long and moves them on to the next lap. Past that they are someone
+		// else's, so the rest of the batch is given up rather than written over them
+		UINT64 expected = pos + i;
+		if (s.sequence.load(std::memory_order_relaxed) != expected)
+			return false;
+		s.event = evts[i];
+		s.event.batchCount = (i == 0) ? count : 0;
+		if (!s.sequence.compare_exchange_strong(expected, pos + i + 1, std::memory_order_release, std::memory_order_relaxed))
+			return false;
+	}
+
+	// Pairs with prepareToSleep(): either the daemon sees this batch before sleeping, or we see it asleep
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_header->daemonSleeping.load(std::memory_order_relaxed) != 0 && m_header->daemonSleeping.exchange(0, std::memory_order_acq_rel) != 0)
+		SetEvent(m_doorbell);
+	return true;
+}
+
+UINT32 InjectRing::pop(std::vector<InjectEvent_t>& out) {
+	if (m_header == nullptr)
+		return 0;
+
+	InjectSlot_t& first = slot(m_dequeuePos);
+	if (first.sequence.load(std::memory_order_acquire) != m_dequeuePos + 1) {
+		skipStalled(0);
+		return 0;
+	}
+
+	UINT32 count = first.event.batchCount;
+	if (count == 0 || count > INJECT_MAX_BATCH) {
+		// Not the start of a batch. Only a misbehaving client can cause this, so skip the slot to recover
+		cerr << "InjectRing: slot " << m_dequeuePos << " has a bad batch size " << count << ", skipping it" << endl;
+		first.sequence.store(m_dequeuePos + INJECT_RING_SLOTS, std::memory_order_release);
+		m_dequeuePos++;
+		m_header->dequeuePos.store(m_dequeuePos, std::memory_order_release);
+		return 0;
+	}
+
+	// The producer writes its slots in order, so the last one being written means they all are
+	UINT64 last = m_dequeuePos + count - 1;
+	if (slot(last).sequence.load(std::memory_order_acquire) != last + 1) {
+		skipStalled(count);
+		return 0;
+	}
+
+	m_stalled = false;
+	for (UINT32 i = 0; i < count; i++) {
+		InjectSlot_t& s = slot(m_dequeuePos + i);
+		out.push_back(s.event);
+		s.sequence.store(m_dequeuePos + i + INJECT_RING_SLOTS, std::memory_order_release);
+	}
+	m_dequeuePos += count;
+	m_header->dequeuePos.store(m_dequeuePos, std::memory_order_release);
+	return count;
+}
+
+UINT64 InjectRing::getSkippedCount() const {
+	return m_skipped;
+}
+
+bool InjectRing::hasPending() const {
+	return m_header != nullptr && m_header->enqueuePos.load(std::memory_order_acquire) != m_dequeuePos;
+}
+
+bool InjectRing::prepareToSleep() {
+	m_header->daemonSleeping.store(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (hasPending()) {
+		m_header->daemonSleeping.store(0, std::memory_order_relaxed);
+		return false;
+	}
+	return true;
+}
+
+void InjectRing::wake() {
+	m_header->daemonSleeping.store(0, std::memory_order_relaxed);
+}
+
+HANDLE InjectRing::getDoorbell() const {
+	return m_doorbell;
+}
+
+InjectHeader_t* InjectRing::getHeader() {
+	return m_header;
+}
+
+/*******************************************************************************
+		class InjectRing, private
+********************************************************************************/
+
+InjectSlot_t& InjectRing::slot(UINT64 pos) {
+	return m_slots[pos & m_mask];
+}
+
+void InjectRing::skipStalled(UINT32 count) {
+	if (!hasPending()) {
+		m_stalled = false;
+		return;
+	}
+
+	ULONGLONG now = GetTickCount64();
+	if (!m_stalled || m_stallPos != m_dequeuePos) {
+		m_stalled = true;
+		m_stallPos = m_dequeuePos;
+		m_stallSince = now;
+		return;
+	}
+	if (now - m_stallSince < INJECT_STALL_TIMEOUT_MS)
+		return;
+
+	// A batch with its first slot written says how far it goes. Otherwise the size is unknown, so every claimed slot up to
+	// the next written one goes, which is where the next batch starts
+	UINT64 from = m_dequeuePos;
+	UINT64 end = m_header->enqueuePos.load(std::memory_order_acquire);
+	if (count > 0)
+		end = std::min(end, m_dequeuePos + count);
+	while (m_dequeuePos < end) {
+		// Moved into the next lap, so a client still writing the batch sees it and gives up
+		InjectSlot_t& s = slot(m_dequeuePos);
+		if (count == 0) {
+			UINT64 expected = m_dequeuePos;
+			if (!s.sequence.compare_exchange_strong(expected, m_dequeuePos + INJECT_RING_SLOTS, std::memory_order_acq_rel))
+				break; // Written, the start of the next batch
+		}
+		else {
+			s.sequence.store(m_dequeuePos + INJECT_RING_SLOTS, std::memory_order_release);
+		}
+		m_dequeuePos++;
+	}
+	m_header->dequeuePos.store(m_dequeuePos, std::memory_order_release);
+	m_skipped += m_dequeuePos - from;
+	m_stalled = false;
+	cerr << "InjectRing: slots " << from << " to " << m_dequeuePos << " were claimed but not written for " << (now - m_stallSince)
+		<< " ms, skipping them" << endl;
+}
@@ -0,0 +1,86 @@
+#pragma once
+/*
+
+InjectRing
+
+Bounded multi-producer single-consumer ring of InjectEvents in named shared memory, with an
+event as the doorbell. Clients in any number of processes push whole batches without
+locks or system calls, the daemon pops them in the order they were claimed
+
+*/
+
+#include <Windows.h>
+
+#include <string>
+#include <vector>
+
+#include "InjectProtocol.h"
+
+namespace pinterface {
+
+	class InjectRing {
+/*******************************************************************************
+		class InjectRing, public
+********************************************************************************/
+	public:
+		InjectRing();
+		~InjectRing();
+		InjectRing(const InjectRing&) = delete;
+		InjectRing& operator=(const InjectRing&) = delete;
+
+		// Daemon side. Creates the section and the doorbell. Fails if another daemon already owns the name
+		bool create(const std::wstring& name);
+		// Client side. Opens the section of a running daemon
+		bool open(const std::wstring& name);
+		void close();
+		bool isOpen() const;
+		// Client side. False once the daemon has stopped, though the section stays mapped until the client closes it
+		bool isDaemonAlive() const;
+
+		// Client side, safe from any thread of any process. Writes the batch into consecutive slots and rings the doorbell
+		// if the daemon is asleep. Returns false without waiting if the daemon has stopped, if the ring does not have room for
+		// the whole batch, or if the daemon skipped the slots because writing them took longer than INJECT_STALL_TIMEOUT_MS
+		bool push(const InjectEvent_t* evts, UINT32 count);
+		// Daemon side. Appends the next complete batch to out and frees its slots. Returns the number of events popped, 0
+		// if no batch has been fully written yet. Slots left unwritten for INJECT_STALL_TIMEOUT_MS are skipped
+		UINT32 pop(std::vector<InjectEvent_t>& out);
+		// Daemon side. Slots skipped because the client that claimed them never finished writing them
+		UINT64 getSkippedCount() const;
+		// Daemon side. True if a batch has at least been claimed
+		bool hasPending() const;
+
+		// Daemon side. Marks the daemon asleep, after which a push rings the doorbell. Returns false (and stays awake) if
+		// something was pushed in the meantime, so the caller doesn't sleep on it
+		bool prepareToSleep();
+		void wake();
+		// Signalled when a client pushes while the daemon is asleep
+		HANDLE getDoorbell() const;
+
+		InjectHeader_t* getHeader();
+
+/*******************************************************************************
+		class InjectRing, private
+********************************************************************************/
+	private:
+		/* Private member functions */
+		InjectSlot_t& slot(UINT64 pos);
+		// Called while the head is claimed but not fully written. Times the stall and skips the unwritten slots once it
+		// has gone on too long. count is the size of the batch at the head, 0 if its first slot isn't written
+		void skipStalled(UINT32 count);
+
+		/* Private member variables */
+		HANDLE m_mapping = NULL;
+		HANDLE m_doorbell = NULL;
+		InjectHeader_t* m_header = nullptr;
+		InjectSlot_t* m_slots = nullptr;
+		UINT64 m_mask = 0;
+		// Daemon side copy of the dequeue position
+		UINT64 m_dequeuePos = 0;
+		// Position the head has been stuck at since m_stallSince (GetTickCount64), if m_stalled
+		bool m_stalled = false;
+		UINT64 m_stallPos = 0;
+		ULONGLONG m_stallSince = 0;
+		UINT64 m_skipped = 0;
+	};
+
+}
@@ -0,0 +1,261 @@
+/*
+
+InjectionPlan
+
+Key and mouse groups compiled once into INPUT records, and the cache that shares them
+
+*/
+
+#include "InjectionPlan.h"
+#include "InputBuilder.h"
+
+#include <algorithm>
+
+namespace pi = pinterface;
+using namespace pi;
+
+static const UINT64 FNV_OFFSET = 14695981039346656037ull;
+static const UINT64 FNV_PRIME = 1099511628211ull;
+
+static void HashValue(UINT64& hash, UINT64 value) {
+	for (int i = 0; i < 8; i++) {
+		hash ^= (value >> (i * 8)) & 0xFF;
+		hash *= FNV_PRIME;
+	}
+}
+
+// Compares everything Hash covers, so two sequences that hash the same can be told apart
+static bool SameGroup(TimedEvent& a, TimedEvent& b) {
+	if (a.kind() != b.kind() || a.delayBefore() != b.delayBefore())
+		return false;
+	switch (a.kind()) {
+	case TimedEvent::Kind::TEVT_KEY: {
+		std::vector<KeyEvent>& x = a.key().getEvents();
+		std::vector<KeyEvent>& y = b.key().getEvents();
+		if (x.size() != y.size())
+			return false;
+		for (size_t i = 0; i < x.size(); i++) {
+			if (x[i].vKey() != y[i].vKey() || x[i].type() != y[i].type() || x[i].scanCode() != y[i].scanCode() || x[i].isExtended() != y[i].isExtended())
+				return false;
+		}
+		return true;
+	}
+	case TimedEvent::Kind::TEVT_MOUSE: {
+		std::vector<MouseEvent>& x = a.mouse().getEvents();
+		std::vector<MouseEvent>& y = b.mouse().getEvents();
+		if (x.size() != y.size())
+			return false;
+		for (size_t i = 0; i < x.size(); i++) {
+			if (x[i].type() != y[i].type() || x[i].key() != y[i].key() || x[i].dx() != y[i].dx() || x[i].dy() != y[i].dy() || x[i].scrollDelta() != y[i].scrollDelta())
+				return false;
+		}
+		return true;
+	}
+	case TimedEvent::Kind::TEVT_PLANNED:
+		return a.planned().plan == b.planned().plan && a.planned().step == b.planned().step;
+	}
+	return false;
+}
+
+/*******************************************************************************
+		class InjectionPlan, private
+********************************************************************************/
+
+InjectionPlan::InjectionPlan() {
+
+}
+
+/*******************************************************************************
+		class InjectionPlan, public
+********************************************************************************/
+/* Public static functions */
+std::shared_ptr<const InjectionPlan> InjectionPlan::Compile(std::vector<TimedEvent> evts) {
+	std::shared_ptr<InjectionPlan> plan(new InjectionPlan());
+	plan->m_layout = CurrentLayout();
+	plan->m_hash = Hash(evts);
+	plan->m_steps.reserve(evts.size());
+
+	INT64 offset = 0;
+	for (auto& evt : evts) {
+		PlanStep_t step;
+		offset += (INT64)evt.delayBefore() * 1000;
+		step.offsetUs = offset;
+		step.delayBefore = evt.delayBefore();
+		step.first = (UINT32)plan->m_records.size();
+		step.count = (UINT32)InputBuilder<NoLog>::BuildGroup(evt, plan->m_records);
+		plan->m_steps.push_back(step);
+	}
+	plan->m_records.shrink_to_fit();
+	plan->m_source = std::move(evts);
+	return plan;
+}
+
+UINT64 InjectionPlan::Hash(std::vector<TimedEvent>& evts) {
+	UINT64 hash = FNV_OFFSET;
+	HashValue(hash, evts.size());
+	for (auto& evt : evts) {
+		HashValue(hash, (UINT64)evt.kind());
+		HashValue(hash, (UINT64)evt.delayBefore());
+		switch (evt.kind()) {
+		case TimedEvent::Kind::TEVT_KEY:
+			HashValue(hash, evt.key().getEvents().size());
+			for (auto& key : evt.key().getEvents()) {
+				HashValue(hash, key.vKey());
+				HashValue(hash, (UINT64)key.type() | (key.scanCode() ? 0x100 : 0) | (key.isExtended() ? 0x200 : 0));
+			}
+			break;
+		case TimedEvent::Kind::TEVT_MOUSE:
+			HashValue(hash, evt.mouse().getEvents().size());
+			for (auto& mouse : evt.mouse().getEvents()) {
+				HashValue(hash, (UINT64)mouse.type() | ((UINT64)mouse.key() << 8));
+				HashValue(hash, ((UINT64)(UINT32)mouse.dx() << 32) | (UINT32)mouse.dy());
+				HashValue(hash, mouse.scrollDelta());
+			}
+			break;
+		case TimedEvent::Kind::TEVT_PLANNED:
+			HashValue(hash, evt.planned().plan->getHash());
+			HashValue(hash, evt.planned().step);
+			break;
+		}
+	}
+	return hash;
+}
+
+HKL InjectionPlan::CurrentLayout() {
+	return GetKeyboardLayout(0);
+}
+
+/* Public member functions */
+size_t InjectionPlan::getStepCount() const {
+	return m_steps.size();
+}
+
+const PlanStep_t& InjectionPlan::getStep(size_t step) const {
+	return m_steps[step];
+}
+
+size_t InjectionPlan::getRecordCount() const {
+	return m_records.size();
+}
+
+INT64 InjectionPlan::getDuration() const {
+	return m_steps.empty() ? 0 : m_steps.back().offsetUs;
+}
+
+UINT64 InjectionPlan::getHash() const {
+	return m_hash;
+}
+
+HKL InjectionPlan::getLayout() const {
+	return m_layout;
+}
+
+bool InjectionPlan::isCurrent() const {
+	return m_layout == CurrentLayout();
+}
+
+int InjectionPlan::appendInputs(size_t step, std::vector<INPUT>& inputs) const {
+	const PlanStep_t& s = m_steps[step];
+	inputs.insert(inputs.end(), m_records.begin() + s.first, m_records.begin() + s.first + s.count);
+	return (int)s.count;
+}
+
+TimedEvent InjectionPlan::getSourceGroup(size_t step) const {
+	return m_source[step];
+}
+
+const std::vector<TimedEvent>& InjectionPlan::getSource() const {
+	return m_source;
+}
+
+bool InjectionPlan::matches(std::vector<TimedEvent>& evts) const {
+	// The accessors of TimedEvent aren't const, nothing of the source is changed
+	std::vector<TimedEvent>& source = const_cast<std::vector<TimedEvent>&>(m_source);
+	if (source.size() != evts.size())
+		return false;
+	for (size_t i = 0; i < evts.size(); i++) {
+		if (!SameGroup(source[i], evts[i]))
+			return false;
+	}
+	return true;
+}
+
+/*******************************************************************************
+		class InjectionPlanCache, public
+********************************************************************************/
+
+InjectionPlanCache::InjectionPlanCache(size_t capacity) : m_capacity(std::max<size_t>(1, capacity)) {
+
+}
+
+std::shared_ptr<const InjectionPlan> InjectionPlanCache::get(std::vector<TimedEvent> evts) {
+	UINT64 hash = InjectionPlan::Hash(evts);
+	HKL layout = InjectionPlan::CurrentLayout();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (layout != m_layout) {
+			// Every scan code in the cache may now be wrong
+			if (!m_plans.empty())
+				m_invalidations++;
+			m_plans.clear();
+			m_recent.clear();
+			m_layout = layout;
+		}
+
+		// A hash only says the groups are probably the same, a different sequence that happens to share it gets its own plan
+		auto found = m_plans.find(hash);
+		if (found != m_plans.end() && (*found->second)->matches(evts)) {
+			m_recent.splice(m_recent.begin(), m_recent, found->second);
+			m_hits++;
+			return *found->second;
+		}
+		m_misses++;
+	}
+
+	// Compiled without the lock, another thread may get there first, which only costs the work
+	std::shared_ptr<const InjectionPlan> plan = InjectionPlan::Compile(std::move(evts));
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (plan->getLayout() != m_layout || m_plans.count(hash) > 0)
+		return plan;
+	m_recent.push_front(plan);
+	m_plans[hash] = m_recent.begin();
+	while (m_plans.size() > m_capacity) {
+		m_plans.erase(m_recent.back()->getHash());
+		m_recent.pop_back();
+	}
+	return plan;
+}
+
+void InjectionPlanCache::clear() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_plans.clear();
+	m_recent.clear();
+}
+
+size_t InjectionPlanCache::size() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_plans.size();
+}
+
+UINT64 InjectionPlanCache::getHits() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_hits;
+}
+
+UINT64 InjectionPlanCache::getMisses() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_misses;
+}
+
+UINT64 InjectionPlanCache::getInvalidations() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_invalidations;
+}
+
+/* Public static functions */
+InjectionPlanCache& InjectionPlanCache::Shared() {
+	static InjectionPlanCache cache;
+	return cache;
+}
@@ -0,0 +1,136 @@
+#pragma once
+/*
+
+InjectionPlan
+
+A sequence of key and mouse groups compiled once into the INPUT records SendInput takes,
+with each group's deadline relative to the start. Replaying a plan skips building the
+groups, the scan code lookups and the record building, so a macro that is played over and
+over only pays for them the first time:
+
+	std::shared_ptr<const pi::InjectionPlan> plan = pi::InjectionPlanCache::Shared().get(macro);
+	app.executePlan(plan);
+
+Scan codes depend on the keyboard layout, so a plan is only good for the layout it was
+compiled under. The cache starts over when the layout changes, and the interface compiles a
+stale plan again before playing it
+
+*/
+
+#include <Windows.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "TimedEvents.h"
+
+namespace pinterface {
+
+/*******************************************************************************
+		struct PlanStep
+********************************************************************************/
+	typedef struct PlanStep {
+		// Deadline relative to the start of the plan, in microseconds
+		INT64 offsetUs;
+		// Delay before the step as it was given, in ms
+		int delayBefore;
+		// Records of the step, a range of the plan's records
+		UINT32 first;
+		UINT32 count;
+	} PlanStep_t;
+
+	class InjectionPlan {
+/*******************************************************************************
+		class InjectionPlan, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		std::vector<INPUT> m_records;
+		std::vector<PlanStep_t> m_steps;
+		// Kept to compile again under a different layout, and for clients that send the groups elsewhere
+		std::vector<TimedEvent> m_source;
+		HKL m_layout = NULL;
+		UINT64 m_hash = 0;
+
+		InjectionPlan();
+
+/*******************************************************************************
+		class InjectionPlan, public
+********************************************************************************/
+	public:
+		/* Public static functions */
+		// Translates the groups under the current keyboard layout
+		static std::shared_ptr<const InjectionPlan> Compile(std::vector<TimedEvent> evts);
+		// 64-bit FNV-1a of everything that affects the records and timing of the groups
+		static UINT64 Hash(std::vector<TimedEvent>& evts);
+		// Layout scan codes are looked up in, that of the calling thread
+		static HKL CurrentLayout();
+
+		/* Public member functions */
+		size_t getStepCount() const;
+		const PlanStep_t& getStep(size_t step) const;
+		size_t getRecordCount() const;
+		// Deadline of the last step relative to the start
+		INT64 getDuration() const;
+		UINT64 getHash() const;
+		HKL getLayout() const;
+		// True if the plan was compiled under the layout in use now
+		bool isCurrent() const;
+		// Appends the records of a step to a batch. Returns the number added
+		int appendInputs(size_t step, std::vector<INPUT>& inputs) const;
+		// The group a step was compiled from
+		TimedEvent getSourceGroup(size_t step) const;
+		const std::vector<TimedEvent>& getSource() const;
+		// True if the plan was compiled from exactly these groups
+		bool matches(std::vector<TimedEvent>& evts) const;
+	};
+
+	// Compiled plans by content, shared between every interface that plays the same groups. Safe to use from any thread
+	class InjectionPlanCache {
+/*******************************************************************************
+		class InjectionPlanCache, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		std::mutex m_mutex;
+		size_t m_capacity;
+		HKL m_layout = NULL;
+		// Most recently used first
+		std::list<std::shared_ptr<const InjectionPlan>> m_recent;
+		std::unordered_map<UINT64, std::list<std::shared_ptr<const InjectionPlan>>::iterator> m_plans;
+		UINT64 m_hits = 0;
+		UINT64 m_misses = 0;
+		UINT64 m_invalidations = 0;
+
+/*******************************************************************************
+		class InjectionPlanCache, public
+********************************************************************************/
+	public:
+		/* Public static variables */
+		static constexpr size_t DEFAULT_CAPACITY = 256;
+
+		// Holds up to capacity plans, dropping the least recently used beyond that
+		InjectionPlanCache(size_t capacity = DEFAULT_CAPACITY);
+		InjectionPlanCache(const InjectionPlanCache&) = delete;
+		InjectionPlanCache& operator=(const InjectionPlanCache&) = delete;
+
+		/* Public member functions */
+		// The plan for the groups, compiled the first time they are seen. Everything is dropped if the keyboard layout
+		// has changed since the last call
+		std::shared_ptr<const InjectionPlan> get(std::vector<TimedEvent> evts);
+		void clear();
+		size_t size();
+		UINT64 getHits();
+		UINT64 getMisses();
+		// Times the cache was dropped for a change of layout
+		UINT64 getInvalidations();
+
+		/* Public static functions */
+		// Cache shared by the whole process
+		static InjectionPlanCache& Shared();
+	};
+
+}
@@ -0,0 +1,135 @@
+/*
+
+InputBackend
+
+Where PegasusWinterface sends its INPUT records
+
+*/
+
+#include "InputBackend.h"
+#include "TitleMatcher.h"
+
+namespace pi = pinterface;
+using namespace pi;
+
+/*******************************************************************************
+		class WinInputBackend, public
+********************************************************************************/
+
+bool WinInputBackend::sendInputs(WinInfo_t& window, std::vector<INPUT>& inputs) {
+	return WinAssist::SendInputs(window, inputs);
+}
+
+TargetState WinInputBackend::probeTarget(WinInfo_t& window, UINT timeoutMs) {
+	// Checks the handle still belongs to the process, or finds the window the process has put in its place
+	HWND hwnd = WinAssist::GetWindowHWND(window);
+	if (hwnd == 0)
+		return TargetState::TGT_MISSING;
+	window.hwnd = hwnd;
+
+	// Marked hung by the system once it hasn't pumped messages for a few seconds. Costs nothing to ask
+	if (IsHungAppWindow(hwnd))
+		return TargetState::TGT_HUNG;
+	// Catches a window that is stuck but not yet marked hung, at the cost of waiting up to the timeout for it
+	DWORD_PTR result;
+	if (!SendMessageTimeoutW(hwnd, WM_NULL, 0, 0, SMTO_ABORTIFHUNG | SMTO_BLOCK, timeoutMs, &result))
+		return IsWindow(hwnd) ? TargetState::TGT_HUNG : TargetState::TGT_MISSING;
+	return TargetState::TGT_OK;
+}
+
+bool WinInputBackend::findTarget(WinInfo_t& window, const TitleMatcher* matcher) {
+	HWND hwnd = WinAssist::GetWindowHWND(window, true, matcher);
+	if (hwnd == 0)
+		return false;
+	window.hwnd = hwnd;
+	return true;
+}
+
+/*******************************************************************************
+		class RecordingBackend, public
+********************************************************************************/
+
+RecordingBackend::RecordingBackend(std::shared_ptr<ClockSource> clock) {
+	m_clock = clock;
+}
+
+bool RecordingBackend::sendInputs(WinInfo_t& window, std::vector<INPUT>& inputs) {
+	if (inputs.empty())
+		return true;
+
+	INT64 time = m_clock->now();
+	for (const INPUT& input : inputs) {
+		m_records.push_back({ time, m_batches, input });
+	}
+	m_batches++;
+	return true;
+}
+
+const std::vector<RecordedInput_t>& RecordingBackend::getRecords() const {
+	return m_records;
+}
+
+UINT64 RecordingBackend::getBatchCount() const {
+	return m_batches;
+}
+
+void RecordingBackend::clear() {
+	m_records.clear();
+	m_batches = 0;
+}
+
+
+/*******************************************************************************
+		class SimulatedTargetBackend, public
+********************************************************************************/
+
+SimulatedTargetBackend::SimulatedTargetBackend(std::shared_ptr<ClockSource> clock, const WinInfo_t& target) : RecordingBackend(clock) {
+	m_target = target;
+}
+
+bool SimulatedTargetBackend::sendInputs(WinInfo_t& window, std::vector<INPUT>& inputs) {
+	if (probeTarget(window, 0) != TargetState::TGT_OK) {
+		m_rejected++;
+		return false;
+	}
+	return RecordingBackend::sendInputs(window, inputs);
+}
+
+TargetState SimulatedTargetBackend::probeTarget(WinInfo_t& window, UINT timeoutMs) {
+	// A window that has been replaced is as gone as a closed one
+	if (m_state == TargetState::TGT_MISSING || window.hwnd != m_target.hwnd || window.pid != m_target.pid)
+		return TargetState::TGT_MISSING;
+	return m_state;
+}
+
+bool SimulatedTargetBackend::findTarget(WinInfo_t& window, const TitleMatcher* matcher) {
+	if (m_state == TargetState::TGT_MISSING)
+		return false;
+	if (matcher != nullptr ? !matcher->matches(m_target.title) : (window.pid != m_target.pid && window.tid != m_target.tid))
+		return false;
+	window = m_target;
+	return true;
+}
+
+void SimulatedTargetBackend::hang() {
+	if (m_state == TargetState::TGT_OK)
+		m_state = TargetState::TGT_HUNG;
+}
+
+void SimulatedTargetBackend::recover() {
+	if (m_state == TargetState::TGT_HUNG)
+		m_state = TargetState::TGT_OK;
+}
+
+void SimulatedTargetBackend::close() {
+	m_state = TargetState::TGT_MISSING;
+}
+
+void SimulatedTargetBackend::recreate(const WinInfo_t& target) {
+	m_target = target;
+	m_state = TargetState::TGT_OK;
+}
+
+UINT64 SimulatedTargetBackend::getRejectedCount() const {
+	return m_rejected;
+}
\ No newline at end of file
@@ -0,0 +1,126 @@
+#pragma once
+/*
+
+InputBackend
+
+Where PegasusWinterface sends its INPUT records. WinInputBackend injects them into the
+bound window, RecordingBackend keeps them with the time they were sent so the emitted
+timeline of a script can be checked exactly, and SimulatedTargetBackend adds a target that
+can hang, close and come back, for exercising the target watchdog
+
+*/
+
+#include <Windows.h>
+
+#include <memory>
+#include <vector>
+
+#include "WinAssist.h"
+#include "ClockSource.h"
+
+namespace pinterface {
+
+	// Health of a bound target window, as seen by the watchdog
+	enum class TargetState { TGT_OK, TGT_HUNG, TGT_MISSING };
+
+	class InputBackend {
+/*******************************************************************************
+		class InputBackend, public
+********************************************************************************/
+	public:
+		virtual ~InputBackend() = default;
+
+		// Sends the batch to the window as one injection. Returns false if any of it could not be sent
+		virtual bool sendInputs(WinInfo_t& window, std::vector<INPUT>& inputs) = 0;
+		// Checks the target is still there and answering, waiting at most timeoutMs for it. May update the handle in window if
+		// the same process has recreated it. Targets are taken to be healthy unless the backend knows better
+		virtual TargetState probeTarget(WinInfo_t& window, UINT timeoutMs) { return TargetState::TGT_OK; }
+		// Looks for a target that has gone missing, by the matcher if there is one, then by the window's pid and tid. Updates
+		// window and returns true if one was found
+		virtual bool findTarget(WinInfo_t& window, const TitleMatcher* matcher) { return true; }
+	};
+
+	class WinInputBackend : public InputBackend {
+/*******************************************************************************
+		class WinInputBackend, public
+********************************************************************************/
+	public:
+		bool sendInputs(WinInfo_t& window, std::vector<INPUT>& inputs) override;
+		// IsHungAppWindow, then a WM_NULL round trip with the timeout
+		TargetState probeTarget(WinInfo_t& window, UINT timeoutMs) override;
+		bool findTarget(WinInfo_t& window, const TitleMatcher* matcher) override;
+	};
+
+/*******************************************************************************
+		struct RecordedInput
+********************************************************************************/
+	typedef struct RecordedInput {
+		// Clock time the batch was sent, in microseconds
+		INT64 time;
+		// Index of the batch, records sent together share it
+		UINT64 batch;
+		INPUT input;
+	} RecordedInput_t;
+
+	class RecordingBackend : public InputBackend {
+/*******************************************************************************
+		class RecordingBackend, public
+********************************************************************************/
+	public:
+		// Times records with the clock given, which should be the one the interface uses
+		RecordingBackend(std::shared_ptr<ClockSource> clock);
+
+		// Records the batch, and nothing is sent to the window
+		bool sendInputs(WinInfo_t& window, std::vector<INPUT>& inputs) override;
+
+		const std::vector<RecordedInput_t>& getRecords() const;
+		UINT64 getBatchCount() const;
+		void clear();
+
+/*******************************************************************************
+		class RecordingBackend, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		std::shared_ptr<ClockSource> m_clock;
+		std::vector<RecordedInput_t> m_records;
+		UINT64 m_batches = 0;
+	};
+
+	// Records like RecordingBackend, to a made up target that can be hung, closed and recreated. Call everything from the
+	// thread ticking the interface
+	class SimulatedTargetBackend : public RecordingBackend {
+/*******************************************************************************
+		class SimulatedTargetBackend, public
+********************************************************************************/
+	public:
+		// The target starts out healthy. Bind the interface to the same window
+		SimulatedTargetBackend(std::shared_ptr<ClockSource> clock, const WinInfo_t& target);
+
+		// Rejects the batch without recording it unless the window is the healthy target
+		bool sendInputs(WinInfo_t& window, std::vector<INPUT>& inputs) override;
+		TargetState probeTarget(WinInfo_t& window, UINT timeoutMs) override;
+		bool findTarget(WinInfo_t& window, const TitleMatcher* matcher) override;
+
+		// The target stops answering
+		void hang();
+		// The target answers again
+		void recover();
+		// The target window is destroyed
+		void close();
+		// A new window replaces the target, to be found by findTarget()
+		void recreate(const WinInfo_t& target);
+		// Batches sent while the target was not healthy
+		UINT64 getRejectedCount() const;
+
+/*******************************************************************************
+		class SimulatedTargetBackend, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		WinInfo_t m_target;
+		TargetState m_state = TargetState::TGT_OK;
+		UINT64 m_rejected = 0;
+	};
+
+}
@@ -0,0 +1,227 @@
+#pragma once
+/*
+
+InputBuilder
+
+Turns key and mouse events into the INPUT records SendInput takes. Templated on a
+LogPolicy so a dispatcher that doesn't log pays nothing for it; WinAssist builds with
+ConsoleLog
+
+*/
+
+#include <Windows.h>
+
+#include <vector>
+
+#include "TimedEvents.h"
+#include "LogPolicy.h"
+
+namespace pinterface {
+
+	template<class LogPolicy = ConsoleLog>
+	class InputBuilder {
+/*******************************************************************************
+		class InputBuilder, public
+********************************************************************************/
+	public:
+		/* Public static functions */
+		// Appends the INPUT records for an event to a batch. Returns the number of records added
+		static int BuildKey(KeyEvent key, std::vector<INPUT>& inputs) {
+			if (key.type() == KeyEvent::EventType::KEVT_NONE)
+				return 0;
+
+			INPUT input[2];
+			ZeroMemory(&input[0], sizeof(INPUT));
+			ZeroMemory(&input[1], sizeof(INPUT));
+
+			WORD scanCode = MapVirtualKey(key.vKey(), MAPVK_VK_TO_VSC);
+			DWORD flags = 0;
+			if (key.scanCode())
+				flags |= KEYEVENTF_SCANCODE;
+			if (key.isExtended())
+				flags |= KEYEVENTF_EXTENDEDKEY;
+
+			LogPolicy::Print("Sending key: VK#=", key.vKey(), ", scanCode=", scanCode);
+			if (key.scanCode())
+				LogPolicy::Print(", mode=scancode");
+			else
+				LogPolicy::Print(", mode=vk");
+
+			int index = 0;
+			if (key.type() == KeyEvent::EventType::KEVT_TYPED || key.type() == KeyEvent::EventType::KEVT_PRESSED) {
+				// Write the press information to input
+				input[index].ki.wVk = key.vKey();
+				input[index].ki.wScan = scanCode;
+				input[index].ki.dwFlags = flags; //press down
+				input[index].type = INPUT_KEYBOARD;
+				LogPolicy::Print(", [PRESSED]");
+				index++;
+			}
+			if (key.type() == KeyEvent::EventType::KEVT_TYPED || key.type() == KeyEvent::EventType::KEVT_RELEASED) {
+				// Write the release information to input
+				input[index].ki.wVk = key.vKey();
+				input[index].ki.wScan = scanCode;
+				input[index].ki.dwFlags = flags | KEYEVENTF_KEYUP; //release key
+				input[index].type = INPUT_KEYBOARD;
+				LogPolicy::Print(", [RELEASED]");
+				index++;
+			}
+
+			LogPolicy::Print(", index == ", index);
+			if (index == 0 || index > 2) {
+				// Error
+				LogPolicy::Print(": ERROR");
+				LogPolicy::EndLine();
+				return 0;
+			}
+			// Add to the batch, sent by the caller
+			LogPolicy::Print(": BATCHED");
+			LogPolicy::EndLine();
+			inputs.insert(inputs.end(), &input[0], &input[index]);
+			return index;
+		}
+
+		static int BuildMouse(MouseEvent evt, std::vector<INPUT>& inputQueue) {
+			if (evt.type() == MouseEvent::EventType::MEVT_NONE)
+				return 0;
+
+			size_t startSize = inputQueue.size();
+
+			LogPolicy::Print("Sending mouse event: typeIndex=", (int)evt.type());
+
+			/* KEY PRESSED DOWN */
+			if (evt.type() == MouseEvent::EventType::MEVT_KEY_PRESSED || evt.type() == MouseEvent::EventType::MEVT_KEY_DOWN) {
+				// Add the mouse key DOWN
+				LogPolicy::Print(", [MOUSE_KEY_DOWN] (");
+				INPUT in;
+				ZeroMemory(&in, sizeof(INPUT));
+				// Put the key information into the flags
+				switch (evt.key()) {
+				case MouseEvent::MouseKey::MKEY_LEFT:
+					in.mi.dwFlags |= MOUSEEVENTF_LEFTDOWN;
+					LogPolicy::Print("LEFT)");
+					break;
+
+				case MouseEvent::MouseKey::MKEY_RIGHT:
+					in.mi.dwFlags |= MOUSEEVENTF_RIGHTDOWN;
+					LogPolicy::Print("RIGHT)");
+					break;
+
+				case MouseEvent::MouseKey::MKEY_MID:
+					in.mi.dwFlags |= MOUSEEVENTF_MIDDLEDOWN;
+					LogPolicy::Print("MID)");
+					break;
+
+				default:
+					LogPolicy::Print("NONE)");
+					break;
+				}
+				// Add to the input queue
+				inputQueue.push_back(in);
+			}
+			/* KEY RELEASED */
+			if (evt.type() == MouseEvent::EventType::MEVT_KEY_PRESSED || evt.type() == MouseEvent::EventType::MEVT_KEY_UP) {
+				// Add the mouse key UP
+				LogPolicy::Print(", [MOUSE_KEY_UP] (");
+				INPUT in;
+				ZeroMemory(&in, sizeof(INPUT));
+				// Put the key information into the flags
+				switch (evt.key()) {
+				case MouseEvent::MouseKey::MKEY_LEFT:
+					in.mi.dwFlags |= MOUSEEVENTF_LEFTUP;
+					LogPolicy::Print("LEFT)");
+					break;
+
+				case MouseEvent::MouseKey::MKEY_RIGHT:
+					in.mi.dwFlags |= MOUSEEVENTF_RIGHTUP;
+					LogPolicy::Print("RIGHT)");
+					break;
+
+				case MouseEvent::MouseKey::MKEY_MID:
+					in.mi.dwFlags |= MOUSEEVENTF_MIDDLEUP;
+					LogPolicy::Print("MID)");
+					break;
+
+				default:
+					LogPolicy::Print("NONe)");
+					break;
+				}
+				// Add to the input queue
+				inputQueue.push_back(in);
+			}
+			/* MOUSE MOVE */
+			if (evt.type() == MouseEvent::EventType::MEVT_MOVE) {
+				// Add the relative mouse movement
+				LogPolicy::Print(", [MOUSE_MOVE]");
+				INPUT in;
+				ZeroMemory(&in, sizeof(INPUT));
+				// Put the values in
+				in.mi.dx = evt.dx();
+				in.mi.dy = evt.dy();
+				LogPolicy::Print(" dx=", in.mi.dx, " dy=", in.mi.dy);
+				in.mi.dwFlags = MOUSEEVENTF_MOVE;
+				// Add to the input queue
+				inputQueue.push_back(in);
+			}
+			/* MOUSE ABS MOVE (Normal and Desktop) */
+			if (evt.type() == MouseEvent::EventType::MEVT_MOVE_ABS || evt.type() == MouseEvent::EventType::MEVT_MOVE_DESKTOP) {
+				// Add the absoltue mouse movement
+				LogPolicy::Print(", [MOUSE_ABS_MOVE]");
+				INPUT in;
+				ZeroMemory(&in, sizeof(INPUT));
+				// Put the values in
+				in.mi.dwFlags |= MOUSEEVENTF_ABSOLUTE;
+				if (evt.type() == MouseEvent::EventType::MEVT_MOVE_DESKTOP) {
+					in.mi.dwFlags |= MOUSEEVENTF_VIRTUALDESK;
+					LogPolicy::Print("[DESKTOP]");
+				}
+				in.mi.dx = evt.dx();
+				in.mi.dy = evt.dy();
+				LogPolicy::Print(" dx=", in.mi.dx, " dy=", in.mi.dy);
+				// Add to the input queue
+				inputQueue.push_back(in);
+			}
+			/* MOUSE SCROLL */
+			if (evt.type() == MouseEvent::EventType::MEVT_SCROLL) {
+				// Add the scroll movement
+				LogPolicy::Print(", [MOUSE_SCROLL]");
+				INPUT in;
+				ZeroMemory(&in, sizeof(INPUT));
+				// Put the values in
+				in.mi.dwFlags |= MOUSEEVENTF_WHEEL;
+				in.mi.mouseData = evt.scrollDelta();
+				LogPolicy::Print(" delta=", in.mi.mouseData);
+				// Add to the input queue
+				inputQueue.push_back(in);
+			}
+
+			if (inputQueue.size() == startSize) {
+				LogPolicy::Print(" [NONE]");
+				LogPolicy::EndLine();
+				return 0;
+			}
+			// Added to the batch, sent by the caller
+			LogPolicy::Print(" [BATCHED]");
+			LogPolicy::EndLine();
+			return (int)(inputQueue.size() - startSize);
+		}
+
+		// Appends the records for every event in a group
+		static int BuildGroup(TimedEvent& evt, std::vector<INPUT>& inputs) {
+			if (evt.kind() == TimedEvent::Kind::TEVT_PLANNED)
+				return evt.buildInputs(inputs);
+
+			int added = 0;
+			if (evt.kind() == TimedEvent::Kind::TEVT_KEY) {
+				for (auto& key : evt.key().getEvents())
+					added += BuildKey(key, inputs);
+			}
+			else {
+				for (auto& mouse : evt.mouse().getEvents())
+					added += BuildMouse(mouse, inputs);
+			}
+			return added;
+		}
+	};
+
+}
@@ -0,0 +1,228 @@
+/*
+
+InputState
+
+Keeps track of the keys and mouse buttons an interface has pressed and not yet released
+
+*/
+
+#include "InputState.h"
+
+
+namespace pi = pinterface;
+using namespace pi;
+
+static const DWORD BUTTON_DOWN_FLAGS[] = { MOUSEEVENTF_LEFTDOWN, MOUSEEVENTF_RIGHTDOWN, MOUSEEVENTF_MIDDLEDOWN };
+// Flags that only say how to read a move, so a record left with nothing else has nothing to send
+static const DWORD MOVE_MODE_FLAGS = MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_VIRTUALDESK;
+
+/*******************************************************************************
+		class InputStateTracker, private
+********************************************************************************/
+/* Private member functions */
+int InputStateTracker::Find(const std::vector<HeldInput_t>& held, bool mouse, WORD vk) {
+	for (size_t i = 0; i < held.size(); i++) {
+		if (held[i].mouse == mouse && held[i].vk == vk)
+			return (int)i;
+	}
+	return -1;
+}
+
+void InputStateTracker::AppendRelease(const HeldInput_t& held, std::vector<INPUT>& inputs) {
+	INPUT in;
+	ZeroMemory(&in, sizeof(INPUT));
+	if (held.mouse) {
+		in.type = INPUT_MOUSE;
+		in.mi.dwFlags = held.flags << 1; // Each button's up flag follows its down flag
+	}
+	else {
+		in.type = INPUT_KEYBOARD;
+		in.ki.wVk = held.vk;
+		in.ki.wScan = held.scan;
+		in.ki.dwFlags = held.flags | KEYEVENTF_KEYUP;
+	}
+	inputs.push_back(in);
+}
+
+/*******************************************************************************
+		class InputStateTracker, public
+********************************************************************************/
+
+InputStateTracker::InputStateTracker() {
+
+}
+
+void InputStateTracker::setElisionEnabled(bool enabled) {
+	m_elide = enabled;
+}
+
+bool InputStateTracker::isElisionEnabled() const {
+	return m_elide;
+}
+
+void InputStateTracker::filter(std::vector<INPUT>& inputs) {
+	filter(inputs, std::vector<UINT64>());
+}
+
+void InputStateTracker::filter(std::vector<INPUT>& inputs, const std::vector<UINT64>& owners) {
+	m_pending = m_held;
+	m_absorbed.clear();
+	m_pendingCounters = InputStateCounters_t();
+
+	size_t kept = 0;
+	for (size_t i = 0; i < inputs.size(); i++) {
+		INPUT& in = inputs[i];
+		UINT64 owner = i < owners.size() ? owners[i] : 0;
+		bool drop = false;
+
+		// Unicode packets aren't keys, they go through untouched
+		if (in.type == INPUT_KEYBOARD && in.ki.wVk != 0 && (in.ki.dwFlags & KEYEVENTF_UNICODE) == 0) {
+			WORD vk = in.ki.wVk;
+			int held = Find(m_pending, false, vk);
+			if ((in.ki.dwFlags & KEYEVENTF_KEYUP) == 0) {
+				if (held < 0)
+					m_pending.push_back({ false, vk, in.ki.wScan, in.ki.dwFlags, owner });
+				else if (m_elide) {
+					drop = true;
+					m_absorbed.push_back(m_pending[held]);
+					m_pendingCounters.elidedPresses++;
+				}
+			}
+			else {
+				int absorbed = Find(m_absorbed, false, vk);
+				if (absorbed >= 0) {
+					// Answers a press that was dropped, so the key stays down for whoever held it first
+					drop = true;
+					m_absorbed.erase(m_absorbed.begin() + absorbed);
+					m_pendingCounters.elidedReleases++;
+				}
+				else if (held >= 0)
+					m_pending.erase(m_pending.begin() + held);
+				else if (m_elide) {
+					drop = true;
+					m_pendingCounters.elidedReleases++;
+				}
+			}
+		}
+		else if (in.type == INPUT_MOUSE) {
+			// Buttons follow the same rules as keys. A record can carry a move along with a button, so a transition that goes
+			// is taken out of the flags, and the record is only dropped if that leaves nothing to send
+			DWORD elided = 0;
+			for (DWORD down : BUTTON_DOWN_FLAGS) {
+				DWORD up = down << 1;
+				if (in.mi.dwFlags & down) {
+					int held = Find(m_pending, true, (WORD)down);
+					if (held < 0)
+						m_pending.push_back({ true, (WORD)down, 0, down, owner });
+					else if (m_elide) {
+						elided |= down;
+						m_absorbed.push_back(m_pending[held]);
+						m_pendingCounters.elidedPresses++;
+					}
+				}
+				if (in.mi.dwFlags & up) {
+					int absorbed = Find(m_absorbed, true, (WORD)down);
+					int held = Find(m_pending, true, (WORD)down);
+					if (absorbed >= 0) {
+						// Answers a press that was dropped, so the button stays down
+						elided |= up;
+						m_absorbed.erase(m_absorbed.begin() + absorbed);
+						m_pendingCounters.elidedReleases++;
+					}
+					else if (held >= 0)
+						m_pending.erase(m_pending.begin() + held);
+					else if (m_elide) {
+						elided |= up;
+						m_pendingCounters.elidedReleases++;
+					}
+				}
+			}
+			if (elided != 0) {
+				in.mi.dwFlags &= ~elided;
+				drop = (in.mi.dwFlags & ~MOVE_MODE_FLAGS) == 0;
+			}
+		}
+
+		if (!drop)
+			inputs[kept++] = in;
+	}
+
+	if (kept == 0 && !inputs.empty())
+		m_pendingCounters.skippedBatches++;
+	inputs.resize(kept);
+	m_pendingCounters.sent = kept;
+}
+
+size_t InputStateTracker::buildRelease(std::vector<INPUT>& inputs) {
+	m_pending.clear();
+	m_pendingCounters = InputStateCounters_t();
+
+	for (auto it = m_held.rbegin(); it != m_held.rend(); ++it)
+		AppendRelease(*it, inputs);
+
+	m_pendingCounters.sent = m_held.size();
+	m_pendingCounters.released = m_held.size();
+	return m_held.size();
+}
+
+size_t InputStateTracker::buildRelease(std::vector<INPUT>& inputs, UINT64 owner) {
+	m_pending.clear();
+	m_pendingCounters = InputStateCounters_t();
+
+	size_t count = 0;
+	for (auto it = m_held.rbegin(); it != m_held.rend(); ++it) {
+		if (it->owner == owner) {
+			AppendRelease(*it, inputs);
+			count++;
+		}
+	}
+	// Everything else stays down, in the order it was pressed
+	for (const HeldInput_t& held : m_held) {
+		if (held.owner != owner)
+			m_pending.push_back(held);
+	}
+
+	m_pendingCounters.sent = count;
+	m_pendingCounters.released = count;
+	return count;
+}
+
+void InputStateTracker::commit() {
+	m_held = m_pending;
+	m_counters.sent += m_pendingCounters.sent;
+	m_counters.elidedPresses += m_pendingCounters.elidedPresses;
+	m_counters.elidedReleases += m_pendingCounters.elidedReleases;
+	m_counters.skippedBatches += m_pendingCounters.skippedBatches;
+	m_counters.released += m_pendingCounters.released;
+	m_pendingCounters = InputStateCounters_t();
+}
+
+void InputStateTracker::clearHeld() {
+	m_held.clear();
+	m_pending.clear();
+}
+
+bool InputStateTracker::isKeyHeld(WORD vk) const {
+	return Find(m_held, false, vk) >= 0;
+}
+
+bool InputStateTracker::isButtonHeld(MouseEvent::MouseKey key) const {
+	switch (key) {
+	case MouseEvent::MouseKey::MKEY_LEFT:
+		return Find(m_held, true, MOUSEEVENTF_LEFTDOWN) >= 0;
+	case MouseEvent::MouseKey::MKEY_RIGHT:
+		return Find(m_held, true, MOUSEEVENTF_RIGHTDOWN) >= 0;
+	case MouseEvent::MouseKey::MKEY_MID:
+		return Find(m_held, true, MOUSEEVENTF_MIDDLEDOWN) >= 0;
+	default:
+		return false;
+	}
+}
+
+size_t InputStateTracker::getHeldCount() const {
+	return m_held.size();
+}
+
+const InputStateCounters_t& InputStateTracker::getCounters() const {
+	return m_counters;
+}
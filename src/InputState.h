@@ -0,0 +1,101 @@
+#pragma once
+/*
+
+InputState
+
+Keeps track of the keys and mouse buttons an interface has pressed and not yet released.
+Batches are filtered on their way out so a key already down isn't pressed again and one
+already up isn't released again, and whatever is still held can be released in one batch
+when the interface is unbound. Each press remembers the sequence that made it, so a
+cancelled sequence releases only what it left down
+
+*/
+
+#include <Windows.h>
+
+#include <vector>
+
+#include "WinAssist.h"
+
+namespace pinterface {
+
+/*******************************************************************************
+		struct InputStateCounters
+********************************************************************************/
+	typedef struct InputStateCounters {
+		// Records injected, including releases
+		UINT64 sent = 0;
+		// Presses dropped because the key or button was already down
+		UINT64 elidedPresses = 0;
+		// Releases dropped because the key or button was already up, or because they answered a dropped press
+		UINT64 elidedReleases = 0;
+		// Batches with nothing left to send once filtered
+		UINT64 skippedBatches = 0;
+		// Records sent to release what was held on unbind, cancel or releaseAll()
+		UINT64 released = 0;
+	} InputStateCounters_t;
+
+	class InputStateTracker {
+/*******************************************************************************
+		class InputStateTracker, private
+********************************************************************************/
+	private:
+		// A key or button that is down, with what it was pressed with so the release matches
+		typedef struct HeldInput {
+			bool mouse;
+			WORD vk; // For a button, its MOUSEEVENTF_*DOWN flag
+			WORD scan;
+			DWORD flags;
+			// Submitted sequence that pressed it, 0 for anything else
+			UINT64 owner;
+		} HeldInput_t;
+
+		/* Private member functions */
+		static int Find(const std::vector<HeldInput_t>& held, bool mouse, WORD vk);
+		static void AppendRelease(const HeldInput_t& held, std::vector<INPUT>& inputs);
+
+		/* Private member variables */
+		bool m_elide = true;
+		// What is down once the last committed batch was sent, oldest press first
+		std::vector<HeldInput_t> m_held;
+		// The same after the batch being filtered, applied by commit()
+		std::vector<HeldInput_t> m_pending;
+		// Keys and buttons whose press was dropped in the batch being filtered, so the release that goes with it is dropped too
+		std::vector<HeldInput_t> m_absorbed;
+		InputStateCounters_t m_counters;
+		InputStateCounters_t m_pendingCounters;
+
+/*******************************************************************************
+		class InputStateTracker, public
+********************************************************************************/
+	public:
+		InputStateTracker();
+
+		// With elision off every record is sent as given. What is held is still tracked so it can be released
+		void setElisionEnabled(bool enabled);
+		bool isElisionEnabled() const;
+
+		// Removes the redundant transitions from a batch about to be sent. A press of a key or button that is already held is
+		// dropped along with the release that answers it in the same batch, so a chord using a modifier that is held, or a
+		// click of a button that is held, leaves it held. Nothing is recorded until commit()
+		void filter(std::vector<INPUT>& inputs);
+		// The same, with owners[i] the submitted sequence record i came from (0 for none). A key stays owned by whoever
+		// pressed it first, however many others press it again while it is down
+		void filter(std::vector<INPUT>& inputs, const std::vector<UINT64>& owners);
+		// Appends a release for everything held, most recently pressed first. Returns the number of records added.
+		// Nothing is recorded until commit()
+		size_t buildRelease(std::vector<INPUT>& inputs);
+		// The same for only what the sequence pressed and still holds
+		size_t buildRelease(std::vector<INPUT>& inputs, UINT64 owner);
+		// The batch last filtered or built was sent
+		void commit();
+		// Forgets what is held without releasing it, for a target that has gone
+		void clearHeld();
+
+		bool isKeyHeld(WORD vk) const;
+		bool isButtonHeld(MouseEvent::MouseKey key) const;
+		size_t getHeldCount() const;
+		const InputStateCounters_t& getCounters() const;
+	};
+
+}
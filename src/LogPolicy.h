@@ -0,0 +1,59 @@
+#pragma once
+/*
+
+LogPolicy
+
+Compile time choice of whether the input path logs. ConsoleLog prints what is sent to
+cout, and window titles to wcout, as the interface always has. NoLog compiles every call away, for dispatchers where
+the logging would cost more than the dispatch itself
+
+*/
+
+#include <iostream>
+
+namespace pinterface {
+
+/*******************************************************************************
+		struct ConsoleLog
+********************************************************************************/
+	struct ConsoleLog {
+		static constexpr bool ENABLED = true;
+
+		template<class... Args>
+		static void Print(const Args&... args) {
+			(std::cout << ... << args);
+		}
+
+		static void EndLine() {
+			std::cout << std::endl;
+		}
+
+		// For lines with window titles in them
+		template<class... Args>
+		static void PrintWide(const Args&... args) {
+			(std::wcout << ... << args);
+		}
+
+		static void EndWideLine() {
+			std::wcout << std::endl;
+		}
+	};
+
+/*******************************************************************************
+		struct NoLog
+********************************************************************************/
+	struct NoLog {
+		static constexpr bool ENABLED = false;
+
+		template<class... Args>
+		static void Print(const Args&...) {}
+
+		static void EndLine() {}
+
+		template<class... Args>
+		static void PrintWide(const Args&...) {}
+
+		static void EndWideLine() {}
+	};
+
+}
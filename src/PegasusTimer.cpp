@@ -0,0 +1,104 @@
+/*
+
+PegasusTimer
+
+High resolution timer built on the performance counter
+
+*/
+
+#include "PegasusTimer.h"
+
+#include <iostream>
+
+namespace pi = pinterface;
+using namespace pi;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+/*******************************************************************************
+		class PegasusTimer, private
+********************************************************************************/
+
+bool PegasusTimer::INITIALIZED = false;
+LARGE_INTEGER PegasusTimer::COUNTER_FREQUENCY;
+double PegasusTimer::MS_PER_COUNT = 0.0;
+double PegasusTimer::US_PER_COUNT = 0.0;
+
+void PegasusTimer::InitializeAPI() {
+	if (!INITIALIZED) {
+		if (!QueryPerformanceFrequency(&COUNTER_FREQUENCY)) {
+			cerr << "FAILED TO INITIALISE THE PegasusTimer API!!!!!" << endl;
+			return;
+		}
+		INITIALIZED = true;
+		INT64 freq = COUNTER_FREQUENCY.QuadPart;
+		MS_PER_COUNT = 1000.0 / (double)freq;
+		US_PER_COUNT = 1000000.0 / (double)freq;
+		cout << "Initialised PegasusTimer API: freq=" << freq << " with " << MS_PER_COUNT << " ms per count" << endl;
+	}
+}
+
+int PegasusTimer::CountsToMS(INT64 counts) {
+	if (counts < 0) {
+		counts = 0 - counts; // Make counts always positive
+	}
+
+	double ms = (double)counts * MS_PER_COUNT;
+	return (int)ms;
+}
+
+INT64 PegasusTimer::CountsToUS(INT64 counts) {
+	if (counts < 0) {
+		counts = 0 - counts; // Make counts always positive
+	}
+
+	double us = (double)counts * US_PER_COUNT;
+	return (INT64)us;
+}
+
+/*******************************************************************************
+		class PegasusTimer, public
+********************************************************************************/
+
+PegasusTimer::PegasusTimer() {
+	if (!PegasusTimer::INITIALIZED)
+		PegasusTimer::InitializeAPI();
+	restart();
+}
+
+void PegasusTimer::restart() {
+	LARGE_INTEGER currentCount;
+	if (!QueryPerformanceCounter(&currentCount)) {
+		cerr << "PegasusTimer error when doing restart(): unable to query the performance counter" << endl;
+		m_startCount = 0;
+		return;
+	}
+	m_startCount = currentCount.QuadPart;
+}
+
+int PegasusTimer::getElapsedTimeAsMilliseconds() {
+	LARGE_INTEGER currentCount;
+	INT64 currentC;
+	if (!QueryPerformanceCounter(&currentCount)) {
+		cerr << "PegasusTimer error when doing getElapsedTimeAsMilliseconds(): unable to query the performance counter" << endl;
+		currentC = 0;
+	}
+	else {
+		currentC = currentCount.QuadPart;
+	}
+	return PegasusTimer::CountsToMS(currentC - m_startCount);
+}
+
+INT64 PegasusTimer::getElapsedTimeAsMicroseconds() {
+	LARGE_INTEGER currentCount;
+	INT64 currentC;
+	if (!QueryPerformanceCounter(&currentCount)) {
+		cerr << "PegasusTimer error when doing getElapsedTimeAsMicroseconds(): unable to query the performance counter" << endl;
+		currentC = 0;
+	}
+	else {
+		currentC = currentCount.QuadPart;
+	}
+	return PegasusTimer::CountsToUS(currentC - m_startCount);
+}
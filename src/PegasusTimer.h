@@ -0,0 +1,46 @@
+#pragma once
+/*
+
+PegasusTimer
+
+High resolution timer built on the performance counter
+
+*/
+
+#include <Windows.h>
+
+namespace pinterface {
+
+	class PegasusTimer {
+/*******************************************************************************
+		class PegasusTimer, private
+********************************************************************************/
+	private:
+		/* Private static API variables */
+		static bool INITIALIZED;
+		static LARGE_INTEGER COUNTER_FREQUENCY;
+		static double MS_PER_COUNT;
+		static double US_PER_COUNT;
+
+		/* Private static API functions */
+		static void InitializeAPI();
+		static int CountsToMS(INT64 counts);
+		static INT64 CountsToUS(INT64 counts);
+
+		/* Private member variables */
+		INT64 m_startCount = 0;
+
+/*******************************************************************************
+		class PegasusTimer, public
+********************************************************************************/
+	public:
+		PegasusTimer();
+
+		void restart();
+
+		int getElapsedTimeAsMilliseconds();
+
+		INT64 getElapsedTimeAsMicroseconds();
+	};
+
+}
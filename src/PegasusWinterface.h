@@ -6,131 +6,76 @@ PegasusWinterface
 Class that provides the ability to send keyboard and mouse commands to
 WinAPI windows.
 
+The interface itself is BasicPegasusWinterface, here on a backend and clock held through
+shared pointers so they can be replaced at run time, logging to the console
+
 */
 
-#include "WinAssist.h"
+#include "BasicPegasusWinterface.h"
+
+#include <memory>
 
 namespace pinterface {
 
-	class TimedMouseEvent {
+	// Backend held through a shared InputBackend, so it can be swapped at run time or shared with other interfaces
+	class SharedBackend {
 /*******************************************************************************
-		class TimedMouseEvent, private
+		class SharedBackend, public
 ********************************************************************************/
-		std::vector<MouseEvent> m_events;
-		int m_delayBefore;
-
 	public:
-/*******************************************************************************
-		class TimedMouseEvent, public
-********************************************************************************/
-		TimedMouseEvent(std::vector<MouseEvent> evts, int delayBefore = 0);
-		TimedMouseEvent(MouseEvent evt, int delayBefore = 0);
-		std::vector<MouseEvent>& getEvents();
-		int delayBefore();
-	};
+		SharedBackend(std::shared_ptr<InputBackend> backend = std::make_shared<WinInputBackend>()) : m_backend(backend) {}
 
-	class TimedKeyEvent {
+		bool sendInputs(WinInfo_t& window, std::vector<INPUT>& inputs) { return m_backend->sendInputs(window, inputs); }
+		TargetState probeTarget(WinInfo_t& window, UINT timeoutMs) { return m_backend->probeTarget(window, timeoutMs); }
+		bool findTarget(WinInfo_t& window, const TitleMatcher* matcher) { return m_backend->findTarget(window, matcher); }
+		std::shared_ptr<InputBackend> get() const { return m_backend; }
 
-	private:
-/*******************************************************************************
-		class TimedKeyEvent, private
-********************************************************************************/
-		std::vector<KeyEvent> m_events;
-		int m_delayBefore;
-
-	public:
 /*******************************************************************************
-		class TimedKeyEvent, public
-********************************************************************************/
-		TimedKeyEvent(std::vector<KeyEvent> evts, int delayBefore = 0);
-		TimedKeyEvent(KeyEvent evt, int delayBefore = 0);
-		std::vector<KeyEvent>& getEvents();
-		int delayBefore();
-	};
-
-	class PegasusTimer {
-/*******************************************************************************
-		class PegasusTimer, private
+		class SharedBackend, private
 ********************************************************************************/
 	private:
-		/* Private static API variables */
-		static bool INITIALIZED;
-		static LARGE_INTEGER COUNTER_FREQUENCY;
-		static double MS_PER_COUNT;
-
-		/* Private static API functions */
-		static void InitializeAPI();
-		static int CountsToMS(INT64 counts);
-
 		/* Private member variables */
-		INT64 m_startCount = 0;
+		std::shared_ptr<InputBackend> m_backend;
+	};
 
+	// Clock held through a shared ClockSource, so it can be swapped at run time or shared with a ScriptScheduler
+	class SharedClock {
 /*******************************************************************************
-		class PegasusTimer, public
+		class SharedClock, public
 ********************************************************************************/
 	public:
-		PegasusTimer();
+		SharedClock(std::shared_ptr<ClockSource> clock = std::make_shared<RealClock>()) : m_clock(clock) {}
 
-		void restart();
+		INT64 now() { return m_clock->now(); }
+		void waitUntil(INT64 deadline) { m_clock->waitUntil(deadline); }
+		INT64 toRealDuration(INT64 duration) { return m_clock->toRealDuration(duration); }
+		bool isVirtual() const { return m_clock->isVirtual(); }
+		std::shared_ptr<ClockSource> get() const { return m_clock; }
 
-		int getElapsedTimeAsMilliseconds();
-	};
-
-	class PegasusWinterface {
 /*******************************************************************************
-		class PegasusWinterface, private
+		class SharedClock, private
 ********************************************************************************/
 	private:
-		/* Private static variables */
-
-
 		/* Private member variables */
-		bool m_bound = false;
-		bool m_blocking = false;
-		PegasusTimer m_timingClockKey;
-		PegasusTimer m_timingClockMouse;
-		// unsigned int m_waitTime = 0;
-		std::vector<TimedKeyEvent> m_keyBuffer;
-		std::vector<TimedMouseEvent> m_mouseBuffer;
+		std::shared_ptr<ClockSource> m_clock;
+	};
 
-		WinInfo_t m_winInfo;
-		WinDimensions_t m_winDims;
+	// Compiled once, in PegasusWinterface.cpp
+	extern template class BasicPegasusWinterface<SharedBackend, SharedClock, ConsoleLog>;
 
+	class PegasusWinterface : public BasicPegasusWinterface<SharedBackend, SharedClock, ConsoleLog> {
 /*******************************************************************************
 		class PegasusWinterface, public
 ********************************************************************************/
 	public:
-		PegasusWinterface();
-		~PegasusWinterface();
-		
 		/* Public member functions */
-		// Bind functions. Takes a string to search window titles for, or a process ID. Returns true if bind is successful
-		bool bind(std::wstring& str);
-		bool bind(std::string& str);
-		bool bind(DWORD processID);
-		// Returns the current status of the interface
-		inline bool isBound() { return m_bound; }
-		// Unbinds the interface
-		void unbind();
-		// Sets the blocking behaviour of the interface. If true, will execute the events when execute<EVENT> is called, instead
-		// of scheduling to be executed if appropriate it the tick function
-		void setBlocking(bool block);
-		// Returns the current blocking status
-		bool isBlocking();
-		// Returns the information about the Window and process that is captured. Not a copy so cannot be modified
-		WinInfo_t getWinInfo();
-		// Returns the window dimension information
-		WinDimensions_t getWindowDimensions();
-		// Executes the current queue of events when appropriate according to their timing
-		void tick();
-		// Checks if there are events in the queues
-		bool hasEventsInQueue();
-		// Schedules or immediately executes key events
-		void executeKeys(std::vector<TimedKeyEvent> keys, bool appendToQueue = false);
-		// Schedules or immediately executes mouse events
-		void executeMouse(std::vector<TimedMouseEvent> evts, bool appendToQueue = false);
-		// Updates the information held by the interface
-		void update();
+		// Replaces the clock the interface is timed on, RealClock by default. Events already queued keep their remaining
+		// delays. Scripts should use the same clock, see ScriptScheduler
+		void setClock(std::shared_ptr<ClockSource> clock);
+		std::shared_ptr<ClockSource> getClock();
+		// Replaces where the inputs are sent, WinInputBackend by default
+		void setBackend(std::shared_ptr<InputBackend> backend);
+		std::shared_ptr<InputBackend> getBackend();
 	};
 
 }
\ No newline at end of file
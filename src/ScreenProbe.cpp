@@ -0,0 +1,353 @@
+/*
+
+ScreenProbe
+
+Regions of the target window captured and compared against a reference
+
+*/
+
+#include "ScreenProbe.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+// SSE2 is part of x64 and the default for x86 builds. Anything else takes the scalar loops
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define PROBE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace pi = pinterface;
+using namespace pi;
+
+// The top byte of a captured pixel is whatever GDI left there
+static const UINT32 COLOUR_MASK = 0x00FFFFFF;
+static const UINT64 FNV_OFFSET = 14695981039346656037ull;
+static const UINT64 FNV_PRIME = 1099511628211ull;
+
+/*******************************************************************************
+		class GdiFrameSource, public
+********************************************************************************/
+
+GdiFrameSource::GdiFrameSource() {
+
+}
+
+GdiFrameSource::~GdiFrameSource() {
+	if (m_bitmap != NULL)
+		DeleteObject(m_bitmap);
+	if (m_memory != NULL)
+		DeleteDC(m_memory);
+	if (m_screen != NULL)
+		ReleaseDC(NULL, m_screen);
+}
+
+bool GdiFrameSource::capture(LONG x, LONG y, LONG width, LONG height, std::vector<UINT32>& pixels) {
+	if (width <= 0 || height <= 0)
+		return false;
+	if (m_screen == NULL)
+		m_screen = GetDC(NULL);
+	if (m_memory == NULL && m_screen != NULL)
+		m_memory = CreateCompatibleDC(m_screen);
+	if (m_memory == NULL)
+		return false;
+	if (m_bitmap == NULL || width != m_width || height != m_height) {
+		if (m_bitmap != NULL)
+			DeleteObject(m_bitmap);
+		m_bitmap = CreateCompatibleBitmap(m_screen, width, height);
+		m_width = width;
+		m_height = height;
+		if (m_bitmap == NULL)
+			return false;
+	}
+
+	HGDIOBJ previous = SelectObject(m_memory, m_bitmap);
+	bool copied = BitBlt(m_memory, 0, 0, width, height, m_screen, x, y, SRCCOPY) != 0;
+	// GetDIBits wants the bitmap out of the device context
+	SelectObject(m_memory, previous);
+	if (!copied)
+		return false;
+
+	BITMAPINFO info;
+	ZeroMemory(&info, sizeof(info));
+	info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	info.bmiHeader.biWidth = width;
+	info.bmiHeader.biHeight = -height; // Top down
+	info.bmiHeader.biPlanes = 1;
+	info.bmiHeader.biBitCount = 32;
+	info.bmiHeader.biCompression = BI_RGB;
+	pixels.resize((size_t)width * height);
+	return GetDIBits(m_memory, m_bitmap, 0, (UINT)height, pixels.data(), &info, DIB_RGB_COLORS) == height;
+}
+
+/*******************************************************************************
+		class SyntheticFrameSource, private
+********************************************************************************/
+/* Private member functions */
+void SyntheticFrameSource::fillLocked(LONG x, LONG y, LONG width, LONG height, UINT32 colour) {
+	LONG left = std::max<LONG>(x, 0);
+	LONG top = std::max<LONG>(y, 0);
+	LONG right = std::min<LONG>(x + width, m_width);
+	LONG bottom = std::min<LONG>(y + height, m_height);
+	for (LONG row = top; row < bottom; row++) {
+		for (LONG col = left; col < right; col++)
+			m_pixels[(size_t)row * m_width + col] = colour;
+	}
+}
+
+/*******************************************************************************
+		class SyntheticFrameSource, public
+********************************************************************************/
+
+SyntheticFrameSource::SyntheticFrameSource(LONG width, LONG height, std::shared_ptr<ClockSource> clock) {
+	m_width = std::max<LONG>(width, 0);
+	m_height = std::max<LONG>(height, 0);
+	m_pixels.assign((size_t)m_width * m_height, 0);
+	m_clock = clock;
+}
+
+bool SyntheticFrameSource::capture(LONG x, LONG y, LONG width, LONG height, std::vector<UINT32>& pixels) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_captures++;
+	if (m_clock && !m_timedFills.empty()) {
+		INT64 now = m_clock->now();
+		// Applied in the order they were given, which is the order they land in
+		auto due = std::stable_partition(m_timedFills.begin(), m_timedFills.end(), [now](const TimedFill_t& f) { return f.time <= now; });
+		for (auto it = m_timedFills.begin(); it != due; ++it)
+			fillLocked(it->x, it->y, it->width, it->height, it->colour);
+		m_timedFills.erase(m_timedFills.begin(), due);
+	}
+
+	if (width <= 0 || height <= 0 || x < 0 || y < 0 || x + width > m_width || y + height > m_height)
+		return false;
+	pixels.resize((size_t)width * height);
+	for (LONG row = 0; row < height; row++) {
+		const UINT32* src = m_pixels.data() + (size_t)(y + row) * m_width + x;
+		std::copy(src, src + width, pixels.begin() + (size_t)row * width);
+	}
+	return true;
+}
+
+void SyntheticFrameSource::fill(LONG x, LONG y, LONG width, LONG height, UINT32 colour) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	fillLocked(x, y, width, height, colour);
+}
+
+void SyntheticFrameSource::fillAt(INT64 time, LONG x, LONG y, LONG width, LONG height, UINT32 colour) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_timedFills.push_back({ time, x, y, width, height, colour });
+}
+
+UINT32 SyntheticFrameSource::getPixel(LONG x, LONG y) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (x < 0 || y < 0 || x >= m_width || y >= m_height)
+		return 0;
+	return m_pixels[(size_t)y * m_width + x];
+}
+
+UINT64 SyntheticFrameSource::getCaptureCount() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_captures;
+}
+
+/*******************************************************************************
+		class ScreenProbe, private
+********************************************************************************/
+/* Private member functions */
+bool ScreenProbe::compare(const std::vector<UINT32>& pixels) {
+	if (!m_hasReference)
+		return false;
+	switch (m_match) {
+	case ProbeMatch::PMATCH_EXACT:
+		return pixels.size() == m_reference.size() && Equal(pixels.data(), m_reference.data(), pixels.size());
+	case ProbeMatch::PMATCH_TOLERANCE:
+		return pixels.size() == m_reference.size() && Within(pixels.data(), m_reference.data(), pixels.size(), m_tolerance);
+	case ProbeMatch::PMATCH_HASH:
+		return Hash(pixels.data(), pixels.size()) == m_referenceHash;
+	default:
+		return false;
+	}
+}
+
+/*******************************************************************************
+		class ScreenProbe, public
+********************************************************************************/
+
+ScreenProbe::ScreenProbe(std::shared_ptr<FrameSource> source, ProbeRegion_t region, ProbeMatch match, BYTE tolerance) {
+	m_source = source;
+	m_region = region;
+	m_match = match;
+	m_tolerance = tolerance;
+}
+
+bool ScreenProbe::setReference(std::vector<UINT32> pixels) {
+	if (m_region.width <= 0 || m_region.height <= 0 || pixels.size() != (size_t)m_region.width * m_region.height)
+		return false;
+	m_referenceHash = Hash(pixels.data(), pixels.size());
+	m_reference = std::move(pixels);
+	m_hasReference = true;
+	return true;
+}
+
+void ScreenProbe::setReferenceHash(UINT64 hash) {
+	m_referenceHash = hash;
+	m_reference.clear();
+	m_hasReference = true;
+}
+
+bool ScreenProbe::captureReference(const WinDimensions_t& window) {
+	std::vector<UINT32> pixels;
+	if (!m_source->capture(std::get<0>(window.topLeft) + m_region.x, std::get<1>(window.topLeft) + m_region.y, m_region.width, m_region.height, pixels))
+		return false;
+	return setReference(std::move(pixels));
+}
+
+void ScreenProbe::setCaptureInterval(INT64 intervalUs) {
+	m_captureIntervalUs = std::max<INT64>(intervalUs, 0);
+}
+
+INT64 ScreenProbe::getCaptureInterval() const {
+	return m_captureIntervalUs;
+}
+
+bool ScreenProbe::check(const WinDimensions_t& window, INT64 now) {
+	m_lastCapture = now;
+	m_stats.captures++;
+	if (!m_source->capture(std::get<0>(window.topLeft) + m_region.x, std::get<1>(window.topLeft) + m_region.y, m_region.width, m_region.height, m_pixels)) {
+		m_stats.failedCaptures++;
+		m_lastResult = false;
+		return false;
+	}
+
+	m_lastResult = compare(m_pixels);
+	if (m_lastResult) {
+		m_stats.matches++;
+		if (m_armedAt >= 0) {
+			INT64 latency = std::max<INT64>(now - m_armedAt, 0);
+			m_stats.minLatencyUs = m_stats.latencySamples == 0 ? latency : std::min(m_stats.minLatencyUs, latency);
+			m_stats.maxLatencyUs = std::max(m_stats.maxLatencyUs, latency);
+			m_stats.totalLatencyUs += latency;
+			m_stats.lastLatencyUs = latency;
+			m_stats.latencySamples++;
+			m_measuredInput = m_armedAt;
+			m_armedAt = -1;
+			if (Tracer::IsEnabled())
+				Tracer::Instant("probe match", "probe", Tracer::Now(), "latencyUs", latency);
+		}
+	}
+	return m_lastResult;
+}
+
+bool ScreenProbe::poll(const WinDimensions_t& window, INT64 now) {
+	m_stats.polls++;
+	if (m_lastCapture >= 0 && now - m_lastCapture < m_captureIntervalUs)
+		return m_lastResult;
+	return check(window, now);
+}
+
+void ScreenProbe::arm(INT64 inputTime) {
+	if (inputTime != m_measuredInput)
+		m_armedAt = inputTime;
+}
+
+bool ScreenProbe::getLastResult() const {
+	return m_lastResult;
+}
+
+const ProbeRegion_t& ScreenProbe::getRegion() const {
+	return m_region;
+}
+
+ProbeMatch ScreenProbe::getMatch() const {
+	return m_match;
+}
+
+UINT64 ScreenProbe::getReferenceHash() const {
+	return m_referenceHash;
+}
+
+const ProbeStats_t& ScreenProbe::getStats() const {
+	return m_stats;
+}
+
+void ScreenProbe::resetStats() {
+	m_stats = ProbeStats_t();
+}
+
+/* Public static functions */
+bool ScreenProbe::Equal(const UINT32* a, const UINT32* b, size_t count) {
+	size_t i = 0;
+#ifdef PROBE_SSE2
+	const __m128i mask = _mm_set1_epi32((int)COLOUR_MASK);
+	const __m128i zero = _mm_setzero_si128();
+	// Sixteen pixels a step with a single branch, so a region that matches costs little more than reading it
+	for (; i + 16 <= count; i += 16) {
+		__m128i d0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+		__m128i d1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i + 4)), _mm_loadu_si128((const __m128i*)(b + i + 4)));
+		__m128i d2 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i + 8)), _mm_loadu_si128((const __m128i*)(b + i + 8)));
+		__m128i d3 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i + 12)), _mm_loadu_si128((const __m128i*)(b + i + 12)));
+		__m128i any = _mm_and_si128(_mm_or_si128(_mm_or_si128(d0, d1), _mm_or_si128(d2, d3)), mask);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xFFFF)
+			return false;
+	}
+	for (; i + 4 <= count; i += 4) {
+		__m128i d = _mm_and_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i))), mask);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(d, zero)) != 0xFFFF)
+			return false;
+	}
+#endif
+	for (; i < count; i++) {
+		if (((a[i] ^ b[i]) & COLOUR_MASK) != 0)
+			return false;
+	}
+	return true;
+}
+
+bool ScreenProbe::Within(const UINT32* a, const UINT32* b, size_t count, BYTE tolerance) {
+	size_t i = 0;
+#ifdef PROBE_SSE2
+	const __m128i mask = _mm_set1_epi32((int)COLOUR_MASK);
+	const __m128i tol = _mm_set1_epi8((char)tolerance);
+	const __m128i zero = _mm_setzero_si128();
+	// Saturating subtraction both ways gives the difference of each channel, and what is left of it after taking off the
+	// tolerance is the amount it is over
+	auto over = [&](size_t at) {
+		__m128i va = _mm_loadu_si128((const __m128i*)(a + at));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b + at));
+		__m128i diff = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+		return _mm_subs_epu8(diff, tol);
+	};
+	for (; i + 16 <= count; i += 16) {
+		__m128i any = _mm_and_si128(_mm_or_si128(_mm_or_si128(over(i), over(i + 4)), _mm_or_si128(over(i + 8), over(i + 12))), mask);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xFFFF)
+			return false;
+	}
+	for (; i + 4 <= count; i += 4) {
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(over(i), mask), zero)) != 0xFFFF)
+			return false;
+	}
+#endif
+	for (; i < count; i++) {
+		for (int shift = 0; shift < 24; shift += 8) {
+			int ca = (a[i] >> shift) & 0xFF;
+			int cb = (b[i] >> shift) & 0xFF;
+			if (std::abs(ca - cb) > tolerance)
+				return false;
+		}
+	}
+	return true;
+}
+
+UINT64 ScreenProbe::Hash(const UINT32* pixels, size_t count) {
+	UINT64 hash = FNV_OFFSET;
+	for (size_t i = 0; i < count; i++) {
+		hash ^= pixels[i] & COLOUR_MASK;
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+UINT32 ScreenProbe::Rgb(BYTE r, BYTE g, BYTE b) {
+	return ((UINT32)r << 16) | ((UINT32)g << 8) | b;
+}
@@ -0,0 +1,218 @@
+#pragma once
+/*
+
+ScreenProbe
+
+A small region of the target window compared against a reference, so a script can wait for
+what the target shows instead of guessing with a fixed delay:
+
+	pi::ScreenProbe dialog(std::make_shared<pi::GdiFrameSource>(), { 12, 40, 24, 8 }, pi::ProbeMatch::PMATCH_TOLERANCE, 8);
+	dialog.setReference(savedPixels);
+	co_await target.keys(openDialog);
+	if (!co_await target.regionMatches(dialog, 2000))
+		co_return;
+
+Regions are relative to the top left of the window. Pixels are 0x00RRGGBB, rows top to
+bottom, and the top byte is ignored. However often a probe is polled it captures at most once
+per capture interval, and the comparisons run four pixels at a time with SSE2 where the build
+targets it. SyntheticFrameSource stands in for the screen where there is none
+
+*/
+
+#include <Windows.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "WinAssist.h"
+#include "ClockSource.h"
+
+namespace pinterface {
+
+	class FrameSource {
+/*******************************************************************************
+		class FrameSource, public
+********************************************************************************/
+	public:
+		virtual ~FrameSource() = default;
+
+		// Copies the width x height pixels at (x, y) in screen coordinates into pixels. Returns false if they can't be read
+		virtual bool capture(LONG x, LONG y, LONG width, LONG height, std::vector<UINT32>& pixels) = 0;
+	};
+
+	// Reads the screen through GDI. Keeps its device contexts between captures, so use each from one thread
+	class GdiFrameSource : public FrameSource {
+/*******************************************************************************
+		class GdiFrameSource, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		HDC m_screen = NULL;
+		HDC m_memory = NULL;
+		HBITMAP m_bitmap = NULL;
+		LONG m_width = 0;
+		LONG m_height = 0;
+
+/*******************************************************************************
+		class GdiFrameSource, public
+********************************************************************************/
+	public:
+		GdiFrameSource();
+		~GdiFrameSource();
+		GdiFrameSource(const GdiFrameSource&) = delete;
+		GdiFrameSource& operator=(const GdiFrameSource&) = delete;
+
+		bool capture(LONG x, LONG y, LONG width, LONG height, std::vector<UINT32>& pixels) override;
+	};
+
+	// A framebuffer in memory standing in for the screen. Changes can be timed on a clock, to play a target that responds
+	// some time after its input. Safe to use from any thread
+	class SyntheticFrameSource : public FrameSource {
+/*******************************************************************************
+		class SyntheticFrameSource, private
+********************************************************************************/
+	private:
+		typedef struct TimedFill {
+			INT64 time;
+			LONG x;
+			LONG y;
+			LONG width;
+			LONG height;
+			UINT32 colour;
+		} TimedFill_t;
+
+		/* Private member functions */
+		void fillLocked(LONG x, LONG y, LONG width, LONG height, UINT32 colour);
+
+		/* Private member variables */
+		std::mutex m_mutex;
+		LONG m_width;
+		LONG m_height;
+		std::vector<UINT32> m_pixels;
+		std::shared_ptr<ClockSource> m_clock;
+		std::vector<TimedFill_t> m_timedFills;
+		UINT64 m_captures = 0;
+
+/*******************************************************************************
+		class SyntheticFrameSource, public
+********************************************************************************/
+	public:
+		// A black screen of the size given, with timed fills read against the clock if there is one
+		SyntheticFrameSource(LONG width, LONG height, std::shared_ptr<ClockSource> clock = nullptr);
+
+		// Fails for a region not wholly on the screen
+		bool capture(LONG x, LONG y, LONG width, LONG height, std::vector<UINT32>& pixels) override;
+
+		// Fills a rectangle now, clipped to the screen
+		void fill(LONG x, LONG y, LONG width, LONG height, UINT32 colour);
+		// Fills a rectangle once the clock reaches time, in microseconds
+		void fillAt(INT64 time, LONG x, LONG y, LONG width, LONG height, UINT32 colour);
+		UINT32 getPixel(LONG x, LONG y);
+		UINT64 getCaptureCount();
+	};
+
+	enum class ProbeMatch { PMATCH_EXACT, PMATCH_TOLERANCE, PMATCH_HASH };
+
+/*******************************************************************************
+		struct ProbeRegion
+********************************************************************************/
+	typedef struct ProbeRegion {
+		// Relative to the top left of the window
+		LONG x;
+		LONG y;
+		LONG width;
+		LONG height;
+	} ProbeRegion_t;
+
+/*******************************************************************************
+		struct ProbeStats
+********************************************************************************/
+	typedef struct ProbeStats {
+		UINT64 polls = 0;
+		UINT64 captures = 0;
+		UINT64 failedCaptures = 0;
+		UINT64 matches = 0;
+		// Time from the input the probe was armed with to the first capture that matched, in microseconds. Only as fine as
+		// the capture interval
+		UINT64 latencySamples = 0;
+		INT64 lastLatencyUs = -1;
+		INT64 minLatencyUs = 0;
+		INT64 maxLatencyUs = 0;
+		INT64 totalLatencyUs = 0;
+	} ProbeStats_t;
+
+	class ScreenProbe {
+/*******************************************************************************
+		class ScreenProbe, private
+********************************************************************************/
+	private:
+		/* Private member functions */
+		bool compare(const std::vector<UINT32>& pixels);
+
+		/* Private member variables */
+		std::shared_ptr<FrameSource> m_source;
+		ProbeRegion_t m_region;
+		ProbeMatch m_match;
+		BYTE m_tolerance;
+		std::vector<UINT32> m_reference;
+		UINT64 m_referenceHash = 0;
+		bool m_hasReference = false;
+		INT64 m_captureIntervalUs = DEFAULT_CAPTURE_INTERVAL_US;
+		// Reused between captures
+		std::vector<UINT32> m_pixels;
+		INT64 m_lastCapture = -1;
+		bool m_lastResult = false;
+		// Time of the input a response is awaited to, -1 when not armed
+		INT64 m_armedAt = -1;
+		// Time of the input the last latency was measured from
+		INT64 m_measuredInput = -1;
+		ProbeStats_t m_stats;
+
+/*******************************************************************************
+		class ScreenProbe, public
+********************************************************************************/
+	public:
+		/* Public static variables */
+		// 60 captures a second
+		static constexpr INT64 DEFAULT_CAPTURE_INTERVAL_US = 16667;
+
+		// Tolerance is the largest difference allowed in each colour channel, used by PMATCH_TOLERANCE. The probe matches
+		// nothing until it has a reference
+		ScreenProbe(std::shared_ptr<FrameSource> source, ProbeRegion_t region, ProbeMatch match = ProbeMatch::PMATCH_EXACT, BYTE tolerance = 0);
+
+		// Width x height pixels, rows top to bottom. Also sets the reference hash. Returns false if the size is wrong
+		bool setReference(std::vector<UINT32> pixels);
+		// For PMATCH_HASH only, see Hash()
+		void setReferenceHash(UINT64 hash);
+		// Takes the region as it is now as the reference
+		bool captureReference(const WinDimensions_t& window);
+		// Least time between captures in microseconds. 0 captures on every poll
+		void setCaptureInterval(INT64 intervalUs);
+		INT64 getCaptureInterval() const;
+
+		// Captures the region and compares it with the reference. now is the interface clock, in microseconds
+		bool check(const WinDimensions_t& window, INT64 now);
+		// As check(), unless the last capture was less than the capture interval ago, in which case its result is returned
+		bool poll(const WinDimensions_t& window, INT64 now);
+		// Starts measuring the latency to the next match from the input sent at inputTime, unless it has been already
+		void arm(INT64 inputTime);
+		bool getLastResult() const;
+
+		const ProbeRegion_t& getRegion() const;
+		ProbeMatch getMatch() const;
+		UINT64 getReferenceHash() const;
+		const ProbeStats_t& getStats() const;
+		void resetStats();
+
+		/* Public static functions */
+		// True if the colour of every pixel is the same
+		static bool Equal(const UINT32* a, const UINT32* b, size_t count);
+		// True if no colour channel of any pixel differs by more than tolerance
+		static bool Within(const UINT32* a, const UINT32* b, size_t count, BYTE tolerance);
+		// 64-bit FNV-1a of the colours, a pixel at a time
+		static UINT64 Hash(const UINT32* pixels, size_t count);
+		static UINT32 Rgb(BYTE r, BYTE g, BYTE b);
+	};
+
+}
@@ -0,0 +1,430 @@
+/*
+
+Script
+
+C++20 coroutine scripting on top of PegasusWinterface. Scripts suspend on co_await without
+holding a thread and are resumed by a ScriptScheduler when their deadline passes or the
+condition they wait on becomes true
+
+*/
+
+#include "Script.h"
+
+#include <algorithm>
+#include <thread>
+#include <iostream>
+#include <exception>
+
+namespace pi = pinterface;
+using namespace pi;
+using std::cerr;
+using std::endl;
+
+namespace {
+	// Orders the timer heap so the earliest deadline (then earliest suspension) is at the front
+	struct TimerLater {
+		template <typename T>
+		bool operator()(const T& a, const T& b) const {
+			if (a.deadline != b.deadline)
+				return a.deadline > b.deadline;
+			return a.order > b.order;
+		}
+	};
+
+	bool SameDimensions(const WinDimensions_t& a, const WinDimensions_t& b) {
+		return a.topLeft == b.topLeft && a.bottomRight == b.bottomRight && a.width == b.width && a.height == b.height;
+	}
+}
+
+/*******************************************************************************
+		class Script, public
+********************************************************************************/
+
+Script Script::promise_type::get_return_object() {
+	return Script(Handle::from_promise(*this));
+}
+
+void Script::promise_type::unhandled_exception() {
+	// The library doesn't use exceptions, so one escaping a script is a bug in the script
+	cerr << "Script: unhandled exception escaped a script, terminating" << endl;
+	std::terminate();
+}
+
+Script::Script(Handle handle) {
+	m_handle = handle;
+}
+
+Script::Script(Script&& other) noexcept {
+	m_handle = other.m_handle;
+	other.m_handle = nullptr;
+}
+
+Script::~Script() {
+	// Only destroys scripts that were never given to a scheduler
+	if (m_handle)
+		m_handle.destroy();
+}
+
+/*******************************************************************************
+		class Script, private
+********************************************************************************/
+
+Script::Handle Script::release() {
+	Handle h = m_handle;
+	m_handle = nullptr;
+	return h;
+}
+
+/*******************************************************************************
+		class ScriptScheduler, public
+********************************************************************************/
+
+ScriptScheduler::ScriptScheduler(std::shared_ptr<ClockSource> clock) {
+	m_clock = clock ? clock : std::make_shared<RealClock>();
+	m_adoptClock = !clock;
+	m_ready = std::make_shared<std::vector<std::coroutine_handle<>>>();
+}
+
+ScriptScheduler::~ScriptScheduler() {
+	for (Script::Handle h : m_scripts) {
+		h.destroy();
+	}
+}
+
+void ScriptScheduler::spawn(Script script) {
+	Script::Handle h = script.release();
+	if (!h)
+		return;
+	h.promise().scheduler = this;
+	m_scripts.push_back(h);
+	resume(h);
+}
+
+int ScriptScheduler::tick() {
+	int wait = PEGASUS_TICK_IDLE;
+	for (PegasusWinterface* app : m_interfaces) {
+		int appWait = app->tick();
+		if (appWait != PEGASUS_TICK_IDLE && (wait == PEGASUS_TICK_IDLE || appWait < wait))
+			wait = appWait;
+	}
+
+	// Resumed scripts may wait on another sequence, which could finish in the same tick, so take the list first
+	std::vector<std::coroutine_handle<>> ready;
+	ready.swap(*m_ready);
+	bool resumed = !ready.empty();
+	for (std::coroutine_handle<> h : ready)
+		resume(h);
+
+	INT64 current = now();
+	while (!m_timers.empty() && m_timers.front().deadline <= current) {
+		std::pop_heap(m_timers.begin(), m_timers.end(), TimerLater());
+		std::coroutine_handle<> h = m_timers.back().handle;
+		m_timers.pop_back();
+		resume(h);
+		resumed = true;
+	}
+
+	// Scripts resumed here may wait on a new condition, so poll a detached copy of the list
+	std::vector<ConditionEntry_t> waiting;
+	waiting.swap(m_conditions);
+	for (ConditionEntry_t& entry : waiting) {
+		if (entry.condition()) {
+			resume(entry.handle);
+			resumed = true;
+		}
+		else
+			m_conditions.push_back(std::move(entry));
+	}
+
+	// A resumed script may have submitted something the interfaces haven't seen yet, so they are ticked again straight away
+	if (resumed)
+		return 0;
+
+	int timerWait = nextDeadlineIn();
+	if (timerWait != PEGASUS_TICK_IDLE && (wait == PEGASUS_TICK_IDLE || timerWait < wait))
+		wait = timerWait;
+	if (!m_conditions.empty() && (wait == PEGASUS_TICK_IDLE || wait > 1))
+		wait = 1;
+	return wait;
+}
+
+void ScriptScheduler::run() {
+	while (scriptCount() > 0) {
+		int wait = tick();
+		if (wait <= 0)
+			continue;
+		if (m_clock->isVirtual())
+			m_clock->waitUntil(m_clock->now() + (INT64)wait * 1000);
+		else
+			std::this_thread::sleep_for(std::chrono::microseconds(m_clock->toRealDuration((INT64)wait * 1000)));
+	}
+}
+
+size_t ScriptScheduler::scriptCount() const {
+	return m_scripts.size();
+}
+
+void ScriptScheduler::resumeAt(INT64 deadlineMs, std::coroutine_handle<> h) {
+	m_timers.push_back({ deadlineMs, m_nextOrder++, h });
+	std::push_heap(m_timers.begin(), m_timers.end(), TimerLater());
+}
+
+void ScriptScheduler::resumeWhen(std::function<bool()> condition, std::coroutine_handle<> h) {
+	m_conditions.push_back({ std::move(condition), h });
+}
+
+std::function<void()> ScriptScheduler::resumeCallback(std::coroutine_handle<> h) {
+	std::weak_ptr<std::vector<std::coroutine_handle<>>> ready = m_ready;
+	return [ready, h]() {
+		if (std::shared_ptr<std::vector<std::coroutine_handle<>>> list = ready.lock())
+			list->push_back(h);
+	};
+}
+
+void ScriptScheduler::addInterface(PegasusWinterface* app) {
+	if (std::find(m_interfaces.begin(), m_interfaces.end(), app) != m_interfaces.end())
+		return;
+	m_interfaces.push_back(app);
+
+	std::shared_ptr<ClockSource> clock = app->getClock();
+	if (clock != m_clock) {
+		if (m_adoptClock) {
+			// Timers already running keep the time they have left
+			INT64 delta = clock->now() / 1000 - now();
+			for (TimerEntry_t& timer : m_timers)
+				timer.deadline += delta;
+			m_clock = clock;
+		}
+		else {
+			app->setClock(m_clock);
+		}
+	}
+	m_adoptClock = false;
+}
+
+INT64 ScriptScheduler::now() {
+	return m_clock->now() / 1000;
+}
+
+std::shared_ptr<ClockSource> ScriptScheduler::getClock() {
+	return m_clock;
+}
+
+/*******************************************************************************
+		class ScriptScheduler, private
+********************************************************************************/
+
+void ScriptScheduler::resume(std::coroutine_handle<> h) {
+	h.resume();
+	if (h.done()) {
+		auto it = std::find_if(m_scripts.begin(), m_scripts.end(), [h](Script::Handle s) { return s.address() == h.address(); });
+		if (it != m_scripts.end()) {
+			// Order of the script list doesn't matter, so swap with the last rather than shifting
+			*it = m_scripts.back();
+			m_scripts.pop_back();
+		}
+		h.destroy();
+	}
+}
+
+int ScriptScheduler::nextDeadlineIn() {
+	if (m_timers.empty())
+		return PEGASUS_TICK_IDLE;
+	INT64 wait = m_timers.front().deadline - now();
+	return wait < 0 ? 0 : (int)wait;
+}
+
+/*******************************************************************************
+		Awaitables
+********************************************************************************/
+
+DelayAwaiter::DelayAwaiter(int ms) {
+	m_ms = ms;
+}
+
+void DelayAwaiter::await_suspend(Script::Handle h) {
+	ScriptScheduler* scheduler = h.promise().scheduler;
+	scheduler->resumeAt(scheduler->now() + m_ms, h);
+}
+
+ConditionAwaiter::ConditionAwaiter(std::function<bool()> condition) {
+	m_condition = std::move(condition);
+}
+
+bool ConditionAwaiter::await_ready() {
+	return m_condition();
+}
+
+void ConditionAwaiter::await_suspend(Script::Handle h) {
+	h.promise().scheduler->resumeWhen(std::move(m_condition), h);
+}
+
+DelayAwaiter pi::delay(std::chrono::milliseconds ms) {
+	return DelayAwaiter((int)ms.count());
+}
+
+ConditionAwaiter pi::waitUntil(std::function<bool()> condition) {
+	return ConditionAwaiter(std::move(condition));
+}
+
+/*******************************************************************************
+		class ScriptTarget::SequenceAwaiter, public
+********************************************************************************/
+
+ScriptTarget::SequenceAwaiter::SequenceAwaiter(ScriptTarget* target, std::vector<TimedKeyEvent> keys, std::vector<TimedMouseEvent> mouse,
+	SubmitPriority priority) {
+	m_target = target;
+	m_keys = std::move(keys);
+	m_mouse = std::move(mouse);
+	m_priority = priority;
+}
+
+void ScriptTarget::SequenceAwaiter::await_suspend(Script::Handle h) {
+	ScriptScheduler* scheduler = h.promise().scheduler;
+	PegasusWinterface& app = m_target->app();
+	scheduler->addInterface(&app);
+
+	if (!m_keys.empty())
+		m_handle = app.submitKeys(std::move(m_keys), m_priority);
+	else
+		m_handle = app.submitMouse(std::move(m_mouse), m_priority);
+
+	m_handle.onFinished(scheduler->resumeCallback(h));
+}
+
+bool ScriptTarget::SequenceAwaiter::await_resume() const {
+	return !m_handle.isCancelled();
+}
+
+/*******************************************************************************
+		class ScriptTarget::GeometryAwaiter, public
+********************************************************************************/
+
+ScriptTarget::GeometryAwaiter::GeometryAwaiter(ScriptTarget* target) {
+	m_target = target;
+	m_start = target->app().getWindowDimensions();
+}
+
+void ScriptTarget::GeometryAwaiter::await_suspend(Script::Handle h) {
+	ScriptScheduler* scheduler = h.promise().scheduler;
+	ScriptTarget* target = m_target;
+	WinDimensions_t start = m_start;
+	scheduler->resumeWhen([target, scheduler, start]() { return !SameDimensions(target->geometry(*scheduler), start); }, h);
+}
+
+WinDimensions_t ScriptTarget::GeometryAwaiter::await_resume() const {
+	return m_target->app().getWindowDimensions();
+}
+
+/*******************************************************************************
+		class ScriptTarget::RegionAwaiter, public
+********************************************************************************/
+
+ScriptTarget::RegionAwaiter::RegionAwaiter(ScriptTarget* target, ScreenProbe* probe, int timeoutMs) {
+	m_target = target;
+	m_probe = probe;
+	m_timeoutMs = timeoutMs;
+}
+
+bool ScriptTarget::RegionAwaiter::await_ready() {
+	PegasusWinterface& app = m_target->app();
+	if (app.getLastInputTime() >= 0)
+		m_probe->arm(app.getLastInputTime());
+	return m_probe->check(app.getWindowDimensions(), app.getClock()->now());
+}
+
+void ScriptTarget::RegionAwaiter::await_suspend(Script::Handle h) {
+	ScriptScheduler* scheduler = h.promise().scheduler;
+	scheduler->addInterface(&m_target->app());
+	ScriptTarget* target = m_target;
+	ScreenProbe* probe = m_probe;
+	std::shared_ptr<ClockSource> clock = target->app().getClock();
+	INT64 deadline = m_timeoutMs < 0 ? -1 : scheduler->now() + m_timeoutMs;
+	scheduler->resumeWhen([target, scheduler, probe, clock, deadline]() {
+		return probe->poll(target->geometry(*scheduler), clock->now()) || (deadline >= 0 && scheduler->now() >= deadline);
+	}, h);
+}
+
+bool ScriptTarget::RegionAwaiter::await_resume() const {
+	return m_probe->getLastResult();
+}
+
+/*******************************************************************************
+		class ScriptTarget, public
+********************************************************************************/
+
+ScriptTarget::ScriptTarget(PegasusWinterface& app, UINT geometryPollMs) : m_app(app) {
+	m_geometryPollMs = geometryPollMs;
+}
+
+ScriptTarget::SequenceAwaiter ScriptTarget::type(const std::wstring& text, int delayMs, SubmitPriority priority) {
+	return SequenceAwaiter(this, TextToKeys(text, delayMs), {}, priority);
+}
+
+ScriptTarget::SequenceAwaiter ScriptTarget::keys(std::vector<TimedKeyEvent> keys, SubmitPriority priority) {
+	return SequenceAwaiter(this, std::move(keys), {}, priority);
+}
+
+ScriptTarget::SequenceAwaiter ScriptTarget::mouse(std::vector<TimedMouseEvent> evts, SubmitPriority priority) {
+	return SequenceAwaiter(this, {}, std::move(evts), priority);
+}
+
+ScriptTarget::GeometryAwaiter ScriptTarget::geometryChanged() {
+	return GeometryAwaiter(this);
+}
+
+ScriptTarget::RegionAwaiter ScriptTarget::regionMatches(ScreenProbe& probe, int timeoutMs) {
+	return RegionAwaiter(this, &probe, timeoutMs);
+}
+
+PegasusWinterface& ScriptTarget::app() {
+	return m_app;
+}
+
+WinDimensions_t ScriptTarget::geometry(ScriptScheduler& scheduler) {
+	INT64 current = scheduler.now();
+	if (m_lastGeometryPoll < 0 || current - m_lastGeometryPoll >= (INT64)m_geometryPollMs) {
+		m_app.update();
+		m_lastGeometryPoll = current;
+	}
+	return m_app.getWindowDimensions();
+}
+
+std::vector<TimedKeyEvent> ScriptTarget::TextToKeys(const std::wstring& text, int delayMs) {
+	std::vector<TimedKeyEvent> keys;
+	keys.reserve(text.size());
+
+	for (wchar_t c : text) {
+		if (c == L'\n') {
+			keys.push_back(TimedKeyEvent(KeyEvent(VK_RETURN), delayMs));
+			continue;
+		}
+
+		short scan = VkKeyScanW(c);
+		if (scan == -1) {
+			std::wcerr << "TextToKeys: no key for character '" << c << "' in the current layout, skipping" << endl;
+			continue;
+		}
+		WORD vk = (WORD)(scan & 0xFF);
+		BYTE shiftState = (BYTE)((scan >> 8) & 0xFF);
+
+		// Modifiers are held around the key in the same group so they can't be split up
+		std::vector<WORD> modifiers;
+		if (shiftState & 1)
+			modifiers.push_back(VK_SHIFT);
+		if (shiftState & 2)
+			modifiers.push_back(VK_CONTROL);
+		if (shiftState & 4)
+			modifiers.push_back(VK_MENU);
+
+		std::vector<KeyEvent> group;
+		for (WORD m : modifiers)
+			group.push_back(KeyEvent(m, KeyEvent::EventType::KEVT_PRESSED));
+		group.push_back(KeyEvent(vk));
+		for (auto it = modifiers.rbegin(); it != modifiers.rend(); ++it)
+			group.push_back(KeyEvent(*it, KeyEvent::EventType::KEVT_RELEASED));
+
+		keys.push_back(TimedKeyEvent(group, delayMs));
+	}
+	return keys;
+}
@@ -0,0 +1,252 @@
+#pragma once
+/*
+
+Script
+
+C++20 coroutine scripting on top of PegasusWinterface. Scripts suspend on co_await without
+holding a thread and are resumed by a ScriptScheduler when their deadline passes or the
+condition they wait on becomes true. Many scripts can share one dispatcher thread:
+
+	pi::Script hello(pi::ScriptTarget& target) {
+		co_await target.type(L"hello");
+		co_await pi::delay(std::chrono::milliseconds(250));
+		co_await target.geometryChanged();
+	}
+
+*/
+
+#include <coroutine>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+
+#include "PegasusWinterface.h"
+#include "ScreenProbe.h"
+
+namespace pinterface {
+
+	class ScriptScheduler;
+
+	class Script {
+/*******************************************************************************
+		class Script, public
+********************************************************************************/
+	public:
+		struct promise_type {
+			ScriptScheduler* scheduler = nullptr;
+
+			Script get_return_object();
+			// Scripts start suspended, ScriptScheduler::spawn starts them
+			std::suspend_always initial_suspend() noexcept { return {}; }
+			// Scripts stay suspended at the end so the scheduler can see they are done and destroy them
+			std::suspend_always final_suspend() noexcept { return {}; }
+			void return_void() {}
+			void unhandled_exception();
+		};
+		typedef std::coroutine_handle<promise_type> Handle;
+
+		Script(Handle handle);
+		Script(Script&& other) noexcept;
+		Script(const Script&) = delete;
+		Script& operator=(const Script&) = delete;
+		~Script();
+
+/*******************************************************************************
+		class Script, private
+********************************************************************************/
+	private:
+		friend class ScriptScheduler;
+		// Gives the coroutine to the caller, which becomes responsible for destroying it
+		Handle release();
+
+		/* Private member variables */
+		Handle m_handle;
+	};
+
+	class ScriptScheduler {
+/*******************************************************************************
+		class ScriptScheduler, public
+********************************************************************************/
+	public:
+		// Times the scripts on the clock given. With none, the scripts are timed on the clock of the first interface they
+		// use, and a RealClock until then. Every interface the scripts use is moved onto the scheduler's clock
+		ScriptScheduler(std::shared_ptr<ClockSource> clock = nullptr);
+		// Destroys any scripts that have not finished
+		~ScriptScheduler();
+		ScriptScheduler(const ScriptScheduler&) = delete;
+		ScriptScheduler& operator=(const ScriptScheduler&) = delete;
+
+		// Takes ownership of the script and runs it up to its first co_await
+		void spawn(Script script);
+		// Ticks the interfaces used by the scripts, then resumes every script whose sequence finished during the ticks, whose
+		// deadline has passed or whose condition is true. Must always be called from the same thread. Returns the time in ms
+		// until something may be due, or PEGASUS_TICK_IDLE if nothing is waiting. Conditions are polled, so scripts waiting
+		// on one keep this at 1 ms. Scripts waiting on a sequence don't, they are woken by it finishing. Returns 0 if any
+		// script was resumed, as it may have submitted something
+		int tick();
+		// Calls tick() until every script has finished, sleeping while nothing can be due. Under a virtual clock the clock
+		// is advanced instead of sleeping
+		void run();
+		// Number of scripts that have not finished
+		size_t scriptCount() const;
+
+		// Used by the awaitables, not normally called directly
+		void resumeAt(INT64 deadlineMs, std::coroutine_handle<> h);
+		void resumeWhen(std::function<bool()> condition, std::coroutine_handle<> h);
+		// A callback that resumes the script on the next pass of tick(), for SequenceHandle::onFinished. It does nothing once
+		// the scheduler is gone
+		std::function<void()> resumeCallback(std::coroutine_handle<> h);
+		// Ticks the interface from tick(). The first interface added gives its clock to a scheduler made without one. Any
+		// other on a different clock is moved onto the scheduler's, keeping the remaining delays of what it has queued
+		void addInterface(PegasusWinterface* app);
+		// Current time in ms on the scheduler clock
+		INT64 now();
+		std::shared_ptr<ClockSource> getClock();
+
+/*******************************************************************************
+		class ScriptScheduler, private
+********************************************************************************/
+	private:
+		typedef struct TimerEntry {
+			INT64 deadline;
+			UINT64 order; // Keeps scripts with the same deadline in the order they suspended
+			std::coroutine_handle<> handle;
+		} TimerEntry_t;
+
+		typedef struct ConditionEntry {
+			std::function<bool()> condition;
+			std::coroutine_handle<> handle;
+		} ConditionEntry_t;
+
+		/* Private member functions */
+		void resume(std::coroutine_handle<> h);
+		// Time until the next timer in ms, or PEGASUS_TICK_IDLE if there is none
+		int nextDeadlineIn();
+
+		/* Private member variables */
+		std::shared_ptr<ClockSource> m_clock;
+		// Set until the first interface is added if no clock was given, to take the interface's
+		bool m_adoptClock = false;
+		// Scripts whose sequence has finished. Shared with the callbacks, which only hold it weakly
+		std::shared_ptr<std::vector<std::coroutine_handle<>>> m_ready;
+		// Min heap on (deadline, order)
+		std::vector<TimerEntry_t> m_timers;
+		std::vector<ConditionEntry_t> m_conditions;
+		std::vector<PegasusWinterface*> m_interfaces;
+		std::vector<Script::Handle> m_scripts;
+		UINT64 m_nextOrder = 0;
+	};
+
+/*******************************************************************************
+		Awaitables
+********************************************************************************/
+	class DelayAwaiter {
+	public:
+		DelayAwaiter(int ms);
+		bool await_ready() const noexcept { return m_ms <= 0; }
+		void await_suspend(Script::Handle h);
+		void await_resume() const noexcept {}
+
+	private:
+		int m_ms;
+	};
+
+	class ConditionAwaiter {
+	public:
+		ConditionAwaiter(std::function<bool()> condition);
+		bool await_ready();
+		void await_suspend(Script::Handle h);
+		void await_resume() const noexcept {}
+
+	private:
+		std::function<bool()> m_condition;
+	};
+
+	// Suspends the script for the given time
+	DelayAwaiter delay(std::chrono::milliseconds ms);
+	// Suspends the script until the condition is true. The condition is polled on every ScriptScheduler::tick()
+	ConditionAwaiter waitUntil(std::function<bool()> condition);
+
+	class ScriptTarget {
+/*******************************************************************************
+		class ScriptTarget, public
+********************************************************************************/
+	public:
+		// Resumes the script once the submitted sequence has been sent. Returns false from co_await if it was cancelled
+		class SequenceAwaiter {
+		public:
+			SequenceAwaiter(ScriptTarget* target, std::vector<TimedKeyEvent> keys, std::vector<TimedMouseEvent> mouse, SubmitPriority priority);
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(Script::Handle h);
+			bool await_resume() const;
+
+		private:
+			ScriptTarget* m_target;
+			std::vector<TimedKeyEvent> m_keys;
+			std::vector<TimedMouseEvent> m_mouse;
+			SubmitPriority m_priority;
+			SequenceHandle m_handle;
+		};
+
+		// Resumes the script once the window has moved or been resized, returning the new dimensions
+		class GeometryAwaiter {
+		public:
+			GeometryAwaiter(ScriptTarget* target);
+			bool await_ready() const noexcept { return false; }
+			void await_suspend(Script::Handle h);
+			WinDimensions_t await_resume() const;
+
+		private:
+			ScriptTarget* m_target;
+			WinDimensions_t m_start;
+		};
+
+		// Resumes the script once the probe matches, or the timeout passes. Returns true from co_await if it matched
+		class RegionAwaiter {
+		public:
+			RegionAwaiter(ScriptTarget* target, ScreenProbe* probe, int timeoutMs);
+			// Arms the probe with the last input sent and checks it straight away
+			bool await_ready();
+			void await_suspend(Script::Handle h);
+			bool await_resume() const;
+
+		private:
+			ScriptTarget* m_target;
+			ScreenProbe* m_probe;
+			int m_timeoutMs;
+		};
+
+		// The interface must be bound, and both it and the target must outlive the scripts using them
+		ScriptTarget(PegasusWinterface& app, UINT geometryPollMs = 50);
+
+		// Types the text, one key group per character with delayMs between them
+		SequenceAwaiter type(const std::wstring& text, int delayMs = 0, SubmitPriority priority = SubmitPriority::SPRIO_NORMAL);
+		SequenceAwaiter keys(std::vector<TimedKeyEvent> keys, SubmitPriority priority = SubmitPriority::SPRIO_NORMAL);
+		SequenceAwaiter mouse(std::vector<TimedMouseEvent> evts, SubmitPriority priority = SubmitPriority::SPRIO_NORMAL);
+		GeometryAwaiter geometryChanged();
+		// Waits for the probe's region of the window to match its reference, up to timeoutMs or for good if negative. The
+		// probe captures at most once per its capture interval, and records the latency from the last input sent to the
+		// match. The probe must outlive the wait
+		RegionAwaiter regionMatches(ScreenProbe& probe, int timeoutMs = -1);
+
+		PegasusWinterface& app();
+		// Returns the window dimensions, refreshing them at most once per poll interval however many scripts ask
+		WinDimensions_t geometry(ScriptScheduler& scheduler);
+
+		// Builds the key groups to type text with the current keyboard layout. Characters with no key are skipped
+		static std::vector<TimedKeyEvent> TextToKeys(const std::wstring& text, int delayMs);
+
+/*******************************************************************************
+		class ScriptTarget, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		PegasusWinterface& m_app;
+		UINT m_geometryPollMs;
+		INT64 m_lastGeometryPoll = -1;
+	};
+
+}
@@ -0,0 +1,378 @@
+/*
+
+ScriptParser
+
+Incremental parser for the compact text script format used by the pwdrive driver
+
+*/
+
+#include "ScriptParser.h"
+#include "Script.h"
+
+#include <cstring>
+#include <charconv>
+#include <climits>
+
+namespace pi = pinterface;
+using namespace pi;
+
+namespace {
+	typedef struct KeyName {
+		const char* name;
+		WORD vk;
+		bool extended;
+	} KeyName_t;
+
+	const KeyName_t KEY_NAMES[] = {
+		{ "enter", VK_RETURN, false }, { "return", VK_RETURN, false }, { "tab", VK_TAB, false }, { "space", VK_SPACE, false },
+		{ "esc", VK_ESCAPE, false }, { "escape", VK_ESCAPE, false }, { "backspace", VK_BACK, false },
+		{ "delete", VK_DELETE, true }, { "del", VK_DELETE, true }, { "insert", VK_INSERT, true },
+		{ "shift", VK_SHIFT, false }, { "ctrl", VK_CONTROL, false }, { "control", VK_CONTROL, false },
+		{ "alt", VK_MENU, false }, { "win", VK_LWIN, true },
+		{ "up", VK_UP, true }, { "down", VK_DOWN, true }, { "left", VK_LEFT, true }, { "right", VK_RIGHT, true },
+		{ "home", VK_HOME, true }, { "end", VK_END, true }, { "pageup", VK_PRIOR, true }, { "pagedown", VK_NEXT, true },
+	};
+
+	bool EqualsNoCase(std::string_view a, const char* b) {
+		size_t n = strlen(b);
+		if (a.size() != n)
+			return false;
+		for (size_t i = 0; i < n; i++) {
+			char c = a[i];
+			if (c >= 'A' && c <= 'Z')
+				c = (char)(c - 'A' + 'a');
+			if (c != b[i])
+				return false;
+		}
+		return true;
+	}
+
+	bool IsExtendedKey(WORD vk) {
+		for (const KeyName_t& k : KEY_NAMES) {
+			if (k.vk == vk)
+				return k.extended;
+		}
+		return false;
+	}
+
+	bool MouseKeyFromName(std::string_view name, MouseEvent::MouseKey& key) {
+		if (EqualsNoCase(name, "left"))
+			key = MouseEvent::MouseKey::MKEY_LEFT;
+		else if (EqualsNoCase(name, "right"))
+			key = MouseEvent::MouseKey::MKEY_RIGHT;
+		else if (EqualsNoCase(name, "middle"))
+			key = MouseEvent::MouseKey::MKEY_MID;
+		else
+			return false;
+		return true;
+	}
+
+	std::string Unescape(std::string_view text) {
+		std::string out;
+		out.reserve(text.size());
+		for (size_t i = 0; i < text.size(); i++) {
+			char c = text[i];
+			if (c == '\\' && i + 1 < text.size()) {
+				char e = text[++i];
+				if (e == 'n')
+					c = '\n';
+				else if (e == 't')
+					c = '\t';
+				else
+					c = e; // \\ and \" and anything else
+			}
+			out.push_back(c);
+		}
+		return out;
+	}
+}
+
+/*******************************************************************************
+		class ScriptTokenizer, public
+********************************************************************************/
+
+ScriptTokenizer::ScriptTokenizer(std::string_view line) {
+	m_line = line;
+}
+
+ScriptTokenizer::Token_t ScriptTokenizer::next() {
+	while (m_pos < m_line.size() && (m_line[m_pos] == ' ' || m_line[m_pos] == '\t' || m_line[m_pos] == '\r'))
+		m_pos++;
+	if (m_pos >= m_line.size() || m_line[m_pos] == '#')
+		return { TokenType::TOK_END, std::string_view(), 0 };
+
+	size_t start = m_pos;
+	char c = m_line[m_pos];
+
+	if (c == '+') {
+		m_pos++;
+		return { TokenType::TOK_PLUS, m_line.substr(start, 1), 0 };
+	}
+
+	if (c == '"') {
+		m_pos++;
+		while (m_pos < m_line.size() && m_line[m_pos] != '"') {
+			if (m_line[m_pos] == '\\')
+				m_pos++;
+			m_pos++;
+		}
+		if (m_pos >= m_line.size())
+			return { TokenType::TOK_ERROR, m_line.substr(start), 0 };
+		m_pos++;
+		return { TokenType::TOK_STRING, m_line.substr(start + 1, m_pos - start - 2), 0 };
+	}
+
+	while (m_pos < m_line.size()) {
+		char w = m_line[m_pos];
+		if (w == ' ' || w == '\t' || w == '\r' || w == '+' || w == '#' || w == '"')
+			break;
+		m_pos++;
+	}
+	std::string_view text = m_line.substr(start, m_pos - start);
+
+	// Numbers are decimal, optionally negative, or hex with 0x
+	const char* first = text.data();
+	const char* last = text.data() + text.size();
+	int base = 10;
+	if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+		first += 2;
+		base = 16;
+	}
+	long long number = 0;
+	std::from_chars_result result = std::from_chars(first, last, number, base);
+	if (result.ec == std::errc() && result.ptr == last)
+		return { TokenType::TOK_NUMBER, text, number };
+	return { TokenType::TOK_WORD, text, 0 };
+}
+
+/*******************************************************************************
+		class ScriptParser, public
+********************************************************************************/
+
+ScriptParser::ScriptParser() {
+}
+
+bool ScriptParser::feed(const char* data, size_t length, std::vector<TimedEvent>& out) {
+	const char* end = data + length;
+	const char* start = data;
+	while (start < end) {
+		const char* newline = (const char*)memchr(start, '\n', end - start);
+		if (newline == nullptr)
+			break;
+
+		bool ok;
+		if (!m_partial.empty()) {
+			// Finish the line started in an earlier chunk
+			m_partial.append(start, newline - start);
+			ok = parseLine(m_partial, out);
+			m_partial.clear();
+		}
+		else {
+			ok = parseLine(std::string_view(start, newline - start), out);
+		}
+		if (!ok)
+			return false;
+		start = newline + 1;
+	}
+	m_partial.append(start, end - start);
+	return true;
+}
+
+bool ScriptParser::finish(std::vector<TimedEvent>& out) {
+	if (!m_partial.empty()) {
+		bool ok = parseLine(m_partial, out);
+		m_partial.clear();
+		if (!ok)
+			return false;
+	}
+	if (m_pendingWait > 0)
+		out.push_back(TimedKeyEvent(std::vector<KeyEvent>(), takeDelay()));
+	return true;
+}
+
+size_t ScriptParser::getLine() const {
+	return m_line;
+}
+
+const std::string& ScriptParser::getError() const {
+	return m_error;
+}
+
+WORD ScriptParser::KeyFromName(std::string_view name) {
+	if (name.size() == 1) {
+		char c = name[0];
+		if (c >= 'a' && c <= 'z')
+			return (WORD)(c - 'a' + 'A');
+		if ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+			return (WORD)c;
+		return 0;
+	}
+
+	if (name.size() > 2 && name[0] == '0' && (name[1] == 'x' || name[1] == 'X')) {
+		unsigned value = 0;
+		std::from_chars_result result = std::from_chars(name.data() + 2, name.data() + name.size(), value, 16);
+		if (result.ec == std::errc() && result.ptr == name.data() + name.size() && value > 0 && value < 0xFF)
+			return (WORD)value;
+		return 0;
+	}
+
+	if ((name[0] == 'f' || name[0] == 'F') && name.size() <= 3) {
+		int n = 0;
+		std::from_chars_result result = std::from_chars(name.data() + 1, name.data() + name.size(), n);
+		if (result.ec == std::errc() && result.ptr == name.data() + name.size() && n >= 1 && n <= 12)
+			return (WORD)(VK_F1 + n - 1);
+	}
+
+	for (const KeyName_t& k : KEY_NAMES) {
+		if (EqualsNoCase(name, k.name))
+			return k.vk;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+		class ScriptParser, private
+********************************************************************************/
+
+int ScriptParser::takeDelay() {
+	// wait and pace keep the sum within an int
+	int delay = (int)(m_pace + m_pendingWait);
+	m_pendingWait = 0;
+	return delay;
+}
+
+bool ScriptParser::fail(const std::string& message) {
+	m_error = "line " + std::to_string(m_line) + ": " + message;
+	return false;
+}
+
+bool ScriptParser::parseLine(std::string_view line, std::vector<TimedEvent>& out) {
+	typedef ScriptTokenizer::TokenType TT;
+	m_line++;
+
+	ScriptTokenizer tokens(line);
+	ScriptTokenizer::Token_t cmd = tokens.next();
+	if (cmd.type == TT::TOK_END)
+		return true;
+	if (cmd.type != TT::TOK_WORD)
+		return fail("expected a command, got '" + std::string(cmd.text) + "'");
+
+	ScriptTokenizer::Token_t arg = tokens.next();
+
+	auto keyArg = [&](WORD& vk) {
+		vk = (arg.type == TT::TOK_WORD || arg.type == TT::TOK_NUMBER) ? KeyFromName(arg.text) : 0;
+		return vk != 0;
+	};
+	auto numberArg = [&](long long& value) {
+		if (arg.type != TT::TOK_NUMBER)
+			return false;
+		value = arg.number;
+		return true;
+	};
+
+	if (EqualsNoCase(cmd.text, "key")) {
+		if (arg.type == TT::TOK_END)
+			return fail("key needs at least one key");
+		while (arg.type != TT::TOK_END) {
+			WORD vk;
+			if (!keyArg(vk))
+				return fail("unknown key '" + std::string(arg.text) + "'");
+			out.push_back(TimedKeyEvent(KeyEvent(vk, KeyEvent::EventType::KEVT_TYPED, true, IsExtendedKey(vk)), takeDelay()));
+			arg = tokens.next();
+		}
+		return true;
+	}
+
+	if (EqualsNoCase(cmd.text, "down") || EqualsNoCase(cmd.text, "up")) {
+		WORD vk;
+		if (!keyArg(vk))
+			return fail("unknown key '" + std::string(arg.text) + "'");
+		KeyEvent::EventType type = EqualsNoCase(cmd.text, "down") ? KeyEvent::EventType::KEVT_PRESSED : KeyEvent::EventType::KEVT_RELEASED;
+		out.push_back(TimedKeyEvent(KeyEvent(vk, type, true, IsExtendedKey(vk)), takeDelay()));
+		arg = tokens.next();
+	}
+	else if (EqualsNoCase(cmd.text, "chord")) {
+		std::vector<WORD> keys;
+		while (true) {
+			WORD vk;
+			if (!keyArg(vk))
+				return fail("unknown key '" + std::string(arg.text) + "' in chord");
+			keys.push_back(vk);
+			arg = tokens.next();
+			if (arg.type != TT::TOK_PLUS)
+				break;
+			arg = tokens.next();
+		}
+		std::vector<KeyEvent> group;
+		for (WORD vk : keys)
+			group.push_back(KeyEvent(vk, KeyEvent::EventType::KEVT_PRESSED, true, IsExtendedKey(vk)));
+		for (auto it = keys.rbegin(); it != keys.rend(); ++it)
+			group.push_back(KeyEvent(*it, KeyEvent::EventType::KEVT_RELEASED, true, IsExtendedKey(*it)));
+		out.push_back(TimedKeyEvent(group, takeDelay()));
+	}
+	else if (EqualsNoCase(cmd.text, "text")) {
+		if (arg.type != TT::TOK_STRING)
+			return fail("text needs a quoted string");
+		std::vector<TimedKeyEvent> keys = ScriptTarget::TextToKeys(WinAssist::Utf8ToWide(Unescape(arg.text)), m_pace);
+		for (size_t i = 0; i < keys.size(); i++) {
+			out.push_back(i == 0 ? TimedKeyEvent(keys[i].getEvents(), takeDelay()) : keys[i]);
+		}
+		arg = tokens.next();
+	}
+	else if (EqualsNoCase(cmd.text, "move") || EqualsNoCase(cmd.text, "moveto")) {
+		long long x, y;
+		if (!numberArg(x))
+			return fail("move needs two numbers");
+		arg = tokens.next();
+		if (!numberArg(y))
+			return fail("move needs two numbers");
+		MouseEvent evt(EqualsNoCase(cmd.text, "move") ? MouseEvent::EventType::MEVT_MOVE : MouseEvent::EventType::MEVT_MOVE_ABS);
+		evt.setMoveValues((LONG)x, (LONG)y);
+		out.push_back(TimedMouseEvent(evt, takeDelay()));
+		arg = tokens.next();
+	}
+	else if (EqualsNoCase(cmd.text, "click") || EqualsNoCase(cmd.text, "mdown") || EqualsNoCase(cmd.text, "mup")) {
+		MouseEvent::MouseKey button = MouseEvent::MouseKey::MKEY_LEFT;
+		if (arg.type != TT::TOK_END) {
+			if (!MouseKeyFromName(arg.text, button))
+				return fail("unknown mouse button '" + std::string(arg.text) + "'");
+			arg = tokens.next();
+		}
+		MouseEvent::EventType type = MouseEvent::EventType::MEVT_KEY_PRESSED;
+		if (EqualsNoCase(cmd.text, "mdown"))
+			type = MouseEvent::EventType::MEVT_KEY_DOWN;
+		else if (EqualsNoCase(cmd.text, "mup"))
+			type = MouseEvent::EventType::MEVT_KEY_UP;
+		out.push_back(TimedMouseEvent(MouseEvent(type, button), takeDelay()));
+	}
+	else if (EqualsNoCase(cmd.text, "scroll")) {
+		long long delta;
+		if (!numberArg(delta))
+			return fail("scroll needs a number");
+		MouseEvent evt(MouseEvent::EventType::MEVT_SCROLL);
+		evt.setScrollDelta((DWORD)delta);
+		out.push_back(TimedMouseEvent(evt, takeDelay()));
+		arg = tokens.next();
+	}
+	else if (EqualsNoCase(cmd.text, "wait") || EqualsNoCase(cmd.text, "pace")) {
+		long long ms;
+		if (!numberArg(ms) || ms < 0 || ms > INT_MAX)
+			return fail(std::string(cmd.text) + " needs a time in ms");
+		bool wait = EqualsNoCase(cmd.text, "wait");
+		// Both are at most INT_MAX, so the sum can't overflow
+		INT64 pending = wait ? m_pendingWait + ms : m_pendingWait;
+		INT64 pace = wait ? m_pace : ms;
+		if (pace + pending > INT_MAX)
+			return fail("the delay before the next group would be over " + std::to_string(INT_MAX) + " ms");
+		m_pendingWait = pending;
+		m_pace = (int)pace;
+		arg = tokens.next();
+	}
+	else {
+		return fail("unknown command '" + std::string(cmd.text) + "'");
+	}
+
+	if (arg.type != TT::TOK_END)
+		return fail("unexpected '" + std::string(arg.text) + "' after " + std::string(cmd.text));
+	return true;
+}
@@ -0,0 +1,105 @@
+#pragma once
+/*
+
+ScriptParser
+
+Incremental parser for the compact text script format used by the pwdrive driver. Input
+can arrive in chunks of any size, complete lines are turned into event groups as soon as
+they are seen. One command per line, # starts a comment:
+
+	key A B enter       types each key, one group per key
+	down shift          presses a key
+	up shift            releases a key
+	chord ctrl+shift+s  presses the keys in order and releases them in reverse, as one group
+	text "Hello\n"      types the text with the current keyboard layout
+	move 10 -5          moves the mouse relative to where it is
+	moveto 32768 32768  moves the mouse to normalised absolute coordinates
+	click left          clicks a mouse button (left, right or middle)
+	mdown left          presses a mouse button
+	mup left            releases a mouse button
+	scroll -120         scrolls the wheel
+	wait 250            waits before the next group, in ms
+	pace 30             waits before every group from now on, in ms
+
+Keys are a single letter or digit, a name (enter, tab, space, esc, backspace, delete, shift,
+ctrl, alt, win, up, down, left, right, home, end, f1 to f12) or a hex virtual key (0x41)
+
+*/
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "TimedEvents.h"
+
+namespace pinterface {
+
+	class ScriptTokenizer {
+/*******************************************************************************
+		class ScriptTokenizer, public
+********************************************************************************/
+	public:
+		enum class TokenType { TOK_END, TOK_WORD, TOK_NUMBER, TOK_STRING, TOK_PLUS, TOK_ERROR };
+
+		// Token text points into the line given to the tokenizer, nothing is copied
+		typedef struct Token {
+			TokenType type;
+			std::string_view text; // For TOK_STRING, the contents between the quotes with escapes still in place
+			long long number; // Only set for TOK_NUMBER
+		} Token_t;
+
+		// The line must outlive the tokenizer and its tokens
+		ScriptTokenizer(std::string_view line);
+		// Returns TOK_END at the end of the line or at a comment
+		Token_t next();
+
+/*******************************************************************************
+		class ScriptTokenizer, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		std::string_view m_line;
+		size_t m_pos = 0;
+	};
+
+	class ScriptParser {
+/*******************************************************************************
+		class ScriptParser, public
+********************************************************************************/
+	public:
+		ScriptParser();
+
+		// Parses every complete line in the data, appending the groups to out. An incomplete last line is kept until the
+		// next call. Returns false at the first bad line, see getError()
+		bool feed(const char* data, size_t length, std::vector<TimedEvent>& out);
+		// Parses whatever is left at the end of the input. A trailing wait becomes an empty group so it is still honoured
+		bool finish(std::vector<TimedEvent>& out);
+
+		// Line number of the last line parsed, from 1
+		size_t getLine() const;
+		const std::string& getError() const;
+
+		// Virtual key for a key name, or 0 if the name is not a key
+		static WORD KeyFromName(std::string_view name);
+
+/*******************************************************************************
+		class ScriptParser, private
+********************************************************************************/
+	private:
+		/* Private member functions */
+		bool parseLine(std::string_view line, std::vector<TimedEvent>& out);
+		// Delay for the next group, using up any waits before it
+		int takeDelay();
+		bool fail(const std::string& message);
+
+		/* Private member variables */
+		// Start of a line split across calls to feed(). The only copy of the input the parser makes
+		std::string m_partial;
+		size_t m_line = 0;
+		int m_pace = 0;
+		// Waits since the last group. Kept wide so a run of long waits can be caught before it overflows the delay
+		INT64 m_pendingWait = 0;
+		std::string m_error;
+	};
+
+}
@@ -0,0 +1,354 @@
+/*
+
+SequenceJournal
+
+Append-only, memory mapped journal of submitted sequences and how far each has been sent
+
+*/
+
+#include "SequenceJournal.h"
+#include "InjectProtocol.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+namespace pi = pinterface;
+using namespace pi;
+using std::cerr;
+using std::wcerr;
+using std::endl;
+
+static const char JOURNAL_MAGIC[8] = { 'P', 'W', 'J', 'R', 'N', 'L', '\0', '\0' };
+static const UINT32 JOURNAL_VERSION = 1;
+
+typedef struct JournalFileHeader {
+	char magic[8];
+	UINT32 version;
+	UINT32 reserved;
+} JournalFileHeader_t;
+
+// Followed by bytes of payload. Every record is a multiple of 8 bytes long
+typedef struct JournalRecordHeader {
+	UINT32 type;
+	UINT32 bytes;
+	UINT64 id;
+	// Priority of a sequence, or the groups done with from the start
+	UINT32 value;
+	// FNV-1a of the header, with this zeroed, and the payload. A record torn by the machine going down fails it
+	UINT32 checksum;
+} JournalRecordHeader_t;
+static_assert(sizeof(JournalRecordHeader_t) % 8 == 0, "Journal records are kept 8 byte aligned");
+
+static UINT32 Checksum(JournalRecordHeader_t header, const void* payload) {
+	header.checksum = 0;
+	UINT32 hash = 2166136261u;
+	const BYTE* parts[2] = { (const BYTE*)&header, (const BYTE*)payload };
+	size_t lengths[2] = { sizeof(header), header.bytes };
+	for (int p = 0; p < 2; p++) {
+		for (size_t i = 0; i < lengths[p]; i++) {
+			hash ^= parts[p][i];
+			hash *= 16777619u;
+		}
+	}
+	return hash;
+}
+
+/*******************************************************************************
+		class SequenceJournal, private
+********************************************************************************/
+/* Private member functions */
+SequenceJournal::SequenceJournal(const std::wstring& path, const JournalConfig_t& config) : m_path(path), m_config(config) {
+
+}
+
+bool SequenceJournal::map(const std::wstring& path, DWORD disposition) {
+	m_file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, disposition, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE) {
+		wcerr << "Unable to open the journal '" << path << "' (error " << GetLastError() << ")" << endl;
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size))
+		size.QuadPart = 0;
+	m_mappedBytes = std::max<size_t>(std::max<size_t>(m_config.initialBytes, 4096), (size_t)size.QuadPart);
+	return grow(m_mappedBytes);
+}
+
+void SequenceJournal::unmap() {
+	if (m_view != nullptr)
+		UnmapViewOfFile(m_view);
+	if (m_mapping != NULL)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_view = nullptr;
+	m_mapping = NULL;
+	m_file = INVALID_HANDLE_VALUE;
+}
+
+bool SequenceJournal::grow(size_t needed) {
+	size_t size = m_view == nullptr ? needed : std::max(m_mappedBytes * 2, needed);
+	if (m_view != nullptr)
+		UnmapViewOfFile(m_view);
+	if (m_mapping != NULL)
+		CloseHandle(m_mapping);
+	m_view = nullptr;
+
+	// Mapping beyond the end of the file extends it with zeroes, which read back as the end of the records
+	m_mapping = CreateFileMappingW(m_file, NULL, PAGE_READWRITE, (DWORD)((UINT64)size >> 32), (DWORD)size, NULL);
+	if (m_mapping != NULL)
+		m_view = (BYTE*)MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (m_view == nullptr) {
+		wcerr << "Unable to map " << size << " bytes of the journal '" << m_path << "' (error " << GetLastError() << ")" << endl;
+		return false;
+	}
+	m_mappedBytes = size;
+	return true;
+}
+
+bool SequenceJournal::writeRecord(JournalRecord type, UINT64 id, UINT32 value, const void* payload, UINT32 bytes) {
+	if (m_view == nullptr)
+		return false;
+	size_t size = sizeof(JournalRecordHeader_t) + bytes;
+	// Room is kept for an empty header after the record, which marks the end
+	if (m_tail + size + sizeof(JournalRecordHeader_t) > m_mappedBytes && !grow(m_tail + size + sizeof(JournalRecordHeader_t)))
+		return false;
+
+	JournalRecordHeader_t header = { (UINT32)type, bytes, id, value, 0 };
+	header.checksum = Checksum(header, payload);
+	// The payload goes in first, so the header never announces a record that isn't there
+	if (bytes > 0)
+		memcpy(m_view + m_tail + sizeof(header), payload, bytes);
+	memcpy(m_view + m_tail, &header, sizeof(header));
+	m_tail += size;
+	m_unflushed++;
+	m_records++;
+	return true;
+}
+
+bool SequenceJournal::flushLocked() {
+	if (m_view == nullptr)
+		return false;
+	bool flushed = true;
+	if (m_tail > m_flushed)
+		flushed = FlushViewOfFile(m_view + m_flushed, m_tail - m_flushed) != 0;
+	m_flushed = m_tail;
+	m_unflushed = 0;
+	m_sinceFlush.restart();
+	return flushed;
+}
+
+bool SequenceJournal::load(const std::wstring& path) {
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return true; // A new journal
+
+	LARGE_INTEGER size;
+	std::vector<BYTE> data;
+	if (GetFileSizeEx(file, &size))
+		data.resize((size_t)size.QuadPart);
+	size_t read = 0;
+	while (read < data.size()) {
+		DWORD chunk = 0;
+		if (!ReadFile(file, data.data() + read, (DWORD)std::min<size_t>(data.size() - read, 1 << 30), &chunk, NULL) || chunk == 0)
+			break;
+		read += chunk;
+	}
+	CloseHandle(file);
+	data.resize(read);
+	if (data.empty())
+		return true;
+
+	JournalFileHeader_t fileHeader;
+	if (data.size() < sizeof(fileHeader) || memcmp(data.data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0) {
+		wcerr << "'" << path << "' is not a journal" << endl;
+		return false;
+	}
+	memcpy(&fileHeader, data.data(), sizeof(fileHeader));
+	if (fileHeader.version != JOURNAL_VERSION) {
+		wcerr << "The journal '" << path << "' is version " << fileHeader.version << ", expected " << JOURNAL_VERSION << endl;
+		return false;
+	}
+
+	typedef struct Pending {
+		SubmitPriority priority;
+		std::vector<InjectEvent_t> events;
+		UINT32 acknowledged = 0;
+	} Pending_t;
+	// In id order, which is the order they were submitted in
+	std::map<UINT64, Pending_t> pending;
+
+	size_t at = sizeof(fileHeader);
+	while (at + sizeof(JournalRecordHeader_t) <= data.size()) {
+		JournalRecordHeader_t header;
+		memcpy(&header, data.data() + at, sizeof(header));
+		if (header.type == (UINT32)JournalRecord::JREC_NONE)
+			break;
+		const BYTE* payload = data.data() + at + sizeof(header);
+		if (header.bytes > data.size() - at - sizeof(header) || Checksum(header, payload) != header.checksum) {
+			wcerr << "The journal '" << path << "' is damaged at offset " << at << ", the rest of it is ignored" << endl;
+			break;
+		}
+
+		switch ((JournalRecord)header.type) {
+		case JournalRecord::JREC_SEQUENCE: {
+			Pending_t& seq = pending[header.id];
+			seq.priority = (SubmitPriority)std::min<UINT32>(header.value, SUBMIT_PRIORITY_COUNT - 1);
+			seq.events.resize(header.bytes / sizeof(InjectEvent_t));
+			memcpy(seq.events.data(), payload, seq.events.size() * sizeof(InjectEvent_t));
+			break;
+		}
+		case JournalRecord::JREC_PROGRESS: {
+			auto found = pending.find(header.id);
+			if (found != pending.end())
+				found->second.acknowledged = std::max(found->second.acknowledged, header.value);
+			break;
+		}
+		case JournalRecord::JREC_END:
+			pending.erase(header.id);
+			break;
+		default:
+			break;
+		}
+		m_nextId = std::max(m_nextId, header.id + 1);
+		at += sizeof(header) + header.bytes;
+	}
+
+	for (auto& p : pending) {
+		JournaledSequence_t seq;
+		seq.id = p.first;
+		seq.priority = p.second.priority;
+		if (!DecodeInjectEvents(p.second.events.data(), (UINT32)p.second.events.size(), seq.groups)) {
+			wcerr << "Sequence " << seq.id << " in the journal '" << path << "' can't be read, skipping it" << endl;
+			continue;
+		}
+		// Carry on from the group after the last one sent
+		size_t sent = std::min<size_t>(p.second.acknowledged, seq.groups.size());
+		seq.groups.erase(seq.groups.begin(), seq.groups.begin() + sent);
+		if (!seq.groups.empty()) {
+			m_progress[seq.id] = { 0, (UINT32)seq.groups.size() };
+			m_unfinished.push_back(std::move(seq));
+		}
+	}
+	return true;
+}
+
+/*******************************************************************************
+		class SequenceJournal, public
+********************************************************************************/
+/* Public static functions */
+std::shared_ptr<SequenceJournal> SequenceJournal::Open(const std::wstring& path, const JournalConfig_t& config) {
+	std::shared_ptr<SequenceJournal> journal(new SequenceJournal(path, config));
+	if (!journal->load(path))
+		return nullptr;
+
+	// Compacted into a new file that replaces the old one once complete, so a crash part way leaves the old one as it was
+	std::wstring temp = path + L".tmp";
+	if (!journal->map(temp, CREATE_ALWAYS))
+		return nullptr;
+	JournalFileHeader_t fileHeader = {};
+	memcpy(fileHeader.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+	fileHeader.version = JOURNAL_VERSION;
+	memcpy(journal->m_view, &fileHeader, sizeof(fileHeader));
+	journal->m_tail = sizeof(fileHeader);
+
+	for (auto& seq : journal->m_unfinished) {
+		std::vector<InjectEvent_t> events;
+		EncodeInjectEvents(0, seq.groups, seq.priority, events);
+		journal->writeRecord(JournalRecord::JREC_SEQUENCE, seq.id, (UINT32)seq.priority, events.data(), (UINT32)(events.size() * sizeof(InjectEvent_t)));
+	}
+	bool written = journal->sync();
+	journal->unmap();
+	if (!written || !MoveFileExW(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		wcerr << "Unable to replace the journal '" << path << "' (error " << GetLastError() << ")" << endl;
+		return nullptr;
+	}
+
+	if (!journal->map(path, OPEN_EXISTING))
+		return nullptr;
+	journal->m_flushed = journal->m_tail;
+	if (!journal->m_unfinished.empty())
+		wcerr << "The journal '" << path << "' has " << journal->m_unfinished.size() << " unfinished sequences" << endl;
+	return journal;
+}
+
+SequenceJournal::~SequenceJournal() {
+	sync();
+	unmap();
+}
+
+/* Public member functions */
+UINT64 SequenceJournal::append(std::vector<TimedEvent>& groups, SubmitPriority priority) {
+	std::vector<InjectEvent_t> events;
+	EncodeInjectEvents(0, groups, priority, events);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	UINT64 id = m_nextId++;
+	if (!writeRecord(JournalRecord::JREC_SEQUENCE, id, (UINT32)priority, events.data(), (UINT32)(events.size() * sizeof(InjectEvent_t))))
+		return 0;
+	m_progress[id] = { 0, (UINT32)groups.size() };
+	return id;
+}
+
+void SequenceJournal::acknowledge(UINT64 id, UINT32 group) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto found = m_progress.find(id);
+	// Already ended, or a group at or before one already recorded
+	if (found == m_progress.end() || group < found->second.first)
+		return;
+	UINT32 count = group + 1;
+	found->second.first = count;
+	if (count < found->second.second)
+		writeRecord(JournalRecord::JREC_PROGRESS, id, count, nullptr, 0);
+	else {
+		writeRecord(JournalRecord::JREC_END, id, 0, nullptr, 0);
+		m_progress.erase(found);
+	}
+}
+
+void SequenceJournal::finish(UINT64 id) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_progress.erase(id) > 0)
+		writeRecord(JournalRecord::JREC_END, id, 0, nullptr, 0);
+}
+
+void SequenceJournal::flushIfDue() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_unflushed == 0)
+		return;
+	if (m_unflushed >= m_config.flushRecords || m_sinceFlush.getElapsedTimeAsMicroseconds() >= m_config.flushIntervalUs)
+		flushLocked();
+}
+
+bool SequenceJournal::flush() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return flushLocked();
+}
+
+bool SequenceJournal::sync() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return flushLocked() && FlushFileBuffers(m_file) != 0;
+}
+
+std::vector<JournaledSequence_t> SequenceJournal::takeUnfinished() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::vector<JournaledSequence_t> unfinished = std::move(m_unfinished);
+	m_unfinished.clear();
+	return unfinished;
+}
+
+const std::wstring& SequenceJournal::getPath() const {
+	return m_path;
+}
+
+UINT64 SequenceJournal::getRecordCount() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_records;
+}
+
+size_t SequenceJournal::getSize() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_tail;
+}
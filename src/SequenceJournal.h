@@ -0,0 +1,136 @@
+#pragma once
+/*
+
+SequenceJournal
+
+Append-only journal of the sequences submitted to a PegasusWinterface and how far each one
+has been sent, kept in a memory mapped file. Records are written straight into the mapping,
+which the OS keeps if the process dies, and flushed towards the disk in batches in case the
+machine goes down too. After a restart the journal is opened again and whatever had not been
+sent carries on from the last group that was:
+
+	std::shared_ptr<pi::SequenceJournal> journal = pi::SequenceJournal::Open(L"macro.pwj");
+	app.setJournal(journal);
+	app.resumeJournal();
+
+Opening compacts the file down to the unfinished sequences. Groups are stored in the
+InjectEvent_t layout, so a compiled plan is journaled as the groups it was compiled from
+
+*/
+
+#include <Windows.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "TimedEvents.h"
+#include "SubmissionQueue.h"
+#include "PegasusTimer.h"
+
+namespace pinterface {
+
+	enum class JournalRecord : UINT32 { JREC_NONE, JREC_SEQUENCE, JREC_PROGRESS, JREC_END };
+
+/*******************************************************************************
+		struct JournalConfig
+********************************************************************************/
+	typedef struct JournalConfig {
+		// Size the file is mapped at to begin with. It doubles whenever it fills up
+		size_t initialBytes = 1 << 20;
+		// Flushes once this many records have been written since the last flush, or once flushIntervalUs has passed with
+		// any written, whichever comes first
+		UINT32 flushRecords = 256;
+		INT64 flushIntervalUs = 100000;
+	} JournalConfig_t;
+
+/*******************************************************************************
+		struct JournaledSequence
+********************************************************************************/
+	// A sequence found unfinished when the journal was opened
+	typedef struct JournaledSequence {
+		UINT64 id;
+		SubmitPriority priority;
+		// The groups still to send
+		std::vector<TimedEvent> groups;
+	} JournaledSequence_t;
+
+	class SequenceJournal {
+/*******************************************************************************
+		class SequenceJournal, private
+********************************************************************************/
+	private:
+		/* Private member functions */
+		SequenceJournal(const std::wstring& path, const JournalConfig_t& config);
+		// Opens the file and maps it, at least as large as it already is
+		bool map(const std::wstring& path, DWORD disposition);
+		void unmap();
+		// Remaps the file at twice its size, or more if needed
+		bool grow(size_t needed);
+		bool writeRecord(JournalRecord type, UINT64 id, UINT32 value, const void* payload, UINT32 bytes);
+		// flush() with m_mutex already held
+		bool flushLocked();
+		// Reads the records of an existing journal into m_unfinished. Returns false if the file isn't a journal
+		bool load(const std::wstring& path);
+
+		/* Private member variables */
+		std::mutex m_mutex;
+		std::wstring m_path;
+		JournalConfig_t m_config;
+		HANDLE m_file = INVALID_HANDLE_VALUE;
+		HANDLE m_mapping = NULL;
+		BYTE* m_view = nullptr;
+		size_t m_mappedBytes = 0;
+		// Offset the next record is written at
+		size_t m_tail = 0;
+		// Offset up to which records have been flushed
+		size_t m_flushed = 0;
+		UINT32 m_unflushed = 0;
+		PegasusTimer m_sinceFlush;
+		UINT64 m_nextId = 1;
+		UINT64 m_records = 0;
+		// Groups done with from the start, and in all, for each sequence not yet ended
+		std::unordered_map<UINT64, std::pair<UINT32, UINT32>> m_progress;
+		std::vector<JournaledSequence_t> m_unfinished;
+
+/*******************************************************************************
+		class SequenceJournal, public
+********************************************************************************/
+	public:
+		/* Public static functions */
+		// Opens the journal at path, or creates it. Unfinished sequences in an existing journal are kept for
+		// takeUnfinished(), and the file is rewritten with only those. Returns null if the file can't be used
+		static std::shared_ptr<SequenceJournal> Open(const std::wstring& path, const JournalConfig_t& config = JournalConfig_t());
+
+		~SequenceJournal();
+		SequenceJournal(const SequenceJournal&) = delete;
+		SequenceJournal& operator=(const SequenceJournal&) = delete;
+
+		/* Public member functions */
+		// Records a submitted sequence. Returns its id in the journal, or 0 if it couldn't be written. Safe from any thread
+		UINT64 append(std::vector<TimedEvent>& groups, SubmitPriority priority);
+		// Records that a group of the sequence has been sent, or dropped, so it isn't sent again on a resume. Groups are
+		// sent in order, so everything before it is done with too. The sequence is ended with its last group
+		void acknowledge(UINT64 id, UINT32 group);
+		// Records that the sequence was cancelled, so it isn't resumed
+		void finish(UINT64 id);
+		// Flushes if enough has been written or enough time has passed, see JournalConfig
+		void flushIfDue();
+		// Starts writing back everything not yet flushed
+		bool flush();
+		// Flushes and waits for it to reach the disk
+		bool sync();
+
+		// The sequences that were unfinished when the journal was opened, with the groups already sent taken off. Only
+		// returns them once
+		std::vector<JournaledSequence_t> takeUnfinished();
+		const std::wstring& getPath() const;
+		UINT64 getRecordCount();
+		// Bytes of records in the file
+		size_t getSize();
+	};
+
+}
@@ -0,0 +1,138 @@
+/*
+
+SubmissionQueue
+
+Lock-free multi-producer single-consumer queue used to submit event sequences to a
+PegasusWinterface from any thread, plus the handles used to cancel them
+
+*/
+
+#include "SubmissionQueue.h"
+
+namespace pi = pinterface;
+using namespace pi;
+
+void pi::FinishSequenceState(SequenceState_t& state) {
+	std::function<void()> callback;
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		state.finished.store(true, std::memory_order_release);
+		callback = std::move(state.onFinished);
+	}
+	// Outside the lock, so the callback may use the handle
+	if (callback)
+		callback();
+}
+
+/*******************************************************************************
+		class SequenceHandle, public
+********************************************************************************/
+
+SequenceHandle::SequenceHandle() {
+	// Invalid handle
+}
+
+SequenceHandle::SequenceHandle(std::shared_ptr<SequenceState_t> state) {
+	m_state = state;
+}
+
+bool SequenceHandle::cancel() {
+	if (!m_state || m_state->finished.load(std::memory_order_acquire))
+		return false;
+	m_state->cancelled.store(true, std::memory_order_release);
+	return true;
+}
+
+bool SequenceHandle::isCancelled() const {
+	return m_state && m_state->cancelled.load(std::memory_order_acquire);
+}
+
+bool SequenceHandle::isFinished() const {
+	return m_state && m_state->finished.load(std::memory_order_acquire);
+}
+
+void SequenceHandle::onFinished(std::function<void()> callback) {
+	if (m_state) {
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		if (!m_state->finished.load(std::memory_order_acquire)) {
+			m_state->onFinished = std::move(callback);
+			return;
+		}
+	}
+	if (callback)
+		callback();
+}
+
+bool SequenceHandle::isValid() const {
+	return (bool)m_state;
+}
+
+UINT64 SequenceHandle::id() const {
+	return m_state ? m_state->id : 0;
+}
+
+/*******************************************************************************
+		class SubmissionQueue, private
+********************************************************************************/
+
+void SubmissionQueue::pushNode(SubmittedSequence_t* node) {
+	node->queueNext.store(nullptr, std::memory_order_relaxed);
+	SubmittedSequence_t* prev = m_head.exchange(node, std::memory_order_acq_rel);
+	// Between the exchange and this store the list is briefly disconnected, pop() treats that as empty
+	prev->queueNext.store(node, std::memory_order_release);
+}
+
+/*******************************************************************************
+		class SubmissionQueue, public
+********************************************************************************/
+
+SubmissionQueue::SubmissionQueue() {
+	m_head.store(&m_stub, std::memory_order_relaxed);
+	m_tail = &m_stub;
+}
+
+SubmissionQueue::~SubmissionQueue() {
+	while (pop()) {
+		// The unique_ptr frees each remaining sequence
+	}
+}
+
+void SubmissionQueue::push(std::unique_ptr<SubmittedSequence_t> seq) {
+	pushNode(seq.release());
+}
+
+std::unique_ptr<SubmittedSequence_t> SubmissionQueue::pop() {
+	SubmittedSequence_t* tail = m_tail;
+	SubmittedSequence_t* next = tail->queueNext.load(std::memory_order_acquire);
+
+	if (tail == &m_stub) {
+		if (next == nullptr)
+			return nullptr;
+		m_tail = next;
+		tail = next;
+		next = next->queueNext.load(std::memory_order_acquire);
+	}
+
+	if (next != nullptr) {
+		m_tail = next;
+		return std::unique_ptr<SubmittedSequence_t>(tail);
+	}
+
+	if (tail != m_head.load(std::memory_order_acquire)) {
+		// A producer has exchanged the head but not linked it yet
+		return nullptr;
+	}
+
+	// tail is the last node: put the stub back behind it so tail can be handed out
+	pushNode(&m_stub);
+	next = tail->queueNext.load(std::memory_order_acquire);
+	if (next != nullptr) {
+		m_tail = next;
+		return std::unique_ptr<SubmittedSequence_t>(tail);
+	}
+	return nullptr;
+}
+
+bool SubmissionQueue::empty() const {
+	return m_tail->queueNext.load(std::memory_order_acquire) == nullptr && m_head.load(std::memory_order_acquire) == m_tail;
+}
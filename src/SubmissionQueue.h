@@ -0,0 +1,118 @@
+#pragma once
+/*
+
+SubmissionQueue
+
+Lock-free multi-producer single-consumer queue used to submit event sequences to a
+PegasusWinterface from any thread, plus the handles used to cancel them
+
+*/
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "TimedEvents.h"
+
+namespace pinterface {
+
+	// Priority lane of a submitted sequence. Higher lanes preempt lower ones between groups of events
+	enum class SubmitPriority { SPRIO_URGENT, SPRIO_NORMAL, SPRIO_BACKGROUND };
+	constexpr int SUBMIT_PRIORITY_COUNT = 3;
+
+/*******************************************************************************
+		struct SequenceState
+********************************************************************************/
+	// State shared between a submitted sequence and the handles to it
+	typedef struct SequenceState {
+		std::atomic<bool> cancelled{ false };
+		std::atomic<bool> finished{ false };
+		UINT64 id = 0;
+		// Guards onFinished against the sequence finishing while it is set
+		std::mutex mutex;
+		std::function<void()> onFinished;
+	} SequenceState_t;
+
+	// Marks the sequence finished and calls its completion callback. Called by the interface that ran it
+	void FinishSequenceState(SequenceState_t& state);
+
+	class SequenceHandle {
+/*******************************************************************************
+		class SequenceHandle, public
+********************************************************************************/
+	public:
+		SequenceHandle();
+		SequenceHandle(std::shared_ptr<SequenceState_t> state);
+
+		// Cancels the sequence. Groups already sent are not undone, the rest are dropped at the next group boundary.
+		// Returns false if the sequence had already finished
+		bool cancel();
+		bool isCancelled() const;
+		// True once the sequence has been fully sent or dropped after a cancel
+		bool isFinished() const;
+		// Calls back once the sequence is finished, on the thread that ticks the interface, or straight away if it already
+		// is. A sequence has one callback, setting another replaces it
+		void onFinished(std::function<void()> callback);
+		// False for a default constructed handle
+		bool isValid() const;
+		UINT64 id() const;
+
+/*******************************************************************************
+		class SequenceHandle, private
+********************************************************************************/
+	private:
+		std::shared_ptr<SequenceState_t> m_state;
+	};
+
+/*******************************************************************************
+		struct SubmittedSequence
+********************************************************************************/
+	// A sequence in the submission queue
+	typedef struct SubmittedSequence {
+		std::vector<TimedEvent> groups;
+		SubmitPriority priority = SubmitPriority::SPRIO_NORMAL;
+		// Index of the next group to send
+		size_t next = 0;
+		std::shared_ptr<SequenceState_t> state;
+		// Id of the sequence in the interface's journal, 0 if there is none
+		UINT64 journalId = 0;
+		// Intrusive link for the submission queue
+		std::atomic<struct SubmittedSequence*> queueNext{ nullptr };
+
+	} SubmittedSequence_t;
+
+	class SubmissionQueue {
+/*******************************************************************************
+		class SubmissionQueue, public
+********************************************************************************/
+	public:
+		SubmissionQueue();
+		~SubmissionQueue();
+		SubmissionQueue(const SubmissionQueue&) = delete;
+		SubmissionQueue& operator=(const SubmissionQueue&) = delete;
+
+		// Safe to call from any number of threads. Sequences pushed by one thread are popped in the order they were pushed
+		void push(std::unique_ptr<SubmittedSequence_t> seq);
+		// Consumer side only. Returns nullptr if the queue is empty, or if a producer is part way through a push
+		std::unique_ptr<SubmittedSequence_t> pop();
+		// Consumer side only
+		bool empty() const;
+
+/*******************************************************************************
+		class SubmissionQueue, private
+********************************************************************************/
+	private:
+		/* Private member functions */
+		void pushNode(SubmittedSequence_t* node);
+
+		/* Private member variables */
+		// Producers exchange the head, the consumer owns the tail. m_stub keeps the queue non-empty so neither side has to
+		// special case an empty list (Vyukov's intrusive MPSC queue)
+		std::atomic<SubmittedSequence_t*> m_head;
+		SubmittedSequence_t* m_tail;
+		SubmittedSequence_t m_stub;
+	};
+
+}
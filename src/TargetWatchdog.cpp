@@ -0,0 +1,92 @@
+/*
+
+TargetWatchdog
+
+Keeps an eye on the window a PegasusWinterface is bound to
+
+*/
+
+#include "TargetWatchdog.h"
+
+namespace pi = pinterface;
+using namespace pi;
+
+/*******************************************************************************
+		class TargetWatchdog, public
+********************************************************************************/
+
+TargetWatchdog::TargetWatchdog() {
+
+}
+
+void TargetWatchdog::setConfig(const WatchdogConfig_t& config) {
+	m_config = config;
+	if (!m_config.enabled)
+		m_state = TargetState::TGT_OK;
+}
+
+const WatchdogConfig_t& TargetWatchdog::getConfig() const {
+	return m_config;
+}
+
+TargetState TargetWatchdog::getState() const {
+	return m_state;
+}
+
+bool TargetWatchdog::isPaused() const {
+	return m_state != TargetState::TGT_OK;
+}
+
+INT64 TargetWatchdog::getPausedSince() const {
+	return m_pausedSince;
+}
+
+bool TargetWatchdog::isProbeDue(INT64 now) const {
+	return m_config.enabled && now >= m_nextProbe;
+}
+
+INT64 TargetWatchdog::getNextProbe() const {
+	return m_nextProbe;
+}
+
+void TargetWatchdog::shift(INT64 delta) {
+	m_nextProbe += delta;
+	m_pausedSince += delta;
+}
+
+void TargetWatchdog::reset(INT64 now) {
+	m_state = TargetState::TGT_OK;
+	m_nextProbe = now + m_config.probeIntervalUs;
+}
+
+const char* TargetWatchdog::StateName(TargetState state) {
+	switch (state) {
+	case TargetState::TGT_OK:
+		return "ok";
+	case TargetState::TGT_HUNG:
+		return "hung";
+	case TargetState::TGT_MISSING:
+		return "missing";
+	}
+	return "unknown";
+}
+
+/*******************************************************************************
+		class TargetWatchdog, private
+********************************************************************************/
+
+bool TargetWatchdog::moveTo(INT64 now, TargetState state, HWND previous, const WinInfo_t& window, TargetEvent_t& evt) {
+	if (state == m_state && window.hwnd == previous)
+		return false;
+
+	evt.from = m_state;
+	evt.to = state;
+	evt.time = now;
+	evt.previousHwnd = previous;
+	evt.hwnd = window.hwnd;
+	evt.rebound = window.hwnd != previous;
+	if (m_state == TargetState::TGT_OK)
+		m_pausedSince = now;
+	m_state = state;
+	return true;
+}
@@ -0,0 +1,102 @@
+#pragma once
+/*
+
+TargetWatchdog
+
+Keeps an eye on the window a PegasusWinterface is bound to. The target is probed through
+the input backend every so often and whenever a dispatch fails. While it is hung or missing
+the interface holds its queue, and a missing target is looked for again by the criteria it
+was bound with, so a window that is restarted is picked up where the queue left off
+
+*/
+
+#include <Windows.h>
+
+#include "WinAssist.h"
+#include "InputBackend.h"
+
+namespace pinterface {
+
+/*******************************************************************************
+		struct WatchdogConfig
+********************************************************************************/
+	typedef struct WatchdogConfig {
+		bool enabled = true;
+		// Time between probes, on the interface clock, while the target is healthy and while waiting for it to recover
+		INT64 probeIntervalUs = 250000;
+		// Longest a probe waits for the target to answer
+		UINT probeTimeoutMs = 20;
+	} WatchdogConfig_t;
+
+/*******************************************************************************
+		struct TargetEvent
+********************************************************************************/
+	// A change in the state of the target, or the target being replaced by a new window
+	typedef struct TargetEvent {
+		TargetState from;
+		TargetState to;
+		// Interface clock time of the probe that saw it
+		INT64 time;
+		HWND previousHwnd;
+		HWND hwnd;
+		// True if the interface is now sending to a different window than before
+		bool rebound;
+	} TargetEvent_t;
+
+	class TargetWatchdog {
+/*******************************************************************************
+		class TargetWatchdog, public
+********************************************************************************/
+	public:
+		TargetWatchdog();
+
+		void setConfig(const WatchdogConfig_t& config);
+		const WatchdogConfig_t& getConfig() const;
+		TargetState getState() const;
+		// True while sending should be held
+		bool isPaused() const;
+		// Interface clock time the current pause started. Only meaningful while paused
+		INT64 getPausedSince() const;
+		// True if a probe is due at now
+		bool isProbeDue(INT64 now) const;
+		// Time the next probe is due
+		INT64 getNextProbe() const;
+		// Moves the times held by delta, for a change of clock
+		void shift(INT64 delta);
+		// Starts over with a healthy target, for a new binding
+		void reset(INT64 now);
+
+		// Probes the target through the backend, or looks for it again if it is missing, and moves to the state found. window
+		// is updated if the target is found somewhere new. Returns true and fills evt if anything changed
+		template<class Backend>
+		bool probe(INT64 now, Backend& backend, WinInfo_t& window, const TitleMatcher* matcher, TargetEvent_t& evt) {
+			m_nextProbe = now + m_config.probeIntervalUs;
+			if (!m_config.enabled)
+				return false;
+
+			HWND previous = window.hwnd;
+			TargetState state = backend.probeTarget(window, m_config.probeTimeoutMs);
+			// Gone: look for it where it was bound, which finds a restarted window by its title or pid
+			if (state == TargetState::TGT_MISSING && backend.findTarget(window, matcher))
+				state = backend.probeTarget(window, m_config.probeTimeoutMs);
+			return moveTo(now, state, previous, window, evt);
+		}
+
+		static const char* StateName(TargetState state);
+
+/*******************************************************************************
+		class TargetWatchdog, private
+********************************************************************************/
+	private:
+		/* Private member functions */
+		// Moves to the state a probe found. Returns true and fills evt if the state or the window changed
+		bool moveTo(INT64 now, TargetState state, HWND previous, const WinInfo_t& window, TargetEvent_t& evt);
+
+		/* Private member variables */
+		WatchdogConfig_t m_config;
+		TargetState m_state = TargetState::TGT_OK;
+		INT64 m_nextProbe = 0;
+		INT64 m_pausedSince = 0;
+	};
+
+}
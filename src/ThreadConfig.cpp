@@ -0,0 +1,112 @@
+/*
+
+ThreadConfig
+
+Scheduling settings for the threads that wait on deadlines and dispatch
+
+*/
+
+#include "ThreadConfig.h"
+
+#include <timeapi.h>
+#include <avrt.h>
+
+#include <iostream>
+
+#pragma comment(lib, "Winmm.lib")
+#pragma comment(lib, "Avrt.lib")
+
+namespace pi = pinterface;
+using namespace pi;
+using std::cerr;
+using std::wcerr;
+using std::endl;
+
+static int PriorityValue(ThreadPriority priority) {
+	switch (priority) {
+	case ThreadPriority::TPRIO_ABOVE_NORMAL:
+		return THREAD_PRIORITY_ABOVE_NORMAL;
+	case ThreadPriority::TPRIO_HIGHEST:
+		return THREAD_PRIORITY_HIGHEST;
+	case ThreadPriority::TPRIO_TIME_CRITICAL:
+		return THREAD_PRIORITY_TIME_CRITICAL;
+	default:
+		return THREAD_PRIORITY_NORMAL;
+	}
+}
+
+/*******************************************************************************
+		class ScopedTimerPeriod, public
+********************************************************************************/
+
+ScopedTimerPeriod::ScopedTimerPeriod(UINT periodMs) {
+	if (periodMs == 0)
+		return;
+	if (timeBeginPeriod(periodMs) != TIMERR_NOERROR) {
+		cerr << "Unable to set the timer period to " << periodMs << " ms" << endl;
+		return;
+	}
+	m_period = periodMs;
+}
+
+ScopedTimerPeriod::~ScopedTimerPeriod() {
+	// Every timeBeginPeriod needs a matching timeEndPeriod with the same period
+	if (m_period != 0)
+		timeEndPeriod(m_period);
+}
+
+bool ScopedTimerPeriod::isApplied() const {
+	return m_period != 0;
+}
+
+/*******************************************************************************
+		class ScopedThreadConfig, public
+********************************************************************************/
+
+ScopedThreadConfig::ScopedThreadConfig(const ThreadConfig_t& config) : m_timer(config.timerPeriodMs) {
+	HANDLE thread = GetCurrentThread();
+	if (config.timerPeriodMs != 0 && !m_timer.isApplied())
+		m_applied = false;
+
+	if (config.affinityMask != 0) {
+		m_previousAffinity = SetThreadAffinityMask(thread, config.affinityMask);
+		if (m_previousAffinity == 0) {
+			cerr << "Unable to set the thread affinity to 0x" << std::hex << config.affinityMask << std::dec << " (error "
+				<< GetLastError() << ")" << endl;
+			m_applied = false;
+		}
+	}
+
+	// MMCSS boosts the thread itself, so a priority is only set without it
+	if (!config.mmcssTask.empty()) {
+		DWORD taskIndex = 0;
+		m_mmcss = AvSetMmThreadCharacteristicsW(config.mmcssTask.c_str(), &taskIndex);
+		if (m_mmcss == NULL) {
+			wcerr << "Unable to register the thread for MMCSS task '" << config.mmcssTask << "' (error " << GetLastError() << ")" << endl;
+			m_applied = false;
+		}
+	}
+	else if (config.priority != ThreadPriority::TPRIO_DEFAULT) {
+		m_previousPriority = GetThreadPriority(thread);
+		if (SetThreadPriority(thread, PriorityValue(config.priority)))
+			m_priorityChanged = true;
+		else {
+			cerr << "Unable to set the thread priority (error " << GetLastError() << ")" << endl;
+			m_applied = false;
+		}
+	}
+}
+
+ScopedThreadConfig::~ScopedThreadConfig() {
+	HANDLE thread = GetCurrentThread();
+	if (m_mmcss != NULL)
+		AvRevertMmThreadCharacteristics(m_mmcss);
+	if (m_priorityChanged)
+		SetThreadPriority(thread, m_previousPriority);
+	if (m_previousAffinity != 0)
+		SetThreadAffinityMask(thread, m_previousAffinity);
+}
+
+bool ScopedThreadConfig::isApplied() const {
+	return m_applied;
+}
@@ -0,0 +1,92 @@
+#pragma once
+/*
+
+ThreadConfig
+
+Scheduling settings for the threads that wait on deadlines and dispatch: which CPUs they
+run on, their priority or MMCSS task, and the system timer period while they run. Being
+preempted, moved between cores or woken on a coarse timer tick is where most of the timing
+jitter comes from. Settings are applied to the calling thread and undone when the scope
+ends:
+
+	pi::ThreadConfig_t config;
+	config.affinityMask = 1 << 3;
+	config.mmcssTask = L"Pro Audio";
+	config.timerPeriodMs = 1;
+	pi::ScopedThreadConfig scope(config);
+	daemon.run(quit);
+
+*/
+
+#include <Windows.h>
+
+#include <string>
+
+namespace pinterface {
+
+	enum class ThreadPriority { TPRIO_DEFAULT, TPRIO_ABOVE_NORMAL, TPRIO_HIGHEST, TPRIO_TIME_CRITICAL };
+
+/*******************************************************************************
+		struct ThreadConfig
+********************************************************************************/
+	typedef struct ThreadConfig {
+		// CPUs the thread may run on, one bit per CPU. 0 leaves the affinity alone
+		DWORD_PTR affinityMask = 0;
+		ThreadPriority priority = ThreadPriority::TPRIO_DEFAULT;
+		// Registers the thread with the Multimedia Class Scheduler under this task (e.g. "Pro Audio", "Games"), which runs it
+		// in the real-time priority range without the process needing to be real-time. Empty for none
+		std::wstring mmcssTask;
+		// System timer period in ms while the scope lasts, which sets how precisely Sleep and timers wake. 0 leaves it alone
+		UINT timerPeriodMs = 0;
+	} ThreadConfig_t;
+
+	// Raises the system timer resolution while it exists
+	class ScopedTimerPeriod {
+/*******************************************************************************
+		class ScopedTimerPeriod, public
+********************************************************************************/
+	public:
+		ScopedTimerPeriod(UINT periodMs);
+		~ScopedTimerPeriod();
+		ScopedTimerPeriod(const ScopedTimerPeriod&) = delete;
+		ScopedTimerPeriod& operator=(const ScopedTimerPeriod&) = delete;
+
+		bool isApplied() const;
+
+/*******************************************************************************
+		class ScopedTimerPeriod, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		UINT m_period = 0;
+	};
+
+	// Applies a ThreadConfig to the calling thread and restores the previous settings when destroyed. Must be destroyed on
+	// the same thread. Settings that can't be applied are reported and skipped, the rest still apply
+	class ScopedThreadConfig {
+/*******************************************************************************
+		class ScopedThreadConfig, public
+********************************************************************************/
+	public:
+		ScopedThreadConfig(const ThreadConfig_t& config);
+		~ScopedThreadConfig();
+		ScopedThreadConfig(const ScopedThreadConfig&) = delete;
+		ScopedThreadConfig& operator=(const ScopedThreadConfig&) = delete;
+
+		// True if every setting asked for was applied
+		bool isApplied() const;
+
+/*******************************************************************************
+		class ScopedThreadConfig, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		bool m_applied = true;
+		DWORD_PTR m_previousAffinity = 0;
+		int m_previousPriority = THREAD_PRIORITY_NORMAL;
+		bool m_priorityChanged = false;
+		HANDLE m_mmcss = NULL;
+		ScopedTimerPeriod m_timer;
+	};
+
+}
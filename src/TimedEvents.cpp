@@ -0,0 +1,122 @@
+/*
+
+TimedEvents
+
+Groups of key and mouse events with the delay to wait before sending them
+
+*/
+
+#include "TimedEvents.h"
+#include "InjectionPlan.h"
+
+namespace pi = pinterface;
+using namespace pi;
+
+/*******************************************************************************
+		class TimedMouseEvent, public
+********************************************************************************/
+
+TimedMouseEvent::TimedMouseEvent(std::vector<MouseEvent> evts, int delayBefore) {
+	m_events = evts;
+	m_delayBefore = delayBefore;
+}
+
+TimedMouseEvent::TimedMouseEvent(MouseEvent evt, int delayBefore) {
+	m_events.push_back(evt);
+	m_delayBefore = delayBefore;
+}
+
+std::vector<MouseEvent>& TimedMouseEvent::getEvents() {
+	return m_events;
+}
+
+int TimedMouseEvent::delayBefore() {
+	return m_delayBefore;
+}
+
+void TimedMouseEvent::setDelayBefore(int delayBefore) {
+	m_delayBefore = delayBefore;
+}
+
+/*******************************************************************************
+		class TimedKeyEvent, public
+********************************************************************************/
+
+TimedKeyEvent::TimedKeyEvent(std::vector<KeyEvent> evts, int delayBefore) {
+	m_events = evts;
+	m_delayBefore = delayBefore;
+}
+
+TimedKeyEvent::TimedKeyEvent(KeyEvent evt, int delayBefore) {
+	m_events.push_back(evt);
+	m_delayBefore = delayBefore;
+}
+
+std::vector<KeyEvent>& TimedKeyEvent::getEvents() {
+	return m_events;
+}
+
+int TimedKeyEvent::delayBefore() {
+	return m_delayBefore;
+}
+
+void TimedKeyEvent::setDelayBefore(int delayBefore) {
+	m_delayBefore = delayBefore;
+}
+
+/*******************************************************************************
+		class TimedEvent, public
+********************************************************************************/
+
+TimedEvent::TimedEvent(TimedKeyEvent evt) : m_event(evt) {
+}
+
+TimedEvent::TimedEvent(TimedMouseEvent evt) : m_event(evt) {
+}
+
+TimedEvent::TimedEvent(PlannedGroup_t group) : m_event(group) {
+}
+
+TimedEvent::Kind TimedEvent::kind() {
+	return (Kind)m_event.index();
+}
+
+int TimedEvent::delayBefore() {
+	switch (kind()) {
+	case Kind::TEVT_KEY:
+		return key().delayBefore();
+	case Kind::TEVT_MOUSE:
+		return mouse().delayBefore();
+	default:
+		return planned().plan->getStep(planned().step).delayBefore;
+	}
+}
+
+TimedKeyEvent& TimedEvent::key() {
+	return std::get<TimedKeyEvent>(m_event);
+}
+
+TimedMouseEvent& TimedEvent::mouse() {
+	return std::get<TimedMouseEvent>(m_event);
+}
+
+PlannedGroup_t& TimedEvent::planned() {
+	return std::get<PlannedGroup_t>(m_event);
+}
+
+int TimedEvent::buildInputs(std::vector<INPUT>& inputs) {
+	// Already translated, nothing to work out
+	if (kind() == Kind::TEVT_PLANNED)
+		return planned().plan->appendInputs(planned().step, inputs);
+
+	int added = 0;
+	if (kind() == Kind::TEVT_KEY) {
+		for (auto& evt : key().getEvents())
+			added += WinAssist::BuildKeyInputs(evt, inputs);
+	}
+	else {
+		for (auto& evt : mouse().getEvents())
+			added += WinAssist::BuildMouseInputs(evt, inputs);
+	}
+	return added;
+}
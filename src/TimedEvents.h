@@ -0,0 +1,135 @@
+#pragma once
+/*
+
+TimedEvents
+
+Groups of key and mouse events with the delay to wait before sending them, and generators
+that produce them on demand
+
+*/
+
+#include "WinAssist.h"
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <type_traits>
+#include <variant>
+
+namespace pinterface {
+
+	class TimedMouseEvent {
+/*******************************************************************************
+		class TimedMouseEvent, private
+********************************************************************************/
+		std::vector<MouseEvent> m_events;
+		int m_delayBefore;
+
+	public:
+/*******************************************************************************
+		class TimedMouseEvent, public
+********************************************************************************/
+		TimedMouseEvent(std::vector<MouseEvent> evts, int delayBefore = 0);
+		TimedMouseEvent(MouseEvent evt, int delayBefore = 0);
+		std::vector<MouseEvent>& getEvents();
+		int delayBefore();
+		void setDelayBefore(int delayBefore);
+	};
+
+	class TimedKeyEvent {
+
+	private:
+/*******************************************************************************
+		class TimedKeyEvent, private
+********************************************************************************/
+		std::vector<KeyEvent> m_events;
+		int m_delayBefore;
+
+	public:
+/*******************************************************************************
+		class TimedKeyEvent, public
+********************************************************************************/
+		TimedKeyEvent(std::vector<KeyEvent> evts, int delayBefore = 0);
+		TimedKeyEvent(KeyEvent evt, int delayBefore = 0);
+		std::vector<KeyEvent>& getEvents();
+		int delayBefore();
+		void setDelayBefore(int delayBefore);
+	};
+
+	class InjectionPlan;
+
+/*******************************************************************************
+		struct PlannedGroup
+********************************************************************************/
+	// One step of a compiled InjectionPlan, whose records are sent as they are
+	typedef struct PlannedGroup {
+		std::shared_ptr<const InjectionPlan> plan;
+		UINT32 step;
+	} PlannedGroup_t;
+
+	class TimedEvent {
+/*******************************************************************************
+		class TimedEvent, public
+********************************************************************************/
+	public:
+		// A key or a mouse group, so both can be placed on one timeline in order, or a step of a compiled plan
+		enum class Kind { TEVT_KEY, TEVT_MOUSE, TEVT_PLANNED };
+		TimedEvent(TimedKeyEvent evt);
+		TimedEvent(TimedMouseEvent evt);
+		TimedEvent(PlannedGroup_t group);
+		Kind kind();
+		int delayBefore();
+		// Only valid for the matching kind
+		TimedKeyEvent& key();
+		TimedMouseEvent& mouse();
+		PlannedGroup_t& planned();
+		// Appends the INPUT records for the group to a batch. Returns the number of records added
+		int buildInputs(std::vector<INPUT>& inputs);
+
+/*******************************************************************************
+		class TimedEvent, private
+********************************************************************************/
+	private:
+		std::variant<TimedKeyEvent, TimedMouseEvent, PlannedGroup_t> m_event;
+	};
+
+	// Produces the next group each time it is called, and nothing once the sequence is over. May never end
+	typedef std::function<std::optional<TimedEvent>()> TimedEventGenerator;
+
+	// Turns an input range of key or mouse groups (e.g. a std::views pipeline) into a generator that walks it lazily. The
+	// range is moved into the generator, so a view must own or outlive whatever it refers to
+	template<std::ranges::input_range R>
+		requires std::convertible_to<std::ranges::range_reference_t<R>, TimedEvent>
+	TimedEventGenerator MakeTimedEventGenerator(R&& range) {
+		typedef std::remove_cvref_t<R> Range;
+		struct State {
+			Range range;
+			std::optional<std::ranges::iterator_t<Range>> it;
+		};
+		std::shared_ptr<State> state(new State{ std::forward<R>(range), std::nullopt });
+		return [state]() -> std::optional<TimedEvent> {
+			if (!state->it)
+				state->it = std::ranges::begin(state->range);
+			if (*state->it == std::ranges::end(state->range))
+				return std::nullopt;
+			TimedEvent evt(*(*state->it));
+			++(*state->it);
+			return evt;
+		};
+	}
+
+/*******************************************************************************
+		struct TimedEventStream
+********************************************************************************/
+	// A generator being played by PegasusWinterface
+	typedef struct TimedEventStream {
+		TimedEventGenerator next;
+		// Deadline of the last group taken from the generator, which the next one's delay runs from
+		INT64 last = 0;
+		// Group taken from the generator but not yet due to go on the timeline
+		std::optional<TimedEvent> pending;
+		INT64 pendingDeadline = 0;
+	} TimedEventStream_t;
+
+}
\ No newline at end of file
@@ -0,0 +1,92 @@
+/*
+
+Timeline
+
+Single queue of key and mouse groups ordered by deadline, then by the order they were
+scheduled, so mixed sequences keep their order and everything due can be sent in one pass
+
+*/
+
+#include "Timeline.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace pi = pinterface;
+using namespace pi;
+
+namespace {
+	// std heap functions keep the greatest element at the front, so compare the other way round
+	struct EntryLater {
+		bool operator()(const TimelineEntry_t& a, const TimelineEntry_t& b) const {
+			if (a.deadline != b.deadline)
+				return a.deadline > b.deadline;
+			return a.order > b.order;
+		}
+	};
+}
+
+/*******************************************************************************
+		class Timeline, public
+********************************************************************************/
+
+Timeline::Timeline() {
+	for (INT64& last : m_lastDeadline) {
+		last = std::numeric_limits<INT64>::min();
+	}
+}
+
+void Timeline::push(INT64 deadline, TimedEvent evt, TimelineSource source, UINT64 tag, UINT64 sequence, UINT32 group) {
+	push({ deadline, 0, source, std::move(evt), tag, sequence, group });
+}
+
+void Timeline::push(TimelineEntry_t entry) {
+	entry.order = m_nextOrder++;
+	m_lastDeadline[(int)entry.source] = std::max(m_lastDeadline[(int)entry.source], entry.deadline);
+	m_heap.push_back(std::move(entry));
+	std::push_heap(m_heap.begin(), m_heap.end(), EntryLater());
+}
+
+size_t Timeline::popDue(INT64 now, std::vector<TimelineEntry_t>& out) {
+	size_t moved = 0;
+	while (!m_heap.empty() && m_heap.front().deadline <= now) {
+		std::pop_heap(m_heap.begin(), m_heap.end(), EntryLater());
+		out.push_back(std::move(m_heap.back()));
+		m_heap.pop_back();
+		moved++;
+	}
+	return moved;
+}
+
+void Timeline::removeSource(TimelineSource source) {
+	m_heap.erase(std::remove_if(m_heap.begin(), m_heap.end(), [source](const TimelineEntry_t& e) { return e.source == source; }), m_heap.end());
+	std::make_heap(m_heap.begin(), m_heap.end(), EntryLater());
+	m_lastDeadline[(int)source] = std::numeric_limits<INT64>::min();
+}
+
+void Timeline::shift(INT64 delta) {
+	// The same delta everywhere keeps the heap order
+	for (TimelineEntry_t& e : m_heap) {
+		e.deadline += delta;
+	}
+	for (INT64& last : m_lastDeadline) {
+		if (last != std::numeric_limits<INT64>::min())
+			last += delta;
+	}
+}
+
+bool Timeline::empty() const {
+	return m_heap.empty();
+}
+
+size_t Timeline::size() const {
+	return m_heap.size();
+}
+
+INT64 Timeline::nextDeadline() const {
+	return m_heap.front().deadline;
+}
+
+INT64 Timeline::lastDeadline(TimelineSource source) const {
+	return m_lastDeadline[(int)source];
+}
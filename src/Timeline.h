@@ -0,0 +1,73 @@
+#pragma once
+/*
+
+Timeline
+
+Single queue of key and mouse groups ordered by deadline, then by the order they were
+scheduled, so mixed sequences keep their order and everything due can be sent in one pass
+
+*/
+
+#include <vector>
+
+#include "TimedEvents.h"
+
+namespace pinterface {
+
+	// Where a timeline entry came from, so executeKeys/executeMouse can replace only their own events
+	enum class TimelineSource { TSRC_KEYS, TSRC_MOUSE, TSRC_MIXED, TSRC_SEQUENCE };
+	constexpr int TIMELINE_SOURCE_COUNT = 4;
+
+/*******************************************************************************
+		struct TimelineEntry
+********************************************************************************/
+	typedef struct TimelineEntry {
+		INT64 deadline; // Microseconds on the interface clock
+		UINT64 order; // Scheduling order, breaks ties between equal deadlines
+		TimelineSource source;
+		TimedEvent event;
+		// Journal id of the submitted sequence the group came from, 0 if it isn't journaled
+		UINT64 tag;
+		// Id of the submitted sequence the group came from, 0 if it didn't come from one
+		UINT64 sequence;
+		// Index of the group in that sequence
+		UINT32 group;
+	} TimelineEntry_t;
+
+	class Timeline {
+/*******************************************************************************
+		class Timeline, public
+********************************************************************************/
+	public:
+		Timeline();
+
+		void push(INT64 deadline, TimedEvent evt, TimelineSource source, UINT64 tag = 0, UINT64 sequence = 0, UINT32 group = 0);
+		// Puts back an entry that was popped, behind anything already queued with the same deadline
+		void push(TimelineEntry_t entry);
+		// Moves every entry with a deadline at or before now to the end of out, in (deadline, order) order. Returns the
+		// number of entries moved
+		size_t popDue(INT64 now, std::vector<TimelineEntry_t>& out);
+		// Removes every entry from the source
+		void removeSource(TimelineSource source);
+		// Moves every deadline by delta, used to carry the queue over to a different clock
+		void shift(INT64 delta);
+
+		bool empty() const;
+		size_t size() const;
+		// Deadline of the earliest entry. Only valid if not empty
+		INT64 nextDeadline() const;
+		// Latest deadline scheduled from the source since it was last cleared, or INT64 min if none
+		INT64 lastDeadline(TimelineSource source) const;
+
+/*******************************************************************************
+		class Timeline, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		// Min heap on (deadline, order)
+		std::vector<TimelineEntry_t> m_heap;
+		UINT64 m_nextOrder = 0;
+		INT64 m_lastDeadline[TIMELINE_SOURCE_COUNT];
+	};
+
+}
@@ -0,0 +1,266 @@
+/*
+
+TimingVariation
+
+Seeded variation of sequence delays and mouse movements, drawn a block at a time
+
+*/
+
+#include "TimingVariation.h"
+
+#include <algorithm>
+#include <cmath>
+
+// SSE2 is part of x64 and the default for x86 builds. Anything else takes the scalar loops
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define VARIATION_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace pi = pinterface;
+using namespace pi;
+
+static const UINT64 SPLITMIX_GAMMA = 0x9E3779B97F4A7C15ull;
+// The top 24 bits of a number as a float in [0, 1)
+static const float UNIT_SCALE = 1.0f / 16777216.0f;
+static const float TWO_PI = 6.28318530718f;
+
+static UINT64 SplitMix(UINT64& x) {
+	UINT64 z = (x += SPLITMIX_GAMMA);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+static inline UINT32 Rotl(UINT32 x, int k) {
+	return (x << k) | (x >> (32 - k));
+}
+
+// Seed of one of the generators a sequence draws from, kept apart from every other sequence and generator
+static UINT64 StreamSeed(UINT64 seed, UINT64 stream, UINT64 which) {
+	UINT64 x = seed ^ ((stream * 2 + which) * SPLITMIX_GAMMA);
+	return SplitMix(x);
+}
+
+// Rounds half away from zero like std::lround, without the call into the runtime or a branch on the sign, which is
+// as random as the samples
+static inline LONG Round(float x) {
+	return (LONG)(x + std::copysign(0.5f, x));
+}
+
+static bool IsMove(MouseEvent::EventType type) {
+	return type == MouseEvent::EventType::MEVT_MOVE || type == MouseEvent::EventType::MEVT_MOVE_ABS || type == MouseEvent::EventType::MEVT_MOVE_DESKTOP;
+}
+
+/*******************************************************************************
+		class SampleBlock
+********************************************************************************/
+// Samples of a distribution, rounded, handed out one at a time and refilled a block at a time. Only as many as are
+// still to be drawn are filled, so a short sequence doesn't pay for a whole block
+class SampleBlock {
+public:
+	SampleBlock(const VariationSpec_t& spec, UINT64 seed, size_t draws) : m_spec(spec), m_rng(seed), m_remaining(draws) {
+	}
+
+	LONG next() {
+		if (m_pos == m_count) {
+			// Rounded up to whole lanes, which Fill needs. The numbers drawn don't depend on how many are filled at once
+			m_count = std::min(m_remaining, VARIATION_BLOCK_SIZE);
+			m_count = (m_count + VARIATION_LANES - 1) / VARIATION_LANES * VARIATION_LANES;
+			if (m_count == 0)
+				m_count = VARIATION_LANES;
+			m_remaining -= std::min(m_remaining, m_count);
+			TimingVariation::Fill(m_rng, m_spec, m_samples, m_count);
+			for (size_t i = 0; i < m_count; i++)
+				m_rounded[i] = Round(m_samples[i]);
+			m_pos = 0;
+		}
+		return m_rounded[m_pos++];
+	}
+
+private:
+	const VariationSpec_t& m_spec;
+	VariationRng m_rng;
+	float m_samples[VARIATION_BLOCK_SIZE];
+	LONG m_rounded[VARIATION_BLOCK_SIZE];
+	size_t m_remaining;
+	size_t m_count = 0;
+	size_t m_pos = 0;
+};
+
+/*******************************************************************************
+		class VariationRng, public
+********************************************************************************/
+
+VariationRng::VariationRng(UINT64 seed) {
+	this->seed(seed);
+}
+
+void VariationRng::seed(UINT64 seed) {
+	UINT64 x = seed;
+	for (size_t lane = 0; lane < VARIATION_LANES; lane++) {
+		UINT64 a = SplitMix(x);
+		UINT64 b = SplitMix(x);
+		m_state[0][lane] = (UINT32)a;
+		m_state[1][lane] = (UINT32)(a >> 32);
+		m_state[2][lane] = (UINT32)b;
+		m_state[3][lane] = (UINT32)(b >> 32);
+		// An all zero state would only ever give zeros
+		if ((a | b) == 0)
+			m_state[0][lane] = 1;
+	}
+}
+
+void VariationRng::fillUnit(float* out, size_t count) {
+#ifdef VARIATION_SSE2
+	// Lanes 0-3 and 4-7 as two vectors each, stepped in turn so they overlap
+	__m128i s0a = _mm_load_si128((const __m128i*)&m_state[0][0]), s0b = _mm_load_si128((const __m128i*)&m_state[0][4]);
+	__m128i s1a = _mm_load_si128((const __m128i*)&m_state[1][0]), s1b = _mm_load_si128((const __m128i*)&m_state[1][4]);
+	__m128i s2a = _mm_load_si128((const __m128i*)&m_state[2][0]), s2b = _mm_load_si128((const __m128i*)&m_state[2][4]);
+	__m128i s3a = _mm_load_si128((const __m128i*)&m_state[3][0]), s3b = _mm_load_si128((const __m128i*)&m_state[3][4]);
+	const __m128 scale = _mm_set1_ps(UNIT_SCALE);
+	for (size_t i = 0; i < count; i += VARIATION_LANES) {
+		__m128i ra = _mm_add_epi32(s0a, s3a);
+		__m128i rb = _mm_add_epi32(s0b, s3b);
+		__m128i ta = _mm_slli_epi32(s1a, 9);
+		__m128i tb = _mm_slli_epi32(s1b, 9);
+		s2a = _mm_xor_si128(s2a, s0a);
+		s2b = _mm_xor_si128(s2b, s0b);
+		s3a = _mm_xor_si128(s3a, s1a);
+		s3b = _mm_xor_si128(s3b, s1b);
+		s1a = _mm_xor_si128(s1a, s2a);
+		s1b = _mm_xor_si128(s1b, s2b);
+		s0a = _mm_xor_si128(s0a, s3a);
+		s0b = _mm_xor_si128(s0b, s3b);
+		s2a = _mm_xor_si128(s2a, ta);
+		s2b = _mm_xor_si128(s2b, tb);
+		s3a = _mm_or_si128(_mm_slli_epi32(s3a, 11), _mm_srli_epi32(s3a, 21));
+		s3b = _mm_or_si128(_mm_slli_epi32(s3b, 11), _mm_srli_epi32(s3b, 21));
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(ra, 8)), scale));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(rb, 8)), scale));
+	}
+	_mm_store_si128((__m128i*)&m_state[0][0], s0a);
+	_mm_store_si128((__m128i*)&m_state[0][4], s0b);
+	_mm_store_si128((__m128i*)&m_state[1][0], s1a);
+	_mm_store_si128((__m128i*)&m_state[1][4], s1b);
+	_mm_store_si128((__m128i*)&m_state[2][0], s2a);
+	_mm_store_si128((__m128i*)&m_state[2][4], s2b);
+	_mm_store_si128((__m128i*)&m_state[3][0], s3a);
+	_mm_store_si128((__m128i*)&m_state[3][4], s3b);
+#else
+	for (size_t i = 0; i < count; i += VARIATION_LANES) {
+		for (size_t lane = 0; lane < VARIATION_LANES; lane++) {
+			UINT32 result = m_state[0][lane] + m_state[3][lane];
+			UINT32 t = m_state[1][lane] << 9;
+			m_state[2][lane] ^= m_state[0][lane];
+			m_state[3][lane] ^= m_state[1][lane];
+			m_state[1][lane] ^= m_state[2][lane];
+			m_state[0][lane] ^= m_state[3][lane];
+			m_state[2][lane] ^= t;
+			m_state[3][lane] = Rotl(m_state[3][lane], 11);
+			out[i + lane] = (float)(result >> 8) * UNIT_SCALE;
+		}
+	}
+#endif
+}
+
+/*******************************************************************************
+		class TimingVariation, public
+********************************************************************************/
+
+TimingVariation::TimingVariation(const VariationConfig_t& config) : m_config(config) {
+
+}
+
+void TimingVariation::apply(std::vector<TimedEvent>& groups) {
+	apply(groups, m_nextStream.fetch_add(1, std::memory_order_relaxed));
+}
+
+void TimingVariation::apply(std::vector<TimedEvent>& groups, UINT64 stream) const {
+	bool varyDelays = m_config.delay.distribution != VariationDistribution::VDIST_NONE;
+	bool varyMoves = m_config.move.distribution != VariationDistribution::VDIST_NONE;
+	if (!varyDelays && !varyMoves)
+		return;
+
+	// Counted first so the blocks fill no more than the sequence draws
+	size_t delayDraws = 0;
+	size_t moveDraws = 0;
+	for (auto& group : groups) {
+		if (group.kind() == TimedEvent::Kind::TEVT_KEY)
+			delayDraws++;
+		else if (group.kind() == TimedEvent::Kind::TEVT_MOUSE) {
+			delayDraws++;
+			for (auto& evt : group.mouse().getEvents()) {
+				if (IsMove(evt.type()))
+					moveDraws += 2;
+			}
+		}
+	}
+
+	// Delays and moves draw from generators of their own, so changing one leaves the other as it was
+	SampleBlock delays(m_config.delay, StreamSeed(m_config.seed, stream, 0), varyDelays ? delayDraws : 0);
+	SampleBlock moves(m_config.move, StreamSeed(m_config.seed, stream, 1), varyMoves ? moveDraws : 0);
+	for (auto& group : groups) {
+		switch (group.kind()) {
+		case TimedEvent::Kind::TEVT_KEY:
+			if (varyDelays)
+				group.key().setDelayBefore(std::max(0, group.key().delayBefore() + (int)delays.next()));
+			break;
+		case TimedEvent::Kind::TEVT_MOUSE:
+			if (varyDelays)
+				group.mouse().setDelayBefore(std::max(0, group.mouse().delayBefore() + (int)delays.next()));
+			if (varyMoves) {
+				for (auto& evt : group.mouse().getEvents()) {
+					if (!IsMove(evt.type()))
+						continue;
+					LONG dx = evt.dx() + moves.next();
+					LONG dy = evt.dy() + moves.next();
+					evt.setMoveValues(dx, dy);
+				}
+			}
+			break;
+		default:
+			// A compiled plan is sent as it was compiled
+			break;
+		}
+	}
+}
+
+void TimingVariation::reset() {
+	m_nextStream.store(0, std::memory_order_relaxed);
+}
+
+const VariationConfig_t& TimingVariation::getConfig() const {
+	return m_config;
+}
+
+/* Public static functions */
+void TimingVariation::Fill(VariationRng& rng, const VariationSpec_t& spec, float* out, size_t count) {
+	rng.fillUnit(out, count);
+	// Copied out, as writes through out could change them as far as the compiler knows, which stops the loops vectorising
+	const float spread = spec.spread;
+	const float limit = spec.limit;
+	switch (spec.distribution) {
+	case VariationDistribution::VDIST_UNIFORM:
+		for (size_t i = 0; i < count; i++)
+			out[i] = (out[i] * 2.0f - 1.0f) * spread;
+		break;
+	case VariationDistribution::VDIST_NORMAL:
+	case VariationDistribution::VDIST_CLAMPED_NORMAL:
+		// Box-Muller, a pair of samples from each pair of numbers. 1 - u keeps the log away from 0
+		for (size_t i = 0; i < count; i += 2) {
+			float r = std::sqrt(-2.0f * std::log(1.0f - out[i])) * spread;
+			float theta = TWO_PI * out[i + 1];
+			out[i] = r * std::cos(theta);
+			out[i + 1] = r * std::sin(theta);
+		}
+		if (spec.distribution == VariationDistribution::VDIST_CLAMPED_NORMAL) {
+			for (size_t i = 0; i < count; i++)
+				out[i] = std::clamp(out[i], -limit, limit);
+		}
+		break;
+	default:
+		std::fill(out, out + count, 0.0f);
+		break;
+	}
+}
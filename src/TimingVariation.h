@@ -0,0 +1,110 @@
+#pragma once
+/*
+
+TimingVariation
+
+Random variation of the delays and mouse movements of whole sequences at once, so input
+isn't perfectly regular without every script randomising each event as it builds them:
+
+	pi::VariationConfig_t config;
+	config.seed = 1234;
+	config.delay = { pi::VariationDistribution::VDIST_CLAMPED_NORMAL, 4.0f, 10.0f };
+	config.move = { pi::VariationDistribution::VDIST_UNIFORM, 2.0f };
+	app.setVariation(std::make_shared<pi::TimingVariation>(config));
+
+The samples come from a seeded xoshiro128+ generator run as eight lanes side by side, a
+block at a time, with SSE2 where the build targets it and the same numbers either way. The
+nth sequence varied from a seed always gets the same variation, so a replay submitted in the
+same order comes out the same
+
+*/
+
+#include <Windows.h>
+
+#include <atomic>
+#include <vector>
+
+#include "TimedEvents.h"
+
+namespace pinterface {
+
+	// Generators stepped side by side in a VariationRng
+	constexpr size_t VARIATION_LANES = 8;
+	// Samples TimingVariation draws at once. A multiple of VARIATION_LANES
+	constexpr size_t VARIATION_BLOCK_SIZE = 256;
+
+	enum class VariationDistribution { VDIST_NONE, VDIST_UNIFORM, VDIST_NORMAL, VDIST_CLAMPED_NORMAL };
+
+/*******************************************************************************
+		struct VariationSpec
+********************************************************************************/
+	typedef struct VariationSpec {
+		VariationDistribution distribution = VariationDistribution::VDIST_NONE;
+		// Half the width of a uniform distribution, or the standard deviation of a normal one
+		float spread = 0.0f;
+		// Largest change either way for VDIST_CLAMPED_NORMAL
+		float limit = 0.0f;
+	} VariationSpec_t;
+
+/*******************************************************************************
+		struct VariationConfig
+********************************************************************************/
+	typedef struct VariationConfig {
+		UINT64 seed = 0;
+		// Added to the delay before each key and mouse group, in ms. Delays are rounded and never go below 0
+		VariationSpec_t delay;
+		// Added to dx and dy of each mouse move, in the units of the move, and rounded
+		VariationSpec_t move;
+	} VariationConfig_t;
+
+	// VARIATION_LANES xoshiro128+ generators stepped together
+	class VariationRng {
+/*******************************************************************************
+		class VariationRng, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		alignas(16) UINT32 m_state[4][VARIATION_LANES];
+
+/*******************************************************************************
+		class VariationRng, public
+********************************************************************************/
+	public:
+		VariationRng(UINT64 seed = 0);
+
+		void seed(UINT64 seed);
+		// Fills out with count numbers in [0, 1). count must be a multiple of VARIATION_LANES
+		void fillUnit(float* out, size_t count);
+	};
+
+	class TimingVariation {
+/*******************************************************************************
+		class TimingVariation, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		VariationConfig_t m_config;
+		// Sequences varied so far, which picks the generator state of the next
+		std::atomic<UINT64> m_nextStream{ 0 };
+
+/*******************************************************************************
+		class TimingVariation, public
+********************************************************************************/
+	public:
+		TimingVariation(const VariationConfig_t& config);
+
+		// Varies the groups as the next sequence from the seed. Safe from any thread, though which sequence is which then
+		// depends on the order the threads get here
+		void apply(std::vector<TimedEvent>& groups);
+		// Varies the groups as the given sequence from the seed, whatever has been varied before
+		void apply(std::vector<TimedEvent>& groups, UINT64 stream) const;
+		// Starts again from the first sequence
+		void reset();
+		const VariationConfig_t& getConfig() const;
+
+		/* Public static functions */
+		// Fills out with count samples of the distribution. count must be a multiple of VARIATION_LANES
+		static void Fill(VariationRng& rng, const VariationSpec_t& spec, float* out, size_t count);
+	};
+
+}
@@ -0,0 +1,282 @@
+/*
+
+TitleMatcher
+
+Precompiled window title matchers and a normalized title index, used by bind() and when
+rebinding to a window whose title has changed
+
+*/
+
+#include "TitleMatcher.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace pi = pinterface;
+using namespace pi;
+
+/*******************************************************************************
+		class TitleMatcher, private
+********************************************************************************/
+
+size_t TitleMatcher::FindGlobSegment(const std::wstring& str, const std::wstring& segment, size_t pos) {
+	if (segment.size() > str.size())
+		return std::wstring::npos;
+	for (size_t i = pos; i + segment.size() <= str.size(); i++) {
+		if (GlobSegmentAt(str, segment, i))
+			return i;
+	}
+	return std::wstring::npos;
+}
+
+bool TitleMatcher::GlobSegmentAt(const std::wstring& str, const std::wstring& segment, size_t pos) {
+	if (pos + segment.size() > str.size())
+		return false;
+	for (size_t i = 0; i < segment.size(); i++) {
+		if (segment[i] != L'?' && segment[i] != str[pos + i])
+			return false;
+	}
+	return true;
+}
+
+void TitleMatcher::compile() {
+	Compiled& c = *m_compiled;
+	c.normalized = Normalize(c.pattern);
+
+	if (m_type == MatchType::TMATCH_GLOB) {
+		// Split the pattern on '*'. The first and last segments are anchored unless the pattern starts/ends with '*'
+		c.globAnchorStart = c.normalized.empty() || c.normalized.front() != L'*';
+		c.globAnchorEnd = c.normalized.empty() || c.normalized.back() != L'*';
+		std::wstring segment;
+		for (wchar_t ch : c.normalized) {
+			if (ch == L'*') {
+				if (!segment.empty())
+					c.globSegments.push_back(segment);
+				segment.clear();
+			}
+			else {
+				segment.push_back(ch);
+			}
+		}
+		if (!segment.empty())
+			c.globSegments.push_back(segment);
+	}
+	else if (m_type == MatchType::TMATCH_REGEX) {
+		// std::regex reports a bad pattern by throwing, we report it through isValid() instead
+		try {
+			c.regex = std::wregex(c.pattern, std::regex_constants::ECMAScript | std::regex_constants::optimize);
+		}
+		catch (const std::regex_error& e) {
+			std::wcerr << "TitleMatcher: invalid regex '" << c.pattern << "': " << e.what() << std::endl;
+			m_valid = false;
+		}
+	}
+}
+
+bool TitleMatcher::matchGlob(const std::wstring& normalized) const {
+	const Compiled& c = *m_compiled;
+	const std::vector<std::wstring>& segs = c.globSegments;
+
+	if (segs.empty()) {
+		// Pattern was empty or only '*'
+		return !c.globAnchorStart || normalized.empty();
+	}
+
+	size_t pos = 0;
+	size_t first = 0;
+	size_t last = segs.size();
+
+	if (c.globAnchorStart) {
+		if (!GlobSegmentAt(normalized, segs[0], 0))
+			return false;
+		pos = segs[0].size();
+		first = 1;
+		if (segs.size() == 1 && c.globAnchorEnd)
+			return pos == normalized.size();
+	}
+	if (c.globAnchorEnd && last > first) {
+		last--;
+	}
+
+	// Middle segments are found greedily left to right, which is sufficient as they are separated by '*'
+	for (size_t i = first; i < last; i++) {
+		size_t found = FindGlobSegment(normalized, segs[i], pos);
+		if (found == std::wstring::npos)
+			return false;
+		pos = found + segs[i].size();
+	}
+
+	if (c.globAnchorEnd && last < segs.size()) {
+		const std::wstring& tail = segs.back();
+		if (tail.size() > normalized.size() || normalized.size() - tail.size() < pos)
+			return false;
+		return GlobSegmentAt(normalized, tail, normalized.size() - tail.size());
+	}
+	return true;
+}
+
+/*******************************************************************************
+		class TitleMatcher, public
+********************************************************************************/
+
+TitleMatcher::TitleMatcher(const std::wstring& pattern, MatchType type) {
+	m_type = type;
+	m_compiled = std::make_shared<Compiled>();
+	m_compiled->pattern = pattern;
+	compile();
+}
+
+TitleMatcher::TitleMatcher() : TitleMatcher(L"", MatchType::TMATCH_CONTAINS) {
+}
+
+std::wstring TitleMatcher::Normalize(const std::wstring& str) {
+	std::wstring normalized = str;
+	if (!normalized.empty())
+		CharLowerBuffW(&normalized[0], (DWORD)normalized.size());
+	return normalized;
+}
+
+bool TitleMatcher::matches(const std::wstring& title) const {
+	if (m_type == MatchType::TMATCH_CONTAINS_NOCASE || m_type == MatchType::TMATCH_GLOB)
+		return matches(title, Normalize(title));
+	return matches(title, title);
+}
+
+bool TitleMatcher::matches(const std::wstring& title, const std::wstring& normalized) const {
+	if (!m_valid)
+		return false;
+
+	const Compiled& c = *m_compiled;
+	switch (m_type) {
+	case MatchType::TMATCH_EXACT:
+		return title == c.pattern;
+
+	case MatchType::TMATCH_PREFIX:
+		return title.compare(0, c.pattern.size(), c.pattern) == 0;
+
+	case MatchType::TMATCH_CONTAINS:
+		return STD_WSTRING_CONTAINS(title, c.pattern);
+
+	case MatchType::TMATCH_CONTAINS_NOCASE:
+		return STD_WSTRING_CONTAINS(normalized, c.normalized);
+
+	case MatchType::TMATCH_GLOB:
+		return matchGlob(normalized);
+
+	case MatchType::TMATCH_REGEX:
+		return std::regex_search(title, c.regex);
+
+	default:
+		return false;
+	}
+}
+
+TitleMatcher::MatchType TitleMatcher::type() const {
+	return m_type;
+}
+
+const std::wstring& TitleMatcher::pattern() const {
+	return m_compiled->pattern;
+}
+
+bool TitleMatcher::isValid() const {
+	return m_valid;
+}
+
+/*******************************************************************************
+		class TitleIndex, public
+********************************************************************************/
+
+TitleIndex::TitleIndex() {
+	// Nothing
+}
+
+TitleIndex::TitleIndex(const std::vector<WinInfo_t>& windows) {
+	rebuild(windows);
+}
+
+void TitleIndex::rebuild(const std::vector<WinInfo_t>& windows) {
+	m_windows = windows;
+	m_normalized.clear();
+	m_normalized.reserve(m_windows.size());
+	m_exact.clear();
+	m_exact.reserve(m_windows.size());
+	m_sorted.clear();
+	m_sorted.reserve(m_windows.size());
+
+	for (size_t i = 0; i < m_windows.size(); i++) {
+		m_normalized.push_back(TitleMatcher::Normalize(m_windows[i].title));
+		// Only there to be found by pid or tid
+		if (m_windows[i].title.empty())
+			continue;
+		m_exact.emplace(m_windows[i].title, (int)i); // Keeps the first window with a given title
+		m_sorted.push_back((int)i);
+	}
+	// Stable so that among equal titles the enumeration order is kept
+	std::stable_sort(m_sorted.begin(), m_sorted.end(), [this](int a, int b) {
+		return m_windows[a].title < m_windows[b].title;
+	});
+}
+
+int TitleIndex::find(const TitleMatcher& matcher) const {
+	if (!matcher.isValid())
+		return -1;
+
+	if (matcher.type() == TitleMatcher::MatchType::TMATCH_EXACT) {
+		auto it = m_exact.find(matcher.pattern());
+		return it == m_exact.end() ? -1 : it->second;
+	}
+
+	if (matcher.type() == TitleMatcher::MatchType::TMATCH_PREFIX) {
+		// All titles with the prefix are adjacent in sorted order, the first in enumeration order is the lowest index among them
+		const std::wstring& prefix = matcher.pattern();
+		auto it = std::lower_bound(m_sorted.begin(), m_sorted.end(), prefix, [this](int i, const std::wstring& p) {
+			return m_windows[i].title < p;
+		});
+		int best = -1;
+		for (; it != m_sorted.end() && m_windows[*it].title.compare(0, prefix.size(), prefix) == 0; ++it) {
+			if (best == -1 || *it < best)
+				best = *it;
+		}
+		return best;
+	}
+
+	for (size_t i = 0; i < m_windows.size(); i++) {
+		if (!m_windows[i].title.empty() && matcher.matches(m_windows[i].title, m_normalized[i]))
+			return (int)i;
+	}
+	return -1;
+}
+
+std::vector<WinInfo_t> TitleIndex::findAll(const TitleMatcher& matcher) const {
+	std::vector<WinInfo_t> found;
+	for (size_t i = 0; i < m_windows.size(); i++) {
+		if (!m_windows[i].title.empty() && matcher.matches(m_windows[i].title, m_normalized[i]))
+			found.push_back(m_windows[i]);
+	}
+	return found;
+}
+
+int TitleIndex::findByPid(DWORD pid) const {
+	for (size_t i = 0; i < m_windows.size(); i++) {
+		if (m_windows[i].pid == pid)
+			return (int)i;
+	}
+	return -1;
+}
+
+int TitleIndex::findByTid(DWORD tid) const {
+	for (size_t i = 0; i < m_windows.size(); i++) {
+		if (m_windows[i].tid == tid)
+			return (int)i;
+	}
+	return -1;
+}
+
+const WinInfo_t& TitleIndex::at(size_t i) const {
+	return m_windows.at(i);
+}
+
+size_t TitleIndex::size() const {
+	return m_windows.size();
+}
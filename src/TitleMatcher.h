@@ -0,0 +1,109 @@
+#pragma once
+/*
+
+TitleMatcher
+
+Precompiled window title matchers and a normalized title index, used by bind() and when
+rebinding to a window whose title has changed
+
+*/
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <regex>
+#include <unordered_map>
+
+#include "WinAssist.h"
+
+namespace pinterface {
+
+	class TitleMatcher {
+/*******************************************************************************
+		class TitleMatcher, public
+********************************************************************************/
+	public:
+		// TMATCH_CONTAINS is the legacy (case sensitive) behaviour of bind(std::wstring&). TMATCH_CONTAINS_NOCASE and TMATCH_GLOB
+		// compare against the normalized (lowercase) title, the others against the title as reported by the window
+		enum class MatchType { TMATCH_EXACT, TMATCH_PREFIX, TMATCH_CONTAINS, TMATCH_CONTAINS_NOCASE, TMATCH_GLOB, TMATCH_REGEX };
+		TitleMatcher(const std::wstring& pattern, MatchType type = MatchType::TMATCH_CONTAINS);
+		TitleMatcher();
+
+		// Returns the normalized (lowercase) form of a title, as stored in the TitleIndex
+		static std::wstring Normalize(const std::wstring& str);
+
+		// Tests a title. Normalizes the title if the match type needs it
+		bool matches(const std::wstring& title) const;
+		// Tests a title for which the normalized form has already been computed
+		bool matches(const std::wstring& title, const std::wstring& normalized) const;
+
+		MatchType type() const;
+		const std::wstring& pattern() const;
+		// False if the pattern failed to compile (bad regex), in which case nothing matches
+		bool isValid() const;
+
+/*******************************************************************************
+		class TitleMatcher, private
+********************************************************************************/
+	private:
+		// Immutable compiled form, shared between copies of the matcher
+		struct Compiled {
+			std::wstring pattern;
+			std::wstring normalized;
+			std::vector<std::wstring> globSegments;
+			bool globAnchorStart = true;
+			bool globAnchorEnd = true;
+			std::wregex regex;
+		};
+
+		/* Private static functions */
+		// Finds segment (which may contain '?') in str starting at pos. Returns npos if not found
+		static size_t FindGlobSegment(const std::wstring& str, const std::wstring& segment, size_t pos);
+		static bool GlobSegmentAt(const std::wstring& str, const std::wstring& segment, size_t pos);
+
+		/* Private member functions */
+		void compile();
+		bool matchGlob(const std::wstring& normalized) const;
+
+		/* Private member variables */
+		MatchType m_type;
+		bool m_valid = true;
+		std::shared_ptr<Compiled> m_compiled;
+	};
+
+	class TitleIndex {
+/*******************************************************************************
+		class TitleIndex, public
+********************************************************************************/
+	public:
+		TitleIndex();
+		TitleIndex(const std::vector<WinInfo_t>& windows);
+
+		// Replaces the contents of the index, normalizing each title once
+		void rebuild(const std::vector<WinInfo_t>& windows);
+		// Returns the index of the first window matching, or -1 if there is none. Windows without a title, which are those
+		// that timed out before a title was ever seen, never match
+		int find(const TitleMatcher& matcher) const;
+		// Returns every window matching
+		std::vector<WinInfo_t> findAll(const TitleMatcher& matcher) const;
+		// Returns the index of the first window owned by the process/thread, or -1 if there is none
+		int findByPid(DWORD pid) const;
+		int findByTid(DWORD tid) const;
+
+		const WinInfo_t& at(size_t i) const;
+		size_t size() const;
+
+/*******************************************************************************
+		class TitleIndex, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		std::vector<WinInfo_t> m_windows;
+		std::vector<std::wstring> m_normalized;
+		// Exact title -> first window index, for TMATCH_EXACT
+		std::unordered_map<std::wstring, int> m_exact;
+		// Indices of the windows with a title, sorted by title, for TMATCH_PREFIX
+		std::vector<int> m_sorted;
+	};
+
+}
@@ -0,0 +1,177 @@
+/*
+
+Trace
+
+Optional tracing of the dispatch path, exported as Chrome trace event JSON
+
+*/
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace pi = pinterface;
+using namespace pi;
+using std::cerr;
+using std::endl;
+
+static void WriteJsonString(std::ostream& out, const char* str) {
+	out << '"';
+	for (const char* c = str; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\')
+			out << '\\' << *c;
+		else if ((unsigned char)*c < 0x20)
+			out << ' ';
+		else
+			out << *c;
+	}
+	out << '"';
+}
+
+/*******************************************************************************
+		class Tracer, private
+********************************************************************************/
+/* Private static variables */
+std::atomic<bool> Tracer::ENABLED{ false };
+std::atomic<UINT64> Tracer::GENERATION{ 1 };
+std::atomic<size_t> Tracer::BUFFER_EVENTS{ Tracer::DEFAULT_BUFFER_EVENTS };
+PegasusTimer Tracer::EPOCH;
+std::vector<std::unique_ptr<Tracer::ThreadBuffer_t>> Tracer::BUFFERS;
+std::mutex Tracer::BUFFERS_MUTEX;
+thread_local Tracer::ThreadBuffer_t* Tracer::LOCAL_BUFFER = nullptr;
+thread_local UINT64 Tracer::LOCAL_GENERATION = 0;
+thread_local std::string Tracer::LOCAL_NAME;
+
+/* Private static functions */
+Tracer::ThreadBuffer_t* Tracer::LocalBuffer() {
+	UINT64 generation = GENERATION.load(std::memory_order_acquire);
+	if (LOCAL_BUFFER != nullptr && LOCAL_GENERATION == generation)
+		return LOCAL_BUFFER;
+
+	std::unique_ptr<ThreadBuffer_t> buffer(new ThreadBuffer_t());
+	buffer->events.resize(std::max<size_t>(1, BUFFER_EVENTS.load(std::memory_order_relaxed)));
+	buffer->tid = GetCurrentThreadId();
+	buffer->name = LOCAL_NAME;
+
+	std::lock_guard<std::mutex> lock(BUFFERS_MUTEX);
+	LOCAL_BUFFER = buffer.get();
+	LOCAL_GENERATION = generation;
+	BUFFERS.push_back(std::move(buffer));
+	return LOCAL_BUFFER;
+}
+
+void Tracer::Record(const TraceEvent_t& evt) {
+	ThreadBuffer_t* buffer = LocalBuffer();
+	UINT64 head = buffer->head.load(std::memory_order_relaxed);
+	buffer->events[head % buffer->events.size()] = evt;
+	// Publishes the event to an exporter on another thread
+	buffer->head.store(head + 1, std::memory_order_release);
+}
+
+/*******************************************************************************
+		class Tracer, public
+********************************************************************************/
+/* Public static functions */
+void Tracer::Start(size_t eventsPerThread) {
+	BUFFER_EVENTS.store(eventsPerThread, std::memory_order_relaxed);
+	ENABLED.store(true, std::memory_order_release);
+}
+
+void Tracer::Stop() {
+	ENABLED.store(false, std::memory_order_release);
+}
+
+void Tracer::Clear() {
+	if (IsEnabled()) {
+		cerr << "Tracer::Clear() called while tracing, ignored" << endl;
+		return;
+	}
+	std::lock_guard<std::mutex> lock(BUFFERS_MUTEX);
+	GENERATION.fetch_add(1, std::memory_order_acq_rel);
+	BUFFERS.clear();
+}
+
+INT64 Tracer::Now() {
+	return EPOCH.getElapsedTimeAsMicroseconds();
+}
+
+void Tracer::Instant(const char* name, const char* category, INT64 timestamp, const char* argName, INT64 arg,
+	const char* arg2Name, INT64 arg2) {
+	Record({ name, category, 'i', timestamp, 0, { argName, arg2Name }, { arg, arg2 } });
+}
+
+void Tracer::Span(const char* name, const char* category, INT64 start, INT64 end, const char* argName, INT64 arg,
+	const char* arg2Name, INT64 arg2) {
+	Record({ name, category, 'X', start, end - start, { argName, arg2Name }, { arg, arg2 } });
+}
+
+void Tracer::SetThreadName(const std::string& name) {
+	LOCAL_NAME = name;
+	ThreadBuffer_t* buffer = LocalBuffer();
+	std::lock_guard<std::mutex> lock(BUFFERS_MUTEX);
+	buffer->name = name;
+}
+
+size_t Tracer::WriteChromeJson(std::ostream& out) {
+	std::lock_guard<std::mutex> lock(BUFFERS_MUTEX);
+	DWORD pid = GetCurrentProcessId();
+	size_t written = 0;
+	bool first = true;
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	for (auto& buffer : BUFFERS) {
+		if (!buffer->name.empty()) {
+			out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer->tid
+				<< ",\"args\":{\"name\":";
+			WriteJsonString(out, buffer->name.c_str());
+			out << "}}";
+			first = false;
+		}
+
+		// Only the last lap of the ring is still there
+		UINT64 head = buffer->head.load(std::memory_order_acquire);
+		UINT64 size = buffer->events.size();
+		for (UINT64 i = head > size ? head - size : 0; i < head; i++) {
+			const TraceEvent_t& evt = buffer->events[i % size];
+			out << (first ? "\n" : ",\n") << "{\"name\":";
+			WriteJsonString(out, evt.name);
+			out << ",\"cat\":";
+			WriteJsonString(out, evt.category);
+			out << ",\"ph\":\"" << evt.phase << "\",\"ts\":" << evt.timestamp;
+			if (evt.phase == 'X')
+				out << ",\"dur\":" << evt.duration;
+			else
+				out << ",\"s\":\"t\""; // Instants are drawn on their thread's track
+			out << ",\"pid\":" << pid << ",\"tid\":" << buffer->tid;
+			if (evt.argNames[0] != nullptr) {
+				out << ",\"args\":{";
+				WriteJsonString(out, evt.argNames[0]);
+				out << ":" << evt.args[0];
+				if (evt.argNames[1] != nullptr) {
+					out << ",";
+					WriteJsonString(out, evt.argNames[1]);
+					out << ":" << evt.args[1];
+				}
+				out << "}";
+			}
+			out << "}";
+			first = false;
+			written++;
+		}
+	}
+	out << "\n]}" << endl;
+	return written;
+}
+
+bool Tracer::ExportChromeJson(const std::string& path) {
+	std::ofstream out(path, std::ios::out | std::ios::trunc);
+	if (!out) {
+		cerr << "Unable to write the trace to '" << path << "'" << endl;
+		return false;
+	}
+	size_t written = WriteChromeJson(out);
+	std::cout << "Wrote " << written << " trace events to '" << path << "'" << endl;
+	return out.good();
+}
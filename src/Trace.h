@@ -0,0 +1,133 @@
+#pragma once
+/*
+
+Trace
+
+Optional tracing of the dispatch path. Spans and instants (submit, schedule, due, dispatch,
+inject, attach, focus, SendInput) are written to a buffer owned by the thread that records
+them, without locks, and can be exported as Chrome trace event JSON, which chrome://tracing
+and ui.perfetto.dev open as a timeline. While tracing is off each trace point costs one
+branch on a flag
+
+*/
+
+#include <Windows.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "PegasusTimer.h"
+
+namespace pinterface {
+
+/*******************************************************************************
+		struct TraceEvent
+********************************************************************************/
+	// Names, categories and argument names must be string literals, only the pointers are kept
+	typedef struct TraceEvent {
+		const char* name;
+		const char* category;
+		// 'X' for a span, 'i' for an instant
+		char phase;
+		// Microseconds on the trace clock, see Tracer::Now()
+		INT64 timestamp;
+		INT64 duration;
+		const char* argNames[2];
+		INT64 args[2];
+	} TraceEvent_t;
+
+	class Tracer {
+/*******************************************************************************
+		class Tracer, private
+********************************************************************************/
+	private:
+		// Ring of events written by one thread. Once full the oldest events are overwritten
+		typedef struct ThreadBuffer {
+			std::vector<TraceEvent_t> events;
+			// Events ever written. Only the owning thread writes it
+			std::atomic<UINT64> head{ 0 };
+			DWORD tid = 0;
+			std::string name;
+		} ThreadBuffer_t;
+
+		/* Private static variables */
+		static std::atomic<bool> ENABLED;
+		// Bumped by Clear(), so each thread knows to take a new buffer
+		static std::atomic<UINT64> GENERATION;
+		static std::atomic<size_t> BUFFER_EVENTS;
+		static PegasusTimer EPOCH;
+		// Every buffer handed out since the last Clear(). Only locked when a thread takes its first buffer and when exporting
+		static std::vector<std::unique_ptr<ThreadBuffer_t>> BUFFERS;
+		static std::mutex BUFFERS_MUTEX;
+		// The calling thread's buffer and the generation it belongs to
+		static thread_local ThreadBuffer_t* LOCAL_BUFFER;
+		static thread_local UINT64 LOCAL_GENERATION;
+		// Kept apart from the buffer so it survives a Clear()
+		static thread_local std::string LOCAL_NAME;
+
+		/* Private static functions */
+		// This thread's buffer, taken from the list the first time
+		static ThreadBuffer_t* LocalBuffer();
+		static void Record(const TraceEvent_t& evt);
+
+/*******************************************************************************
+		class Tracer, public
+********************************************************************************/
+	public:
+		/* Public static variables */
+		static constexpr size_t DEFAULT_BUFFER_EVENTS = 64 * 1024;
+
+		/* Public static functions */
+		// The check every trace point makes before doing anything else
+		static inline bool IsEnabled() { return ENABLED.load(std::memory_order_relaxed); }
+		// Starts recording. Buffers are made with room for eventsPerThread events the first time each thread records
+		static void Start(size_t eventsPerThread = DEFAULT_BUFFER_EVENTS);
+		static void Stop();
+		// Drops everything recorded. Tracing must be stopped, and no thread may still be inside a trace call
+		static void Clear();
+		// Trace timestamp, in microseconds from when the program started. Real time whatever clock the interfaces run on
+		static INT64 Now();
+
+		static void Instant(const char* name, const char* category, INT64 timestamp, const char* argName = nullptr, INT64 arg = 0,
+			const char* arg2Name = nullptr, INT64 arg2 = 0);
+		static void Span(const char* name, const char* category, INT64 start, INT64 end, const char* argName = nullptr, INT64 arg = 0,
+			const char* arg2Name = nullptr, INT64 arg2 = 0);
+		// Names the calling thread in the exported timeline. The name is copied
+		static void SetThreadName(const std::string& name);
+
+		// Writes everything recorded as Chrome trace event JSON. Stop tracing first, or events being written at the time
+		// may come out half written. Returns the number of events written
+		static size_t WriteChromeJson(std::ostream& out);
+		// Writes the JSON to a file. Returns false if the file can't be written
+		static bool ExportChromeJson(const std::string& path);
+	};
+
+	// Records a span covering its own lifetime, if tracing was on when it was made
+	class TraceScope {
+/*******************************************************************************
+		class TraceScope, public
+********************************************************************************/
+	public:
+		TraceScope(const char* name, const char* category) : m_name(name), m_category(category), m_start(Tracer::IsEnabled() ? Tracer::Now() : -1) {}
+		~TraceScope() {
+			if (m_start >= 0)
+				Tracer::Span(m_name, m_category, m_start, Tracer::Now());
+		}
+		TraceScope(const TraceScope&) = delete;
+		TraceScope& operator=(const TraceScope&) = delete;
+
+/*******************************************************************************
+		class TraceScope, private
+********************************************************************************/
+	private:
+		/* Private member variables */
+		const char* m_name;
+		const char* m_category;
+		INT64 m_start;
+	};
+
+}
@@ -7,11 +7,41 @@ Static class that provides utility functions for getting windows API information
 */
 
 #include "WinAssist.h"
+#include "TitleMatcher.h"
+#include "Trace.h"
+#include "InputBuilder.h"
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 
 namespace pi = pinterface;
 using namespace pi;
 
+// Finds a window in the index by matcher (or the old title if there is none), then pid, then tid. Returns -1 if none match
+static int FindInIndex(const TitleIndex& index, const WinInfo_t& window, const TitleMatcher* matcher) {
+	int found = index.find(matcher ? *matcher : TitleMatcher(window.title, TitleMatcher::MatchType::TMATCH_CONTAINS));
+	if (found >= 0) {
+		std::cout << "Match found by window title" << std::endl;
+	}
+	else if ((found = index.findByPid(window.pid)) >= 0) {
+		std::cout << "Match found by pid" << std::endl;
+	}
+	else if ((found = index.findByTid(window.tid)) >= 0) {
+		std::cout << "Match found by tid" << std::endl;
+	}
+	return found;
+}
+
+// True if the handle from an enumeration still belongs to the window's process
+static bool IsSameWindow(const WinInfo_t& window) {
+	if (!IsWindow(window.hwnd))
+		return false;
+	DWORD pid = 0;
+	GetWindowThreadProcessId(window.hwnd, &pid);
+	return pid == window.pid;
+}
+
 /*******************************************************************************
 		namespace WinCallbacks
 ********************************************************************************/
@@ -34,12 +64,19 @@ BOOL CALLBACK WinCallbacks::winInfoList(HWND hwnd, LPARAM lParam) {
 	winInfo.title = std::wstring(&windowTitle[0]);
 	winInfo.isVisible = IsWindowVisible(hwnd);
 	winInfo.tid = GetWindowThreadProcessId(hwnd, &winInfo.pid);
+	winInfo.hwnd = hwnd;
 
 	infoList.push_back(winInfo);
 
 	return TRUE;
 }
 
+BOOL CALLBACK WinCallbacks::winHandleList(HWND hwnd, LPARAM lParam) {
+	std::vector<HWND>& handles = *reinterpret_cast<std::vector<HWND>*>(lParam);
+	handles.push_back(hwnd);
+	return TRUE;
+}
+
 /*******************************************************************************
 		class KeyEvent, public
 ********************************************************************************/
@@ -119,188 +156,131 @@ DWORD MouseEvent::scrollDelta() {
 ********************************************************************************/
 /* Private static variables */
 std::vector<WinInfo_t> WinAssist::WIN_INFO(0);
+std::shared_ptr<const TitleIndex> WinAssist::WIN_INDEX;
+bool WinAssist::WIN_INFO_LISTED = false;
+std::mutex WinAssist::WIN_INFO_MUTEX;
+std::unordered_map<HWND, std::wstring> WinAssist::LAST_TITLES;
+std::mutex WinAssist::LAST_TITLES_MUTEX;
 
 /* Private static functinos */
-void WinAssist::UpdateWinNames() {
-	WIN_INFO.clear();
-	EnumWindows(WinCallbacks::winInfoList, reinterpret_cast<LPARAM>(&WIN_INFO));
-}
-
-bool WinAssist::CheckWinHwndValidity(HWND hwnd) {
-	return IsWindow(hwnd);
+void WinAssist::UpdateWinNames(UINT timeoutMs) {
+	std::vector<WinInfo_t> windows = EnumerateWindows(timeoutMs);
+	std::lock_guard<std::mutex> lock(WIN_INFO_MUTEX);
+	WIN_INFO.swap(windows);
+	WIN_INFO_LISTED = true;
+	// Built again when next asked for
+	WIN_INDEX.reset();
 }
 
-void WinAssist::SendKey(KeyEvent key) {
-	if (key.type() == KeyEvent::EventType::KEVT_NONE)
-		return;
-
-	INPUT input[2];
-	ZeroMemory(&input[0], sizeof(INPUT));
-	ZeroMemory(&input[1], sizeof(INPUT));
-
-	WORD scanCode = MapVirtualKey(key.vKey(), MAPVK_VK_TO_VSC);
-	DWORD flags = 0;
-	if (key.scanCode())
-		flags |= KEYEVENTF_SCANCODE;
-	if (key.isExtended())
-		flags |= KEYEVENTF_EXTENDEDKEY;
-
-	std::cout << "Sending key: VK#=" << key.vKey() << ", scanCode=" << scanCode;
-	if (key.scanCode())
-		std::cout << ", mode=scancode";
-	else
-		std::cout << ", mode=vk";
-
-	int index = 0;
-	if (key.type() == KeyEvent::EventType::KEVT_TYPED || key.type() == KeyEvent::EventType::KEVT_PRESSED) {
-		// Write the press information to input
-		input[index].ki.wVk = key.vKey();
-		input[index].ki.wScan = scanCode;
-		input[index].ki.dwFlags = flags; //press down
-		input[index].type = INPUT_KEYBOARD;
-		std::cout << ", [PRESSED]";
-		index++;
-	}
-	if (key.type() == KeyEvent::EventType::KEVT_TYPED || key.type() == KeyEvent::EventType::KEVT_RELEASED) {
-		// Write the release information to input
-		input[index].ki.wVk = key.vKey();
-		input[index].ki.wScan = scanCode;
-		input[index].ki.dwFlags = flags | KEYEVENTF_KEYUP; //release key
-		input[index].type = INPUT_KEYBOARD;
-		std::cout << ", [RELEASED]";
-		index++;
+std::vector<WinInfo_t> WinAssist::EnumerateWindows(UINT timeoutMs) {
+	// Collecting the handles does not send any messages, so this part can't be held up by a hung window
+	std::vector<HWND> handles;
+	EnumWindows(WinCallbacks::winHandleList, reinterpret_cast<LPARAM>(&handles));
+
+	std::vector<WinInfo_t> infos(handles.size());
+	// 0 = no title (skipped), 1 = fetched, 2 = timed out
+	std::vector<char> results(handles.size(), 0);
+
+	auto fetch = [&](size_t i) {
+		if (FetchWinInfo(handles[i], timeoutMs, infos[i]))
+			results[i] = infos[i].title.empty() ? 0 : 1;
+		else
+			results[i] = 2;
+	};
+
+	// A window of the calling thread only answers another thread when this one pumps messages, which it doesn't while it
+	// waits for the workers. Asked from this thread the message goes straight to its window procedure, so they are done here
+	std::vector<char> own(handles.size(), 0);
+	DWORD self = GetCurrentThreadId();
+	for (size_t i = 0; i < handles.size(); i++) {
+		if (GetWindowThreadProcessId(handles[i], NULL) == self) {
+			own[i] = 1;
+			fetch(i);
+		}
 	}
 
-	std::cout << ", index == " << index;
-	if (index == 0 || index > 2) {
-		// Error
-		std::cout << ": ERROR" << std::endl;
-		return;
-	}
-	// Send
-	std::cout << ": SEND" << std::endl;
-	SendInput(index, input, sizeof(INPUT));
-}
-
-void WinAssist::SendMouse(MouseEvent evt) {
-	if (evt.type() == MouseEvent::EventType::MEVT_NONE)
-		return;
-
-	std::vector<INPUT> inputQueue;
-
-	std::cout << "Sending mouse event: typeIndex=" << (int)evt.type();
-
-	/* KEY PRESSED DOWN */
-	if (evt.type() == MouseEvent::EventType::MEVT_KEY_PRESSED || evt.type() == MouseEvent::EventType::MEVT_KEY_DOWN) {
-		// Add the mouse key DOWN
-		std::cout << ", [MOUSE_KEY_DOWN] (";
-		INPUT in;
-		ZeroMemory(&in, sizeof(INPUT));
-		// Put the key information into the flags
-		switch (evt.key()) {
-		case MouseEvent::MouseKey::MKEY_LEFT:
-			in.mi.dwFlags |= MOUSEEVENTF_LEFTDOWN;
-			std::cout << "LEFT)";
-			break;
-
-		case MouseEvent::MouseKey::MKEY_RIGHT:
-			in.mi.dwFlags |= MOUSEEVENTF_RIGHTDOWN;
-			std::cout << "RIGHT)";
-			break;
-
-		case MouseEvent::MouseKey::MKEY_MID:
-			in.mi.dwFlags |= MOUSEEVENTF_MIDDLEDOWN;
-			std::cout << "MID)";
-			break;
-
-		default:
-			std::cout << "NONE)";
-			break;
+	// Workers take the next handle from a shared counter, so one hung window only holds up the worker that met it
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		size_t i;
+		while ((i = next.fetch_add(1)) < handles.size()) {
+			if (!own[i])
+				fetch(i);
 		}
-		// Add to the input queue
-		inputQueue.push_back(in);
-	}
-	/* KEY RELEASED */
-	if (evt.type() == MouseEvent::EventType::MEVT_KEY_PRESSED || evt.type() == MouseEvent::EventType::MEVT_KEY_UP) {
-		// Add the mouse key UP
-		std::cout << ", [MOUSE_KEY_UP] (";
-		INPUT in;
-		ZeroMemory(&in, sizeof(INPUT));
-		// Put the key information into the flags
-		switch (evt.key()) {
-		case MouseEvent::MouseKey::MKEY_LEFT:
-			in.mi.dwFlags |= MOUSEEVENTF_LEFTUP;
-			std::cout << "LEFT)";
-			break;
-
-		case MouseEvent::MouseKey::MKEY_RIGHT:
-			in.mi.dwFlags |= MOUSEEVENTF_RIGHTUP;
-			std::cout << "RIGHT)";
-			break;
-
-		case MouseEvent::MouseKey::MKEY_MID:
-			in.mi.dwFlags |= MOUSEEVENTF_MIDDLEUP;
-			std::cout << "MID)";
-			break;
-
-		default:
-			std::cout << "NONe)";
-			break;
+	};
+
+	unsigned workers = std::min<unsigned>(std::max(1u, std::thread::hardware_concurrency()), ENUM_MAX_WORKERS);
+	workers = std::min<unsigned>(workers, (unsigned)((handles.size() + 31) / 32)); // Not worth a thread for a few windows
+	std::vector<std::thread> pool;
+	for (unsigned w = 1; w < workers; w++)
+		pool.emplace_back(worker);
+	worker();
+	for (auto& t : pool)
+		t.join();
+
+	// Keep the enumeration order, which is the Z order
+	std::vector<WinInfo_t> windows;
+	windows.reserve(handles.size());
+	std::lock_guard<std::mutex> lock(LAST_TITLES_MUTEX);
+	std::unordered_map<HWND, std::wstring> seen;
+	for (size_t i = 0; i < handles.size(); i++) {
+		if (results[i] == 1) {
+			seen[handles[i]] = infos[i].title;
+			windows.push_back(infos[i]);
 		}
-		// Add to the input queue
-		inputQueue.push_back(in);
-	}
-	/* MOUSE MOVE */
-	if (evt.type() == MouseEvent::EventType::MEVT_MOVE) {
-		// Add the relative mouse movement
-		std::cout << ", [MOUSE_MOVE]";
-		INPUT in;
-		ZeroMemory(&in, sizeof(INPUT));
-		// Put the values in
-		in.mi.dx = evt.dx();
-		in.mi.dy = evt.dy();
-		std::cout << " dx=" << in.mi.dx << " dy=" << in.mi.dy;
-		in.mi.dwFlags = MOUSEEVENTF_MOVE;
-		// Add to the input queue
-		inputQueue.push_back(in);
-	}
-	/* MOUSE ABS MOVE (Normal and Desktop) */
-	if (evt.type() == MouseEvent::EventType::MEVT_MOVE_ABS || evt.type() == MouseEvent::EventType::MEVT_MOVE_DESKTOP) {
-		// Add the absoltue mouse movement
-		std::cout << ", [MOUSE_ABS_MOVE]";
-		INPUT in;
-		ZeroMemory(&in, sizeof(INPUT));
-		// Put the values in
-		in.mi.dwFlags |= MOUSEEVENTF_ABSOLUTE;
-		if (evt.type() == MouseEvent::EventType::MEVT_MOVE_DESKTOP) {
-			in.mi.dwFlags |= MOUSEEVENTF_VIRTUALDESK;
-			std::cout << "[DESKTOP]";
+		else if (results[i] == 2) {
+			// Listed either way, so a hung process can still be found by its pid. Without a title seen before it is left
+			// empty, and title matching passes over it
+			auto last = LAST_TITLES.find(handles[i]);
+			if (last != LAST_TITLES.end()) {
+				infos[i].title = last->second;
+				seen[handles[i]] = last->second;
+			}
+			infos[i].isStale = true;
+			windows.push_back(infos[i]);
 		}
-		in.mi.dx = evt.dx();
-		in.mi.dy = evt.dy();
-		std::cout << " dx=" << in.mi.dx << " dy=" << in.mi.dy;
-		// Add to the input queue
-		inputQueue.push_back(in);
-	}
-	/* MOUSE SCROLL */
-	if (evt.type() == MouseEvent::EventType::MEVT_SCROLL) {
-		// Add the scroll movement
-		std::cout << ", [MOUSE_SCROLL]";
-		INPUT in;
-		ZeroMemory(&in, sizeof(INPUT));
-		// Put the values in
-		in.mi.dwFlags |= MOUSEEVENTF_WHEEL;
-		in.mi.mouseData = evt.scrollDelta();
-		std::cout << " delta=" << in.mi.mouseData;
 	}
+	// Only keep the handles still alive, so the cache can't grow without bound
+	LAST_TITLES.swap(seen);
 
-	if (inputQueue.size() == 0) {
-		std::cout << " [NONE]" << std::endl;
-		return;
-	}
-	// Dispatch the inputs
-	SendInput((UINT)inputQueue.size(), &inputQueue[0], sizeof(INPUT));
-	std::cout << " [SENT]" << std::endl;
+	return windows;
+}
+
+bool WinAssist::FetchWinInfo(HWND hwnd, UINT timeoutMs, WinInfo_t& info) {
+	// These don't send messages to the owning thread
+	info.hwnd = hwnd;
+	info.isVisible = IsWindowVisible(hwnd);
+	info.tid = GetWindowThreadProcessId(hwnd, &info.pid);
+	info.isStale = false;
+	info.title.clear();
+
+	// GetWindowText would wait on the owning thread indefinitely, so ask for the text with a bounded wait
+	DWORD_PTR length = 0;
+	if (!SendMessageTimeoutW(hwnd, WM_GETTEXTLENGTH, 0, 0, SMTO_ABORTIFHUNG | SMTO_BLOCK, timeoutMs, &length))
+		return false;
+	if (length == 0)
+		return true;
+
+	std::wstring title(length + 1, L'\0');
+	DWORD_PTR copied = 0;
+	if (!SendMessageTimeoutW(hwnd, WM_GETTEXT, (WPARAM)title.size(), reinterpret_cast<LPARAM>(&title[0]), SMTO_ABORTIFHUNG | SMTO_BLOCK,
+		timeoutMs, &copied))
+		return false;
+	title.resize(std::min<size_t>(copied, length));
+	info.title = title;
+	return true;
+}
+
+bool WinAssist::CheckWinHwndValidity(HWND hwnd) {
+	return IsWindow(hwnd);
+}
+
+int WinAssist::BuildKeyInputs(KeyEvent key, std::vector<INPUT>& inputs) {
+	return InputBuilder<ConsoleLog>::BuildKey(key, inputs);
+}
+
+int WinAssist::BuildMouseInputs(MouseEvent evt, std::vector<INPUT>& inputs) {
+	return InputBuilder<ConsoleLog>::BuildMouse(evt, inputs);
 }
 
 //void WinAssist::sendKeyB(WinInfo_t window, WORD key) {
@@ -330,13 +310,15 @@ bool WinAssist::DisconnectThread(WinInfo_t window) {
 		class WinAssist, public
 ********************************************************************************/
 /* Public static functions */
-std::vector<WinInfo_t> WinAssist::GetWindowList() {
-	UpdateWinNames();
+std::vector<WinInfo_t> WinAssist::GetWindowList(UINT timeoutMs) {
+	UpdateWinNames(timeoutMs);
+	std::lock_guard<std::mutex> lock(WIN_INFO_MUTEX);
 	return WIN_INFO;
 }
 
-std::vector<WinInfo_t> WinAssist::GetVisibleWindowList() {
-	UpdateWinNames();
+std::vector<WinInfo_t> WinAssist::GetVisibleWindowList(UINT timeoutMs) {
+	UpdateWinNames(timeoutMs);
+	std::lock_guard<std::mutex> lock(WIN_INFO_MUTEX);
 	std::vector<WinInfo_t> windows;
 	for (auto w : WIN_INFO) {
 		if (w.isVisible) {
@@ -346,43 +328,92 @@ std::vector<WinInfo_t> WinAssist::GetVisibleWindowList() {
 	return windows;
 }
 
-void WinAssist::SendKeys(WinInfo_t window, std::vector<KeyEvent> keys) {
-	// Attempt to connect to the window
-	if (!ConnectToThread(window)) {
-		std::wcerr << "Failed to send keys: unable to connect to thread of window with title '" << window.title << "', pid="
-			<< window.pid << ", tid=" << window.tid << std::endl;
-		return; // We failed to connect, just return
+std::shared_ptr<const TitleIndex> WinAssist::GetWindowIndex(bool refresh, UINT timeoutMs) {
+	bool listed;
+	{
+		std::lock_guard<std::mutex> lock(WIN_INFO_MUTEX);
+		listed = WIN_INFO_LISTED;
 	}
-	// std::cout << "Connected thread" << std::endl;
-	SetActiveWindow(GetWindowHWND(window, true));
+	if (refresh || !listed)
+		UpdateWinNames(timeoutMs);
+
+	std::lock_guard<std::mutex> lock(WIN_INFO_MUTEX);
+	if (!WIN_INDEX)
+		WIN_INDEX = std::make_shared<const TitleIndex>(WIN_INFO);
+	return WIN_INDEX;
+}
+
+std::future<std::vector<WinInfo_t>> WinAssist::GetWindowListAsync(UINT timeoutMs) {
+	return std::async(std::launch::async, EnumerateWindows, timeoutMs);
+}
+
+void WinAssist::SendKeys(WinInfo_t window, std::vector<KeyEvent> keys) {
+	std::vector<INPUT> inputs;
 	for (auto key : keys) {
-		SendKey(key);
+		BuildKeyInputs(key, inputs);
 	}
+	SendInputs(window, inputs);
+}
 
-	while (!DisconnectThread(window)) {
-		std::cerr << "Failed to disconnect from thread!!!" << std::endl;
+void WinAssist::SendMouseEvents(WinInfo_t window, std::vector<MouseEvent> events) {
+	std::vector<INPUT> inputs;
+	for (auto evt : events) {
+		BuildMouseInputs(evt, inputs);
 	}
+	SendInputs(window, inputs);
 }
 
-void WinAssist::SendMouseEvents(WinInfo_t window, std::vector<MouseEvent> events) {
+bool WinAssist::SendInputs(WinInfo_t window, std::vector<INPUT>& inputs) {
+	if (inputs.empty())
+		return true;
+
+	// Without a window the input would go to whatever has focus, so nothing is sent. Nor is it sent to some other window
+	// that happens to look like it, finding the window again is up to the caller and the matcher it was bound with
+	HWND hwnd = GetWindowHWND(window, false);
+	if (hwnd == 0) {
+		std::wcerr << "Failed to send inputs: window with title '" << window.title << "' is gone, pid=" << window.pid << std::endl;
+		return false;
+	}
+
+	// Each stage is timed for the trace, a read of the flag when tracing is off
+	bool tracing = Tracer::IsEnabled();
+	INT64 traceStart = tracing ? Tracer::Now() : 0;
+
 	// Attempt to connect to the window
 	if (!ConnectToThread(window)) {
-		std::wcerr << "Failed to send mouse events: unable to connect to thread of window with title '" << window.title << "', pid="
+		std::wcerr << "Failed to send inputs: unable to connect to thread of window with title '" << window.title << "', pid="
 			<< window.pid << ", tid=" << window.tid << std::endl;
-		return; // We failed to connect, just return
+		return false; // We failed to connect, just return
 	}
+	INT64 traceAttached = tracing ? Tracer::Now() : 0;
 	// std::cout << "Connected thread" << std::endl;
-	SetActiveWindow(GetWindowHWND(window, true));
-	for (auto evt : events) {
-		SendMouse(evt);
-	}
+	SetActiveWindow(hwnd);
+	INT64 traceFocused = tracing ? Tracer::Now() : 0;
+	// One call, so the whole batch is inserted into the input stream without anything in between
+	UINT sent = SendInput((UINT)inputs.size(), &inputs[0], sizeof(INPUT));
+	INT64 traceSent = tracing ? Tracer::Now() : 0;
 
 	while (!DisconnectThread(window)) {
 		std::cerr << "Failed to disconnect from thread!!!" << std::endl;
 	}
+	if (tracing) {
+		Tracer::Span("attach", "win", traceStart, traceAttached, "tid", window.tid);
+		Tracer::Span("focus", "win", traceAttached, traceFocused);
+		Tracer::Span("SendInput", "win", traceFocused, traceSent, "inputs", (INT64)inputs.size(), "sent", sent);
+		Tracer::Span("detach", "win", traceSent, Tracer::Now());
+	}
+	return sent == inputs.size();
 }
 
-HWND WinAssist::GetWindowHWND(WinInfo_t& window, bool allowUpdate) {
+HWND WinAssist::GetWindowHWND(WinInfo_t& window, bool allowUpdate, const TitleMatcher* matcher) {
+	// The handle from enumeration is checked first, as the title may have changed since
+	if (window.hwnd != 0 && CheckWinHwndValidity(window.hwnd)) {
+		DWORD handlePid;
+		GetWindowThreadProcessId(window.hwnd, &handlePid);
+		if (handlePid == window.pid)
+			return window.hwnd;
+	}
+
 	HWND hwnd = FindWindow(NULL, window.title.c_str());
 	DWORD pid;
 	DWORD tid = GetWindowThreadProcessId(hwnd, &pid);
@@ -396,24 +427,20 @@ HWND WinAssist::GetWindowHWND(WinInfo_t& window, bool allowUpdate) {
 	// If we have update on, try to update the struct
 	if (allowUpdate) {
 		std::cout << "Attempting to update information: ";
-		std::vector<WinInfo_t> winList = GetWindowList();
-		for (auto w : winList) {
-			if (STD_WSTRING_CONTAINS(w.title, window.title)) {
-				std::cout << "Match found by window title" << std::endl;
-				window = w;
-				return GetWindowHWND(window);
-			}
-			else if (w.pid == window.pid) {
-				std::cout << "Match found by pid" << std::endl;
-				window = w;
-				return GetWindowHWND(window);
-			}
-			else if (w.tid == window.tid) {
-				std::cout << "Match found by tid" << std::endl;
-				window = w;
-				return GetWindowHWND(window);
-			}
+		// The last list is only trusted for a window that is still there. Otherwise it is from before the window was
+		// replaced, so the list is taken again
+		std::shared_ptr<const TitleIndex> index = GetWindowIndex(false);
+		int found = FindInIndex(*index, window, matcher);
+		if (found < 0 || !IsSameWindow(index->at(found))) {
+			index = GetWindowIndex(true);
+			found = FindInIndex(*index, window, matcher);
+		}
+
+		if (found >= 0) {
+			window = index->at(found);
+			return GetWindowHWND(window);
 		}
+		std::cout << "No match found" << std::endl;
 	}
 
 	return 0;
@@ -438,4 +465,18 @@ WinDimensions_t WinAssist::GetWindowDimensions(WinInfo_t window) {
 	}
 
 	return dims;
+}
+
+std::wstring WinAssist::Utf8ToWide(const std::string& str) {
+	if (str.empty())
+		return std::wstring();
+
+	int length = MultiByteToWideChar(CP_UTF8, 0, str.data(), (int)str.size(), NULL, 0);
+	if (length <= 0) {
+		std::cerr << "Utf8ToWide: unable to convert string (error " << GetLastError() << ")" << std::endl;
+		return std::wstring();
+	}
+	std::wstring wide(length, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, str.data(), (int)str.size(), &wide[0], length);
+	return wide;
 }
\ No newline at end of file
@@ -10,6 +10,10 @@ Static class that provides utility functions for getting windows API information
 #include <vector>
 #include <string>
 #include <tuple>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include <Windows.h>
 
@@ -17,6 +21,9 @@ Static class that provides utility functions for getting windows API information
 
 namespace pinterface {
 
+	class TitleMatcher;
+	class TitleIndex;
+
 /*******************************************************************************
 		struct WinInfo
 ********************************************************************************/
@@ -25,6 +32,10 @@ namespace pinterface {
 		bool isVisible;
 		DWORD pid; // Process ID
 		DWORD tid; // Thread ID
+		HWND hwnd = 0; // Window handle at the time of enumeration
+		// Set if the window did not answer for its title in time. title then holds the last title seen for the handle, or is
+		// empty if there wasn't one, in which case the window can only be found by its pid or tid
+		bool isStale = false;
 	} WinInfo_t;
 
 /*******************************************************************************
@@ -96,7 +107,11 @@ namespace pinterface {
 	namespace WinCallbacks {
 		// Callback function that is called per window to return the information about the window.
 		// Requires a std::vector<WinCallbacks::WinInfo_t>* to be passed as lParam
+		// WARNING: fetches the title synchronously, so a hung window stalls the enumeration. Prefer winHandleList
 		BOOL CALLBACK winInfoList(HWND hwnd, LPARAM lParam); 
+		// Callback function that is called per window to collect the window handles only.
+		// Requires a std::vector<HWND>* to be passed as lParam
+		BOOL CALLBACK winHandleList(HWND hwnd, LPARAM lParam);
 	}
 
 	class WinAssist {
@@ -106,10 +121,24 @@ namespace pinterface {
 	private:
 		/* Private static variables */
 		static std::vector<WinInfo_t> WIN_INFO;
+		// WIN_INFO with its titles indexed, built the first time it is needed after each refresh
+		static std::shared_ptr<const TitleIndex> WIN_INDEX;
+		static bool WIN_INFO_LISTED;
+		static std::mutex WIN_INFO_MUTEX;
+		// Last title seen per window handle, used to fill in windows that time out
+		static std::unordered_map<HWND, std::wstring> LAST_TITLES;
+		static std::mutex LAST_TITLES_MUTEX;
 
 		/* Private static functions */
 		// Updates the names in the WIN_NAMES list to the currently open applications
-		static void UpdateWinNames();
+		static void UpdateWinNames(UINT timeoutMs);
+
+		// Enumerates the top level windows: collects the handles, then fetches the titles on a pool of worker threads with a
+		// timeout per window. Does not touch WIN_INFO so may be called from any thread
+		static std::vector<WinInfo_t> EnumerateWindows(UINT timeoutMs);
+
+		// Fills in the information for one window. Returns false if the window did not answer within the timeout
+		static bool FetchWinInfo(HWND hwnd, UINT timeoutMs, WinInfo_t& info);
 
 		// Checks the validity of the handle passed to it. WARNING: handle reuse may give the indication nothing has changed, further
 		// the window may change state immediately after the test. DO NOT USE AS A GUARANTEE, just an indication
@@ -121,11 +150,6 @@ namespace pinterface {
 		// Disconnects this thread from another thread
 		static bool DisconnectThread(WinInfo_t window);
 
-		// Sends a key to another thread. MUST BE CONNECTED BEFORE DOING SO
-		static void SendKey(KeyEvent key);
-
-		// Sends a mouse event to another thread. MUST BE CONNECTED BEFORE DOING SO
-		static void SendMouse(MouseEvent evt);
 
 		// Sends a key to another thread. Doesn't need connection before doing so. (PostThreadMessage method)
 		// DEPRECATED
@@ -139,18 +163,41 @@ namespace pinterface {
 		class WinAssist, public
 ********************************************************************************/
 	public:
+		/* Public static variables */
+		// Default time a window is given to answer for its title during enumeration
+		static constexpr UINT TITLE_TIMEOUT_MS = 50;
+		// Upper bound on the worker threads used to fetch titles
+		static constexpr unsigned ENUM_MAX_WORKERS = 8;
+
 		/* Public static functions */
-		static std::vector<WinInfo_t> GetWindowList();
-		static std::vector<WinInfo_t> GetVisibleWindowList();
+		// Windows that did not answer in time are returned with isStale set, and an empty title if none was seen before
+		static std::vector<WinInfo_t> GetWindowList(UINT timeoutMs = TITLE_TIMEOUT_MS);
+		static std::vector<WinInfo_t> GetVisibleWindowList(UINT timeoutMs = TITLE_TIMEOUT_MS);
+		// The window list with its titles indexed. Enumerates first if refresh is set or nothing has been enumerated yet,
+		// otherwise returns the index of the last list. The index is built once per enumeration and shared, so looking up
+		// many times between refreshes costs only the lookups
+		static std::shared_ptr<const TitleIndex> GetWindowIndex(bool refresh = true, UINT timeoutMs = TITLE_TIMEOUT_MS);
+		// Enumerates the windows on another thread, so the caller is never blocked by a hung window
+		static std::future<std::vector<WinInfo_t>> GetWindowListAsync(UINT timeoutMs = TITLE_TIMEOUT_MS);
 		// Sends many keys
 		static void SendKeys(WinInfo_t window, std::vector<KeyEvent> keys);
 		// Sends many mouse events
 		static void SendMouseEvents(WinInfo_t window, std::vector<MouseEvent> events);
+		// Appends the INPUT records for an event to a batch. Returns the number of records added
+		static int BuildKeyInputs(KeyEvent key, std::vector<INPUT>& inputs);
+		static int BuildMouseInputs(MouseEvent evt, std::vector<INPUT>& inputs);
+		// Sends a batch of INPUT records to the window with a single SendInput, so nothing can be interleaved with it.
+		// Returns false if the window is gone (nothing is sent, and the window isn't looked for again), could not be
+		// connected to, or not every record was inserted
+		static bool SendInputs(WinInfo_t window, std::vector<INPUT>& inputs);
 		// Gets the window HWND from windows using the window information. If allow update is set, will update the info
-		// struct if the window can't be found
-		static HWND GetWindowHWND(WinInfo_t& window, bool allowUpdate = false);
+		// struct if the window can't be found, searching by matcher (or by the old title if none is given), then pid, then tid.
+		// The search goes through the last window list first and only enumerates again if that doesn't find a live window
+		static HWND GetWindowHWND(WinInfo_t& window, bool allowUpdate = false, const TitleMatcher* matcher = nullptr);
 		// Returns the dimensions of a window from its window handle 
 		static WinDimensions_t GetWindowDimensions(WinInfo_t window);
+		// Converts a UTF-8 string to UTF-16. Invalid sequences are replaced rather than dropped
+		static std::wstring Utf8ToWide(const std::string& str);
 	};
 
 }
\ No newline at end of file